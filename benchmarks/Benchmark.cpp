@@ -0,0 +1,587 @@
+#include "Benchmark.h"
+#include "Colored_Console.h"
+#include "Directory_Walker.h"
+#include "File_Manager.h"
+#include "Instrumentation.h"
+#include "Output_Sink.h"
+#include "Thread_Pool.h"
+#include "Tree_Deleter.h"
+
+#include <cerrno>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <deque>
+#include <fstream>
+#include <functional>
+#include <iomanip>
+#include <random>
+#include <streambuf>
+#include <vector>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace {
+#ifdef _WIN32
+    const char PATH_SEPARATOR = '\\';
+#else
+    const char PATH_SEPARATOR = '/';
+#endif
+
+    using Clock = std::chrono::steady_clock;
+
+    double secondsSince(Clock::time_point start) {
+        return std::chrono::duration<double>(Clock::now() - start).count();
+    }
+
+    bool directoryExists(const std::string& path) {
+#ifdef _WIN32
+        DWORD attributes = GetFileAttributesA(path.c_str());
+        return attributes != INVALID_FILE_ATTRIBUTES && (attributes & FILE_ATTRIBUTE_DIRECTORY);
+#else
+        struct stat status;
+        return stat(path.c_str(), &status) == 0 && S_ISDIR(status.st_mode);
+#endif
+    }
+
+    bool makeDirectory(const std::string& path) {
+#ifdef _WIN32
+        return CreateDirectoryA(path.c_str(), NULL) || GetLastError() == ERROR_ALREADY_EXISTS;
+#else
+        return mkdir(path.c_str(), 0755) == 0 || errno == EEXIST;
+#endif
+    }
+
+    // The size is set without writing any data, so large synthetic files do not fill a tmpfs scratch directory.
+    bool createFile(const std::string& path, std::uint64_t size = 0) {
+#ifdef _WIN32
+        HANDLE hFile = CreateFileA(path.c_str(), GENERIC_WRITE, 0, NULL, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+        if (hFile == INVALID_HANDLE_VALUE) {
+            return false;
+        }
+        LARGE_INTEGER distance;
+        distance.QuadPart = static_cast<LONGLONG>(size);
+        bool sized = size == 0 || (SetFilePointerEx(hFile, distance, NULL, FILE_BEGIN) && SetEndOfFile(hFile));
+        CloseHandle(hFile);
+        return sized;
+#else
+        int fd = open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+        if (fd < 0) {
+            return false;
+        }
+        bool sized = size == 0 || ftruncate(fd, static_cast<off_t>(size)) == 0;
+        close(fd);
+        return sized;
+#endif
+    }
+
+    // Mirrors the original single-threaded recursive writer: one path string per entry, one new indentation string per
+    // level and a flush after every line.
+    void writeLegacyStructure(const std::string& directoryPath, std::ofstream& outputFile, const std::string& indentation, const std::string& prefix) {
+        std::vector<DirectoryWalker::Entry> entries;
+        DirectoryWalker::readDirectory(directoryPath, entries);
+        for (const DirectoryWalker::Entry& entry : entries) {
+            std::string itemPath = directoryPath + PATH_SEPARATOR + entry.name;
+            outputFile << indentation << prefix << entry.name << std::endl;
+            if (entry.isDirectory) {
+                writeLegacyStructure(itemPath, outputFile, indentation + "  ", "|-- ");
+            }
+        }
+    }
+
+    void printResult(const std::string& label, double seconds, const std::string& details) {
+        ColoredConsole::out() << "  " << std::left << std::setw(36) << label << std::right << std::fixed << std::setprecision(3)
+            << std::setw(9) << seconds << " s";
+        if (!details.empty()) {
+            ColoredConsole::out() << "   " << details;
+        }
+        ColoredConsole::out() << std::endl;
+    }
+
+    const char* const MIXED_STEMS[] = { "main", "util", "test", "readme", "config", "image", "data", "build" };
+    const char* const MIXED_EXTENSIONS[] = { ".cpp", ".h", ".txt", ".md", ".json", ".png", ".log", "" };
+    // std::mt19937 yields the same sequence on every platform, unlike the standard distributions, which are not used.
+    const std::uint32_t MIXED_SEED = 20240601;
+
+    struct Measurement {
+        const char* shape;
+        const char* operation;
+        std::size_t entries;
+        double seconds;
+        std::uint64_t systemCalls;
+        bool succeeded;
+    };
+
+    // Swallows the output of the measured commands, which would otherwise time the console instead of the command.
+    class DiscardBuffer : public std::streambuf {
+    protected:
+        int overflow(int character) override {
+            return traits_type::not_eof(character);
+        }
+
+        std::streamsize xsputn(const char*, std::streamsize count) override {
+            return count;
+        }
+    };
+
+    const char* shapeName(Benchmark::Shape shape) {
+        switch (shape) {
+        case Benchmark::Shape::WIDE:
+            return "wide";
+        case Benchmark::Shape::DEEP:
+            return "deep";
+        case Benchmark::Shape::MIXED:
+            return "mixed";
+        }
+        return "";
+    }
+
+    // Counts the entries of a directory whose names start with a prefix; an empty prefix counts all of them.
+    std::size_t countEntries(const std::string& directoryPath, const std::string& prefix) {
+        std::vector<DirectoryWalker::Entry> entries;
+        DirectoryWalker::readDirectory(directoryPath, entries);
+        std::size_t count = 0;
+        for (const DirectoryWalker::Entry& entry : entries) {
+            count += entry.name.compare(0, prefix.size(), prefix) == 0 ? 1 : 0;
+        }
+        return count;
+    }
+
+    std::size_t countLines(const std::string& path) {
+        std::ifstream file(path, std::ios::binary);
+        std::size_t lines = 0;
+        char buffer[64 * 1024];
+        while (file.read(buffer, sizeof(buffer)) || file.gcount() > 0) {
+            for (std::streamsize index = 0; index < file.gcount(); ++index) {
+                lines += buffer[index] == '\n' ? 1 : 0;
+            }
+        }
+        return lines;
+    }
+
+    void writeJson(std::ostream& output, const std::vector<Measurement>& results) {
+#ifdef _WIN32
+        const char* platform = "windows";
+#elif defined(__linux__)
+        const char* platform = "linux";
+#else
+        const char* platform = "posix";
+#endif
+        output << "{\n  \"platform\": \"" << platform << "\",\n  \"threads\": " << ThreadPool::defaultThreadCount()
+            << ",\n  \"instrumented\": " << (Instrumentation::isEnabled() ? "true" : "false") << ",\n  \"results\": [";
+        for (std::size_t index = 0; index < results.size(); ++index) {
+            const Measurement& result = results[index];
+            output << (index == 0 ? "\n" : ",\n") << "    { \"shape\": \"" << result.shape << "\", \"operation\": \"" << result.operation
+                << "\", \"entries\": " << result.entries << ", \"seconds\": " << std::fixed << std::setprecision(6) << result.seconds
+                << ", \"systemCalls\": " << result.systemCalls << ", \"ok\": " << (result.succeeded ? "true" : "false") << " }";
+        }
+        output << "\n  ]\n}\n";
+    }
+}
+
+std::string Benchmark::scratchDirectory() {
+#ifdef _WIN32
+    char tempPath[MAX_PATH];
+    DWORD length = GetTempPathA(MAX_PATH, tempPath);
+    if (length > 0 && length < MAX_PATH) {
+        std::string path(tempPath, length);
+        if (path.back() == '\\') {
+            path.pop_back();
+        }
+        return path;
+    }
+    return ".";
+#else
+    if (directoryExists("/dev/shm")) {
+        return "/dev/shm";
+    }
+    const char* tempPath = getenv("TMPDIR");
+    return tempPath != nullptr && tempPath[0] != '\0' ? tempPath : "/tmp";
+#endif
+}
+
+bool Benchmark::createSyntheticTree(const std::string& rootPath, std::size_t fileCount, std::size_t filesPerDirectory, std::size_t subdirectoriesPerDirectory) {
+    if (filesPerDirectory == 0 || subdirectoriesPerDirectory == 0) {
+        return false;
+    }
+
+    std::size_t directoryCount = (fileCount + filesPerDirectory - 1) / filesPerDirectory;
+    if (directoryCount == 0) {
+        directoryCount = 1;
+    }
+
+    std::vector<std::string> directories;
+    directories.reserve(directoryCount);
+    directories.push_back(rootPath);
+    if (!makeDirectory(rootPath)) {
+        return false;
+    }
+
+    for (std::size_t parent = 0; directories.size() < directoryCount; ++parent) {
+        for (std::size_t i = 0; i < subdirectoriesPerDirectory && directories.size() < directoryCount; ++i) {
+            std::string path = directories[parent] + PATH_SEPARATOR + "dir" + std::to_string(i);
+            if (!makeDirectory(path)) {
+                return false;
+            }
+            directories.push_back(path);
+        }
+    }
+
+    std::size_t created = 0;
+    for (const std::string& directory : directories) {
+        for (std::size_t i = 0; i < filesPerDirectory && created < fileCount; ++i, ++created) {
+            if (!createFile(directory + PATH_SEPARATOR + "file" + std::to_string(i) + ".txt")) {
+                return false;
+            }
+        }
+    }
+
+    return true;
+}
+
+bool Benchmark::createWideTree(const std::string& rootPath, std::size_t fileCount) {
+    if (!makeDirectory(rootPath)) {
+        return false;
+    }
+    std::string path = rootPath + PATH_SEPARATOR;
+    std::size_t prefixLength = path.size();
+    for (std::size_t i = 0; i < fileCount; ++i) {
+        path.resize(prefixLength);
+        path += "file";
+        path += std::to_string(i);
+        path += ".txt";
+        if (!createFile(path)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool Benchmark::createDeepTree(const std::string& rootPath, std::size_t depth) {
+    if (!makeDirectory(rootPath)) {
+        return false;
+    }
+#ifdef _WIN32
+    std::string path = rootPath;
+    for (std::size_t level = 0;; ++level) {
+        if (!createFile(path + PATH_SEPARATOR + "file.txt")) {
+            return false;
+        }
+        if (level == depth) {
+            return true;
+        }
+        path += PATH_SEPARATOR;
+        path += 'd';
+        if (!makeDirectory(path)) {
+            return false;
+        }
+    }
+#else
+    int directoryFd = open(rootPath.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    bool created = directoryFd >= 0;
+    for (std::size_t level = 0; created; ++level) {
+        int fileFd = openat(directoryFd, "file.txt", O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+        created = fileFd >= 0 && close(fileFd) == 0;
+        if (!created || level == depth) {
+            break;
+        }
+        int childFd = -1;
+        created = (mkdirat(directoryFd, "d", 0755) == 0 || errno == EEXIST) &&
+            (childFd = openat(directoryFd, "d", O_RDONLY | O_DIRECTORY | O_CLOEXEC)) >= 0;
+        close(directoryFd);
+        directoryFd = childFd;
+    }
+    if (directoryFd >= 0) {
+        close(directoryFd);
+    }
+    return created;
+#endif
+}
+
+bool Benchmark::createMixedTree(const std::string& rootPath, std::size_t fileCount, std::size_t& entryCount) {
+    entryCount = 0;
+    if (!makeDirectory(rootPath)) {
+        return false;
+    }
+
+    std::mt19937 random(MIXED_SEED);
+    std::deque<std::pair<std::string, std::size_t>> pending;
+    pending.emplace_back(rootPath, 0);
+    std::size_t created = 0;
+    std::size_t directoryNumber = 0;
+    while (created < fileCount) {
+        // Every directory may have been filled before the files run out; another branch then starts at the root.
+        if (pending.empty()) {
+            std::string path = rootPath + PATH_SEPARATOR + "more" + std::to_string(directoryNumber++);
+            if (!makeDirectory(path)) {
+                return false;
+            }
+            ++entryCount;
+            pending.emplace_back(path, 1);
+        }
+        std::string directoryPath = pending.front().first;
+        std::size_t depth = pending.front().second;
+        pending.pop_front();
+
+        // Most directories hold a few dozen files, one in eight a few hundred; most files are small, a few are large.
+        std::size_t files = random() % 8 == 0 ? 100 + random() % 400 : random() % 30;
+        for (std::size_t i = 0; i < files && created < fileCount; ++i, ++created, ++entryCount) {
+            std::string name = MIXED_STEMS[random() % 8] + std::to_string(created) + MIXED_EXTENSIONS[random() % 8];
+            std::uint64_t size = random() % 4 == 0 ? random() % (1u << 20) : random() % 8192;
+            if (!createFile(directoryPath + PATH_SEPARATOR + name, size)) {
+                return false;
+            }
+        }
+
+        std::size_t subdirectories = depth >= 12 ? 0 : random() % (depth < 3 ? 8 : 4);
+        for (std::size_t i = 0; i < subdirectories; ++i, ++entryCount) {
+            std::string path = directoryPath + PATH_SEPARATOR + "dir" + std::to_string(directoryNumber++);
+            if (!makeDirectory(path)) {
+                return false;
+            }
+            pending.emplace_back(path, depth + 1);
+        }
+    }
+    return true;
+}
+
+void Benchmark::runTreeOutputBenchmark(std::size_t fileCount) {
+    std::string scratch = scratchDirectory();
+    std::string rootPath = scratch + PATH_SEPARATOR + "fm_bench_tree_" + std::to_string(fileCount);
+
+    if (!directoryExists(rootPath)) {
+        ColoredConsole::out() << "\nCreating synthetic tree with " << fileCount << " files in " << rootPath << "..." << std::endl;
+        Clock::time_point start = Clock::now();
+        if (!createSyntheticTree(rootPath, fileCount)) {
+            ColoredConsole::setConsoleColor(ERROR_COLOR);
+            ColoredConsole::out() << "\nFailed to create synthetic tree in " << rootPath << std::endl << std::endl;
+            ColoredConsole::setConsoleColor(DEFAULT_COLOR);
+            return;
+        }
+        ColoredConsole::out() << "Created in " << std::fixed << std::setprecision(3) << secondsSince(start) << " s" << std::endl;
+    }
+
+    std::string legacyOutput = scratch + PATH_SEPARATOR + "fm_bench_tree_before.txt";
+    std::string sinkOutput = scratch + PATH_SEPARATOR + "fm_bench_tree_after.txt";
+
+    // Collect the entries once so the writer-only runs measure nothing but the output path.
+    std::vector<std::pair<std::size_t, std::string>> entries;
+    DirectoryWalker::walk(rootPath, 0, [&entries](std::size_t depth, std::string_view name, bool) {
+        entries.emplace_back(depth, std::string(name));
+    });
+
+    Clock::time_point start = Clock::now();
+    {
+        std::ofstream file(legacyOutput);
+        writeLegacyStructure(rootPath, file, "", "");
+    }
+    double legacyTotal = secondsSince(start);
+
+    start = Clock::now();
+    std::size_t sinkTotalCalls = 0;
+    {
+        OutputSink file;
+        file.open(sinkOutput);
+        FileManager::writeDirectoryStructure(rootPath, file, 0);
+        file.close();
+        sinkTotalCalls = file.writeCallCount();
+    }
+    double sinkTotal = secondsSince(start);
+
+    start = Clock::now();
+    {
+        std::ofstream file(legacyOutput);
+        for (const auto& entry : entries) {
+            std::string indentation(entry.first * 2, ' ');
+            file << indentation << (entry.first > 0 ? "|-- " : "") << entry.second << std::endl;
+        }
+    }
+    double legacyWriter = secondsSince(start);
+
+    start = Clock::now();
+    std::size_t sinkWriterCalls = 0;
+    {
+        OutputSink file;
+        file.open(sinkOutput);
+        std::string indentation;
+        for (const auto& entry : entries) {
+            if (indentation.size() < entry.first * 2) {
+                indentation.resize(entry.first * 2, ' ');
+            }
+            file.write(indentation.data(), entry.first * 2);
+            if (entry.first > 0) {
+                file.write("|-- ", 4);
+            }
+            file.write(entry.second);
+            file.put('\n');
+        }
+        file.close();
+        sinkWriterCalls = file.writeCallCount();
+    }
+    double sinkWriter = secondsSince(start);
+
+    std::remove(legacyOutput.c_str());
+    std::remove(sinkOutput.c_str());
+
+    ColoredConsole::setConsoleColor(SUCCESS_COLOR);
+    ColoredConsole::out() << "\nTree output benchmark: " << fileCount << " files, " << entries.size() << " entries" << std::endl;
+    ColoredConsole::setConsoleColor(DEFAULT_COLOR);
+    printResult("before: serial walk, std::endl", legacyTotal, std::to_string(entries.size()) + " flushes");
+    printResult("after: parallel walk, OutputSink", sinkTotal, std::to_string(sinkTotalCalls) + " write calls");
+    printResult("writer only, std::endl", legacyWriter, std::to_string(entries.size()) + " flushes");
+    printResult("writer only, OutputSink", sinkWriter, std::to_string(sinkWriterCalls) + " write calls");
+    ColoredConsole::out() << std::endl;
+}
+
+bool Benchmark::runSuite(const SuiteOptions& options) {
+    std::string scratch = scratchDirectory();
+    std::vector<Measurement> results;
+    DiscardBuffer discardBuffer;
+    std::ostream discard(&discardBuffer);
+    bool allSucceeded = true;
+
+    ColoredConsole::setConsoleColor(SUCCESS_COLOR);
+    ColoredConsole::out() << "\nBenchmark suite in " << scratch << std::endl;
+    ColoredConsole::setConsoleColor(DEFAULT_COLOR);
+
+    // Only the operation is timed; the check that it did its work runs afterwards. The entries are read after the
+    // operation, which lets a generator report how many it created.
+    auto measure = [&](const char* shape, const char* operation, const std::size_t& entries, const std::function<bool()>& run,
+        const std::function<bool()>& check) {
+        std::uint64_t systemCalls = Instrumentation::total(Instrumentation::Counter::SYSTEM_CALLS);
+        ColoredConsole::redirectOutput(&discard);
+        Clock::time_point start = Clock::now();
+        bool succeeded = run();
+        double seconds = secondsSince(start);
+        ColoredConsole::redirectOutput(nullptr);
+        succeeded = succeeded && (!check || check());
+        results.push_back({ shape, operation, entries, seconds,
+            Instrumentation::total(Instrumentation::Counter::SYSTEM_CALLS) - systemCalls, succeeded });
+
+        std::string details = std::to_string(entries) + " entries";
+        if (Instrumentation::isEnabled()) {
+            details += ", " + std::to_string(results.back().systemCalls) + " system calls";
+        }
+        if (!succeeded) {
+            ColoredConsole::setConsoleColor(ERROR_COLOR);
+            details += ", FAILED";
+            allSucceeded = false;
+        }
+        printResult(std::string(shape) + " " + operation, seconds, details);
+        ColoredConsole::setConsoleColor(DEFAULT_COLOR);
+        return succeeded;
+    };
+
+    for (Shape shape : options.shapes) {
+        const char* name = shapeName(shape);
+        std::string root = scratch + PATH_SEPARATOR + "fm_bench_suite_" + name;
+        std::string target = root + "_moved";
+        std::string treeFile = root + "_tree.txt";
+        // The leftovers of an interrupted run would change the numbers.
+        if (directoryExists(root)) {
+            TreeDeleter::remove(root);
+        }
+        if (directoryExists(target)) {
+            TreeDeleter::remove(target);
+        }
+
+        std::size_t entries = 0;
+        bool created = measure(name, "create", entries, [&] {
+            switch (shape) {
+            case Shape::WIDE:
+                entries = options.wideFiles;
+                return createWideTree(root, options.wideFiles);
+            case Shape::DEEP:
+                entries = 2 * options.depth + 1;
+                return createDeepTree(root, options.depth);
+            case Shape::MIXED:
+                return createMixedTree(root, options.mixedFiles, entries);
+            }
+            return false;
+        }, nullptr);
+        if (!created) {
+            TreeDeleter::remove(root);
+            continue;
+        }
+
+        measure(name, "tree", entries, [&] {
+            OutputSink output;
+            bool written = output.open(treeFile) && FileManager::writeDirectoryStructure(root, output);
+            return output.close() && written;
+        }, [&] { return countLines(treeFile) == entries; });
+        std::remove(treeFile.c_str());
+
+        measure(name, "ls", entries, [&] {
+            FileManager::listFilesAndDirectories(root);
+            return true;
+        }, nullptr);
+
+        // Renames and moves touch every entry of the wide directory and the root of the other shapes.
+        switch (shape) {
+        case Shape::WIDE:
+            measure(name, "rename", entries, [&] {
+                FileManager::renameMatching("s/^file/item/", root);
+                return true;
+            }, [&] { return countEntries(root, "item") == entries; });
+            makeDirectory(target);
+            measure(name, "move", entries, [&] {
+                FileManager::moveMatching(root + PATH_SEPARATOR + "item*", target);
+                return true;
+            }, [&] { return countEntries(target, "item") == entries; });
+            break;
+        case Shape::DEEP:
+            measure(name, "rename", entries, [&] {
+                FileManager::renameFileOrDirectory(root + PATH_SEPARATOR + "d", root + PATH_SEPARATOR + "e");
+                return true;
+            }, [&] { return directoryExists(root + PATH_SEPARATOR + "e"); });
+            makeDirectory(target);
+            measure(name, "move", entries, [&] {
+                FileManager::moveFileOrDirectory(root + PATH_SEPARATOR + "e", target);
+                return true;
+            }, [&] { return directoryExists(target + PATH_SEPARATOR + "e"); });
+            break;
+        case Shape::MIXED:
+            measure(name, "rename", entries, [&] {
+                FileManager::renameMatching("s/^/x_/", root);
+                return true;
+            }, [&] { return countEntries(root, "x_") == countEntries(root, ""); });
+            makeDirectory(target);
+            measure(name, "move", entries, [&] {
+                FileManager::moveMatching(root + PATH_SEPARATOR + "*", target);
+                return true;
+            }, [&] { return countEntries(root, "") == 0; });
+            break;
+        }
+
+        measure(name, "delete", entries, [&] {
+            FileManager::deleteFileOrDirectory(target, true);
+            return true;
+        }, [&] { return !directoryExists(target); });
+        for (const std::string& path : { root, target }) {
+            if (directoryExists(path)) {
+                TreeDeleter::remove(path);
+            }
+        }
+    }
+    ColoredConsole::out() << std::endl;
+
+    if (!options.jsonPath.empty()) {
+        std::ofstream json(options.jsonPath);
+        writeJson(json, results);
+        json.close();
+        if (!json) {
+            ColoredConsole::setConsoleColor(ERROR_COLOR);
+            ColoredConsole::out() << "Failed to write the results to " << options.jsonPath << std::endl << std::endl;
+            ColoredConsole::setConsoleColor(DEFAULT_COLOR);
+            return false;
+        }
+        ColoredConsole::out() << "Results written to " << options.jsonPath << std::endl << std::endl;
+    }
+    return allSucceeded;
+}
\ No newline at end of file
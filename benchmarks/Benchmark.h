@@ -0,0 +1,108 @@
+#ifndef BENCHMARK_H
+#define BENCHMARK_H
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+/**
+ * @class Benchmark
+ * @brief Benchmarks of the file manager that run against synthetic directory trees.
+ *
+ * The Benchmark class generates reproducible directory trees in a scratch directory and measures the file manager
+ * operations on them, so performance changes can be compared between versions.
+ */
+class Benchmark {
+public:
+    /**
+     * Returns the directory in which the synthetic trees are created.
+     *
+     * @return The system temporary directory, or /dev/shm on Linux when it is available.
+     */
+    static std::string scratchDirectory();
+
+    /**
+     * Creates a balanced synthetic tree of empty files.
+     *
+     * @param rootPath The path of the root directory to create.
+     * @param fileCount The total number of files to create.
+     * @param filesPerDirectory The number of files placed in each directory.
+     * @param subdirectoriesPerDirectory The number of subdirectories created in each directory.
+     * @return True if the whole tree was created, false otherwise.
+     */
+    static bool createSyntheticTree(const std::string& rootPath, std::size_t fileCount, std::size_t filesPerDirectory = 100, std::size_t subdirectoriesPerDirectory = 10);
+
+    /**
+     * Compares the per-line flushing tree writer with the buffered OutputSink writer and prints the results.
+     *
+     * The synthetic tree is created on the first run and reused afterwards.
+     *
+     * @param fileCount The number of files in the synthetic tree.
+     */
+    static void runTreeOutputBenchmark(std::size_t fileCount);
+
+    /**
+     * Shapes of synthetic trees used by the benchmark suite.
+     */
+    enum class Shape {
+        /** Every file in one directory. */
+        WIDE,
+        /** A chain of nested directories with one file on every level. */
+        DEEP,
+        /** Directories of varying fan-out and depth holding files of varying names and sizes. */
+        MIXED
+    };
+
+    /**
+     * Settings of a benchmark suite run.
+     */
+    struct SuiteOptions {
+        std::vector<Shape> shapes = { Shape::WIDE, Shape::DEEP, Shape::MIXED };
+        std::size_t wideFiles = 1000000;
+        std::size_t depth = 10000;
+        std::size_t mixedFiles = 200000;
+        /** The file the results are written to as JSON, or empty for the console table only. */
+        std::string jsonPath;
+    };
+
+    /**
+     * Creates a directory holding a number of empty files.
+     *
+     * @param rootPath The path of the directory to create.
+     * @param fileCount The number of files.
+     * @return True if every file was created, false otherwise.
+     */
+    static bool createWideTree(const std::string& rootPath, std::size_t fileCount);
+
+    /**
+     * Creates a chain of nested directories, each holding one empty file. On POSIX systems levels are created relative
+     * to their parent, so the chain may be deeper than the longest path the system accepts.
+     *
+     * @param rootPath The path of the directory to create.
+     * @param depth The number of nested directories below the root.
+     * @return True if the whole chain was created, false otherwise.
+     */
+    static bool createDeepTree(const std::string& rootPath, std::size_t depth);
+
+    /**
+     * Creates a tree that resembles a source checkout: the fan-out, the file names and the file sizes vary, but come
+     * from a fixed seed, so every run creates the same tree.
+     *
+     * @param rootPath The path of the directory to create.
+     * @param fileCount The number of files.
+     * @param entryCount Receives the number of files and directories below the root.
+     * @return True if the whole tree was created, false otherwise.
+     */
+    static bool createMixedTree(const std::string& rootPath, std::size_t fileCount, std::size_t& entryCount);
+
+    /**
+     * Times tree, ls, rename, move and delete through the FileManager API on every requested shape, prints a table and
+     * optionally writes the results as JSON. The trees are created in the scratch directory and removed afterwards.
+     *
+     * @param options The shapes, their sizes and the JSON output file.
+     * @return True if every operation succeeded and the results could be written, false otherwise.
+     */
+    static bool runSuite(const SuiteOptions& options);
+};
+
+#endif
\ No newline at end of file
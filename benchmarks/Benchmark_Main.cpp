@@ -0,0 +1,76 @@
+#include "Benchmark.h"
+#include "Colored_Console.h"
+
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <vector>
+
+namespace {
+    bool parseCount(const char* text, std::size_t& count) {
+        char* end = nullptr;
+        unsigned long long value = std::strtoull(text, &end, 10);
+        if (end == text || *end != '\0' || text[0] == '-') {
+            return false;
+        }
+        count = static_cast<std::size_t>(value);
+        return true;
+    }
+}
+
+// Runs the benchmarks outside the interactive program, so a build can be measured from a script or CI job:
+// file_manager_benchmark [wide] [deep] [mixed] [--files <count>] [--depth <levels>] [--json <file>]
+// file_manager_benchmark tree [<files>]
+int main(int argc, char* argv[]) {
+    if (argc >= 2 && std::string(argv[1]) == "tree") {
+        std::size_t fileCount = 1000000;
+        if (argc > 3 || (argc == 3 && !parseCount(argv[2], fileCount))) {
+            std::cout << "Usage: " << argv[0] << " tree [<files>]" << std::endl;
+            return 2;
+        }
+        Benchmark::runTreeOutputBenchmark(fileCount);
+        ColoredConsole::flush();
+        return 0;
+    }
+
+    Benchmark::SuiteOptions options;
+    std::vector<Benchmark::Shape> shapes;
+    bool valid = true;
+    for (int index = 1; valid && index < argc; ++index) {
+        std::string option = argv[index];
+        if (option == "wide") {
+            shapes.push_back(Benchmark::Shape::WIDE);
+        }
+        else if (option == "deep") {
+            shapes.push_back(Benchmark::Shape::DEEP);
+        }
+        else if (option == "mixed") {
+            shapes.push_back(Benchmark::Shape::MIXED);
+        }
+        else if (option == "--files" && index + 1 < argc) {
+            valid = parseCount(argv[++index], options.wideFiles);
+            options.mixedFiles = options.wideFiles;
+        }
+        else if (option == "--depth" && index + 1 < argc) {
+            valid = parseCount(argv[++index], options.depth);
+        }
+        else if (option == "--json" && index + 1 < argc) {
+            options.jsonPath = argv[++index];
+        }
+        else {
+            valid = false;
+        }
+    }
+    if (!valid) {
+        std::cout << "Usage: " << argv[0] << " [wide] [deep] [mixed] [--files <count>] [--depth <levels>] [--json <file>]" << std::endl;
+        std::cout << "       " << argv[0] << " tree [<files>]" << std::endl;
+        return 2;
+    }
+    if (!shapes.empty()) {
+        options.shapes = shapes;
+    }
+
+    bool succeeded = Benchmark::runSuite(options);
+    ColoredConsole::flush();
+    return succeeded ? 0 : 1;
+}
\ No newline at end of file
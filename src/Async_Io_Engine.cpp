@@ -0,0 +1,517 @@
+#include "Async_Io_Engine.h"
+#include "Instrumentation.h"
+#include "Thread_Pool.h"
+
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#ifdef __linux__
+#include <sys/syscall.h>
+#endif
+#if defined(__linux__) && defined(__has_include)
+#if __has_include(<linux/io_uring.h>)
+#include <linux/io_uring.h>
+#include <signal.h>
+#include <sys/mman.h>
+#endif
+#endif
+#endif
+
+// IORING_FEAT_EXT_ARG arrived with the same kernel headers as IORING_OP_UNLINKAT and IORING_OP_RENAMEAT, which are
+// enumerators and cannot be tested by the preprocessor.
+#if defined(IORING_FEAT_EXT_ARG) && defined(STATX_TYPE)
+#define HAVE_IO_URING 1
+#endif
+
+#if defined(__linux__) && !defined(RENAME_NOREPLACE)
+#define RENAME_NOREPLACE (1 << 0)
+#endif
+
+const unsigned AsyncIoEngine::DEFAULT_QUEUE_DEPTH;
+const std::size_t AsyncIoEngine::BATCH_THRESHOLD;
+const int AsyncIoEngine::CURRENT_DIRECTORY;
+const int AsyncIoEngine::NO_REPLACE;
+
+namespace {
+#ifndef _WIN32
+    int directoryOf(int fd) {
+        return fd == AsyncIoEngine::CURRENT_DIRECTORY ? AT_FDCWD : fd;
+    }
+
+    int resultOf(long result) {
+        return result < 0 ? -errno : static_cast<int>(result);
+    }
+#endif
+
+#ifdef HAVE_IO_URING
+    const unsigned STATX_FIELDS = STATX_TYPE | STATX_MODE | STATX_SIZE | STATX_MTIME;
+
+    int setupRing(unsigned entries, io_uring_params& params) {
+        return static_cast<int>(syscall(__NR_io_uring_setup, entries, &params));
+    }
+
+    int enterRing(int fd, unsigned toSubmit, unsigned minComplete, unsigned flags) {
+        INSTRUMENT_COUNT(SYSTEM_CALLS, 1);
+        return static_cast<int>(syscall(__NR_io_uring_enter, fd, toSubmit, minComplete, flags, nullptr, _NSIG / 8));
+    }
+
+    // Asks the kernel which opcodes it implements; a ring on an older kernel may lack the path operations.
+    bool probeOperations(int fd, bool (&supported)[IORING_OP_LAST]) {
+        const unsigned operationCount = 256;
+        std::vector<char> storage(sizeof(io_uring_probe) + operationCount * sizeof(io_uring_probe_op), 0);
+        io_uring_probe* probe = reinterpret_cast<io_uring_probe*>(storage.data());
+        if (syscall(__NR_io_uring_register, fd, IORING_REGISTER_PROBE, probe, operationCount) < 0) {
+            return false;
+        }
+        for (unsigned index = 0; index < probe->ops_len && index < operationCount; ++index) {
+            unsigned op = probe->ops[index].op;
+            if (op < IORING_OP_LAST) {
+                supported[op] = (probe->ops[index].flags & IO_URING_OP_SUPPORTED) != 0;
+            }
+        }
+        return true;
+    }
+#endif
+}
+
+#ifdef HAVE_IO_URING
+// The submission and completion rings are shared with the kernel: the tail of the submission ring and the head of the
+// completion ring are published with release stores, the other ends are read with acquire loads.
+struct AsyncIoEngine::Ring {
+    struct Slot {
+        std::uint64_t userData;
+        DirectoryWalker::Entry* metadata;
+        struct statx status;
+    };
+
+    int fd = -1;
+    void* ringMemory = MAP_FAILED;
+    std::size_t ringSize = 0;
+    io_uring_sqe* sqes = static_cast<io_uring_sqe*>(MAP_FAILED);
+    std::size_t sqesSize = 0;
+
+    unsigned* sqTail = nullptr;
+    unsigned sqMask = 0;
+    unsigned* sqArray = nullptr;
+    unsigned* cqHead = nullptr;
+    unsigned* cqTail = nullptr;
+    unsigned cqMask = 0;
+    io_uring_cqe* cqes = nullptr;
+
+    unsigned entries = 0;
+    unsigned queued = 0;
+    bool supported[IORING_OP_LAST] = {};
+
+    std::vector<Slot> slots;
+    std::vector<unsigned> freeSlots;
+    std::vector<Completion> ready;
+
+    ~Ring() {
+        if (sqes != MAP_FAILED) {
+            munmap(sqes, sqesSize);
+        }
+        if (ringMemory != MAP_FAILED) {
+            munmap(ringMemory, ringSize);
+        }
+        if (fd >= 0) {
+            close(fd);
+        }
+    }
+
+    bool setup(unsigned queueDepth) {
+        io_uring_params params;
+        std::memset(&params, 0, sizeof(params));
+        fd = setupRing(queueDepth, params);
+        if (fd < 0 || !(params.features & IORING_FEAT_SINGLE_MMAP) || !probeOperations(fd, supported)) {
+            return false;
+        }
+
+        std::size_t sqSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+        std::size_t cqSize = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+        ringSize = sqSize > cqSize ? sqSize : cqSize;
+        ringMemory = mmap(nullptr, ringSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+        sqesSize = params.sq_entries * sizeof(io_uring_sqe);
+        void* sqeMemory = mmap(nullptr, sqesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES);
+        sqes = static_cast<io_uring_sqe*>(sqeMemory);
+        if (ringMemory == MAP_FAILED || sqeMemory == MAP_FAILED) {
+            return false;
+        }
+
+        char* base = static_cast<char*>(ringMemory);
+        sqTail = reinterpret_cast<unsigned*>(base + params.sq_off.tail);
+        sqMask = *reinterpret_cast<unsigned*>(base + params.sq_off.ring_mask);
+        sqArray = reinterpret_cast<unsigned*>(base + params.sq_off.array);
+        cqHead = reinterpret_cast<unsigned*>(base + params.cq_off.head);
+        cqTail = reinterpret_cast<unsigned*>(base + params.cq_off.tail);
+        cqMask = *reinterpret_cast<unsigned*>(base + params.cq_off.ring_mask);
+        cqes = reinterpret_cast<io_uring_cqe*>(base + params.cq_off.cqes);
+
+        // Every request in flight owns a slot, so the completion ring, twice the size of the submission ring, never overflows.
+        entries = params.sq_entries;
+        slots.resize(entries);
+        for (unsigned slot = entries; slot > 0; --slot) {
+            freeSlots.push_back(slot - 1);
+        }
+        return true;
+    }
+
+    bool supports(Operation operation) const {
+        switch (operation) {
+        case Operation::STAT:
+            return supported[IORING_OP_STATX];
+        case Operation::OPEN:
+            return supported[IORING_OP_OPENAT];
+        case Operation::CLOSE:
+            return supported[IORING_OP_CLOSE];
+        case Operation::READ:
+            return supported[IORING_OP_READ];
+        case Operation::WRITE:
+            return supported[IORING_OP_WRITE];
+        case Operation::RENAME:
+            return supported[IORING_OP_RENAMEAT];
+        case Operation::UNLINK:
+        case Operation::REMOVE_DIRECTORY:
+            return supported[IORING_OP_UNLINKAT];
+        default:
+            return false;
+        }
+    }
+
+    // Places a request in the submission ring, first reaping a completion when every slot is in use.
+    void push(const Request& request) {
+        if (freeSlots.empty()) {
+            submitQueued(1);
+            reap();
+        }
+        unsigned slotIndex = freeSlots.back();
+        freeSlots.pop_back();
+        Slot& slot = slots[slotIndex];
+        slot.userData = request.userData;
+        slot.metadata = request.metadata;
+
+        unsigned tail = *sqTail;
+        unsigned index = tail & sqMask;
+        io_uring_sqe& sqe = sqes[index];
+        std::memset(&sqe, 0, sizeof(sqe));
+        sqe.user_data = slotIndex;
+
+        switch (request.operation) {
+        case Operation::STAT:
+            sqe.opcode = IORING_OP_STATX;
+            sqe.fd = directoryOf(request.directoryFd);
+            sqe.addr = reinterpret_cast<std::uint64_t>(request.path);
+            sqe.len = STATX_FIELDS;
+            sqe.off = reinterpret_cast<std::uint64_t>(&slot.status);
+            sqe.statx_flags = AT_SYMLINK_NOFOLLOW | AT_STATX_DONT_SYNC;
+            break;
+        case Operation::OPEN:
+            sqe.opcode = IORING_OP_OPENAT;
+            sqe.fd = directoryOf(request.directoryFd);
+            sqe.addr = reinterpret_cast<std::uint64_t>(request.path);
+            sqe.len = request.mode;
+            sqe.open_flags = static_cast<std::uint32_t>(request.flags);
+            break;
+        case Operation::CLOSE:
+            sqe.opcode = IORING_OP_CLOSE;
+            sqe.fd = request.fd;
+            break;
+        case Operation::READ:
+        case Operation::WRITE:
+            sqe.opcode = request.operation == Operation::READ ? IORING_OP_READ : IORING_OP_WRITE;
+            sqe.fd = request.fd;
+            sqe.addr = reinterpret_cast<std::uint64_t>(request.buffer);
+            sqe.len = request.length;
+            sqe.off = request.offset;
+            break;
+        case Operation::RENAME:
+            sqe.opcode = IORING_OP_RENAMEAT;
+            sqe.fd = directoryOf(request.directoryFd);
+            sqe.addr = reinterpret_cast<std::uint64_t>(request.path);
+            sqe.len = static_cast<std::uint32_t>(directoryOf(request.newDirectoryFd));
+            sqe.addr2 = reinterpret_cast<std::uint64_t>(request.newPath);
+            sqe.rename_flags = (request.flags & NO_REPLACE) != 0 ? RENAME_NOREPLACE : 0;
+            break;
+        default:
+            sqe.opcode = IORING_OP_UNLINKAT;
+            sqe.fd = directoryOf(request.directoryFd);
+            sqe.addr = reinterpret_cast<std::uint64_t>(request.path);
+            sqe.unlink_flags = request.operation == Operation::REMOVE_DIRECTORY ? AT_REMOVEDIR : 0;
+            break;
+        }
+
+        sqArray[index] = index;
+        __atomic_store_n(sqTail, tail + 1, __ATOMIC_RELEASE);
+        if (++queued == entries) {
+            submitQueued(0);
+        }
+    }
+
+    // Hands the queued entries to the kernel, optionally waiting for completions in the same call.
+    void submitQueued(unsigned minComplete) {
+        while (queued > 0 || minComplete > 0) {
+            int submitted = enterRing(fd, queued, minComplete, minComplete > 0 ? IORING_ENTER_GETEVENTS : 0);
+            if (submitted < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                if (errno == EAGAIN || errno == EBUSY) {
+                    reap();
+                    continue;
+                }
+                return;
+            }
+            queued -= static_cast<unsigned>(submitted) < queued ? static_cast<unsigned>(submitted) : queued;
+            minComplete = 0;
+        }
+    }
+
+    // Moves the available completions to the ready list, converting the statx results of STAT requests.
+    std::size_t reap() {
+        std::size_t reaped = 0;
+        unsigned head = *cqHead;
+        unsigned tail = __atomic_load_n(cqTail, __ATOMIC_ACQUIRE);
+        for (; head != tail; ++head, ++reaped) {
+            const io_uring_cqe& cqe = cqes[head & cqMask];
+            unsigned slotIndex = static_cast<unsigned>(cqe.user_data);
+            Slot& slot = slots[slotIndex];
+            if (cqe.res >= 0 && slot.metadata != nullptr) {
+                slot.metadata->isDirectory = S_ISDIR(slot.status.stx_mode);
+                slot.metadata->size = slot.status.stx_size;
+                slot.metadata->modificationTime = static_cast<std::int64_t>(slot.status.stx_mtime.tv_sec) * 1000000000LL + slot.status.stx_mtime.tv_nsec;
+                slot.metadata->attributes = slot.status.stx_mode;
+            }
+            ready.push_back({ slot.userData, cqe.res });
+            freeSlots.push_back(slotIndex);
+        }
+        __atomic_store_n(cqHead, head, __ATOMIC_RELEASE);
+        return reaped;
+    }
+
+    std::size_t inFlight() const {
+        return entries - freeSlots.size();
+    }
+};
+#else
+struct AsyncIoEngine::Ring {
+    bool supports(Operation) const {
+        return false;
+    }
+};
+#endif
+
+AsyncIoEngine::AsyncIoEngine(unsigned queueDepth) : ringOutstanding(0), fallbackInFlight(0) {
+#ifdef HAVE_IO_URING
+    if (isKernelQueueAvailable()) {
+        ring.reset(new Ring());
+        if (!ring->setup(queueDepth == 0 ? DEFAULT_QUEUE_DEPTH : queueDepth)) {
+            ring.reset();
+        }
+    }
+#else
+    (void)queueDepth;
+#endif
+}
+
+AsyncIoEngine::~AsyncIoEngine() {
+    std::vector<Completion> completions;
+    while (outstanding() > 0) {
+        wait(completions, outstanding());
+    }
+}
+
+void AsyncIoEngine::submit(const Request& request) {
+#ifdef HAVE_IO_URING
+    if (ring && ring->supports(request.operation)) {
+        ring->push(request);
+        ++ringOutstanding;
+        return;
+    }
+#endif
+    runOnPool(request);
+}
+
+void AsyncIoEngine::flush() {
+#ifdef HAVE_IO_URING
+    if (ring) {
+        ring->submitQueued(0);
+    }
+#endif
+}
+
+std::size_t AsyncIoEngine::wait(std::vector<Completion>& completions, std::size_t minimum) {
+    flush();
+    std::size_t appended = 0;
+    while (true) {
+#ifdef HAVE_IO_URING
+        if (ring) {
+            ring->reap();
+            appended += ring->ready.size();
+            ringOutstanding -= ring->ready.size();
+            completions.insert(completions.end(), ring->ready.begin(), ring->ready.end());
+            ring->ready.clear();
+        }
+#endif
+        appended += takeFallbackCompletions(completions);
+        if (appended >= minimum || outstanding() == 0) {
+            return appended;
+        }
+
+        std::size_t poolRunning;
+        {
+            std::lock_guard<std::mutex> lock(fallbackMutex);
+            poolRunning = fallbackInFlight - fallbackCompletions.size();
+        }
+#ifdef HAVE_IO_URING
+        // With requests in both places the kernel is polled between short waits for the pool.
+        if (ring && ring->inFlight() > 0 && poolRunning == 0) {
+            ring->submitQueued(1);
+            continue;
+        }
+#endif
+        if (poolRunning > 0) {
+            std::unique_lock<std::mutex> lock(fallbackMutex);
+            fallbackDone.wait_for(lock, std::chrono::milliseconds(1), [this] { return !fallbackCompletions.empty(); });
+        }
+    }
+}
+
+std::size_t AsyncIoEngine::outstanding() const {
+    std::lock_guard<std::mutex> lock(fallbackMutex);
+    return ringOutstanding + fallbackInFlight;
+}
+
+bool AsyncIoEngine::usesKernelQueue() const {
+    return ring != nullptr;
+}
+
+bool AsyncIoEngine::isKernelQueueAvailable() {
+#ifdef HAVE_IO_URING
+    static const bool available = [] {
+        io_uring_params params;
+        std::memset(&params, 0, sizeof(params));
+        int fd = setupRing(4, params);
+        if (fd < 0) {
+            return false;
+        }
+        bool supported[IORING_OP_LAST] = {};
+        bool probed = probeOperations(fd, supported);
+        close(fd);
+        return probed && (params.features & IORING_FEAT_SINGLE_MMAP) && supported[IORING_OP_STATX] && supported[IORING_OP_UNLINKAT];
+    }();
+    return available;
+#else
+    return false;
+#endif
+}
+
+AsyncIoEngine& AsyncIoEngine::forCurrentThread() {
+    thread_local AsyncIoEngine engine;
+    return engine;
+}
+
+#ifdef _WIN32
+int AsyncIoEngine::execute(const Request& request) {
+    // A stat that fills an entry goes through DirectoryWalker::readMetadata, which counts its own call.
+    INSTRUMENT_COUNT(SYSTEM_CALLS, request.operation == Operation::STAT && request.metadata != nullptr ? 0 : 1);
+    BOOL succeeded = FALSE;
+    switch (request.operation) {
+    case Operation::STAT:
+        if (request.metadata != nullptr) {
+            succeeded = DirectoryWalker::readMetadata(request.path, *request.metadata);
+        } else {
+            succeeded = GetFileAttributesA(request.path) != INVALID_FILE_ATTRIBUTES;
+        }
+        break;
+    case Operation::RENAME:
+        succeeded = MoveFileExA(request.path, request.newPath, (request.flags & NO_REPLACE) != 0 ? 0 : MOVEFILE_REPLACE_EXISTING);
+        break;
+    case Operation::UNLINK:
+        succeeded = DeleteFileA(request.path);
+        break;
+    case Operation::REMOVE_DIRECTORY:
+        succeeded = RemoveDirectoryA(request.path);
+        break;
+    case Operation::CHMOD:
+        succeeded = SetFileAttributesA(request.path, request.mode);
+        break;
+    default:
+        return -ERROR_NOT_SUPPORTED;
+    }
+    return succeeded ? 0 : -static_cast<int>(GetLastError());
+}
+#else
+int AsyncIoEngine::execute(const Request& request) {
+    INSTRUMENT_COUNT(SYSTEM_CALLS, 1);
+    switch (request.operation) {
+    case Operation::STAT: {
+        struct stat status;
+        if (fstatat(directoryOf(request.directoryFd), request.path, &status, AT_SYMLINK_NOFOLLOW) != 0) {
+            return -errno;
+        }
+        if (request.metadata != nullptr) {
+            request.metadata->isDirectory = S_ISDIR(status.st_mode);
+            request.metadata->size = static_cast<std::uint64_t>(status.st_size);
+            request.metadata->modificationTime = static_cast<std::int64_t>(status.st_mtim.tv_sec) * 1000000000LL + status.st_mtim.tv_nsec;
+            request.metadata->attributes = status.st_mode;
+        }
+        return 0;
+    }
+    case Operation::OPEN:
+        return resultOf(openat(directoryOf(request.directoryFd), request.path, request.flags, static_cast<mode_t>(request.mode)));
+    case Operation::CLOSE:
+        return resultOf(close(request.fd));
+    case Operation::READ:
+        return resultOf(pread(request.fd, request.buffer, request.length, static_cast<off_t>(request.offset)));
+    case Operation::WRITE:
+        return resultOf(pwrite(request.fd, request.buffer, request.length, static_cast<off_t>(request.offset)));
+    case Operation::RENAME:
+        if ((request.flags & NO_REPLACE) != 0) {
+#if defined(__linux__) && defined(SYS_renameat2)
+            return resultOf(syscall(SYS_renameat2, directoryOf(request.directoryFd), request.path, directoryOf(request.newDirectoryFd), request.newPath, RENAME_NOREPLACE));
+#else
+            return -EINVAL;
+#endif
+        }
+        return resultOf(renameat(directoryOf(request.directoryFd), request.path, directoryOf(request.newDirectoryFd), request.newPath));
+    case Operation::UNLINK:
+        return resultOf(unlinkat(directoryOf(request.directoryFd), request.path, 0));
+    case Operation::REMOVE_DIRECTORY:
+        return resultOf(unlinkat(directoryOf(request.directoryFd), request.path, AT_REMOVEDIR));
+    case Operation::CHMOD:
+        return resultOf(fchmodat(directoryOf(request.directoryFd), request.path, static_cast<mode_t>(request.mode), 0));
+    }
+    return -ENOSYS;
+}
+#endif
+
+void AsyncIoEngine::runOnPool(const Request& request) {
+    if (!pool) {
+        pool.reset(new ThreadPool());
+    }
+    {
+        std::lock_guard<std::mutex> lock(fallbackMutex);
+        ++fallbackInFlight;
+    }
+    pool->submit([this, request] {
+        int result = execute(request);
+        std::lock_guard<std::mutex> lock(fallbackMutex);
+        fallbackCompletions.push_back({ request.userData, result });
+        fallbackDone.notify_one();
+    });
+}
+
+std::size_t AsyncIoEngine::takeFallbackCompletions(std::vector<Completion>& completions) {
+    std::lock_guard<std::mutex> lock(fallbackMutex);
+    std::size_t taken = fallbackCompletions.size();
+    completions.insert(completions.end(), fallbackCompletions.begin(), fallbackCompletions.end());
+    fallbackCompletions.clear();
+    fallbackInFlight -= taken;
+    return taken;
+}
\ No newline at end of file
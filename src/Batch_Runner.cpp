@@ -0,0 +1,236 @@
+#include "Batch_Runner.h"
+#include "Colored_Console.h"
+#include "Thread_Pool.h"
+
+#include <atomic>
+#include <cctype>
+#include <chrono>
+#include <condition_variable>
+#include <exception>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <sstream>
+
+namespace {
+    // A path reduced to its components, so "a/./b/" and "a\\b" compare equal.
+    struct NormalizedPath {
+        std::string path;
+        bool absolute = false;
+        bool resolved = true;
+    };
+
+    struct Footprint {
+        std::vector<NormalizedPath> reads;
+        std::vector<NormalizedPath> writes;
+    };
+
+    bool isSeparator(char c) {
+        return c == '/' || c == '\\';
+    }
+
+    // Windows paths are compared without regard to case; ".." that climbs above the start of a relative path, or a
+    // rooted path without a drive, leaves the path unresolved and overlapping everything.
+    NormalizedPath normalize(const std::string& path) {
+        NormalizedPath result;
+        std::vector<std::string> components;
+        std::size_t position = 0;
+#ifdef _WIN32
+        if (path.size() >= 2 && path[1] == ':') {
+            components.push_back(std::string(1, static_cast<char>(std::tolower(static_cast<unsigned char>(path[0])))) + ":");
+            result.absolute = true;
+            position = 2;
+        } else if (!path.empty() && isSeparator(path[0])) {
+            result.absolute = true;
+            result.resolved = false;
+        }
+#else
+        result.absolute = !path.empty() && path[0] == '/';
+#endif
+        std::size_t rootComponents = components.size();
+
+        while (position <= path.size()) {
+            std::size_t end = position;
+            while (end < path.size() && !isSeparator(path[end])) {
+                ++end;
+            }
+            std::string component = path.substr(position, end - position);
+            position = end + 1;
+
+            if (component.empty() || component == ".") {
+                continue;
+            }
+            if (component == "..") {
+                if (components.size() > rootComponents) {
+                    components.pop_back();
+                } else if (!result.absolute) {
+                    result.resolved = false;
+                }
+                continue;
+            }
+#ifdef _WIN32
+            for (char& c : component) {
+                c = static_cast<char>(std::tolower(static_cast<unsigned char>(c)));
+            }
+#endif
+            components.push_back(std::move(component));
+        }
+
+        for (const std::string& component : components) {
+            result.path += '/';
+            result.path += component;
+        }
+        return result;
+    }
+
+    bool overlap(const NormalizedPath& left, const NormalizedPath& right) {
+        if (!left.resolved || !right.resolved || left.absolute != right.absolute) {
+            return true;
+        }
+        const std::string& shorter = left.path.size() <= right.path.size() ? left.path : right.path;
+        const std::string& longer = left.path.size() <= right.path.size() ? right.path : left.path;
+        return longer.compare(0, shorter.size(), shorter) == 0 && (longer.size() == shorter.size() || longer[shorter.size()] == '/');
+    }
+
+    bool anyOverlap(const std::vector<NormalizedPath>& left, const std::vector<NormalizedPath>& right) {
+        for (const NormalizedPath& leftPath : left) {
+            for (const NormalizedPath& rightPath : right) {
+                if (overlap(leftPath, rightPath)) {
+                    return true;
+                }
+            }
+        }
+        return false;
+    }
+
+    bool conflicts(const Footprint& earlier, const Footprint& later) {
+        return anyOverlap(earlier.writes, later.writes) || anyOverlap(earlier.writes, later.reads) || anyOverlap(earlier.reads, later.writes);
+    }
+
+    struct Task {
+        std::atomic<std::size_t> waitingFor{0};
+        std::vector<std::size_t> dependents;
+        std::string output;
+        bool done = false;
+    };
+
+    struct BatchState {
+        const std::vector<BatchRunner::Command>& commands;
+        std::unique_ptr<Task[]> tasks;
+        ThreadPool pool;
+        std::mutex doneMutex;
+        std::condition_variable doneChanged;
+
+        BatchState(const std::vector<BatchRunner::Command>& commands, unsigned threadCount)
+            : commands(commands), tasks(new Task[commands.size()]), pool(threadCount) {}
+
+        // Runs a command whose dependencies have finished, then releases the commands that waited only for it.
+        void start(std::size_t index) {
+            pool.submit([this, index] {
+                std::ostringstream output;
+                ColoredConsole::redirectOutput(&output);
+                // A failing command still finishes, so its output is printed and the commands after it are released;
+                // the pool hands its exception to run once the batch is done.
+                std::exception_ptr exception;
+                try {
+                    commands[index].action();
+                } catch (...) {
+                    exception = std::current_exception();
+                }
+                ColoredConsole::redirectOutput(nullptr);
+
+                Task& task = tasks[index];
+                {
+                    std::lock_guard<std::mutex> lock(doneMutex);
+                    task.output = output.str();
+                    task.done = true;
+                }
+                doneChanged.notify_all();
+
+                for (std::size_t dependent : task.dependents) {
+                    if (tasks[dependent].waitingFor.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+                        start(dependent);
+                    }
+                }
+                if (exception) {
+                    std::rethrow_exception(exception);
+                }
+            });
+        }
+
+        void printWhenDone(std::size_t index) {
+            std::string output;
+            {
+                std::unique_lock<std::mutex> lock(doneMutex);
+                doneChanged.wait(lock, [this, index] { return tasks[index].done; });
+                output.swap(tasks[index].output);
+            }
+            std::cout.write(output.data(), static_cast<std::streamsize>(output.size()));
+        }
+    };
+}
+
+BatchRunner::Result BatchRunner::run(const std::vector<Command>& commands, unsigned threadCount) {
+    auto start = std::chrono::steady_clock::now();
+    Result result = {};
+    result.commands = commands.size();
+
+    std::vector<Footprint> footprints(commands.size());
+    for (std::size_t index = 0; index < commands.size(); ++index) {
+        for (const std::string& path : commands[index].reads) {
+            footprints[index].reads.push_back(normalize(path));
+        }
+        for (const std::string& path : commands[index].writes) {
+            footprints[index].writes.push_back(normalize(path));
+        }
+    }
+
+    BatchState state(commands, threadCount);
+    std::size_t begin = 0;
+    while (begin < commands.size()) {
+        if (commands[begin].barrier) {
+            commands[begin].action();
+            std::cout.flush();
+            ++result.barriers;
+            ++begin;
+            continue;
+        }
+
+        // The commands between two barriers form a dependency graph; all edges point forward in the script.
+        std::size_t end = begin;
+        while (end < commands.size() && !commands[end].barrier) {
+            ++end;
+        }
+        // Every command also waits for this loop, so a command released by a finished one is not started twice.
+        for (std::size_t later = begin; later < end; ++later) {
+            std::size_t dependencies = 0;
+            for (std::size_t earlier = begin; earlier < later; ++earlier) {
+                if (conflicts(footprints[earlier], footprints[later])) {
+                    state.tasks[earlier].dependents.push_back(later);
+                    ++dependencies;
+                }
+            }
+            state.tasks[later].waitingFor.store(dependencies + 1, std::memory_order_relaxed);
+            result.dependentCommands += dependencies > 0 ? 1 : 0;
+        }
+
+        for (std::size_t index = begin; index < end; ++index) {
+            if (state.tasks[index].waitingFor.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+                state.start(index);
+            }
+        }
+        for (std::size_t index = begin; index < end; ++index) {
+            state.printWhenDone(index);
+        }
+        state.pool.wait();
+        std::cout.flush();
+        begin = end;
+    }
+
+    result.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    return result;
+}
+
+bool BatchRunner::overlaps(const std::string& left, const std::string& right) {
+    return overlap(normalize(left), normalize(right));
+}
\ No newline at end of file
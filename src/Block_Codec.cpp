@@ -0,0 +1,183 @@
+#include "Block_Codec.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+
+namespace {
+    const std::size_t MIN_MATCH = 4;
+    const std::size_t MAX_DISTANCE = 65535;
+    // The hash table grows with the block up to this size, so compressing a small block does not clear a large table.
+    const unsigned MAX_HASH_BITS = 16;
+    const unsigned MIN_HASH_BITS = 10;
+    // The last bytes of a block are always literals, so the search may read eight bytes ahead without a bounds check.
+    const std::size_t END_LITERALS = 8;
+    // Every 64 failed searches double the step, so incompressible data is skipped quickly.
+    const unsigned SKIP_SHIFT = 6;
+    const std::size_t LENGTH_MASK = 15;
+
+    std::uint32_t read32(const char* data) {
+        std::uint32_t value;
+        std::memcpy(&value, data, sizeof(value));
+        return value;
+    }
+
+    std::uint64_t read64(const char* data) {
+        std::uint64_t value;
+        std::memcpy(&value, data, sizeof(value));
+        return value;
+    }
+
+    std::uint32_t hashOf(std::uint32_t value, unsigned hashBits) {
+        return (value * 2654435761U) >> (32 - hashBits);
+    }
+
+    char* writeExtraLength(char* output, std::size_t length) {
+        while (length >= 255) {
+            *output++ = static_cast<char>(255);
+            length -= 255;
+        }
+        *output++ = static_cast<char>(length);
+        return output;
+    }
+
+    char* writeLiterals(char* output, const char* literals, std::size_t length, std::size_t matchCode) {
+        *output++ = static_cast<char>((std::min(length, LENGTH_MASK) << 4) | std::min(matchCode, LENGTH_MASK));
+        if (length >= LENGTH_MASK) {
+            output = writeExtraLength(output, length - LENGTH_MASK);
+        }
+        if (length > 0) {
+            std::memcpy(output, literals, length);
+        }
+        return output + length;
+    }
+
+    bool readExtraLength(const unsigned char*& input, const unsigned char* end, std::size_t& length) {
+        unsigned char value;
+        do {
+            if (input == end) {
+                return false;
+            }
+            value = *input++;
+            length += value;
+        } while (value == 255);
+        return true;
+    }
+}
+
+std::size_t BlockCodec::maxCompressedSize(std::size_t size) {
+    return size + size / 255 + 16;
+}
+
+void BlockCodec::compress(const char* input, std::size_t size, std::vector<char>& output) {
+    output.resize(maxCompressedSize(size));
+    char* out = output.data();
+    const char* anchor = input;
+
+    if (size > MIN_MATCH + END_LITERALS) {
+        // Positions are stored relative to the input; stale ones from an earlier block are rejected by the comparison.
+        thread_local std::vector<std::uint32_t> table(std::size_t(1) << MAX_HASH_BITS);
+        unsigned hashBits = MIN_HASH_BITS;
+        while (hashBits < MAX_HASH_BITS && (std::size_t(1) << hashBits) < size) {
+            ++hashBits;
+        }
+        std::fill(table.begin(), table.begin() + (std::size_t(1) << hashBits), 0);
+
+        const char* limit = input + size - END_LITERALS;
+        const char* position = input + 1;
+        unsigned searches = 1U << SKIP_SHIFT;
+        while (position + MIN_MATCH <= limit) {
+            std::uint32_t sequence = read32(position);
+            std::uint32_t& slot = table[hashOf(sequence, hashBits)];
+            const char* candidate = input + slot;
+            slot = static_cast<std::uint32_t>(position - input);
+            if (candidate >= position || static_cast<std::size_t>(position - candidate) > MAX_DISTANCE || read32(candidate) != sequence) {
+                position += searches++ >> SKIP_SHIFT;
+                continue;
+            }
+
+            while (position > anchor && candidate > input && position[-1] == candidate[-1]) {
+                --position;
+                --candidate;
+            }
+            const char* matchEnd = position + MIN_MATCH;
+            const char* source = candidate + MIN_MATCH;
+            while (matchEnd + 8 <= limit && read64(matchEnd) == read64(source)) {
+                matchEnd += 8;
+                source += 8;
+            }
+            while (matchEnd < limit && *matchEnd == *source) {
+                ++matchEnd;
+                ++source;
+            }
+
+            std::size_t distance = static_cast<std::size_t>(position - candidate);
+            std::size_t matchCode = static_cast<std::size_t>(matchEnd - position) - MIN_MATCH;
+            out = writeLiterals(out, anchor, static_cast<std::size_t>(position - anchor), matchCode);
+            *out++ = static_cast<char>(distance & 0xFF);
+            *out++ = static_cast<char>(distance >> 8);
+            if (matchCode >= LENGTH_MASK) {
+                out = writeExtraLength(out, matchCode - LENGTH_MASK);
+            }
+
+            position = matchEnd;
+            anchor = position;
+            table[hashOf(read32(position - 2), hashBits)] = static_cast<std::uint32_t>(position - 2 - input);
+            searches = 1U << SKIP_SHIFT;
+        }
+    }
+
+    out = writeLiterals(out, anchor, static_cast<std::size_t>(input + size - anchor), 0);
+    output.resize(static_cast<std::size_t>(out - output.data()));
+}
+
+bool BlockCodec::decompress(const char* input, std::size_t size, char* output, std::size_t outputSize) {
+    const unsigned char* in = reinterpret_cast<const unsigned char*>(input);
+    const unsigned char* end = in + size;
+    char* out = output;
+    char* outEnd = output + outputSize;
+
+    while (in < end) {
+        unsigned token = *in++;
+        std::size_t literalLength = token >> 4;
+        if (literalLength == LENGTH_MASK && !readExtraLength(in, end, literalLength)) {
+            return false;
+        }
+        if (literalLength > static_cast<std::size_t>(end - in) || literalLength > static_cast<std::size_t>(outEnd - out)) {
+            return false;
+        }
+        if (literalLength > 0) {
+            std::memcpy(out, in, literalLength);
+        }
+        in += literalLength;
+        out += literalLength;
+        if (in == end) {
+            break;
+        }
+
+        if (end - in < 2) {
+            return false;
+        }
+        std::size_t distance = static_cast<std::size_t>(in[0]) | static_cast<std::size_t>(in[1]) << 8;
+        in += 2;
+        std::size_t matchLength = token & LENGTH_MASK;
+        if (matchLength == LENGTH_MASK && !readExtraLength(in, end, matchLength)) {
+            return false;
+        }
+        matchLength += MIN_MATCH;
+        if (distance == 0 || distance > static_cast<std::size_t>(out - output) || matchLength > static_cast<std::size_t>(outEnd - out)) {
+            return false;
+        }
+
+        // A match closer than its length repeats the bytes it is still producing. Each copy doubles the repeated part, so
+        // a long run takes a few copies rather than one per byte.
+        const char* match = out - distance;
+        while (matchLength > 0) {
+            std::size_t chunk = std::min(matchLength, static_cast<std::size_t>(out - match));
+            std::memcpy(out, match, chunk);
+            out += chunk;
+            matchLength -= chunk;
+        }
+    }
+    return out == outEnd;
+}
\ No newline at end of file
@@ -0,0 +1,398 @@
+#include "Bulk_Operation.h"
+#include "Async_Io_Engine.h"
+#include "Directory_Walker.h"
+#include "Instrumentation.h"
+#include "Pattern_Matcher.h"
+#include "Thread_Pool.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <chrono>
+#include <mutex>
+#include <regex>
+#include <unordered_map>
+#include <unordered_set>
+
+namespace {
+    bool isSeparator(char c) {
+#ifdef _WIN32
+        return c == '/' || c == '\\';
+#else
+        return c == '/';
+#endif
+    }
+
+    // Runs every request and hands each completion to the callback, keeping at most one queue of requests in flight.
+    template <typename Callback>
+    void runRequests(AsyncIoEngine& engine, const std::vector<AsyncIoEngine::Request>& requests, Callback callback) {
+        std::vector<AsyncIoEngine::Completion> completions;
+        for (const AsyncIoEngine::Request& request : requests) {
+            engine.submit(request);
+        }
+        while (engine.outstanding() > 0) {
+            completions.clear();
+            engine.wait(completions, engine.outstanding());
+            for (const AsyncIoEngine::Completion& completion : completions) {
+                callback(completion);
+            }
+        }
+    }
+
+    std::size_t lastSeparator(const std::string& path) {
+        for (std::size_t index = path.size(); index > 0; --index) {
+            if (isSeparator(path[index - 1])) {
+                return index - 1;
+            }
+        }
+        return std::string::npos;
+    }
+
+    bool hasGlob(const std::string& text) {
+        return text.find_first_of("*?[") != std::string::npos;
+    }
+
+    // Names are compared as the filesystem compares them: without regard to case on Windows.
+    std::string nameKey(const std::string& name) {
+#ifdef _WIN32
+        std::string key(name);
+        for (char& c : key) {
+            c = static_cast<char>(std::tolower(static_cast<unsigned char>(c)));
+        }
+        return key;
+#else
+        return name;
+#endif
+    }
+
+    std::string nameOf(const std::string& path) {
+        std::size_t separator = lastSeparator(path);
+        return separator == std::string::npos ? path : path.substr(separator + 1);
+    }
+
+    bool readEntries(const std::string& directoryPath, std::vector<DirectoryWalker::Entry>& entries, std::string& error) {
+        if (!DirectoryWalker::readDirectory(directoryPath.empty() ? "." : directoryPath, entries)) {
+            error = "Cannot read directory " + (directoryPath.empty() ? std::string(".") : directoryPath);
+            return false;
+        }
+        return true;
+    }
+
+    // Splits s<d>regex<d>replacement<d>flags at unescaped delimiters, removing the escapes of the delimiter itself.
+    bool splitSubstitution(const std::string& expression, std::string& pattern, std::string& replacement, std::string& flags) {
+        if (expression.size() < 4 || expression[0] != 's') {
+            return false;
+        }
+        char delimiter = expression[1];
+        if (!std::ispunct(static_cast<unsigned char>(delimiter)) || delimiter == '\\') {
+            return false;
+        }
+
+        std::string parts[2];
+        std::size_t part = 0;
+        std::size_t position = 2;
+        while (position < expression.size() && part < 2) {
+            char c = expression[position];
+            if (c == '\\' && position + 1 < expression.size() && expression[position + 1] == delimiter) {
+                parts[part] += delimiter;
+                position += 2;
+                continue;
+            }
+            if (c == delimiter) {
+                ++part;
+            } else {
+                parts[part] += c;
+            }
+            ++position;
+        }
+        if (part < 2) {
+            return false;
+        }
+
+        pattern = parts[0];
+        replacement = parts[1];
+        flags = expression.substr(position);
+        return flags.find_first_not_of("gi") == std::string::npos;
+    }
+}
+
+const std::size_t BulkOperation::MAX_REPORTED;
+const std::size_t BulkOperation::BATCH_SIZE;
+
+bool BulkOperation::isPattern(const std::string& path) {
+    return hasGlob(nameOf(path));
+}
+
+bool BulkOperation::isSubstitution(const std::string& expression) {
+    std::string pattern, replacement, flags;
+    return splitSubstitution(expression, pattern, replacement, flags);
+}
+
+std::string BulkOperation::directoryOf(const std::string& path) {
+    std::size_t separator = lastSeparator(path);
+    if (separator == std::string::npos) {
+        return std::string();
+    }
+    // Keep the separator of a root directory, so "/*.log" lists "/" rather than the current directory.
+    return path.substr(0, separator == 0 || (separator == 2 && path[1] == ':') ? separator + 1 : separator);
+}
+
+bool BulkOperation::expand(const std::string& pattern, std::vector<Item>& items, std::string& error) {
+    std::string directoryPath = directoryOf(pattern);
+    if (hasGlob(directoryPath)) {
+        error = "Wildcards are only supported in the last component of a path";
+        return false;
+    }
+
+    PatternMatcher matcher;
+    if (!matcher.compile(nameOf(pattern), PatternMatcher::Syntax::GLOB, error)) {
+        return false;
+    }
+
+    std::vector<DirectoryWalker::Entry> entries;
+    if (!readEntries(directoryPath, entries, error)) {
+        return false;
+    }
+    for (const DirectoryWalker::Entry& entry : entries) {
+        if (matcher.matches(entry.name)) {
+            items.push_back({DirectoryWalker::joinPath(directoryPath, entry.name), std::string()});
+        }
+    }
+    return true;
+}
+
+bool BulkOperation::expandSubstitution(const std::string& expression, const std::string& directoryPath, std::vector<Item>& items, std::string& error) {
+    std::string pattern, replacement, flags;
+    if (!splitSubstitution(expression, pattern, replacement, flags)) {
+        error = "Expected a substitution of the form s/regex/replacement/ with the optional flags g and i";
+        return false;
+    }
+
+    std::regex::flag_type syntax = std::regex::ECMAScript;
+    if (flags.find('i') != std::string::npos) {
+        syntax |= std::regex::icase;
+    }
+    std::regex regex;
+    try {
+        regex.assign(pattern, syntax);
+    } catch (const std::regex_error& exception) {
+        error = exception.what();
+        return false;
+    }
+    std::regex_constants::match_flag_type replaceFlags = flags.find('g') != std::string::npos ? std::regex_constants::format_default : std::regex_constants::format_first_only;
+
+    std::vector<DirectoryWalker::Entry> entries;
+    if (!readEntries(directoryPath, entries, error)) {
+        return false;
+    }
+    for (const DirectoryWalker::Entry& entry : entries) {
+        if (!std::regex_search(entry.name, regex)) {
+            continue;
+        }
+        std::string newName = std::regex_replace(entry.name, regex, replacement, replaceFlags);
+        if (newName == entry.name) {
+            continue;
+        }
+        if (newName.empty() || newName == "." || newName == ".." || std::any_of(newName.begin(), newName.end(), isSeparator)) {
+            error = "Renaming " + entry.name + " would give the invalid name \"" + newName + "\"";
+            return false;
+        }
+        items.push_back({DirectoryWalker::joinPath(directoryPath, entry.name), DirectoryWalker::joinPath(directoryPath, newName)});
+    }
+    return true;
+}
+
+void BulkOperation::setTargets(std::vector<Item>& items, const std::string& destinationDirectory) {
+    for (Item& item : items) {
+        item.target = DirectoryWalker::joinPath(destinationDirectory, nameOf(item.source));
+    }
+}
+
+std::size_t BulkOperation::findCollisions(const std::vector<Item>& items, const std::string& targetDirectory, std::vector<std::string>& examples) {
+    std::size_t collisions = 0;
+    auto report = [&collisions, &examples](const std::string& description) {
+        ++collisions;
+        if (examples.size() < MAX_REPORTED) {
+            examples.push_back(description);
+        }
+    };
+
+    std::unordered_set<std::string> existing;
+    std::vector<DirectoryWalker::Entry> entries;
+    if (DirectoryWalker::readDirectory(targetDirectory.empty() ? "." : targetDirectory, entries)) {
+        for (const DirectoryWalker::Entry& entry : entries) {
+            existing.insert(nameKey(entry.name));
+        }
+    }
+
+    // The items are renamed concurrently, so a target may not even take the name of another source that is about
+    // to leave: whether that works would depend on which of the two runs first.
+    std::unordered_map<std::string, const Item*> targets;
+    targets.reserve(items.size());
+    for (const Item& item : items) {
+        const std::string& source = item.source;
+        std::string key = nameKey(nameOf(item.target));
+        bool sameFile = directoryOf(source) == directoryOf(item.target) && nameKey(nameOf(source)) == key;
+
+        auto inserted = targets.emplace(key, &item);
+        if (!inserted.second) {
+            report(inserted.first->second->source + " and " + source + " would both become " + item.target);
+        } else if (!sameFile && existing.count(key) != 0) {
+            report(item.target + " already exists");
+        }
+
+        if (item.target.size() > source.size() && nameKey(item.target.substr(0, source.size())) == nameKey(source) && isSeparator(item.target[source.size()])) {
+            report(source + " cannot be moved into itself");
+        }
+    }
+    return collisions;
+}
+
+BulkOperation::Result BulkOperation::run(const std::vector<Item>& items, const std::function<bool(const Item&)>& operation, unsigned threadCount) {
+    INSTRUMENT_SCOPE("BulkOperation::run");
+    auto start = std::chrono::steady_clock::now();
+    Result result = {};
+
+    std::atomic<std::size_t> succeeded{0};
+    std::atomic<std::size_t> failed{0};
+    std::mutex failuresMutex;
+    {
+        ThreadPool pool(threadCount);
+        for (std::size_t begin = 0; begin < items.size(); begin += BATCH_SIZE) {
+            std::size_t end = std::min(items.size(), begin + BATCH_SIZE);
+            pool.submit([&, begin, end] {
+                for (std::size_t index = begin; index < end; ++index) {
+                    if (operation(items[index])) {
+                        succeeded.fetch_add(1, std::memory_order_relaxed);
+                        continue;
+                    }
+                    failed.fetch_add(1, std::memory_order_relaxed);
+                    std::lock_guard<std::mutex> lock(failuresMutex);
+                    if (result.failures.size() < MAX_REPORTED) {
+                        result.failures.push_back(items[index].source);
+                    }
+                }
+            });
+        }
+        pool.wait();
+    }
+
+    result.succeeded = succeeded.load();
+    result.failed = failed.load();
+    result.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    return result;
+}
+
+BulkOperation::Result BulkOperation::rename(const std::vector<Item>& items, const std::function<bool(const Item&)>& acrossDevices) {
+    INSTRUMENT_SCOPE("BulkOperation::rename");
+    auto start = std::chrono::steady_clock::now();
+    Result result = {};
+    auto fail = [&result](const std::string& path) {
+        ++result.failed;
+        if (result.failures.size() < MAX_REPORTED) {
+            result.failures.push_back(path);
+        }
+    };
+
+    std::vector<AsyncIoEngine::Request> requests;
+    requests.reserve(items.size());
+    for (std::size_t index = 0; index < items.size(); ++index) {
+        AsyncIoEngine::Request request{ AsyncIoEngine::Operation::RENAME };
+        request.userData = index;
+        request.path = items[index].source.c_str();
+        request.newPath = items[index].target.c_str();
+        request.flags = AsyncIoEngine::NO_REPLACE;
+        requests.push_back(request);
+    }
+    std::vector<FilesystemBackend::Status> statuses(items.size(), FilesystemBackend::Status::OK);
+    runRequests(AsyncIoEngine::forCurrentThread(), requests, [&statuses](const AsyncIoEngine::Completion& completion) {
+        if (completion.result < 0) {
+            statuses[completion.userData] = FilesystemBackend::statusOfError(-completion.result);
+        }
+    });
+
+    std::vector<Item> moves;
+    for (std::size_t index = 0; index < items.size(); ++index) {
+        FilesystemBackend::Status status = statuses[index];
+        // Kernels and filesystems that cannot refuse to replace a target fail with EINVAL; the backend checks first.
+        if (status == FilesystemBackend::Status::FAILED) {
+            status = FilesystemBackend::rename(items[index].source, items[index].target);
+        }
+        if (status == FilesystemBackend::Status::OK) {
+            ++result.succeeded;
+        } else if (status == FilesystemBackend::Status::CROSS_DEVICE && acrossDevices) {
+            moves.push_back(items[index]);
+        } else {
+            fail(items[index].source);
+        }
+    }
+
+    if (!moves.empty()) {
+        Result moved = run(moves, acrossDevices);
+        result.succeeded += moved.succeeded;
+        result.failed += moved.failed - moved.failures.size();
+        for (const std::string& path : moved.failures) {
+            fail(path);
+        }
+    }
+
+    result.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    return result;
+}
+
+BulkOperation::Result BulkOperation::setPermissions(const std::vector<Item>& items, FilesystemBackend::Access access) {
+    INSTRUMENT_SCOPE("BulkOperation::setPermissions");
+    auto start = std::chrono::steady_clock::now();
+    Result result = {};
+    auto fail = [&result, &items](std::size_t index) {
+        ++result.failed;
+        if (result.failures.size() < MAX_REPORTED) {
+            result.failures.push_back(items[index].source);
+        }
+    };
+
+    AsyncIoEngine& engine = AsyncIoEngine::forCurrentThread();
+    std::vector<DirectoryWalker::Entry> metadata(items.size());
+    std::vector<AsyncIoEngine::Request> requests;
+    requests.reserve(items.size());
+    for (std::size_t index = 0; index < items.size(); ++index) {
+        AsyncIoEngine::Request request{ AsyncIoEngine::Operation::STAT };
+        request.userData = index;
+        request.path = items[index].source.c_str();
+        request.metadata = &metadata[index];
+        requests.push_back(request);
+    }
+    std::vector<bool> statted(items.size(), false);
+    runRequests(engine, requests, [&statted](const AsyncIoEngine::Completion& completion) {
+        statted[completion.userData] = completion.result >= 0;
+    });
+
+    requests.clear();
+    for (std::size_t index = 0; index < items.size(); ++index) {
+        if (!statted[index]) {
+            fail(index);
+            continue;
+        }
+        std::uint32_t current = metadata[index].attributes;
+        std::uint32_t target = FilesystemBackend::permissionsForAccess(current, access);
+        if (FilesystemBackend::isLink(current) || target == FilesystemBackend::permissionsOf(current)) {
+            ++result.succeeded;
+            continue;
+        }
+        AsyncIoEngine::Request request{ AsyncIoEngine::Operation::CHMOD };
+        request.userData = index;
+        request.path = items[index].source.c_str();
+        request.mode = target;
+        requests.push_back(request);
+    }
+    runRequests(engine, requests, [&result, &fail](const AsyncIoEngine::Completion& completion) {
+        if (completion.result >= 0) {
+            ++result.succeeded;
+        } else {
+            fail(static_cast<std::size_t>(completion.userData));
+        }
+    });
+
+    result.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    return result;
+}
\ No newline at end of file
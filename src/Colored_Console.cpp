@@ -1,6 +1,410 @@
 #include "Colored_Console.h"
 
-void ColoredConsole::setConsoleColor(WORD color) {
-	HANDLE hConsole = GetStdHandle(STD_OUTPUT_HANDLE);
-	SetConsoleTextAttribute(hConsole, color);
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <streambuf>
+#include <string>
+#include <thread>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <cerrno>
+#include <unistd.h>
+#endif
+
+namespace {
+    std::atomic<bool> colorsEnabled{true};
+    thread_local std::ostream* redirectedOutput = nullptr;
+
+    // Color changes travel through the queue in-band: MARKER COLOR_TAG low high. A NUL byte of the text is sent as
+    // MARKER LITERAL_TAG.
+    const char MARKER = '\0';
+    const char COLOR_TAG = 'c';
+    const char LITERAL_TAG = '0';
+    const std::size_t COLOR_RECORD_SIZE = 4;
+
+    const std::size_t QUEUE_SIZE = 1 << 20;
+    const std::size_t STREAM_BUFFER_SIZE = 1 << 16;
+
+#ifndef _WIN32
+    // The console bits are blue, green, red; ANSI numbers the same colors red, green, blue.
+    int ansiColor(std::uint16_t bits) {
+        return ((bits & COLOR_RED) ? 1 : 0) | ((bits & COLOR_GREEN) ? 2 : 0) | ((bits & COLOR_BLUE) ? 4 : 0);
+    }
+
+    void appendEscapeSequence(std::string& text, std::uint16_t color) {
+        if (color == DEFAULT_COLOR) {
+            text += "\033[0m";
+            return;
+        }
+        std::uint16_t background = color >> BACKGROUND_SHIFT;
+        text += "\033[0;" + std::to_string(((color & COLOR_INTENSITY) ? 90 : 30) + ansiColor(color));
+        if (background != 0) {
+            text += ";" + std::to_string(((background & COLOR_INTENSITY) ? 100 : 40) + ansiColor(background));
+        }
+        text += 'm';
+    }
+#endif
+
+    // Escape sequences written to a file or a pipe would end up in the text, and a console attribute would not apply.
+    bool isConsole() {
+#ifdef _WIN32
+        DWORD mode = 0;
+        return GetConsoleMode(GetStdHandle(STD_OUTPUT_HANDLE), &mode) != 0;
+#else
+        return isatty(STDOUT_FILENO) != 0;
+#endif
+    }
+
+    // A byte ring with one producer and one consumer. The producer copies into the ring past the published head and
+    // publishes several writes at once; the consumer renders up to the head and then advances the tail. Both counters
+    // only grow, their difference is the number of queued bytes. The mutex is taken only to sleep and to wake a
+    // sleeper, never to pass data.
+    class RenderQueue {
+    public:
+        RenderQueue() : ring(new char[QUEUE_SIZE]), reserved(0), head(0), tail(0), stopping(false), rendererSleeping(false),
+            producerWaiting(false), currentColor(DEFAULT_COLOR), pendingColor(DEFAULT_COLOR) {
+            renderer = std::thread([this] { render(); });
+        }
+
+        ~RenderQueue() {
+            publish();
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                stopping.store(true, std::memory_order_seq_cst);
+            }
+            wake.notify_one();
+            renderer.join();
+        }
+
+        void writeText(const char* data, std::size_t size) {
+            while (size > 0) {
+                const char* marker = static_cast<const char*>(std::memchr(data, MARKER, size));
+                std::size_t length = marker != nullptr ? static_cast<std::size_t>(marker - data) : size;
+                writeBytes(data, length);
+                if (marker == nullptr) {
+                    return;
+                }
+                const char literal[] = { MARKER, LITERAL_TAG };
+                writeBytes(literal, sizeof(literal));
+                data += length + 1;
+                size -= length + 1;
+            }
+        }
+
+        void writeColor(std::uint16_t color) {
+            const char record[COLOR_RECORD_SIZE] = { MARKER, COLOR_TAG, static_cast<char>(color & 0xFF), static_cast<char>(color >> 8) };
+            writeBytes(record, sizeof(record));
+        }
+
+        // The head is read by the renderer before it sleeps, the sleeping flag after it is set; with both sequentially
+        // consistent, either the renderer sees the new head or this sees the flag.
+        void publish() {
+            if (reserved == head.load(std::memory_order_relaxed)) {
+                return;
+            }
+            head.store(reserved, std::memory_order_seq_cst);
+            if (rendererSleeping.load(std::memory_order_seq_cst)) {
+                std::lock_guard<std::mutex> lock(mutex);
+                wake.notify_one();
+            }
+        }
+
+        void drain() {
+            publish();
+            waitForTail(reserved);
+        }
+
+    private:
+        void writeBytes(const char* data, std::size_t size) {
+            while (size > 0) {
+                std::size_t space = QUEUE_SIZE - (reserved - tail.load(std::memory_order_acquire));
+                if (space == 0) {
+                    publish();
+                    waitForTail(reserved - QUEUE_SIZE + 1);
+                    continue;
+                }
+                std::size_t chunk = std::min(space, size);
+                std::size_t offset = reserved & (QUEUE_SIZE - 1);
+                std::size_t first = std::min(chunk, QUEUE_SIZE - offset);
+                std::memcpy(ring.get() + offset, data, first);
+                std::memcpy(ring.get(), data + first, chunk - first);
+                reserved += chunk;
+                data += chunk;
+                size -= chunk;
+            }
+        }
+
+        void waitForTail(std::size_t target) {
+            std::unique_lock<std::mutex> lock(mutex);
+            producerWaiting.store(true, std::memory_order_seq_cst);
+            rendered.wait(lock, [this, target] { return tail.load(std::memory_order_seq_cst) >= target; });
+            producerWaiting.store(false, std::memory_order_relaxed);
+        }
+
+        char at(std::size_t position) const {
+            return ring[position & (QUEUE_SIZE - 1)];
+        }
+
+        void render() {
+            std::string frame;
+            std::size_t position = 0;
+            std::size_t seen = 0;
+            while (true) {
+                std::size_t end = head.load(std::memory_order_acquire);
+                if (end == seen) {
+                    std::unique_lock<std::mutex> lock(mutex);
+                    if (stopping.load(std::memory_order_seq_cst)) {
+                        break;
+                    }
+                    rendererSleeping.store(true, std::memory_order_seq_cst);
+                    wake.wait(lock, [this, seen] {
+                        return head.load(std::memory_order_seq_cst) != seen || stopping.load(std::memory_order_seq_cst);
+                    });
+                    rendererSleeping.store(false, std::memory_order_relaxed);
+                    continue;
+                }
+                seen = end;
+
+                position = decode(position, end, frame);
+                // Typed input is echoed in the color the console is left in, so a reset after the last text of the batch
+                // is applied even though no text follows it yet.
+                if (position == end && pendingColor != currentColor) {
+                    setColor(pendingColor, frame);
+                }
+                writeFrame(frame);
+                tail.store(position, std::memory_order_seq_cst);
+                if (producerWaiting.load(std::memory_order_seq_cst)) {
+                    std::lock_guard<std::mutex> lock(mutex);
+                    rendered.notify_all();
+                }
+            }
+
+            if (currentColor != DEFAULT_COLOR) {
+                setColor(DEFAULT_COLOR, frame);
+                writeFrame(frame);
+            }
+        }
+
+        // Returns the position after the last complete record; a color record split by a full queue is decoded once
+        // the producer has published the rest of it.
+        std::size_t decode(std::size_t position, std::size_t end, std::string& frame) {
+            while (position < end) {
+                if (at(position) != MARKER) {
+                    std::size_t offset = position & (QUEUE_SIZE - 1);
+                    std::size_t limit = std::min(end - position, QUEUE_SIZE - offset);
+                    const char* run = ring.get() + offset;
+                    const char* marker = static_cast<const char*>(std::memchr(run, MARKER, limit));
+                    std::size_t length = marker != nullptr ? static_cast<std::size_t>(marker - run) : limit;
+                    appendText(run, length, frame);
+                    position += length;
+                    continue;
+                }
+                if (end - position < 2) {
+                    break;
+                }
+                if (at(position + 1) == LITERAL_TAG) {
+                    appendText(&MARKER, 1, frame);
+                    position += 2;
+                    continue;
+                }
+                if (end - position < COLOR_RECORD_SIZE) {
+                    break;
+                }
+                pendingColor = static_cast<std::uint16_t>(static_cast<unsigned char>(at(position + 2)) | static_cast<unsigned char>(at(position + 3)) << 8);
+                position += COLOR_RECORD_SIZE;
+            }
+            return position;
+        }
+
+        // Within a batch, a color change only reaches the console when text follows it in a different color, so the reset
+        // after one message and the change before the next one cancel out when both use the same color.
+        void appendText(const char* text, std::size_t length, std::string& frame) {
+            if (pendingColor != currentColor) {
+                setColor(pendingColor, frame);
+            }
+            frame.append(text, length);
+        }
+
+        void setColor(std::uint16_t color, std::string& frame) {
+#ifdef _WIN32
+            writeFrame(frame);
+            SetConsoleTextAttribute(GetStdHandle(STD_OUTPUT_HANDLE), color);
+#else
+            appendEscapeSequence(frame, color);
+#endif
+            currentColor = color;
+        }
+
+        void writeFrame(std::string& frame) {
+            const char* data = frame.data();
+            std::size_t size = frame.size();
+#ifdef _WIN32
+            HANDLE console = GetStdHandle(STD_OUTPUT_HANDLE);
+            while (size > 0) {
+                DWORD written = 0;
+                DWORD chunk = size > 0x40000000 ? 0x40000000 : static_cast<DWORD>(size);
+                if (!WriteFile(console, data, chunk, &written, NULL) || written == 0) {
+                    break;
+                }
+                data += written;
+                size -= written;
+            }
+#else
+            while (size > 0) {
+                ssize_t written = ::write(STDOUT_FILENO, data, size);
+                if (written < 0 && errno == EINTR) {
+                    continue;
+                }
+                if (written <= 0) {
+                    break;
+                }
+                data += written;
+                size -= static_cast<std::size_t>(written);
+            }
+#endif
+            frame.clear();
+        }
+
+        std::unique_ptr<char[]> ring;
+        std::size_t reserved;
+        std::atomic<std::size_t> head;
+        std::atomic<std::size_t> tail;
+        std::atomic<bool> stopping;
+        std::atomic<bool> rendererSleeping;
+        std::atomic<bool> producerWaiting;
+        std::mutex mutex;
+        std::condition_variable wake;
+        std::condition_variable rendered;
+        std::uint16_t currentColor;
+        std::uint16_t pendingColor;
+        std::thread renderer;
+    };
+
+    // Collects the text written to std::cout and passes it to the queue on a flush, on std::endl or when full.
+    class ConsoleBuffer : public std::streambuf {
+    public:
+        explicit ConsoleBuffer(RenderQueue& queue) : queue(queue), buffer(new char[STREAM_BUFFER_SIZE]) {
+            setp(buffer.get(), buffer.get() + STREAM_BUFFER_SIZE);
+        }
+
+        // Moves the buffered text into the queue without publishing it, so the text and the color change that follows
+        // it reach the renderer together.
+        void transfer() {
+            queue.writeText(pbase(), static_cast<std::size_t>(pptr() - pbase()));
+            setp(buffer.get(), buffer.get() + STREAM_BUFFER_SIZE);
+        }
+
+    protected:
+        int_type overflow(int_type character) override {
+            transfer();
+            queue.publish();
+            if (!traits_type::eq_int_type(character, traits_type::eof())) {
+                *pptr() = traits_type::to_char_type(character);
+                pbump(1);
+            }
+            return traits_type::not_eof(character);
+        }
+
+        std::streamsize xsputn(const char* data, std::streamsize size) override {
+            if (size <= epptr() - pptr()) {
+                std::memcpy(pptr(), data, static_cast<std::size_t>(size));
+                pbump(static_cast<int>(size));
+                return size;
+            }
+            transfer();
+            queue.writeText(data, static_cast<std::size_t>(size));
+            queue.publish();
+            return size;
+        }
+
+        int sync() override {
+            transfer();
+            queue.publish();
+            return 0;
+        }
+
+    private:
+        RenderQueue& queue;
+        std::unique_ptr<char[]> buffer;
+    };
+
+    // Installed into std::cout on first use and removed at exit, after the renderer has written everything.
+    class Console {
+    public:
+        Console() : buffer(queue) {
+            std::cout.flush();
+            std::fflush(stdout);
+            previous = std::cout.rdbuf(&buffer);
+        }
+
+        ~Console() {
+            buffer.pubsync();
+            std::cout.rdbuf(previous);
+        }
+
+        void setColor(std::uint16_t color) {
+            buffer.transfer();
+            queue.writeColor(color);
+        }
+
+        void flush() {
+            buffer.transfer();
+            queue.drain();
+        }
+
+    private:
+        RenderQueue queue;
+        ConsoleBuffer buffer;
+        std::streambuf* previous;
+    };
+
+    Console* console() {
+        static const std::unique_ptr<Console> instance(isConsole() ? new Console() : nullptr);
+        return instance.get();
+    }
+}
+
+void ColoredConsole::setConsoleColor(std::uint16_t color) {
+    if (redirectedOutput != nullptr) {
+        return;
+    }
+    Console* renderer = console();
+    if (renderer != nullptr && colorsEnabled.load(std::memory_order_relaxed)) {
+        renderer->setColor(color);
+    }
+}
+
+void ColoredConsole::setColorsEnabled(bool enabled) {
+    colorsEnabled.store(enabled, std::memory_order_relaxed);
+}
+
+void ColoredConsole::flush() {
+    Console* renderer = console();
+    if (renderer != nullptr) {
+        renderer->flush();
+    }
+}
+
+std::ostream& ColoredConsole::out() {
+    if (redirectedOutput != nullptr) {
+        return *redirectedOutput;
+    }
+    console();
+    return std::cout;
+}
+
+void ColoredConsole::redirectOutput(std::ostream* stream) {
+    redirectedOutput = stream;
+}
+
+bool ColoredConsole::isRedirected() {
+    return redirectedOutput != nullptr;
 }
\ No newline at end of file
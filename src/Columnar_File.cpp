@@ -0,0 +1,143 @@
+#include "Columnar_File.h"
+#include "Output_Sink.h"
+
+#include <cstring>
+
+const std::size_t ColumnarFile::MAX_NAME_LENGTH;
+
+namespace {
+    // Followed by the offsets of the columns, then their sizes.
+    struct Header {
+        char magic[8];
+        std::uint32_t version;
+        std::uint32_t entryCount;
+    };
+
+    void writePadding(OutputSink& output, std::uint64_t& offset) {
+        while (offset % 8 != 0) {
+            output.put('\0');
+            ++offset;
+        }
+    }
+}
+
+void ColumnarFile::NameColumns::append(std::string_view name) {
+    std::size_t length = name.size() > MAX_NAME_LENGTH ? MAX_NAME_LENGTH : name.size();
+    offsets.push_back(characters.size());
+    lengths.push_back(static_cast<std::uint16_t>(length));
+    characters.append(name.data(), length);
+}
+
+ColumnarFile::Writer::Writer(const char* magic, std::uint32_t version, std::uint32_t entryCount) : version(version), entryCount(entryCount) {
+    std::memcpy(this->magic, magic, sizeof(this->magic));
+}
+
+void ColumnarFile::Writer::add(const char* data, std::uint64_t size) {
+    columnData.push_back(data);
+    columnSizes.push_back(size);
+}
+
+bool ColumnarFile::Writer::write(const std::string& path) const {
+    Header header;
+    std::memcpy(header.magic, magic, sizeof(magic));
+    header.version = version;
+    header.entryCount = entryCount;
+
+    std::size_t columnCount = columnSizes.size();
+    std::vector<std::uint64_t> columnOffsets(columnCount);
+    std::uint64_t offset = sizeof(Header) + 2 * columnCount * sizeof(std::uint64_t);
+    for (std::size_t column = 0; column < columnCount; ++column) {
+        offset = (offset + 7) / 8 * 8;
+        columnOffsets[column] = offset;
+        offset += columnSizes[column];
+    }
+
+    OutputSink output;
+    if (!output.open(path)) {
+        return false;
+    }
+    output.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    output.write(reinterpret_cast<const char*>(columnOffsets.data()), columnCount * sizeof(std::uint64_t));
+    output.write(reinterpret_cast<const char*>(columnSizes.data()), columnCount * sizeof(std::uint64_t));
+    offset = sizeof(Header) + 2 * columnCount * sizeof(std::uint64_t);
+    for (std::size_t column = 0; column < columnCount; ++column) {
+        writePadding(output, offset);
+        output.write(columnData[column], static_cast<std::size_t>(columnSizes[column]));
+        offset += columnSizes[column];
+    }
+    return output.close();
+}
+
+ColumnarFile::ColumnarFile() : count(0), columnOffsets(nullptr), columnSizes(nullptr) {}
+
+bool ColumnarFile::open(const std::string& path, const char* magic, std::uint32_t version, const std::size_t* valueSizes, std::size_t columnCount) {
+    close();
+    std::size_t headerSize = sizeof(Header) + 2 * columnCount * sizeof(std::uint64_t);
+    if (!file.open(path) || file.size() < headerSize) {
+        file.close();
+        return false;
+    }
+
+    const char* base = file.data();
+    std::size_t mappedSize = file.size();
+    const Header* header = reinterpret_cast<const Header*>(base);
+    const std::uint64_t* offsets = reinterpret_cast<const std::uint64_t*>(base + sizeof(Header));
+    const std::uint64_t* sizes = offsets + columnCount;
+    bool valid = std::memcmp(header->magic, magic, sizeof(header->magic)) == 0 && header->version == version && header->entryCount > 0;
+    for (std::size_t column = 0; valid && column < columnCount; ++column) {
+        valid = offsets[column] % 8 == 0 && offsets[column] <= mappedSize && sizes[column] <= mappedSize - offsets[column] &&
+            (valueSizes[column] == 0 || sizes[column] == static_cast<std::uint64_t>(header->entryCount) * valueSizes[column]);
+    }
+    if (!valid) {
+        file.close();
+        return false;
+    }
+
+    count = header->entryCount;
+    columnOffsets = offsets;
+    columnSizes = sizes;
+    return true;
+}
+
+void ColumnarFile::close() {
+    file.close();
+    count = 0;
+    columnOffsets = nullptr;
+    columnSizes = nullptr;
+}
+
+bool ColumnarFile::isOpen() const {
+    return count > 0;
+}
+
+std::uint32_t ColumnarFile::entryCount() const {
+    return count;
+}
+
+std::string_view ColumnarFile::bytes(std::size_t column) const {
+    return std::string_view(file.data() + columnOffsets[column], static_cast<std::size_t>(columnSizes[column]));
+}
+
+bool ColumnarFile::hasValidNames(std::size_t offsetColumn, std::size_t lengthColumn, std::size_t characterColumn) const {
+    const std::uint64_t* offsets = values<std::uint64_t>(offsetColumn);
+    const std::uint16_t* lengths = values<std::uint16_t>(lengthColumn);
+    std::uint64_t characterCount = columnSizes[characterColumn];
+    for (std::uint32_t index = 0; index < count; ++index) {
+        if (offsets[index] > characterCount || lengths[index] > characterCount - offsets[index]) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool ColumnarFile::hasValidChildRanges(std::size_t firstChildColumn, std::size_t childCountColumn) const {
+    const std::uint32_t* firstChildren = values<std::uint32_t>(firstChildColumn);
+    const std::uint32_t* childCounts = values<std::uint32_t>(childCountColumn);
+    for (std::uint32_t index = 0; index < count; ++index) {
+        std::uint64_t end = static_cast<std::uint64_t>(firstChildren[index]) + childCounts[index];
+        if (childCounts[index] > 0 && (firstChildren[index] <= index || end > count)) {
+            return false;
+        }
+    }
+    return true;
+}
\ No newline at end of file
@@ -0,0 +1,45 @@
+#include "Descriptor_Budget.h"
+
+#include <algorithm>
+
+#ifndef _WIN32
+#include <sys/resource.h>
+#endif
+
+const std::size_t DescriptorBudget::MAX_RELATIVE_PATH;
+const std::size_t DescriptorBudget::DEFAULT_LIMIT;
+const std::size_t DescriptorBudget::MINIMUM_LIMIT;
+
+DescriptorBudget& DescriptorBudget::instance() {
+    static DescriptorBudget budget;
+    return budget;
+}
+
+// Windows handles are limited by memory only; there the default merely keeps a traversal from holding one per directory.
+DescriptorBudget::DescriptorBudget() : slots(DEFAULT_LIMIT), used(0) {
+#ifndef _WIN32
+    struct rlimit limit;
+    if (getrlimit(RLIMIT_NOFILE, &limit) == 0 && limit.rlim_cur != RLIM_INFINITY) {
+        slots = static_cast<std::size_t>(limit.rlim_cur / 2);
+    }
+#endif
+    slots = std::max(slots, MINIMUM_LIMIT);
+}
+
+bool DescriptorBudget::tryAcquire() {
+    std::size_t current = used.load(std::memory_order_relaxed);
+    while (current < slots) {
+        if (used.compare_exchange_weak(current, current + 1, std::memory_order_relaxed)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+void DescriptorBudget::release() {
+    used.fetch_sub(1, std::memory_order_relaxed);
+}
+
+std::size_t DescriptorBudget::limit() const {
+    return slots;
+}
\ No newline at end of file
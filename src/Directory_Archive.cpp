@@ -0,0 +1,1056 @@
+#include "Directory_Archive.h"
+#include "Async_Io_Engine.h"
+#include "Block_Codec.h"
+#include "Directory_Walker.h"
+#include "Fast_Hash.h"
+#include "Filesystem_Backend.h"
+#include "Instrumentation.h"
+#include "Mapped_File.h"
+#include "Output_Sink.h"
+#include "Thread_Pool.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <string_view>
+#include <vector>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <cerrno>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+const std::size_t DirectoryArchive::BLOCK_SIZE;
+
+namespace {
+    const char MAGIC[8] = { 'F', 'M', 'P', 'A', 'C', 'K', '0', '1' };
+    const std::uint32_t FORMAT_VERSION = 1;
+    const std::uint32_t BLOCK_STORED = 1;
+    const std::uint32_t ENTRY_DIRECTORY = 1;
+    // Rejects a damaged footer before it makes every worker allocate a huge block buffer.
+    const std::uint64_t MAX_BLOCK_SIZE = 1 << 26;
+    // The blocks compressed ahead of the one being written, per worker. Bounds the memory of a pack of any size.
+    const std::size_t BLOCKS_IN_FLIGHT_PER_WORKER = 2;
+    // Empty and multi-block files are created in batches, so a tree of many empty files is spread over all workers.
+    const std::size_t FILES_PER_TASK = 64;
+
+    struct FileHeader {
+        char magic[8];
+        std::uint32_t version;
+        std::uint32_t blockSize;
+    };
+
+    struct BlockRecord {
+        std::uint64_t offset;
+        /** Hash of the uncompressed bytes, which also catches damage to a block stored as is. */
+        std::uint64_t hash;
+        std::uint32_t storedSize;
+        std::uint32_t rawSize;
+        std::uint32_t flags;
+        std::uint32_t reserved;
+    };
+
+    struct EntryRecord {
+        /** Position of the contents among the concatenated bytes of all files. */
+        std::uint64_t dataOffset;
+        std::uint64_t size;
+        std::int64_t modificationTime;
+        std::uint64_t pathOffset;
+        std::uint32_t pathLength;
+        /** POSIX permission bits, also on Windows, where only the owner's write bit is used. */
+        std::uint32_t mode;
+        std::uint32_t flags;
+        std::uint32_t reserved;
+    };
+
+    // The last bytes of the archive, which locate the index. The magic comes last, so the end of a file identifies it.
+    struct Footer {
+        std::uint64_t blockTableOffset;
+        std::uint64_t blockCount;
+        std::uint64_t entryTableOffset;
+        std::uint64_t entryCount;
+        std::uint64_t pathsOffset;
+        std::uint64_t pathsSize;
+        std::uint64_t indexHash;
+        std::uint32_t version;
+        std::uint32_t blockSize;
+        char magic[8];
+    };
+
+    struct ScanNode {
+        std::string path;
+        std::vector<DirectoryWalker::Entry> entries;
+        std::vector<std::unique_ptr<ScanNode>> children;
+        bool readable = false;
+    };
+
+    struct ScanState {
+        ThreadPool& pool;
+        std::string excludedPath;
+        std::string_view excludedName;
+        std::atomic<std::size_t> unreadable{0};
+
+        ScanState(ThreadPool& pool, const std::string& excluded) : pool(pool), excludedPath(excluded) {}
+    };
+
+    struct Index {
+        std::vector<EntryRecord> entries;
+        std::string paths;
+        /** The file entries in the order of their contents. */
+        std::vector<std::uint32_t> files;
+        std::uint64_t streamSize = 0;
+
+        std::uint32_t append(const std::string& path, std::uint64_t size, std::int64_t modificationTime, std::uint32_t mode, std::uint32_t flags) {
+            EntryRecord record = {};
+            record.dataOffset = streamSize;
+            record.size = size;
+            record.modificationTime = modificationTime;
+            record.pathOffset = paths.size();
+            record.pathLength = static_cast<std::uint32_t>(path.size());
+            record.mode = mode;
+            record.flags = flags;
+            paths += path;
+            streamSize += size;
+            entries.push_back(record);
+            return static_cast<std::uint32_t>(entries.size() - 1);
+        }
+
+        std::string_view pathOf(const EntryRecord& entry) const {
+            return std::string_view(paths.data() + entry.pathOffset, entry.pathLength);
+        }
+    };
+
+    struct BlockSlot {
+        std::vector<char> data;
+        std::uint64_t hash = 0;
+        std::uint32_t rawSize = 0;
+        bool stored = false;
+        bool ready = false;
+    };
+
+    struct PackState {
+        const std::string& rootPath;
+        const Index& index;
+        std::unique_ptr<std::atomic<bool>[]> damaged;
+        std::atomic<std::size_t> unreadable{0};
+        std::mutex slotMutex;
+        std::condition_variable slotReady;
+
+        PackState(const std::string& rootPath, const Index& index)
+            : rootPath(rootPath), index(index), damaged(new std::atomic<bool>[index.entries.size()]) {
+            for (std::size_t entry = 0; entry < index.entries.size(); ++entry) {
+                damaged[entry].store(false, std::memory_order_relaxed);
+            }
+        }
+    };
+
+    /** The part of a file that falls into one block. */
+    struct Piece {
+        std::uint32_t entry;
+        std::string path;
+        std::uint64_t offset;
+        char* target;
+        std::size_t length;
+        std::size_t read = 0;
+        /** The descriptor of a queued read. */
+        int file = -1;
+    };
+
+    /** The validated tables of a mapped archive. */
+    struct ArchiveView {
+        const char* base;
+        const BlockRecord* blocks;
+        const EntryRecord* entries;
+        const char* paths;
+        std::uint64_t blockCount;
+        std::uint64_t entryCount;
+        std::uint64_t blockSize;
+        std::uint64_t streamSize;
+
+        std::string_view pathOf(const EntryRecord& entry) const {
+            return std::string_view(paths + entry.pathOffset, entry.pathLength);
+        }
+    };
+
+    struct UnpackState {
+        ThreadPool pool;
+        const ArchiveView& archive;
+        const std::string& destination;
+        /** The selected file entries in the order of their contents. */
+        std::vector<std::uint32_t> files;
+        /** Per selected file, set by whichever task fails on it first, so the file is counted once. */
+        std::unique_ptr<std::atomic<bool>[]> failedFiles;
+        std::atomic<std::size_t> filesWritten{0};
+        std::atomic<std::size_t> failures{0};
+        std::atomic<std::uint64_t> bytes{0};
+        std::mutex failureMutex;
+        std::string firstFailure;
+
+        UnpackState(unsigned threadCount, const ArchiveView& archive, const std::string& destination)
+            : pool(threadCount), archive(archive), destination(destination) {}
+
+        void fail(const std::string& path) {
+            failures.fetch_add(1, std::memory_order_relaxed);
+            std::lock_guard<std::mutex> lock(failureMutex);
+            if (firstFailure.empty()) {
+                firstFailure = path;
+            }
+        }
+
+        void failFile(std::size_t position, const std::string& path) {
+            if (!failedFiles[position].exchange(true)) {
+                fail(path);
+            }
+        }
+
+        bool spansBlocks(const EntryRecord& entry) const {
+            return entry.size > 0 && entry.dataOffset / archive.blockSize != (entry.dataOffset + entry.size - 1) / archive.blockSize;
+        }
+
+        std::string outputPath(const EntryRecord& entry) const {
+            std::string path = DirectoryWalker::joinPath(destination, archive.pathOf(entry));
+            std::replace(path.begin() + static_cast<std::ptrdiff_t>(path.size() - entry.pathLength), path.end(), '/', FilesystemBackend::separator());
+            return path;
+        }
+    };
+
+#ifdef _WIN32
+    using FileHandle = HANDLE;
+    const FileHandle NO_FILE = INVALID_HANDLE_VALUE;
+
+    // Junctions and directory symlinks may point back into the tree, so they are not followed.
+    bool isPackedDirectory(const DirectoryWalker::Entry& entry) {
+        return entry.isDirectory && !(entry.attributes & FILE_ATTRIBUTE_REPARSE_POINT);
+    }
+
+    bool isRegularFile(const DirectoryWalker::Entry& entry) {
+        return !entry.isDirectory && !(entry.attributes & FILE_ATTRIBUTE_REPARSE_POINT);
+    }
+
+    std::uint32_t modeOf(const DirectoryWalker::Entry& entry) {
+        std::uint32_t mode = entry.isDirectory ? 0755 : 0644;
+        return (entry.attributes & FILE_ATTRIBUTE_READONLY) ? mode & ~0222U : mode;
+    }
+
+    FILETIME toFileTime(std::int64_t modificationTime) {
+        ULARGE_INTEGER ticks;
+        ticks.QuadPart = static_cast<ULONGLONG>(modificationTime / 100 + 116444736000000000LL);
+        FILETIME time;
+        time.dwLowDateTime = ticks.LowPart;
+        time.dwHighDateTime = ticks.HighPart;
+        return time;
+    }
+
+    OVERLAPPED positionAt(std::uint64_t offset) {
+        OVERLAPPED position = {};
+        position.Offset = static_cast<DWORD>(offset);
+        position.OffsetHigh = static_cast<DWORD>(offset >> 32);
+        return position;
+    }
+
+    std::size_t readRange(const std::string& path, std::uint64_t offset, char* buffer, std::size_t length) {
+        INSTRUMENT_COUNT(SYSTEM_CALLS, 1);
+        HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, NULL, OPEN_EXISTING,
+            FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+        if (file == INVALID_HANDLE_VALUE) {
+            return 0;
+        }
+        std::size_t done = 0;
+        while (done < length) {
+            INSTRUMENT_COUNT(SYSTEM_CALLS, 1);
+            OVERLAPPED position = positionAt(offset + done);
+            DWORD count = 0;
+            DWORD request = static_cast<DWORD>(std::min<std::size_t>(length - done, 1 << 30));
+            if (!ReadFile(file, buffer + done, request, &count, &position) || count == 0) {
+                break;
+            }
+            done += count;
+        }
+        CloseHandle(file);
+        return done;
+    }
+
+    // Windows has no kernel queue for the reads.
+    bool readQueued(std::vector<Piece>&) {
+        return false;
+    }
+
+    FileHandle createOutput(const std::string& path) {
+        INSTRUMENT_COUNT(SYSTEM_CALLS, 1);
+        return CreateFileA(path.c_str(), GENERIC_WRITE, FILE_SHARE_READ | FILE_SHARE_WRITE, NULL, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+    }
+
+    FileHandle openOutput(const std::string& path) {
+        INSTRUMENT_COUNT(SYSTEM_CALLS, 1);
+        return CreateFileA(path.c_str(), GENERIC_WRITE, FILE_SHARE_READ | FILE_SHARE_WRITE, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    }
+
+    // Reserves the clusters of a file that several block tasks write, so they do not extend it one after another.
+    bool preallocate(FileHandle file, std::uint64_t size) {
+        INSTRUMENT_COUNT(SYSTEM_CALLS, 2);
+        LARGE_INTEGER end;
+        end.QuadPart = static_cast<LONGLONG>(size);
+        return SetFilePointerEx(file, end, NULL, FILE_BEGIN) && SetEndOfFile(file);
+    }
+
+    bool writeAt(FileHandle file, const char* data, std::size_t size, std::uint64_t offset) {
+        std::size_t done = 0;
+        while (done < size) {
+            INSTRUMENT_COUNT(SYSTEM_CALLS, 1);
+            OVERLAPPED position = positionAt(offset + done);
+            DWORD count = 0;
+            DWORD request = static_cast<DWORD>(std::min<std::size_t>(size - done, 1 << 30));
+            if (!WriteFile(file, data + done, request, &count, &position) || count == 0) {
+                return false;
+            }
+            done += count;
+        }
+        return true;
+    }
+
+    bool closeOutput(FileHandle file) {
+        return CloseHandle(file) != 0;
+    }
+
+    bool finishOutput(FileHandle file, const std::string& path, std::uint32_t mode, std::int64_t modificationTime) {
+        INSTRUMENT_COUNT(SYSTEM_CALLS, 2);
+        FILETIME time = toFileTime(modificationTime);
+        SetFileTime(file, NULL, NULL, &time);
+        bool closed = CloseHandle(file) != 0;
+        if (!(mode & 0200)) {
+            SetFileAttributesA(path.c_str(), FILE_ATTRIBUTE_READONLY);
+        }
+        return closed;
+    }
+
+    void applyMetadata(const std::string& path, bool isDirectory, std::uint32_t mode, std::int64_t modificationTime) {
+        INSTRUMENT_COUNT(SYSTEM_CALLS, 2);
+        HANDLE file = CreateFileA(path.c_str(), FILE_WRITE_ATTRIBUTES, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, NULL, OPEN_EXISTING,
+            FILE_FLAG_BACKUP_SEMANTICS, NULL);
+        if (file != INVALID_HANDLE_VALUE) {
+            FILETIME time = toFileTime(modificationTime);
+            SetFileTime(file, NULL, NULL, &time);
+            CloseHandle(file);
+        }
+        // The read-only attribute of a directory only marks it as customized in Explorer, so it is left alone.
+        if (!isDirectory && !(mode & 0200)) {
+            SetFileAttributesA(path.c_str(), FILE_ATTRIBUTE_READONLY);
+        }
+    }
+#else
+    using FileHandle = int;
+    const FileHandle NO_FILE = -1;
+
+    bool isPackedDirectory(const DirectoryWalker::Entry& entry) {
+        return entry.isDirectory;
+    }
+
+    bool isRegularFile(const DirectoryWalker::Entry& entry) {
+        return S_ISREG(entry.attributes);
+    }
+
+    std::uint32_t modeOf(const DirectoryWalker::Entry& entry) {
+        return entry.attributes & 07777;
+    }
+
+    struct timespec toTimespec(std::int64_t modificationTime) {
+        struct timespec time;
+        time.tv_sec = static_cast<time_t>(modificationTime / 1000000000);
+        time.tv_nsec = static_cast<long>(modificationTime % 1000000000);
+        if (time.tv_nsec < 0) {
+            time.tv_nsec += 1000000000;
+            --time.tv_sec;
+        }
+        return time;
+    }
+
+    std::size_t readRange(const std::string& path, std::uint64_t offset, char* buffer, std::size_t length) {
+        INSTRUMENT_COUNT(SYSTEM_CALLS, 1);
+        int file = open(path.c_str(), O_RDONLY | O_CLOEXEC | O_NOFOLLOW);
+        if (file < 0) {
+            return 0;
+        }
+        std::size_t done = 0;
+        while (done < length) {
+            INSTRUMENT_COUNT(SYSTEM_CALLS, 1);
+            ssize_t count = pread(file, buffer + done, length - done, static_cast<off_t>(offset + done));
+            if (count < 0 && errno == EINTR) {
+                continue;
+            }
+            if (count <= 0) {
+                break;
+            }
+            done += static_cast<std::size_t>(count);
+        }
+        close(file);
+        return done;
+    }
+
+    // Opens, reads and closes the files of a block in three batches on the kernel queue instead of with three system
+    // calls per file. Returns false without reading anything if the block has too few files or there is no queue.
+    bool readQueued(std::vector<Piece>& pieces) {
+        if (pieces.size() < AsyncIoEngine::BATCH_THRESHOLD || !AsyncIoEngine::isKernelQueueAvailable()) {
+            return false;
+        }
+        AsyncIoEngine& engine = AsyncIoEngine::forCurrentThread();
+        std::vector<AsyncIoEngine::Completion> completions;
+        for (std::size_t index = 0; index < pieces.size(); ++index) {
+            AsyncIoEngine::Request request{ AsyncIoEngine::Operation::OPEN };
+            request.userData = index;
+            request.path = pieces[index].path.c_str();
+            request.flags = O_RDONLY | O_CLOEXEC | O_NOFOLLOW;
+            engine.submit(request);
+        }
+        while (engine.outstanding() > 0) {
+            engine.wait(completions, engine.outstanding());
+        }
+        for (const AsyncIoEngine::Completion& completion : completions) {
+            pieces[completion.userData].file = completion.result;
+        }
+
+        completions.clear();
+        for (std::size_t index = 0; index < pieces.size(); ++index) {
+            if (pieces[index].file < 0) {
+                continue;
+            }
+            AsyncIoEngine::Request request{ AsyncIoEngine::Operation::READ };
+            request.userData = index;
+            request.fd = pieces[index].file;
+            request.buffer = pieces[index].target;
+            request.length = static_cast<std::uint32_t>(pieces[index].length);
+            request.offset = pieces[index].offset;
+            engine.submit(request);
+        }
+        while (engine.outstanding() > 0) {
+            engine.wait(completions, engine.outstanding());
+        }
+        for (const AsyncIoEngine::Completion& completion : completions) {
+            pieces[completion.userData].read = completion.result > 0 ? static_cast<std::size_t>(completion.result) : 0;
+        }
+
+        completions.clear();
+        for (Piece& piece : pieces) {
+            if (piece.file < 0) {
+                continue;
+            }
+            AsyncIoEngine::Request request{ AsyncIoEngine::Operation::CLOSE };
+            request.fd = piece.file;
+            engine.submit(request);
+            // A read may return less than asked before the end of the file; the rest is read the usual way.
+            if (piece.read < piece.length) {
+                piece.read += readRange(piece.path, piece.offset + piece.read, piece.target + piece.read, piece.length - piece.read);
+            }
+        }
+        while (engine.outstanding() > 0) {
+            engine.wait(completions, engine.outstanding());
+        }
+        return true;
+    }
+
+    // The file is created private and receives its permissions once it is complete.
+    FileHandle createOutput(const std::string& path) {
+        INSTRUMENT_COUNT(SYSTEM_CALLS, 1);
+        return open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+    }
+
+    FileHandle openOutput(const std::string& path) {
+        INSTRUMENT_COUNT(SYSTEM_CALLS, 1);
+        return open(path.c_str(), O_WRONLY | O_CLOEXEC);
+    }
+
+    // Reserves the extents of a file that several block tasks write, so they do not extend it one after another.
+    bool preallocate(FileHandle file, std::uint64_t size) {
+        INSTRUMENT_COUNT(SYSTEM_CALLS, 1);
+#ifdef __linux__
+        // Unlike posix_fallocate, fallocate fails on filesystems without extents instead of writing zeros.
+        if (fallocate(file, 0, 0, static_cast<off_t>(size)) == 0) {
+            return true;
+        }
+#endif
+        return ftruncate(file, static_cast<off_t>(size)) == 0;
+    }
+
+    bool writeAt(FileHandle file, const char* data, std::size_t size, std::uint64_t offset) {
+        std::size_t done = 0;
+        while (done < size) {
+            INSTRUMENT_COUNT(SYSTEM_CALLS, 1);
+            ssize_t count = pwrite(file, data + done, size - done, static_cast<off_t>(offset + done));
+            if (count < 0 && errno == EINTR) {
+                continue;
+            }
+            if (count <= 0) {
+                return false;
+            }
+            done += static_cast<std::size_t>(count);
+        }
+        return true;
+    }
+
+    bool closeOutput(FileHandle file) {
+        return close(file) == 0;
+    }
+
+    bool finishOutput(FileHandle file, const std::string&, std::uint32_t mode, std::int64_t modificationTime) {
+        INSTRUMENT_COUNT(SYSTEM_CALLS, 3);
+        struct timespec times[2] = { { 0, UTIME_OMIT }, toTimespec(modificationTime) };
+        fchmod(file, static_cast<mode_t>(mode));
+        futimens(file, times);
+        return close(file) == 0;
+    }
+
+    void applyMetadata(const std::string& path, bool, std::uint32_t mode, std::int64_t modificationTime) {
+        INSTRUMENT_COUNT(SYSTEM_CALLS, 2);
+        struct timespec times[2] = { { 0, UTIME_OMIT }, toTimespec(modificationTime) };
+        utimensat(AT_FDCWD, path.c_str(), times, AT_SYMLINK_NOFOLLOW);
+        chmod(path.c_str(), static_cast<mode_t>(mode));
+    }
+#endif
+
+    std::size_t fileNameStart(const std::string& path) {
+        std::size_t separator = path.find_last_of("/\\");
+        return separator == std::string::npos ? 0 : separator + 1;
+    }
+
+    void scanNode(ScanState& state, ScanNode* node) {
+        node->readable = DirectoryWalker::readDirectory(node->path, node->entries, true);
+        if (!node->readable) {
+            state.unreadable.fetch_add(1, std::memory_order_relaxed);
+        }
+
+        node->entries.erase(std::remove_if(node->entries.begin(), node->entries.end(), [&](const DirectoryWalker::Entry& entry) {
+            return entry.name == state.excludedName && DirectoryWalker::joinPath(node->path, entry.name) == state.excludedPath;
+        }), node->entries.end());
+        // Sorted names make the archive of an unchanged tree byte for byte the same.
+        std::sort(node->entries.begin(), node->entries.end(), [](const DirectoryWalker::Entry& left, const DirectoryWalker::Entry& right) {
+            return left.name < right.name;
+        });
+
+        for (const DirectoryWalker::Entry& entry : node->entries) {
+            if (isPackedDirectory(entry)) {
+                std::unique_ptr<ScanNode> child(new ScanNode());
+                child->path = DirectoryWalker::joinPath(node->path, entry.name);
+                node->children.push_back(std::move(child));
+            }
+        }
+        for (auto it = node->children.rbegin(); it != node->children.rend(); ++it) {
+            ScanNode* child = it->get();
+            state.pool.submit([&state, child] { scanNode(state, child); });
+        }
+    }
+
+    // Lays the tree out depth-first, so the files of a directory and of its subdirectories form one range of blocks.
+    void flatten(ScanNode& root, Index& index, DirectoryArchive::PackResult& result) {
+        struct Frame {
+            ScanNode* node;
+            std::size_t position;
+            std::size_t childIndex;
+            std::size_t prefixLength;
+        };
+        std::string path;
+        std::vector<Frame> stack;
+        stack.push_back({ &root, 0, 0, 0 });
+        while (!stack.empty()) {
+            Frame& frame = stack.back();
+            ScanNode* node = frame.node;
+            if (frame.position == node->entries.size()) {
+                node->entries = std::vector<DirectoryWalker::Entry>();
+                stack.pop_back();
+                continue;
+            }
+
+            const DirectoryWalker::Entry& entry = node->entries[frame.position++];
+            path.resize(frame.prefixLength);
+            path += entry.name;
+            if (isPackedDirectory(entry)) {
+                ScanNode* child = node->children[frame.childIndex++].get();
+                index.append(path, 0, entry.modificationTime, modeOf(entry), ENTRY_DIRECTORY);
+                ++result.directories;
+                path += '/';
+                stack.push_back({ child, 0, 0, path.size() });
+            } else if (isRegularFile(entry)) {
+                index.files.push_back(index.append(path, entry.size, entry.modificationTime, modeOf(entry), 0));
+                ++result.files;
+            } else {
+                ++result.skipped;
+            }
+        }
+    }
+
+    // Returns the first of the files, ordered by their contents, that ends after the given position of the stream.
+    template <typename Entries>
+    std::size_t firstFileEndingAfter(const std::vector<std::uint32_t>& files, const Entries& entries, std::uint64_t position) {
+        auto it = std::upper_bound(files.begin(), files.end(), position, [&](std::uint64_t value, std::uint32_t entry) {
+            return value < entries[entry].dataOffset + entries[entry].size;
+        });
+        return static_cast<std::size_t>(it - files.begin());
+    }
+
+    void packBlock(PackState& state, std::size_t block, BlockSlot& slot) {
+        thread_local std::vector<char> raw;
+        raw.resize(DirectoryArchive::BLOCK_SIZE);
+        const Index& index = state.index;
+        std::uint64_t begin = static_cast<std::uint64_t>(block) * DirectoryArchive::BLOCK_SIZE;
+        std::uint64_t end = std::min<std::uint64_t>(begin + DirectoryArchive::BLOCK_SIZE, index.streamSize);
+
+        std::vector<Piece> pieces;
+        for (std::size_t position = firstFileEndingAfter(index.files, index.entries, begin); position < index.files.size(); ++position) {
+            std::uint32_t entryIndex = index.files[position];
+            const EntryRecord& entry = index.entries[entryIndex];
+            if (entry.dataOffset >= end) {
+                break;
+            }
+            if (entry.size == 0) {
+                continue;
+            }
+            std::uint64_t pieceBegin = std::max(begin, entry.dataOffset);
+            std::uint64_t pieceEnd = std::min(end, entry.dataOffset + entry.size);
+            Piece piece = { entryIndex, DirectoryWalker::joinPath(state.rootPath, index.pathOf(entry)), pieceBegin - entry.dataOffset,
+                raw.data() + (pieceBegin - begin), static_cast<std::size_t>(pieceEnd - pieceBegin) };
+            pieces.push_back(std::move(piece));
+        }
+
+        if (!readQueued(pieces)) {
+            for (Piece& piece : pieces) {
+                piece.read = readRange(piece.path, piece.offset, piece.target, piece.length);
+            }
+        }
+        for (const Piece& piece : pieces) {
+            // A file that shrank or vanished since it was listed keeps its place in the stream, filled with zeros.
+            if (piece.read < piece.length) {
+                std::memset(piece.target + piece.read, 0, piece.length - piece.read);
+                if (!state.damaged[piece.entry].exchange(true)) {
+                    state.unreadable.fetch_add(1, std::memory_order_relaxed);
+                }
+            }
+        }
+
+        std::size_t rawSize = static_cast<std::size_t>(end - begin);
+        slot.hash = FastHash::hash(raw.data(), rawSize);
+        BlockCodec::compress(raw.data(), rawSize, slot.data);
+        slot.stored = slot.data.size() >= rawSize;
+        if (slot.stored) {
+            slot.data.assign(raw.data(), raw.data() + rawSize);
+        }
+        slot.rawSize = static_cast<std::uint32_t>(rawSize);
+        {
+            std::lock_guard<std::mutex> lock(state.slotMutex);
+            slot.ready = true;
+        }
+        state.slotReady.notify_all();
+    }
+
+    void writeRecords(OutputSink& output, FastHash& hash, const void* data, std::size_t size, std::uint64_t& offset) {
+        output.write(static_cast<const char*>(data), size);
+        hash.update(data, size);
+        offset += size;
+    }
+
+    void writePadding(OutputSink& output, std::uint64_t& offset) {
+        while (offset % 8 != 0) {
+            output.put('\0');
+            ++offset;
+        }
+    }
+
+    bool writeArchive(const std::string& archivePath, ThreadPool& pool, PackState& state, DirectoryArchive::PackResult& result) {
+        const Index& index = state.index;
+        OutputSink output;
+        if (!output.open(archivePath)) {
+            return false;
+        }
+
+        FileHeader header;
+        std::memset(&header, 0, sizeof(header));
+        std::memcpy(header.magic, MAGIC, sizeof(MAGIC));
+        header.version = FORMAT_VERSION;
+        header.blockSize = static_cast<std::uint32_t>(DirectoryArchive::BLOCK_SIZE);
+        output.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        std::uint64_t offset = sizeof(header);
+        std::uint64_t compressedBytes = 0;
+
+        // Blocks are compressed out of order but written in order, through a ring of slots that workers fill ahead.
+        std::size_t blockCount = static_cast<std::size_t>((index.streamSize + DirectoryArchive::BLOCK_SIZE - 1) / DirectoryArchive::BLOCK_SIZE);
+        std::vector<BlockRecord> blocks(blockCount);
+        std::vector<BlockSlot> slots(std::max<std::size_t>(1, pool.size() * BLOCKS_IN_FLIGHT_PER_WORKER));
+        std::size_t submitted = 0;
+        for (std::size_t block = 0; block < blockCount; ++block) {
+            for (; submitted < blockCount && submitted < block + slots.size(); ++submitted) {
+                BlockSlot* slot = &slots[submitted % slots.size()];
+                std::size_t next = submitted;
+                pool.submit([&state, next, slot] { packBlock(state, next, *slot); });
+            }
+
+            BlockSlot& slot = slots[block % slots.size()];
+            {
+                std::unique_lock<std::mutex> lock(state.slotMutex);
+                state.slotReady.wait(lock, [&] { return slot.ready; });
+                slot.ready = false;
+            }
+            output.write(slot.data.data(), slot.data.size());
+            blocks[block] = { offset, slot.hash, static_cast<std::uint32_t>(slot.data.size()), slot.rawSize, slot.stored ? BLOCK_STORED : 0, 0 };
+            offset += slot.data.size();
+            compressedBytes += slot.data.size();
+        }
+        pool.wait();
+
+        Footer footer;
+        std::memset(&footer, 0, sizeof(footer));
+        FastHash hash;
+        writePadding(output, offset);
+        footer.blockTableOffset = offset;
+        footer.blockCount = blocks.size();
+        writeRecords(output, hash, blocks.data(), blocks.size() * sizeof(BlockRecord), offset);
+        footer.entryTableOffset = offset;
+        footer.entryCount = index.entries.size();
+        writeRecords(output, hash, index.entries.data(), index.entries.size() * sizeof(EntryRecord), offset);
+        footer.pathsOffset = offset;
+        footer.pathsSize = index.paths.size();
+        writeRecords(output, hash, index.paths.data(), index.paths.size(), offset);
+        writePadding(output, offset);
+        footer.indexHash = hash.digest();
+        footer.version = FORMAT_VERSION;
+        footer.blockSize = header.blockSize;
+        std::memcpy(footer.magic, MAGIC, sizeof(MAGIC));
+        output.write(reinterpret_cast<const char*>(&footer), sizeof(footer));
+        offset += sizeof(footer);
+
+        result.blocks = blocks.size();
+        result.bytes = index.streamSize;
+        result.compressedBytes = compressedBytes;
+        result.archiveBytes = offset;
+        return output.close();
+    }
+
+    // Accepts only relative paths of plain components, so no entry of a damaged or hostile archive leaves the destination.
+    bool isSafePath(std::string_view path) {
+        if (path.empty()) {
+            return false;
+        }
+        std::size_t start = 0;
+        while (true) {
+            std::size_t end = path.find('/', start);
+            std::string_view component = path.substr(start, end == std::string_view::npos ? std::string_view::npos : end - start);
+            if (component.empty() || component == "." || component == ".." || component.find_first_of(std::string_view("\\:\0", 3)) != std::string_view::npos) {
+                return false;
+            }
+            if (end == std::string_view::npos) {
+                return true;
+            }
+            start = end + 1;
+        }
+    }
+
+    bool readArchive(const MappedFile& file, ArchiveView& archive) {
+        if (file.size() < sizeof(FileHeader) + sizeof(Footer)) {
+            return false;
+        }
+        const char* base = file.data();
+        std::uint64_t footerOffset = file.size() - sizeof(Footer);
+        const FileHeader* header = reinterpret_cast<const FileHeader*>(base);
+        const Footer* footer = reinterpret_cast<const Footer*>(base + footerOffset);
+        if (std::memcmp(header->magic, MAGIC, sizeof(MAGIC)) != 0 || std::memcmp(footer->magic, MAGIC, sizeof(MAGIC)) != 0 ||
+            footer->version != FORMAT_VERSION || footer->blockSize == 0 || footer->blockSize > MAX_BLOCK_SIZE) {
+            return false;
+        }
+
+        bool valid = footer->blockTableOffset % 8 == 0 && footer->entryTableOffset % 8 == 0 &&
+            footer->blockTableOffset >= sizeof(FileHeader) && footer->blockTableOffset <= footerOffset &&
+            footer->blockCount <= (footerOffset - footer->blockTableOffset) / sizeof(BlockRecord) &&
+            footer->entryTableOffset >= footer->blockTableOffset + footer->blockCount * sizeof(BlockRecord) && footer->entryTableOffset <= footerOffset &&
+            footer->entryCount <= (footerOffset - footer->entryTableOffset) / sizeof(EntryRecord) &&
+            footer->pathsOffset >= footer->entryTableOffset + footer->entryCount * sizeof(EntryRecord) && footer->pathsOffset <= footerOffset &&
+            footer->pathsSize <= footerOffset - footer->pathsOffset;
+        if (!valid) {
+            return false;
+        }
+        FastHash hash;
+        hash.update(base + footer->blockTableOffset, static_cast<std::size_t>(footer->blockCount * sizeof(BlockRecord)));
+        hash.update(base + footer->entryTableOffset, static_cast<std::size_t>(footer->entryCount * sizeof(EntryRecord)));
+        hash.update(base + footer->pathsOffset, static_cast<std::size_t>(footer->pathsSize));
+        if (hash.digest() != footer->indexHash) {
+            return false;
+        }
+
+        archive.base = base;
+        archive.blocks = reinterpret_cast<const BlockRecord*>(base + footer->blockTableOffset);
+        archive.entries = reinterpret_cast<const EntryRecord*>(base + footer->entryTableOffset);
+        archive.paths = base + footer->pathsOffset;
+        archive.blockCount = footer->blockCount;
+        archive.entryCount = footer->entryCount;
+        archive.blockSize = footer->blockSize;
+        archive.streamSize = 0;
+
+        // Every block but the last is full, so the block of any position of the stream is found by a division.
+        for (std::uint64_t block = 0; block < archive.blockCount; ++block) {
+            const BlockRecord& record = archive.blocks[block];
+            bool last = block + 1 == archive.blockCount;
+            valid = record.offset >= sizeof(FileHeader) && record.offset <= footer->blockTableOffset &&
+                record.storedSize <= footer->blockTableOffset - record.offset && record.rawSize > 0 &&
+                (last ? record.rawSize <= archive.blockSize : record.rawSize == archive.blockSize) &&
+                (!(record.flags & BLOCK_STORED) || record.storedSize == record.rawSize);
+            if (!valid) {
+                return false;
+            }
+            archive.streamSize += record.rawSize;
+        }
+
+        // The contents of the files follow each other without gaps, which the search for the files of a block relies on.
+        std::uint64_t streamOffset = 0;
+        for (std::uint64_t entryIndex = 0; entryIndex < archive.entryCount; ++entryIndex) {
+            const EntryRecord& entry = archive.entries[entryIndex];
+            valid = entry.pathOffset <= footer->pathsSize && entry.pathLength <= footer->pathsSize - entry.pathOffset &&
+                isSafePath(archive.pathOf(entry)) && entry.dataOffset == streamOffset && entry.size <= archive.streamSize - streamOffset &&
+                (!(entry.flags & ENTRY_DIRECTORY) || entry.size == 0);
+            if (!valid) {
+                return false;
+            }
+            streamOffset += entry.size;
+        }
+        return streamOffset == archive.streamSize;
+    }
+
+    // Normalizes the requested entry to the form of the stored paths; an empty result selects the whole archive.
+    std::string normalizeEntryPath(const std::string& entryPath) {
+        std::string path = entryPath;
+        std::replace(path.begin(), path.end(), '\\', '/');
+        while (path.compare(0, 2, "./") == 0) {
+            path.erase(0, 2);
+        }
+        std::size_t first = path.find_first_not_of('/');
+        std::size_t last = path.find_last_not_of('/');
+        if (first == std::string::npos || path == ".") {
+            return std::string();
+        }
+        return path.substr(first, last - first + 1);
+    }
+
+    bool isSelected(std::string_view path, const std::string& selection) {
+        return selection.empty() || (path.compare(0, selection.size(), selection) == 0 && (path.size() == selection.size() || path[selection.size()] == '/'));
+    }
+
+    bool makeDirectory(const std::string& path) {
+        FilesystemBackend::Status status = FilesystemBackend::createDirectory(path);
+        return status == FilesystemBackend::Status::OK || (status == FilesystemBackend::Status::ALREADY_EXISTS && FilesystemBackend::isDirectory(path));
+    }
+
+    // Creates the empty files, which belong to no block, and reserves the space of the files that span several blocks.
+    void createFiles(UnpackState& state, std::size_t begin, std::size_t end) {
+        for (std::size_t position = begin; position < end; ++position) {
+            const EntryRecord& entry = state.archive.entries[state.files[position]];
+            if (entry.size > 0 && !state.spansBlocks(entry)) {
+                continue;
+            }
+            std::string path = state.outputPath(entry);
+            FileHandle file = createOutput(path);
+            if (file == NO_FILE) {
+                state.failFile(position, path);
+                continue;
+            }
+            if (entry.size == 0) {
+                if (finishOutput(file, path, entry.mode, entry.modificationTime)) {
+                    state.filesWritten.fetch_add(1, std::memory_order_relaxed);
+                } else {
+                    state.failFile(position, path);
+                }
+                continue;
+            }
+            // Without reserved space the block tasks still write correctly, only slower.
+            preallocate(file, entry.size);
+            if (!closeOutput(file)) {
+                state.failFile(position, path);
+            }
+        }
+    }
+
+    void unpackBlock(UnpackState& state, std::uint64_t block) {
+        thread_local std::vector<char> buffer;
+        const ArchiveView& archive = state.archive;
+        const BlockRecord& record = archive.blocks[block];
+        std::uint64_t begin = block * archive.blockSize;
+        std::uint64_t end = begin + record.rawSize;
+
+        const char* raw = archive.base + record.offset;
+        bool intact = true;
+        if (!(record.flags & BLOCK_STORED)) {
+            buffer.resize(record.rawSize);
+            intact = BlockCodec::decompress(raw, record.storedSize, buffer.data(), record.rawSize);
+            raw = buffer.data();
+        }
+        intact = intact && FastHash::hash(raw, record.rawSize) == record.hash;
+
+        for (std::size_t position = firstFileEndingAfter(state.files, archive.entries, begin); position < state.files.size(); ++position) {
+            const EntryRecord& entry = archive.entries[state.files[position]];
+            if (entry.dataOffset >= end) {
+                break;
+            }
+            if (entry.size == 0 || state.failedFiles[position].load(std::memory_order_relaxed)) {
+                continue;
+            }
+            std::string path = state.outputPath(entry);
+            if (!intact) {
+                state.failFile(position, path);
+                continue;
+            }
+
+            std::uint64_t pieceBegin = std::max(begin, entry.dataOffset);
+            std::uint64_t pieceEnd = std::min(end, entry.dataOffset + entry.size);
+            const char* piece = raw + (pieceBegin - begin);
+            std::size_t length = static_cast<std::size_t>(pieceEnd - pieceBegin);
+            bool spanning = state.spansBlocks(entry);
+            FileHandle file = spanning ? openOutput(path) : createOutput(path);
+            if (file == NO_FILE) {
+                state.failFile(position, path);
+                continue;
+            }
+            bool written = writeAt(file, piece, length, pieceBegin - entry.dataOffset);
+            bool closed = spanning ? closeOutput(file) : finishOutput(file, path, entry.mode, entry.modificationTime);
+            if (!written || !closed) {
+                state.failFile(position, path);
+                continue;
+            }
+            state.bytes.fetch_add(length, std::memory_order_relaxed);
+            if (!spanning) {
+                state.filesWritten.fetch_add(1, std::memory_order_relaxed);
+            }
+        }
+    }
+}
+
+bool DirectoryArchive::pack(const std::string& rootPath, const std::string& archivePath, unsigned threadCount, PackResult& result) {
+    INSTRUMENT_SCOPE("DirectoryArchive::pack");
+    auto start = std::chrono::steady_clock::now();
+    result = {};
+
+    ThreadPool pool(threadCount);
+    ScanNode root;
+    root.path = rootPath;
+    {
+        ScanState state(pool, archivePath);
+        state.excludedName = std::string_view(state.excludedPath).substr(fileNameStart(state.excludedPath));
+        scanNode(state, &root);
+        pool.wait();
+        result.unreadable = state.unreadable.load();
+    }
+    if (!root.readable) {
+        return false;
+    }
+
+    Index index;
+    flatten(root, index, result);
+    PackState state(rootPath, index);
+    bool written = writeArchive(archivePath, pool, state, result);
+    result.unreadable += state.unreadable.load();
+    if (!written) {
+        std::remove(archivePath.c_str());
+    }
+    result.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    return written;
+}
+
+bool DirectoryArchive::unpack(const std::string& archivePath, const std::string& destination, const std::string& entryPath, unsigned threadCount,
+    UnpackResult& result) {
+    INSTRUMENT_SCOPE("DirectoryArchive::unpack");
+    auto start = std::chrono::steady_clock::now();
+    result = {};
+
+    MappedFile file;
+    ArchiveView archive;
+    if (!file.open(archivePath) || !readArchive(file, archive)) {
+        return false;
+    }
+
+    std::string selection = normalizeEntryPath(entryPath);
+    std::vector<std::uint32_t> directories;
+    UnpackState state(threadCount, archive, destination);
+    for (std::uint64_t entryIndex = 0; entryIndex < archive.entryCount; ++entryIndex) {
+        const EntryRecord& entry = archive.entries[entryIndex];
+        if (isSelected(archive.pathOf(entry), selection)) {
+            (entry.flags & ENTRY_DIRECTORY ? directories : state.files).push_back(static_cast<std::uint32_t>(entryIndex));
+        }
+    }
+    if (!selection.empty() && directories.empty() && state.files.empty()) {
+        return false;
+    }
+    state.failedFiles.reset(new std::atomic<bool>[state.files.size()]);
+    for (std::size_t position = 0; position < state.files.size(); ++position) {
+        state.failedFiles[position].store(false, std::memory_order_relaxed);
+    }
+
+    // A selected entry keeps its path, so the directories above it are created without their stored metadata.
+    bool prepared = makeDirectory(destination);
+    for (std::size_t separator = selection.find('/'); prepared && separator != std::string::npos; separator = selection.find('/', separator + 1)) {
+        std::string ancestor = DirectoryWalker::joinPath(destination, std::string_view(selection).substr(0, separator));
+        std::replace(ancestor.end() - static_cast<std::ptrdiff_t>(separator), ancestor.end(), '/', FilesystemBackend::separator());
+        prepared = makeDirectory(ancestor);
+    }
+    if (!prepared) {
+        state.fail(destination);
+    }
+
+    // Directories are listed before their contents, so creating them in order creates every parent first.
+    std::vector<std::uint8_t> created(directories.size(), 0);
+    for (std::size_t position = 0; prepared && position < directories.size(); ++position) {
+        std::string path = state.outputPath(archive.entries[directories[position]]);
+        created[position] = makeDirectory(path) ? 1 : 0;
+        if (created[position]) {
+            ++result.directories;
+        } else {
+            state.fail(path);
+        }
+    }
+
+    if (prepared) {
+        for (std::size_t begin = 0; begin < state.files.size(); begin += FILES_PER_TASK) {
+            std::size_t end = std::min(begin + FILES_PER_TASK, state.files.size());
+            state.pool.submit([&state, begin, end] { createFiles(state, begin, end); });
+        }
+        state.pool.wait();
+
+        // Only the blocks holding a selected file are decompressed, so extracting one file reads one range of blocks.
+        std::vector<std::uint8_t> needed(static_cast<std::size_t>(archive.blockCount), 0);
+        for (std::uint32_t entryIndex : state.files) {
+            const EntryRecord& entry = archive.entries[entryIndex];
+            if (entry.size > 0) {
+                std::fill(needed.begin() + static_cast<std::ptrdiff_t>(entry.dataOffset / archive.blockSize),
+                    needed.begin() + static_cast<std::ptrdiff_t>((entry.dataOffset + entry.size - 1) / archive.blockSize + 1), 1);
+            }
+        }
+        for (std::uint64_t block = 0; block < archive.blockCount; ++block) {
+            if (needed[static_cast<std::size_t>(block)]) {
+                state.pool.submit([&state, block] { unpackBlock(state, block); });
+            }
+        }
+        state.pool.wait();
+    }
+
+    // The files written by several blocks, and the directories after all their contents, receive their metadata last.
+    for (std::size_t position = 0; prepared && position < state.files.size(); ++position) {
+        const EntryRecord& entry = archive.entries[state.files[position]];
+        if (state.spansBlocks(entry) && !state.failedFiles[position].load()) {
+            applyMetadata(state.outputPath(entry), false, entry.mode, entry.modificationTime);
+            state.filesWritten.fetch_add(1, std::memory_order_relaxed);
+        }
+    }
+    for (std::size_t position = directories.size(); position-- > 0;) {
+        if (created[position]) {
+            const EntryRecord& entry = archive.entries[directories[position]];
+            applyMetadata(state.outputPath(entry), true, entry.mode, entry.modificationTime);
+        }
+    }
+
+    result.files = state.filesWritten.load();
+    result.failures = state.failures.load();
+    result.bytes = state.bytes.load();
+    result.firstFailure = state.firstFailure;
+    result.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    return true;
+}
\ No newline at end of file
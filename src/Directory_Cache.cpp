@@ -0,0 +1,203 @@
+#include "Directory_Cache.h"
+
+#include <algorithm>
+#include <iterator>
+
+DirectoryCache::DirectoryCache(std::size_t byteBudget, std::size_t maxDirectories) : byteBudget(byteBudget), maxDirectories(maxDirectories),
+    usedBytes(0), entryCount(0), hits(0), misses(0), evictions(0) {
+}
+
+bool DirectoryCache::get(const std::string& directoryPath, std::vector<DirectoryWalker::Entry>& entries) {
+    return visit(directoryPath, [&entries](const std::vector<DirectoryWalker::Entry>& cached) { entries = cached; });
+}
+
+bool DirectoryCache::visit(const std::string& directoryPath, const Consumer& consumer) {
+    std::lock_guard<std::mutex> lock(mutex);
+    auto slot = slots.find(directoryPath);
+    if (slot == slots.end()) {
+        ++misses;
+        return false;
+    }
+
+    ++hits;
+    usageOrder.splice(usageOrder.begin(), usageOrder, slot->second.usage);
+    consumer(slot->second.entries);
+    return true;
+}
+
+bool DirectoryCache::contains(const std::string& directoryPath) {
+    std::lock_guard<std::mutex> lock(mutex);
+    return slots.find(directoryPath) != slots.end();
+}
+
+std::vector<std::string> DirectoryCache::put(const std::string& directoryPath, std::vector<DirectoryWalker::Entry> entries) {
+    std::vector<std::string> evicted;
+    std::lock_guard<std::mutex> lock(mutex);
+    store(directoryPath, std::move(entries), evicted);
+    return evicted;
+}
+
+void DirectoryCache::beginLoad(const std::string& directoryPath) {
+    std::lock_guard<std::mutex> lock(mutex);
+    Load& load = loads.emplace(directoryPath, Load{ 0, false }).first->second;
+    ++load.readers;
+}
+
+bool DirectoryCache::finishLoad(const std::string& directoryPath, std::vector<DirectoryWalker::Entry> entries, std::vector<std::string>& evicted) {
+    std::lock_guard<std::mutex> lock(mutex);
+    auto load = loads.find(directoryPath);
+    bool changed = load == loads.end() || load->second.changed;
+    if (load != loads.end() && --load->second.readers == 0) {
+        loads.erase(load);
+    }
+    if (changed) {
+        return false;
+    }
+    store(directoryPath, std::move(entries), evicted);
+    return slots.count(directoryPath) > 0;
+}
+
+void DirectoryCache::abandonLoad(const std::string& directoryPath) {
+    std::lock_guard<std::mutex> lock(mutex);
+    auto load = loads.find(directoryPath);
+    if (load != loads.end() && --load->second.readers == 0) {
+        loads.erase(load);
+    }
+}
+
+std::vector<std::string> DirectoryCache::addEntry(const std::string& directoryPath, const DirectoryWalker::Entry& entry) {
+    std::vector<std::string> evicted;
+    std::lock_guard<std::mutex> lock(mutex);
+    markChanged(directoryPath);
+    auto slot = slots.find(directoryPath);
+    if (slot == slots.end()) {
+        return evicted;
+    }
+
+    std::vector<DirectoryWalker::Entry>& entries = slot->second.entries;
+    for (DirectoryWalker::Entry& existing : entries) {
+        if (existing.name == entry.name) {
+            existing = entry;
+            return evicted;
+        }
+    }
+
+    entries.push_back(entry);
+    std::size_t bytes = estimateBytes(entry);
+    slot->second.bytes += bytes;
+    usedBytes += bytes;
+    ++entryCount;
+
+    // A directory that grows is evicted like one stored by put: the others first, then itself if it is still too large.
+    evictOver(0, directoryPath, evicted);
+    if (usedBytes > byteBudget) {
+        evicted.push_back(directoryPath);
+        eraseSlot(slots.find(directoryPath));
+        ++evictions;
+    }
+    return evicted;
+}
+
+void DirectoryCache::removeEntry(const std::string& directoryPath, const std::string& name) {
+    std::lock_guard<std::mutex> lock(mutex);
+    markChanged(directoryPath);
+    auto slot = slots.find(directoryPath);
+    if (slot == slots.end()) {
+        return;
+    }
+
+    std::vector<DirectoryWalker::Entry>& entries = slot->second.entries;
+    auto entry = std::find_if(entries.begin(), entries.end(), [&name](const DirectoryWalker::Entry& candidate) { return candidate.name == name; });
+    if (entry == entries.end()) {
+        return;
+    }
+
+    std::size_t bytes = estimateBytes(*entry);
+    slot->second.bytes -= bytes;
+    usedBytes -= bytes;
+    --entryCount;
+    entries.erase(entry);
+}
+
+void DirectoryCache::erase(const std::string& directoryPath) {
+    std::lock_guard<std::mutex> lock(mutex);
+    markChanged(directoryPath);
+    auto slot = slots.find(directoryPath);
+    if (slot != slots.end()) {
+        eraseSlot(slot);
+    }
+}
+
+std::vector<std::string> DirectoryCache::directories() {
+    std::lock_guard<std::mutex> lock(mutex);
+    return std::vector<std::string>(usageOrder.begin(), usageOrder.end());
+}
+
+DirectoryCache::Stats DirectoryCache::stats() {
+    std::lock_guard<std::mutex> lock(mutex);
+    return { slots.size(), entryCount, usedBytes, byteBudget, hits, misses, evictions };
+}
+
+std::size_t DirectoryCache::estimateBytes(const DirectoryWalker::Entry& entry) {
+    return sizeof(DirectoryWalker::Entry) + (entry.name.size() >= 16 ? entry.name.size() + 1 : 0);
+}
+
+void DirectoryCache::store(const std::string& directoryPath, std::vector<DirectoryWalker::Entry> entries, std::vector<std::string>& evicted) {
+    std::size_t bytes = sizeof(Slot) + directoryPath.size() * 2;
+    for (const DirectoryWalker::Entry& entry : entries) {
+        bytes += estimateBytes(entry);
+    }
+
+    auto existing = slots.find(directoryPath);
+    if (existing != slots.end()) {
+        eraseSlot(existing);
+    }
+    if (bytes > byteBudget) {
+        evicted.push_back(directoryPath);
+        return;
+    }
+    evictOver(bytes, std::string(), evicted);
+    while (!usageOrder.empty() && slots.size() >= maxDirectories) {
+        evicted.push_back(usageOrder.back());
+        eraseSlot(slots.find(usageOrder.back()));
+        ++evictions;
+    }
+
+    usageOrder.push_front(directoryPath);
+    Slot& slot = slots[directoryPath];
+    slot.usage = usageOrder.begin();
+    slot.bytes = bytes;
+    entryCount += entries.size();
+    usedBytes += bytes;
+    slot.entries = std::move(entries);
+}
+
+// Evicts the least recently used directories other than keptPath until the bytes to add fit into the budget.
+void DirectoryCache::evictOver(std::size_t bytes, const std::string& keptPath, std::vector<std::string>& evicted) {
+    auto victim = usageOrder.end();
+    while (usedBytes + bytes > byteBudget && victim != usageOrder.begin()) {
+        --victim;
+        if (*victim == keptPath) {
+            continue;
+        }
+        std::string path = *victim;
+        victim = std::next(victim);
+        evicted.push_back(path);
+        eraseSlot(slots.find(path));
+        ++evictions;
+    }
+}
+
+void DirectoryCache::markChanged(const std::string& directoryPath) {
+    auto load = loads.find(directoryPath);
+    if (load != loads.end()) {
+        load->second.changed = true;
+    }
+}
+
+void DirectoryCache::eraseSlot(std::unordered_map<std::string, Slot>::iterator slot) {
+    usedBytes -= slot->second.bytes;
+    entryCount -= slot->second.entries.size();
+    usageOrder.erase(slot->second.usage);
+    slots.erase(slot);
+}
\ No newline at end of file
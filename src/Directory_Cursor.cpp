@@ -0,0 +1,87 @@
+#include "Directory_Cursor.h"
+#include "Instrumentation.h"
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/stat.h>
+#endif
+
+const std::size_t DirectoryCursor::BATCH_SIZE;
+
+bool DirectoryCursor::open(const std::string& directoryPath) {
+    return listing.open(directoryPath);
+}
+
+void DirectoryCursor::close() {
+    listing.close();
+}
+
+#ifdef _WIN32
+void DirectoryCursor::readMetadata(Entry& entry, bool withMetadata) const {
+    DirectoryWalker::Entry metadata;
+    listing.readMetadata(metadata);
+    entry.isDirectory = metadata.isDirectory;
+    if (withMetadata) {
+        entry.size = metadata.size;
+        entry.modificationTime = metadata.modificationTime;
+    }
+}
+#else
+// The type reported with the name saves the stat of a short listing; the size and time always need one.
+void DirectoryCursor::readMetadata(Entry& entry, bool withMetadata) const {
+    DirectoryWalker::EntryType type = listing.type();
+    if (!withMetadata && type != DirectoryWalker::EntryType::UNKNOWN) {
+        entry.isDirectory = type == DirectoryWalker::EntryType::DIRECTORY;
+        return;
+    }
+    INSTRUMENT_COUNT(SYSTEM_CALLS, 1);
+#if defined(__linux__) && defined(STATX_TYPE)
+    struct statx status;
+    if (statx(listing.descriptor(), listing.name(), AT_SYMLINK_NOFOLLOW | AT_STATX_DONT_SYNC, STATX_TYPE | STATX_SIZE | STATX_MTIME, &status) == 0) {
+        entry.isDirectory = S_ISDIR(status.stx_mode);
+        entry.size = status.stx_size;
+        entry.modificationTime = static_cast<std::int64_t>(status.stx_mtime.tv_sec) * 1000000000LL + status.stx_mtime.tv_nsec;
+    }
+#else
+    struct stat status;
+    if (fstatat(listing.descriptor(), listing.name(), &status, AT_SYMLINK_NOFOLLOW) == 0) {
+        entry.isDirectory = S_ISDIR(status.st_mode);
+        entry.size = static_cast<std::uint64_t>(status.st_size);
+        entry.modificationTime = static_cast<std::int64_t>(status.st_mtim.tv_sec) * 1000000000LL + status.st_mtim.tv_nsec;
+    }
+#endif
+}
+#endif
+
+std::size_t DirectoryCursor::skip(std::size_t count) {
+    std::size_t skipped = 0;
+    while (skipped < count && listing.next()) {
+        ++skipped;
+    }
+    INSTRUMENT_COUNT(ENTRIES_VISITED, skipped);
+    return skipped;
+}
+
+// The names are copied into one reused buffer and the views are formed once the batch is complete, because appending
+// may move the buffer.
+bool DirectoryCursor::next(std::vector<Entry>& batch, std::size_t maxEntries, bool withMetadata) {
+    INSTRUMENT_SCOPE("DirectoryCursor::next");
+    batch.clear();
+    names.clear();
+    nameOffsets.clear();
+
+    while (batch.size() < maxEntries && listing.next()) {
+        Entry entry{ std::string_view(), false, 0, 0 };
+        nameOffsets.push_back(names.size());
+        names.append(listing.name());
+        readMetadata(entry, withMetadata);
+        batch.push_back(entry);
+    }
+
+    for (std::size_t index = 0; index < batch.size(); ++index) {
+        std::size_t end = index + 1 < batch.size() ? nameOffsets[index + 1] : names.size();
+        batch[index].name = std::string_view(names.data() + nameOffsets[index], end - nameOffsets[index]);
+    }
+    INSTRUMENT_COUNT(ENTRIES_VISITED, batch.size());
+    return !batch.empty();
+}
\ No newline at end of file
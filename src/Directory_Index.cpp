@@ -0,0 +1,585 @@
+#include "Directory_Index.h"
+#include "Async_Io_Engine.h"
+#include "Directory_Walker.h"
+#include "Instrumentation.h"
+#include "Thread_Pool.h"
+
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <sys/stat.h>
+#endif
+
+namespace {
+#ifdef _WIN32
+    const char PATH_SEPARATOR = '\\';
+#else
+    const char PATH_SEPARATOR = '/';
+#endif
+
+    const char MAGIC[8] = { 'F', 'M', 'I', 'N', 'D', 'E', 'X', '1' };
+    const std::uint32_t FORMAT_VERSION = 1;
+    const std::uint8_t FLAG_DIRECTORY = 1;
+
+    enum Column {
+        PARENTS,
+        NAME_OFFSETS,
+        NAME_LENGTHS,
+        SIZES,
+        MODIFICATION_TIMES,
+        ATTRIBUTES,
+        FLAGS,
+        FIRST_CHILDREN,
+        CHILD_COUNTS,
+        NAMES,
+        ROOT_PATH,
+        COLUMN_COUNT
+    };
+
+    // The size of a value in every column; the names and the root path are byte columns.
+    const std::size_t VALUE_SIZES[COLUMN_COUNT] = {
+        sizeof(std::uint32_t), sizeof(std::uint64_t), sizeof(std::uint16_t), sizeof(std::uint64_t), sizeof(std::int64_t),
+        sizeof(std::uint32_t), sizeof(std::uint8_t), sizeof(std::uint32_t), sizeof(std::uint32_t), 0, 0
+    };
+
+    struct BuildNode {
+        std::string path;
+        // Empty for a reused directory, whose entries stay in the previous index until the tree is flattened.
+        std::vector<DirectoryWalker::Entry> entries;
+        std::vector<std::unique_ptr<BuildNode>> children;
+        std::int64_t modificationTime = 0;
+        std::uint32_t attributes = 0;
+        std::uint32_t previousIndex = DirectoryIndex::NO_ENTRY;
+        bool hasMetadata = false;
+        bool readable = false;
+        bool reused = false;
+    };
+
+    struct BuildState {
+        ThreadPool pool;
+        const DirectoryIndex* previous;
+        std::atomic<std::size_t> directoriesRead{0};
+        std::atomic<std::size_t> directoriesReused{0};
+
+        BuildState(unsigned threadCount, const DirectoryIndex* previousIndex) : pool(threadCount), previous(previousIndex) {}
+    };
+
+    struct Columns {
+        std::vector<std::uint32_t> parents;
+        ColumnarFile::NameColumns names;
+        std::vector<std::uint64_t> sizes;
+        std::vector<std::int64_t> modificationTimes;
+        std::vector<std::uint32_t> attributes;
+        std::vector<std::uint8_t> flags;
+        std::vector<std::uint32_t> firstChildren;
+        std::vector<std::uint32_t> childCounts;
+
+        std::uint32_t append(std::uint32_t parent, std::string_view name, std::uint64_t size, std::int64_t modificationTime, std::uint32_t attributeValue, bool isDirectory) {
+            std::uint32_t index = static_cast<std::uint32_t>(parents.size());
+            parents.push_back(parent);
+            names.append(name);
+            sizes.push_back(size);
+            modificationTimes.push_back(modificationTime);
+            attributes.push_back(attributeValue);
+            flags.push_back(isDirectory ? FLAG_DIRECTORY : 0);
+            firstChildren.push_back(0);
+            childCounts.push_back(0);
+            return index;
+        }
+    };
+
+    bool isSeparator(char character) {
+        return character == '/' || character == '\\';
+    }
+
+    bool namesEqual(std::string_view left, std::string_view right) {
+        if (left.size() != right.size()) {
+            return false;
+        }
+#ifdef _WIN32
+        return _strnicmp(left.data(), right.data(), left.size()) == 0;
+#else
+        return left == right;
+#endif
+    }
+
+    bool makeDirectory(const std::string& path) {
+#ifdef _WIN32
+        return CreateDirectoryA(path.c_str(), NULL) || GetLastError() == ERROR_ALREADY_EXISTS;
+#else
+        return mkdir(path.c_str(), 0755) == 0 || errno == EEXIST;
+#endif
+    }
+
+    bool replaceFile(const std::string& source, const std::string& destination) {
+#ifdef _WIN32
+        return MoveFileExA(source.c_str(), destination.c_str(), MOVEFILE_REPLACE_EXISTING) != 0;
+#else
+        return std::rename(source.c_str(), destination.c_str()) == 0;
+#endif
+    }
+
+    std::string cacheDirectory() {
+#ifdef _WIN32
+        const char* base = std::getenv("LOCALAPPDATA");
+        std::string path = base != nullptr && base[0] != '\0' ? base : ".";
+        path += "\\FileManager";
+        makeDirectory(path);
+#else
+        const char* base = std::getenv("XDG_CACHE_HOME");
+        std::string path;
+        if (base != nullptr && base[0] != '\0') {
+            path = base;
+        } else {
+            const char* home = std::getenv("HOME");
+            path = std::string(home != nullptr && home[0] != '\0' ? home : "/tmp") + "/.cache";
+            makeDirectory(path);
+        }
+        path += "/file_manager";
+        makeDirectory(path);
+#endif
+        return path;
+    }
+
+    // The subdirectories of a reused directory still have to be checked against the disk. When there are many, their
+    // metadata is fetched in one batch here instead of one lstat per subdirectory task.
+    void readChildMetadata(BuildNode* node) {
+        AsyncIoEngine& engine = AsyncIoEngine::forCurrentThread();
+        std::vector<DirectoryWalker::Entry> metadata(node->children.size());
+        for (std::size_t index = 0; index < node->children.size(); ++index) {
+            AsyncIoEngine::Request request{ AsyncIoEngine::Operation::STAT };
+            request.userData = index;
+            request.path = node->children[index]->path.c_str();
+            request.metadata = &metadata[index];
+            engine.submit(request);
+        }
+
+        std::vector<AsyncIoEngine::Completion> completions;
+        while (engine.outstanding() > 0) {
+            engine.wait(completions, engine.outstanding());
+        }
+        for (const AsyncIoEngine::Completion& completion : completions) {
+            if (completion.result == 0) {
+                BuildNode* child = node->children[completion.userData].get();
+                child->modificationTime = metadata[completion.userData].modificationTime;
+                child->attributes = metadata[completion.userData].attributes;
+                child->hasMetadata = true;
+            }
+        }
+    }
+
+    void buildNode(BuildState& state, BuildNode* node) {
+        DirectoryWalker::Entry self{};
+        if (!node->hasMetadata && DirectoryWalker::readMetadata(node->path, self)) {
+            node->modificationTime = self.modificationTime;
+            node->attributes = self.attributes;
+        }
+
+        const DirectoryIndex* previous = state.previous;
+        std::vector<std::uint32_t> previousChildren;
+
+        if (previous != nullptr && node->previousIndex != DirectoryIndex::NO_ENTRY && node->modificationTime != 0 &&
+            previous->modificationTime(node->previousIndex) == node->modificationTime) {
+            // Only the subdirectories are needed to carry on; the entries are copied when the tree is flattened, which
+            // an update that re-reads no directory skips entirely.
+            std::uint32_t first = previous->firstChild(node->previousIndex);
+            std::uint32_t count = previous->childCount(node->previousIndex);
+            for (std::uint32_t child = first; child < first + count; ++child) {
+                if (previous->isDirectory(child)) {
+                    std::unique_ptr<BuildNode> childNode(new BuildNode());
+                    childNode->path = DirectoryWalker::joinPath(node->path, previous->name(child));
+                    childNode->previousIndex = child;
+                    node->children.push_back(std::move(childNode));
+                }
+            }
+            node->readable = true;
+            node->reused = true;
+            state.directoriesReused.fetch_add(1, std::memory_order_relaxed);
+        } else {
+            node->readable = DirectoryWalker::readDirectory(node->path, node->entries, true);
+            state.directoriesRead.fetch_add(1, std::memory_order_relaxed);
+
+            if (previous != nullptr && node->previousIndex != DirectoryIndex::NO_ENTRY) {
+                std::unordered_map<std::string_view, std::uint32_t> previousDirectories;
+                std::uint32_t first = previous->firstChild(node->previousIndex);
+                std::uint32_t count = previous->childCount(node->previousIndex);
+                for (std::uint32_t child = first; child < first + count; ++child) {
+                    if (previous->isDirectory(child)) {
+                        previousDirectories.emplace(previous->name(child), child);
+                    }
+                }
+                for (const DirectoryWalker::Entry& entry : node->entries) {
+                    if (entry.isDirectory) {
+                        auto found = previousDirectories.find(entry.name);
+                        previousChildren.push_back(found != previousDirectories.end() ? found->second : DirectoryIndex::NO_ENTRY);
+                    }
+                }
+            }
+        }
+
+        std::size_t directoryIndex = 0;
+        for (const DirectoryWalker::Entry& entry : node->entries) {
+            if (!entry.isDirectory) {
+                continue;
+            }
+            std::unique_ptr<BuildNode> child(new BuildNode());
+            child->path = DirectoryWalker::joinPath(node->path, entry.name);
+            if (directoryIndex < previousChildren.size()) {
+                child->previousIndex = previousChildren[directoryIndex];
+            }
+            // A freshly read listing already carries the current metadata of the subdirectory.
+            child->modificationTime = entry.modificationTime;
+            child->attributes = entry.attributes;
+            child->hasMetadata = true;
+            ++directoryIndex;
+            node->children.push_back(std::move(child));
+        }
+        if (node->reused && node->children.size() >= AsyncIoEngine::BATCH_THRESHOLD && AsyncIoEngine::isKernelQueueAvailable()) {
+            readChildMetadata(node);
+        }
+
+        for (auto it = node->children.rbegin(); it != node->children.rend(); ++it) {
+            BuildNode* child = it->get();
+            state.pool.submit([&state, child] { buildNode(state, child); });
+        }
+    }
+
+    // Lays the tree out breadth-first, so the children of every directory form one contiguous range.
+    void flatten(BuildNode& root, const DirectoryIndex* previous, Columns& columns) {
+        columns.append(0, "", 0, root.modificationTime, root.attributes, true);
+
+        std::vector<std::pair<BuildNode*, std::uint32_t>> queue;
+        queue.emplace_back(&root, 0);
+        for (std::size_t head = 0; head < queue.size(); ++head) {
+            BuildNode* node = queue[head].first;
+            std::uint32_t index = queue[head].second;
+            columns.firstChildren[index] = static_cast<std::uint32_t>(columns.parents.size());
+
+            std::size_t childIndex = 0;
+            // The time observed before the directory was read decides whether the next refresh re-reads it.
+            auto appendEntry = [&](std::string_view name, std::uint64_t size, std::int64_t modificationTime, std::uint32_t attributes, bool isDirectory) {
+                std::uint32_t entryIndex = columns.append(index, name, size, modificationTime, attributes, isDirectory);
+                if (isDirectory) {
+                    BuildNode* child = node->children[childIndex++].get();
+                    columns.modificationTimes[entryIndex] = child->modificationTime;
+                    queue.emplace_back(child, entryIndex);
+                }
+            };
+            if (node->reused) {
+                std::uint32_t first = previous->firstChild(node->previousIndex);
+                std::uint32_t count = previous->childCount(node->previousIndex);
+                columns.childCounts[index] = count;
+                for (std::uint32_t child = first; child < first + count; ++child) {
+                    appendEntry(previous->name(child), previous->size(child), previous->modificationTime(child), previous->attributes(child),
+                        previous->isDirectory(child));
+                }
+            } else {
+                columns.childCounts[index] = static_cast<std::uint32_t>(node->entries.size());
+                for (const DirectoryWalker::Entry& entry : node->entries) {
+                    appendEntry(entry.name, entry.size, entry.modificationTime, entry.attributes, entry.isDirectory);
+                }
+            }
+
+            node->entries.clear();
+            node->entries.shrink_to_fit();
+        }
+    }
+
+    bool writeIndexFile(const std::string& path, const std::string& rootPath, const Columns& columns) {
+        ColumnarFile::Writer writer(MAGIC, FORMAT_VERSION, static_cast<std::uint32_t>(columns.parents.size()));
+        writer.add(columns.parents);
+        writer.add(columns.names.offsets);
+        writer.add(columns.names.lengths);
+        writer.add(columns.sizes);
+        writer.add(columns.modificationTimes);
+        writer.add(columns.attributes);
+        writer.add(columns.flags);
+        writer.add(columns.firstChildren);
+        writer.add(columns.childCounts);
+        writer.add(columns.names.characters.data(), columns.names.characters.size());
+        writer.add(rootPath.data(), rootPath.size());
+        return writer.write(path);
+    }
+
+    // The columns of a file can have the right sizes and still hold names or child ranges that point outside the file,
+    // or parents that form a cycle, which would make lookups read out of bounds or never end. The breadth-first layout
+    // puts every parent before its children, and the children of a directory name it as their parent.
+    bool hasValidLinks(const ColumnarFile& file) {
+        if (!file.hasValidNames(NAME_OFFSETS, NAME_LENGTHS, NAMES) || !file.hasValidChildRanges(FIRST_CHILDREN, CHILD_COUNTS)) {
+            return false;
+        }
+
+        const std::uint32_t* parents = file.values<std::uint32_t>(PARENTS);
+        const std::uint32_t* firstChildren = file.values<std::uint32_t>(FIRST_CHILDREN);
+        const std::uint32_t* childCounts = file.values<std::uint32_t>(CHILD_COUNTS);
+        if (parents[0] != 0) {
+            return false;
+        }
+        for (std::uint32_t index = 0; index < file.entryCount(); ++index) {
+            if (index > 0 && parents[index] >= index) {
+                return false;
+            }
+            std::uint64_t first = firstChildren[index];
+            for (std::uint64_t child = first; child < first + childCounts[index]; ++child) {
+                if (parents[child] != index) {
+                    return false;
+                }
+            }
+        }
+        return true;
+    }
+}
+
+const std::uint32_t DirectoryIndex::NO_ENTRY;
+
+DirectoryIndex::DirectoryIndex() : count(0), parents(nullptr), nameOffsets(nullptr), nameLengths(nullptr), sizes(nullptr),
+    modificationTimes(nullptr), attributeValues(nullptr), flags(nullptr), firstChildren(nullptr), childCounts(nullptr), names(nullptr) {}
+
+DirectoryIndex::~DirectoryIndex() {
+    close();
+}
+
+std::string DirectoryIndex::indexFilePath(const std::string& rootPath) {
+    // FNV-1a keeps the file name short and stable for any root path.
+    std::uint64_t hash = 14695981039346656037ULL;
+    for (char character : rootPath) {
+        hash ^= static_cast<unsigned char>(character);
+        hash *= 1099511628211ULL;
+    }
+
+    char fileName[32];
+    std::snprintf(fileName, sizeof(fileName), "%016llx.idx", static_cast<unsigned long long>(hash));
+    return cacheDirectory() + PATH_SEPARATOR + fileName;
+}
+
+bool DirectoryIndex::open(const std::string& rootPath) {
+    close();
+    return map(indexFilePath(rootPath), rootPath);
+}
+
+bool DirectoryIndex::update(const std::string& rootPath, unsigned threadCount, RefreshStats* stats) {
+    INSTRUMENT_SCOPE("DirectoryIndex::update");
+    // The caller may pass rootPath(), which close() clears before the new file is mapped.
+    const std::string indexRoot = rootPath;
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+    if (!isOpen() || indexedRoot != indexRoot) {
+        open(indexRoot);
+    }
+
+    BuildNode root;
+    root.path = indexRoot;
+    root.previousIndex = isOpen() ? 0 : NO_ENTRY;
+
+    std::size_t directoriesRead = 0;
+    std::size_t directoriesReused = 0;
+    {
+        BuildState state(threadCount, isOpen() ? this : nullptr);
+        buildNode(state, &root);
+        state.pool.wait();
+        directoriesRead = state.directoriesRead.load();
+        directoriesReused = state.directoriesReused.load();
+    }
+    if (!root.readable) {
+        return false;
+    }
+
+    // Every directory still matching the index means the mapped file already holds the current layout, so a warm
+    // update costs one stat per directory and writes nothing.
+    if (directoriesRead > 0) {
+        Columns columns;
+        flatten(root, isOpen() ? this : nullptr, columns);
+
+        std::string path = indexFilePath(indexRoot);
+        std::string temporaryPath = path + ".tmp";
+        if (!writeIndexFile(temporaryPath, indexRoot, columns)) {
+            std::remove(temporaryPath.c_str());
+            return false;
+        }
+
+        // Windows refuses to replace a file that is still mapped.
+        close();
+        if (!replaceFile(temporaryPath, path)) {
+            std::remove(temporaryPath.c_str());
+            return false;
+        }
+        if (!map(path, indexRoot)) {
+            return false;
+        }
+    }
+
+    if (stats != nullptr) {
+        stats->directoriesRead = directoriesRead;
+        stats->directoriesReused = directoriesReused;
+        stats->entryCount = count;
+        stats->seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    }
+    return true;
+}
+
+void DirectoryIndex::close() {
+    file.close();
+    count = 0;
+    indexedRoot.clear();
+}
+
+bool DirectoryIndex::isOpen() const {
+    return file.isOpen();
+}
+
+const std::string& DirectoryIndex::rootPath() const {
+    return indexedRoot;
+}
+
+std::uint32_t DirectoryIndex::entryCount() const {
+    return count;
+}
+
+std::string_view DirectoryIndex::name(std::uint32_t index) const {
+    return std::string_view(names + nameOffsets[index], nameLengths[index]);
+}
+
+std::uint32_t DirectoryIndex::parent(std::uint32_t index) const {
+    return parents[index];
+}
+
+std::uint64_t DirectoryIndex::size(std::uint32_t index) const {
+    return sizes[index];
+}
+
+std::int64_t DirectoryIndex::modificationTime(std::uint32_t index) const {
+    return modificationTimes[index];
+}
+
+std::uint32_t DirectoryIndex::attributes(std::uint32_t index) const {
+    return attributeValues[index];
+}
+
+bool DirectoryIndex::isDirectory(std::uint32_t index) const {
+    return (flags[index] & FLAG_DIRECTORY) != 0;
+}
+
+std::uint32_t DirectoryIndex::firstChild(std::uint32_t index) const {
+    return firstChildren[index];
+}
+
+std::uint32_t DirectoryIndex::childCount(std::uint32_t index) const {
+    return childCounts[index];
+}
+
+std::uint32_t DirectoryIndex::findDirectory(const std::string& directoryPath) const {
+    if (!isOpen() || directoryPath.size() < indexedRoot.size() || !namesEqual(std::string_view(directoryPath).substr(0, indexedRoot.size()), indexedRoot)) {
+        return NO_ENTRY;
+    }
+    if (directoryPath.size() > indexedRoot.size() && !isSeparator(directoryPath[indexedRoot.size()]) && !isSeparator(indexedRoot.back())) {
+        return NO_ENTRY;
+    }
+
+    std::uint32_t current = 0;
+    std::size_t position = indexedRoot.size();
+    while (position < directoryPath.size()) {
+        std::size_t end = position;
+        while (end < directoryPath.size() && !isSeparator(directoryPath[end])) {
+            ++end;
+        }
+        std::string_view component(directoryPath.data() + position, end - position);
+        position = end + 1;
+
+        if (component.empty() || component == ".") {
+            continue;
+        }
+        if (component == "..") {
+            if (current == 0) {
+                return NO_ENTRY;
+            }
+            current = parents[current];
+            continue;
+        }
+
+        std::uint32_t next = NO_ENTRY;
+        std::uint32_t first = firstChildren[current];
+        for (std::uint32_t child = first; child < first + childCounts[current]; ++child) {
+            if (isDirectory(child) && namesEqual(name(child), component)) {
+                next = child;
+                break;
+            }
+        }
+        if (next == NO_ENTRY) {
+            return NO_ENTRY;
+        }
+        current = next;
+    }
+
+    return current;
+}
+
+std::string DirectoryIndex::pathOf(std::uint32_t index) const {
+    std::vector<std::uint32_t> chain;
+    for (std::uint32_t current = index; current != 0; current = parents[current]) {
+        chain.push_back(current);
+    }
+
+    std::string path = indexedRoot;
+    for (auto it = chain.rbegin(); it != chain.rend(); ++it) {
+        if (!path.empty() && !isSeparator(path.back())) {
+            path += PATH_SEPARATOR;
+        }
+        path.append(name(*it));
+    }
+    return path;
+}
+
+void DirectoryIndex::walk(std::uint32_t directory, const Visitor& visitor) const {
+    struct Frame {
+        std::uint32_t next;
+        std::uint32_t end;
+    };
+    std::vector<Frame> stack;
+    stack.push_back({ firstChildren[directory], firstChildren[directory] + childCounts[directory] });
+
+    while (!stack.empty()) {
+        Frame& frame = stack.back();
+        if (frame.next == frame.end) {
+            stack.pop_back();
+            continue;
+        }
+
+        std::uint32_t index = frame.next++;
+        visitor(stack.size() - 1, index);
+        if (isDirectory(index) && childCounts[index] > 0) {
+            stack.push_back({ firstChildren[index], firstChildren[index] + childCounts[index] });
+        }
+    }
+}
+
+bool DirectoryIndex::map(const std::string& path, const std::string& expectedRoot) {
+    bool valid = file.open(path, MAGIC, FORMAT_VERSION, VALUE_SIZES, COLUMN_COUNT) && file.bytes(ROOT_PATH) == expectedRoot && hasValidLinks(file);
+    if (!valid) {
+        close();
+        return false;
+    }
+
+    count = file.entryCount();
+    parents = file.values<std::uint32_t>(PARENTS);
+    nameOffsets = file.values<std::uint64_t>(NAME_OFFSETS);
+    nameLengths = file.values<std::uint16_t>(NAME_LENGTHS);
+    sizes = file.values<std::uint64_t>(SIZES);
+    modificationTimes = file.values<std::int64_t>(MODIFICATION_TIMES);
+    attributeValues = file.values<std::uint32_t>(ATTRIBUTES);
+    flags = file.values<std::uint8_t>(FLAGS);
+    firstChildren = file.values<std::uint32_t>(FIRST_CHILDREN);
+    childCounts = file.values<std::uint32_t>(CHILD_COUNTS);
+    names = file.bytes(NAMES).data();
+    indexedRoot = expectedRoot;
+    return true;
+}
\ No newline at end of file
@@ -0,0 +1,408 @@
+#include "Directory_Snapshot.h"
+#include "Directory_Walker.h"
+#include "Fast_Hash.h"
+#include "Instrumentation.h"
+#include "Mapped_File.h"
+#include "Path_Builder.h"
+#include "Thread_Pool.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <memory>
+#include <vector>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <sys/stat.h>
+#endif
+
+namespace {
+    const char MAGIC[8] = { 'F', 'M', 'S', 'N', 'A', 'P', 'S', '1' };
+    const std::uint32_t FORMAT_VERSION = 1;
+    const std::uint8_t FLAG_DIRECTORY = 1;
+    const std::uint8_t FLAG_UNREADABLE = 2;
+    // Seeds the hash of every directory, so an empty directory and an empty file never share a hash.
+    const std::uint64_t DIRECTORY_SEED = 0x4449524543544f52ULL;
+    // The files of a directory are hashed in batches, so a directory of many large files is spread over all workers.
+    const std::size_t FILES_PER_TASK = 64;
+
+    enum Column {
+        NAME_OFFSETS,
+        NAME_LENGTHS,
+        SIZES,
+        MODIFICATION_TIMES,
+        HASHES,
+        FLAGS,
+        FIRST_CHILDREN,
+        CHILD_COUNTS,
+        DESCENDANT_COUNTS,
+        NAMES,
+        ROOT_PATH,
+        COLUMN_COUNT
+    };
+
+    // The size of a value in every column; the names and the root path are byte columns.
+    const std::size_t VALUE_SIZES[COLUMN_COUNT] = {
+        sizeof(std::uint64_t), sizeof(std::uint16_t), sizeof(std::uint64_t), sizeof(std::int64_t), sizeof(std::uint64_t),
+        sizeof(std::uint8_t), sizeof(std::uint32_t), sizeof(std::uint32_t), sizeof(std::uint32_t), 0, 0
+    };
+
+    struct BuildNode {
+        std::string path;
+        std::vector<DirectoryWalker::Entry> entries;
+        std::vector<std::uint64_t> contentHashes;
+        // One byte per entry rather than std::vector<bool>, since the batches of a directory write it concurrently.
+        std::vector<std::uint8_t> unreadableFiles;
+        std::vector<std::unique_ptr<BuildNode>> children;
+        bool readable = false;
+    };
+
+    struct BuildState {
+        ThreadPool pool;
+        std::string excludedPath;
+        std::string_view excludedName;
+        std::atomic<std::size_t> files{0};
+        std::atomic<std::size_t> directories{0};
+        std::atomic<std::size_t> unreadable{0};
+        std::atomic<std::uint64_t> bytesHashed{0};
+
+        BuildState(unsigned threadCount, const std::string& excluded) : pool(threadCount), excludedPath(excluded) {}
+    };
+
+    struct Columns {
+        ColumnarFile::NameColumns names;
+        std::vector<std::uint64_t> sizes;
+        std::vector<std::int64_t> modificationTimes;
+        std::vector<std::uint64_t> hashes;
+        std::vector<std::uint8_t> flags;
+        std::vector<std::uint32_t> firstChildren;
+        std::vector<std::uint32_t> childCounts;
+        std::vector<std::uint32_t> descendantCounts;
+
+        std::uint32_t append(const std::string& name, std::uint64_t size, std::int64_t modificationTime, std::uint64_t hash, std::uint8_t flagValue) {
+            std::uint32_t index = static_cast<std::uint32_t>(flags.size());
+            names.append(name);
+            sizes.push_back(size);
+            modificationTimes.push_back(modificationTime);
+            hashes.push_back(hash);
+            flags.push_back(flagValue);
+            firstChildren.push_back(0);
+            childCounts.push_back(0);
+            descendantCounts.push_back(0);
+            return index;
+        }
+    };
+
+#ifdef _WIN32
+    bool isRegularFile(const DirectoryWalker::Entry& entry) {
+        return !entry.isDirectory && !(entry.attributes & FILE_ATTRIBUTE_REPARSE_POINT);
+    }
+#else
+    bool isRegularFile(const DirectoryWalker::Entry& entry) {
+        return S_ISREG(entry.attributes);
+    }
+#endif
+
+    void hashFiles(BuildState& state, BuildNode* node, std::size_t begin, std::size_t end) {
+        PathBuilder path(node->path);
+        std::size_t directoryLength = path.size();
+        for (std::size_t index = begin; index < end; ++index) {
+            const DirectoryWalker::Entry& entry = node->entries[index];
+            if (!isRegularFile(entry)) {
+                continue;
+            }
+            path.truncate(directoryLength);
+            path.push(entry.name);
+
+            // A file that changes size while it is read is recorded as unreadable rather than with a torn hash.
+            MappedFile file;
+            if (file.open(path.c_str()) && file.size() == entry.size) {
+                node->contentHashes[index] = FastHash::hash(file.data(), file.size(), entry.size);
+                state.bytesHashed.fetch_add(file.size(), std::memory_order_relaxed);
+            } else {
+                node->unreadableFiles[index] = 1;
+                state.unreadable.fetch_add(1, std::memory_order_relaxed);
+            }
+        }
+    }
+
+    void buildNode(BuildState& state, BuildNode* node) {
+        node->readable = DirectoryWalker::readDirectory(node->path, node->entries, true);
+        if (!node->readable) {
+            state.unreadable.fetch_add(1, std::memory_order_relaxed);
+        }
+
+        if (!state.excludedName.empty()) {
+            node->entries.erase(std::remove_if(node->entries.begin(), node->entries.end(), [&](const DirectoryWalker::Entry& entry) {
+                return entry.name == state.excludedName && DirectoryWalker::joinPath(node->path, entry.name) == state.excludedPath;
+            }), node->entries.end());
+        }
+        // Both snapshots list every directory in the same order, so a comparison merges two sorted ranges.
+        std::sort(node->entries.begin(), node->entries.end(), [](const DirectoryWalker::Entry& left, const DirectoryWalker::Entry& right) {
+            return left.name < right.name;
+        });
+        node->contentHashes.assign(node->entries.size(), 0);
+        node->unreadableFiles.assign(node->entries.size(), 0);
+
+        std::size_t fileCount = 0;
+        for (const DirectoryWalker::Entry& entry : node->entries) {
+            if (entry.isDirectory) {
+                std::unique_ptr<BuildNode> child(new BuildNode());
+                child->path = DirectoryWalker::joinPath(node->path, entry.name);
+                node->children.push_back(std::move(child));
+            } else {
+                ++fileCount;
+            }
+        }
+        state.files.fetch_add(fileCount, std::memory_order_relaxed);
+        state.directories.fetch_add(node->children.size(), std::memory_order_relaxed);
+
+        for (std::size_t begin = 0; begin < node->entries.size(); begin += FILES_PER_TASK) {
+            std::size_t end = std::min(begin + FILES_PER_TASK, node->entries.size());
+            state.pool.submit([&state, node, begin, end] { hashFiles(state, node, begin, end); });
+        }
+        for (auto it = node->children.rbegin(); it != node->children.rend(); ++it) {
+            BuildNode* child = it->get();
+            state.pool.submit([&state, child] { buildNode(state, child); });
+        }
+    }
+
+    // Lays the tree out breadth-first, so the children of every directory form one contiguous range that follows it.
+    void flatten(BuildNode& root, std::int64_t rootModificationTime, Columns& columns) {
+        columns.append("", 0, rootModificationTime, 0, FLAG_DIRECTORY);
+
+        std::vector<std::pair<BuildNode*, std::uint32_t>> queue;
+        queue.emplace_back(&root, 0);
+        for (std::size_t head = 0; head < queue.size(); ++head) {
+            BuildNode* node = queue[head].first;
+            std::uint32_t index = queue[head].second;
+
+            columns.firstChildren[index] = static_cast<std::uint32_t>(columns.flags.size());
+            columns.childCounts[index] = static_cast<std::uint32_t>(node->entries.size());
+
+            std::size_t childIndex = 0;
+            for (std::size_t position = 0; position < node->entries.size(); ++position) {
+                const DirectoryWalker::Entry& entry = node->entries[position];
+                if (entry.isDirectory) {
+                    BuildNode* child = node->children[childIndex++].get();
+                    // The size of a directory is a property of the filesystem, not of its contents.
+                    std::uint32_t entryIndex = columns.append(entry.name, 0, entry.modificationTime, 0,
+                        FLAG_DIRECTORY | (child->readable ? 0 : FLAG_UNREADABLE));
+                    queue.emplace_back(child, entryIndex);
+                } else {
+                    columns.append(entry.name, entry.size, entry.modificationTime, node->contentHashes[position],
+                        node->unreadableFiles[position] ? FLAG_UNREADABLE : 0);
+                }
+            }
+
+            node->entries.clear();
+            node->entries.shrink_to_fit();
+            node->contentHashes = std::vector<std::uint64_t>();
+            node->unreadableFiles = std::vector<std::uint8_t>();
+        }
+    }
+
+    // Children follow their directory, so walking the entries backwards finishes every child before its directory.
+    void hashDirectories(Columns& columns) {
+        for (std::size_t index = columns.flags.size(); index-- > 0;) {
+            if (!(columns.flags[index] & FLAG_DIRECTORY)) {
+                continue;
+            }
+            FastHash hash(DIRECTORY_SEED);
+            std::uint32_t descendants = 0;
+            std::uint32_t first = columns.firstChildren[index];
+            for (std::uint32_t child = first; child < first + columns.childCounts[index]; ++child) {
+                hash.update(&columns.names.lengths[child], sizeof(std::uint16_t));
+                hash.update(columns.names.characters.data() + columns.names.offsets[child], columns.names.lengths[child]);
+                hash.update(&columns.flags[child], sizeof(std::uint8_t));
+                hash.update(&columns.sizes[child], sizeof(std::uint64_t));
+                hash.update(&columns.hashes[child], sizeof(std::uint64_t));
+                descendants += 1 + columns.descendantCounts[child];
+            }
+            columns.hashes[index] = hash.digest();
+            columns.descendantCounts[index] = descendants;
+        }
+    }
+
+    bool writeSnapshotFile(const std::string& path, const std::string& rootPath, const Columns& columns) {
+        ColumnarFile::Writer writer(MAGIC, FORMAT_VERSION, static_cast<std::uint32_t>(columns.flags.size()));
+        writer.add(columns.names.offsets);
+        writer.add(columns.names.lengths);
+        writer.add(columns.sizes);
+        writer.add(columns.modificationTimes);
+        writer.add(columns.hashes);
+        writer.add(columns.flags);
+        writer.add(columns.firstChildren);
+        writer.add(columns.childCounts);
+        writer.add(columns.descendantCounts);
+        writer.add(columns.names.characters.data(), columns.names.characters.size());
+        writer.add(rootPath.data(), rootPath.size());
+        return writer.write(path);
+    }
+
+    std::size_t fileNameStart(const std::string& path) {
+        std::size_t separator = path.find_last_of("/\\");
+        return separator == std::string::npos ? 0 : separator + 1;
+    }
+}
+
+bool DirectorySnapshot::create(const std::string& rootPath, const std::string& snapshotPath, unsigned threadCount, CreateResult& result) {
+    INSTRUMENT_SCOPE("DirectorySnapshot::create");
+    auto start = std::chrono::steady_clock::now();
+    result = {};
+
+    DirectoryWalker::Entry rootEntry{};
+    DirectoryWalker::readMetadata(rootPath, rootEntry);
+
+    BuildNode root;
+    root.path = rootPath;
+    Columns columns;
+    {
+        BuildState state(threadCount, snapshotPath);
+        state.excludedName = std::string_view(state.excludedPath).substr(fileNameStart(state.excludedPath));
+        buildNode(state, &root);
+        state.pool.wait();
+        result.files = state.files.load();
+        result.directories = state.directories.load();
+        result.unreadable = state.unreadable.load();
+        result.bytesHashed = state.bytesHashed.load();
+    }
+    if (!root.readable) {
+        return false;
+    }
+    flatten(root, rootEntry.modificationTime, columns);
+    hashDirectories(columns);
+
+    bool written = writeSnapshotFile(snapshotPath, rootPath, columns);
+    if (!written) {
+        std::remove(snapshotPath.c_str());
+    }
+    result.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    return written;
+}
+
+// The comparison trusts the names and the child ranges, so a damaged file is rejected here rather than read out of bounds.
+bool DirectorySnapshot::open(const std::string& snapshotPath) {
+    count = 0;
+    if (!file.open(snapshotPath, MAGIC, FORMAT_VERSION, VALUE_SIZES, COLUMN_COUNT) || !file.hasValidNames(NAME_OFFSETS, NAME_LENGTHS, NAMES) ||
+        !file.hasValidChildRanges(FIRST_CHILDREN, CHILD_COUNTS)) {
+        file.close();
+        return false;
+    }
+
+    nameOffsets = file.values<std::uint64_t>(NAME_OFFSETS);
+    nameLengths = file.values<std::uint16_t>(NAME_LENGTHS);
+    sizes = file.values<std::uint64_t>(SIZES);
+    modificationTimes = file.values<std::int64_t>(MODIFICATION_TIMES);
+    hashes = file.values<std::uint64_t>(HASHES);
+    flags = file.values<std::uint8_t>(FLAGS);
+    firstChildren = file.values<std::uint32_t>(FIRST_CHILDREN);
+    childCounts = file.values<std::uint32_t>(CHILD_COUNTS);
+    descendantCounts = file.values<std::uint32_t>(DESCENDANT_COUNTS);
+    names = file.bytes(NAMES).data();
+    root = file.bytes(ROOT_PATH);
+    count = file.entryCount();
+    return true;
+}
+
+std::string_view DirectorySnapshot::rootPath() const {
+    return root;
+}
+
+std::uint32_t DirectorySnapshot::entryCount() const {
+    return count;
+}
+
+std::string_view DirectorySnapshot::name(std::uint32_t index) const {
+    return std::string_view(names + nameOffsets[index], nameLengths[index]);
+}
+
+bool DirectorySnapshot::isDirectory(std::uint32_t index) const {
+    return (flags[index] & FLAG_DIRECTORY) != 0;
+}
+
+bool DirectorySnapshot::sameContents(std::uint32_t index, const DirectorySnapshot& other, std::uint32_t otherIndex) const {
+    return flags[index] == other.flags[otherIndex] && sizes[index] == other.sizes[otherIndex] && hashes[index] == other.hashes[otherIndex];
+}
+
+DirectorySnapshot::DiffResult DirectorySnapshot::diff(const DirectorySnapshot& before, const DirectorySnapshot& after, const ChangeVisitor& visitor) {
+    INSTRUMENT_SCOPE("DirectorySnapshot::diff");
+    auto start = std::chrono::steady_clock::now();
+    DiffResult result = {};
+    if (before.count == 0 || after.count == 0) {
+        return result;
+    }
+    if (before.sameContents(0, after, 0)) {
+        result.subtreesSkipped = 1;
+        result.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        return result;
+    }
+
+    // One frame per directory that differs, holding the merge position in both listings.
+    struct Frame {
+        std::uint32_t beforeNext;
+        std::uint32_t beforeEnd;
+        std::uint32_t afterNext;
+        std::uint32_t afterEnd;
+        std::size_t pathLength;
+    };
+    PathBuilder path;
+    std::vector<Frame> stack;
+    stack.push_back({ before.firstChildren[0], before.firstChildren[0] + before.childCounts[0], after.firstChildren[0],
+        after.firstChildren[0] + after.childCounts[0], 0 });
+    result.directoriesCompared = 1;
+
+    auto report = [&](Change change, const DirectorySnapshot& snapshot, std::uint32_t index) {
+        std::size_t entries = 1 + (snapshot.isDirectory(index) ? snapshot.descendantCounts[index] : 0);
+        std::size_t length = path.push(snapshot.name(index));
+        visitor(change, path.view(), snapshot.isDirectory(index), entries);
+        path.truncate(length);
+        (change == Change::ADDED ? result.added : result.removed) += entries;
+    };
+
+    while (!stack.empty()) {
+        Frame& frame = stack.back();
+        path.truncate(frame.pathLength);
+        bool beforeLeft = frame.beforeNext < frame.beforeEnd;
+        bool afterLeft = frame.afterNext < frame.afterEnd;
+        if (!beforeLeft && !afterLeft) {
+            stack.pop_back();
+            continue;
+        }
+
+        int order = !beforeLeft ? 1 : !afterLeft ? -1 : before.name(frame.beforeNext).compare(after.name(frame.afterNext));
+        if (order < 0) {
+            report(Change::REMOVED, before, frame.beforeNext++);
+            continue;
+        }
+        if (order > 0) {
+            report(Change::ADDED, after, frame.afterNext++);
+            continue;
+        }
+
+        std::uint32_t beforeIndex = frame.beforeNext++;
+        std::uint32_t afterIndex = frame.afterNext++;
+        if (before.sameContents(beforeIndex, after, afterIndex)) {
+            result.subtreesSkipped += before.isDirectory(beforeIndex) ? 1 : 0;
+        } else if (before.isDirectory(beforeIndex) != after.isDirectory(afterIndex)) {
+            report(Change::REMOVED, before, beforeIndex);
+            report(Change::ADDED, after, afterIndex);
+        } else if (before.isDirectory(beforeIndex)) {
+            path.push(after.name(afterIndex));
+            ++result.directoriesCompared;
+            stack.push_back({ before.firstChildren[beforeIndex], before.firstChildren[beforeIndex] + before.childCounts[beforeIndex],
+                after.firstChildren[afterIndex], after.firstChildren[afterIndex] + after.childCounts[afterIndex], path.size() });
+        } else {
+            std::size_t length = path.push(after.name(afterIndex));
+            visitor(Change::MODIFIED, path.view(), false, 1);
+            path.truncate(length);
+            ++result.modified;
+        }
+    }
+
+    result.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    return result;
+}
\ No newline at end of file
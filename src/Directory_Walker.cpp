@@ -0,0 +1,606 @@
+#include "Directory_Walker.h"
+#include "Async_Io_Engine.h"
+#include "Descriptor_Budget.h"
+#include "Filesystem_Backend.h"
+#include "Instrumentation.h"
+#include "Path_Builder.h"
+#include "Thread_Pool.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#ifdef __linux__
+#include <sys/syscall.h>
+#endif
+#endif
+
+namespace {
+#ifdef _WIN32
+    const char PATH_SEPARATOR = '\\';
+#else
+    const char PATH_SEPARATOR = '/';
+#endif
+
+    // A directory of the walk. On POSIX systems it is opened by its path relative to its anchor, the nearest ancestor
+    // that kept its descriptor, and a kept descriptor stays open until every directory below has been read.
+    struct Node {
+        Node* parent = nullptr;
+        // The full path on Windows; elsewhere the path relative to the anchor, or the root path without one.
+        std::string path;
+        DirectoryWalker::NameList entries;
+        std::vector<std::unique_ptr<Node>> children;
+        std::atomic<bool> ready{false};
+#ifndef _WIN32
+        Node* anchor = nullptr;
+        int fd = -1;
+        bool holdsSlot = false;
+        std::atomic<std::size_t> pending{1};
+#endif
+    };
+
+    // The pool is declared last, so it joins its workers before the mutex and the condition variable they use go away.
+    struct WalkState {
+        std::mutex mutex;
+        std::condition_variable nodeReady;
+        // Set when a directory could not be published, so the walk stops instead of waiting for its subdirectories.
+        std::atomic<bool> failed{false};
+        ThreadPool pool;
+
+        explicit WalkState(unsigned threadCount) : pool(threadCount) {}
+    };
+
+    bool readNode(WalkState& state, Node* node);
+
+#ifndef _WIN32
+    // Closes the descriptors of the directories whose subtrees have been read completely.
+    void finishNode(Node* node) {
+        while (node != nullptr && node->pending.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+            if (node->fd >= 0) {
+                INSTRUMENT_COUNT(SYSTEM_CALLS, 1);
+                close(node->fd);
+                node->fd = -1;
+            }
+            if (node->holdsSlot) {
+                DescriptorBudget::instance().release();
+            }
+            node = node->parent;
+        }
+    }
+#endif
+
+    void publishNode(WalkState& state, Node* node) {
+        for (std::size_t index = 0; index < node->entries.size(); ++index) {
+            if (node->entries.isDirectory(index)) {
+                std::string_view name = node->entries.name(index);
+                std::unique_ptr<Node> child(new Node());
+#ifdef _WIN32
+                child->path = DirectoryWalker::joinPath(node->path, name);
+#else
+                child->parent = node;
+                child->anchor = node->fd >= 0 ? node : node->anchor;
+                child->path = node->fd >= 0 ? std::string(name) : DirectoryWalker::joinPath(node->path, name);
+#endif
+                node->children.push_back(std::move(child));
+            }
+        }
+
+#ifndef _WIN32
+        node->pending.fetch_add(node->children.size(), std::memory_order_relaxed);
+#endif
+        // Workers pop their own queue from the back, so pushing in reverse makes the first subdirectory run first.
+        std::size_t queued = 0;
+        try {
+            for (auto it = node->children.rbegin(); it != node->children.rend(); ++it) {
+                Node* child = it->get();
+                state.pool.submit([&state, child] { readNode(state, child); });
+                ++queued;
+            }
+        } catch (...) {
+#ifndef _WIN32
+            node->pending.fetch_sub(node->children.size() - queued, std::memory_order_relaxed);
+#endif
+            throw;
+        }
+#ifndef _WIN32
+        // The walk frees a node once it is ready and consumed, so its descriptor is settled before.
+        finishNode(node);
+#endif
+
+        // Notified under the lock: once it is released, the walk may finish and destroy the state.
+        std::lock_guard<std::mutex> lock(state.mutex);
+        node->ready.store(true, std::memory_order_release);
+        state.nodeReady.notify_all();
+    }
+
+    // Marks a directory whose reading threw as ready, so the walk stops at it rather than waiting for it forever.
+    void abandonNode(WalkState& state, Node* node) {
+#ifndef _WIN32
+        finishNode(node);
+#endif
+        std::lock_guard<std::mutex> lock(state.mutex);
+        state.failed.store(true, std::memory_order_release);
+        node->ready.store(true, std::memory_order_release);
+        state.nodeReady.notify_all();
+    }
+
+    // Returns false if the walk failed, in which case the node may never become ready.
+    bool waitForNode(WalkState& state, const Node* node) {
+        if (!node->ready.load(std::memory_order_acquire)) {
+            std::unique_lock<std::mutex> lock(state.mutex);
+            state.nodeReady.wait(lock, [&state, node] {
+                return node->ready.load(std::memory_order_acquire) || state.failed.load(std::memory_order_acquire);
+            });
+        }
+        return !state.failed.load(std::memory_order_acquire);
+    }
+
+#if defined(__linux__)
+    struct LinuxDirent64 {
+        ino64_t d_ino;
+        off64_t d_off;
+        unsigned short d_reclen;
+        unsigned char d_type;
+        char d_name[1];
+    };
+#endif
+
+#ifdef _WIN32
+    // FILETIME counts 100 ns intervals since 1601-01-01.
+    std::int64_t fileTimeToNanoseconds(const FILETIME& fileTime) {
+        std::int64_t ticks = (static_cast<std::int64_t>(fileTime.dwHighDateTime) << 32) | fileTime.dwLowDateTime;
+        return (ticks - 116444736000000000LL) * 100;
+    }
+#else
+    void fillMetadata(const struct stat& status, DirectoryWalker::Entry& entry) {
+        entry.isDirectory = S_ISDIR(status.st_mode);
+        entry.size = static_cast<std::uint64_t>(status.st_size);
+        entry.modificationTime = static_cast<std::int64_t>(status.st_mtim.tv_sec) * 1000000000LL + status.st_mtim.tv_nsec;
+        entry.attributes = status.st_mode;
+    }
+#endif
+
+    bool isDotEntry(const char* name) {
+        return name[0] == '.' && (name[1] == '\0' || (name[1] == '.' && name[2] == '\0'));
+    }
+
+    // Filesystems that do not report the type in the listing, and readdir outside Linux, need a stat per entry.
+    void addNames(DirectoryWalker::Listing& listing, DirectoryWalker::NameList& names) {
+        while (listing.next()) {
+            DirectoryWalker::EntryType type = listing.type();
+#ifndef _WIN32
+            if (type == DirectoryWalker::EntryType::UNKNOWN) {
+                struct stat status;
+                INSTRUMENT_COUNT(SYSTEM_CALLS, 1);
+                bool isDirectory = fstatat(listing.descriptor(), listing.name(), &status, AT_SYMLINK_NOFOLLOW) == 0 && S_ISDIR(status.st_mode);
+                type = isDirectory ? DirectoryWalker::EntryType::DIRECTORY : DirectoryWalker::EntryType::OTHER;
+            }
+#endif
+            names.add(listing.name(), type == DirectoryWalker::EntryType::DIRECTORY);
+        }
+    }
+
+#ifndef _WIN32
+    // A directory with subdirectories keeps its descriptor for them while the budget has a slot, and regardless of the
+    // budget once its path from the anchor is long enough that a longer one would make every open below it expensive.
+    void keepDescriptor(Node* node) {
+        bool hasSubdirectories = false;
+        for (std::size_t index = 0; index < node->entries.size() && !hasSubdirectories; ++index) {
+            hasSubdirectories = node->entries.isDirectory(index);
+        }
+        if (hasSubdirectories) {
+            node->holdsSlot = DescriptorBudget::instance().tryAcquire();
+            if (node->holdsSlot || node->path.size() >= DescriptorBudget::MAX_RELATIVE_PATH) {
+                return;
+            }
+        }
+        INSTRUMENT_COUNT(SYSTEM_CALLS, 1);
+        close(node->fd);
+        node->fd = -1;
+    }
+#endif
+
+    // Reads a directory and queues its subdirectories; returns false if the directory could not be read.
+    bool readNode(WalkState& state, Node* node) {
+        try {
+#ifdef _WIN32
+            bool readable = DirectoryWalker::readNames(node->path, node->entries);
+#else
+            INSTRUMENT_SCOPE("DirectoryWalker::readNames");
+            int anchorFd = node->anchor != nullptr ? node->anchor->fd : AT_FDCWD;
+            // Only the root may be reached through a symbolic link; the entries below are classified without following them.
+            INSTRUMENT_COUNT(SYSTEM_CALLS, 1);
+            node->fd = openat(anchorFd, node->path.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC | (node->parent != nullptr ? O_NOFOLLOW : 0));
+            bool readable = false;
+            if (node->fd >= 0) {
+                DirectoryWalker::Listing listing;
+                readable = listing.open(node->fd);
+                if (readable) {
+                    addNames(listing, node->entries);
+                }
+                keepDescriptor(node);
+            }
+            INSTRUMENT_COUNT(ENTRIES_VISITED, node->entries.size());
+#endif
+            publishNode(state, node);
+            return readable;
+        } catch (...) {
+            // The exception reaches the caller of the walk through the pool.
+            abandonNode(state, node);
+            throw;
+        }
+    }
+}
+
+bool DirectoryWalker::walk(const std::string& rootPath, unsigned threadCount, const Visitor& visitor) {
+    INSTRUMENT_SCOPE("DirectoryWalker::walk");
+    // The root outlives the pool, whose destructor waits for the tasks that still read below it.
+    Node root;
+    root.path = rootPath;
+    WalkState state(threadCount);
+    if (!readNode(state, &root)) {
+        return false;
+    }
+
+    struct Frame {
+        Node* node;
+        std::size_t entryIndex;
+        std::size_t childIndex;
+    };
+    std::vector<Frame> stack;
+    stack.push_back({ &root, 0, 0 });
+
+    while (!stack.empty()) {
+        Frame& frame = stack.back();
+        Node* node = frame.node;
+        if (!waitForNode(state, node)) {
+            break;
+        }
+
+        if (frame.entryIndex == node->entries.size()) {
+            stack.pop_back();
+            if (!stack.empty()) {
+                Frame& parent = stack.back();
+                parent.node->children[parent.childIndex - 1].reset();
+            }
+            continue;
+        }
+
+        std::size_t index = frame.entryIndex++;
+        bool isDirectory = node->entries.isDirectory(index);
+        visitor(stack.size() - 1, node->entries.name(index), isDirectory);
+        if (isDirectory) {
+            Node* child = node->children[frame.childIndex++].get();
+            stack.push_back({ child, 0, 0 });
+        }
+    }
+
+    state.pool.wait();
+    return true;
+}
+
+bool DirectoryWalker::walkPaths(const std::string& rootPath, unsigned threadCount, const PathVisitor& visitor) {
+    // Every directory is reported before its contents, so the length of the path of the current directory at each
+    // depth is known.
+    PathBuilder path(rootPath);
+    std::vector<std::size_t> directoryLengths(1, path.size());
+    return walk(rootPath, threadCount, [&](std::size_t depth, std::string_view name, bool isDirectory) {
+        directoryLengths.resize(depth + 1);
+        path.truncate(directoryLengths[depth]);
+        path.push(name);
+        visitor(path.view(), path.view().substr(path.size() - name.size()), isDirectory);
+        if (isDirectory) {
+            directoryLengths.push_back(path.size());
+        }
+    });
+}
+
+std::string DirectoryWalker::joinPath(std::string_view directoryPath, std::string_view name) {
+    std::string path;
+    path.reserve(directoryPath.size() + name.size() + 1);
+    path += directoryPath;
+    if (!path.empty() && path.back() != '/' && path.back() != '\\') {
+        path += PATH_SEPARATOR;
+    }
+    path += name;
+    return path;
+}
+
+std::size_t DirectoryWalker::NameList::size() const {
+    return offsets.size();
+}
+
+std::string_view DirectoryWalker::NameList::name(std::size_t index) const {
+    std::size_t end = index + 1 < offsets.size() ? offsets[index + 1] : characters.size();
+    return std::string_view(characters.data() + offsets[index], end - offsets[index] - 1);
+}
+
+bool DirectoryWalker::NameList::isDirectory(std::size_t index) const {
+    return directoryFlags[index];
+}
+
+void DirectoryWalker::NameList::add(std::string_view name, bool isDirectory) {
+    offsets.push_back(static_cast<std::uint32_t>(characters.size()));
+    characters.insert(characters.end(), name.begin(), name.end());
+    characters.push_back('\0');
+    directoryFlags.push_back(isDirectory);
+}
+
+void DirectoryWalker::NameList::clear() {
+    characters.clear();
+    offsets.clear();
+    directoryFlags.clear();
+}
+
+bool DirectoryWalker::readMetadata(const std::string& path, Entry& entry) {
+    FilesystemBackend::Metadata metadata;
+    if (!FilesystemBackend::getMetadata(path, metadata)) {
+        return false;
+    }
+    entry.isDirectory = metadata.isDirectory;
+    entry.size = metadata.size;
+    entry.modificationTime = metadata.modificationTime;
+    entry.attributes = metadata.attributes;
+    return true;
+}
+
+#ifdef _WIN32
+DirectoryWalker::Listing::Listing() : handle(INVALID_HANDLE_VALUE), findData(new WIN32_FIND_DATAA), first(false) {}
+
+DirectoryWalker::Listing::~Listing() {
+    close();
+    delete static_cast<WIN32_FIND_DATAA*>(findData);
+}
+
+bool DirectoryWalker::Listing::open(const std::string& directoryPath) {
+    close();
+    INSTRUMENT_COUNT(SYSTEM_CALLS, 1);
+    handle = FindFirstFileExA(joinPath(directoryPath, "*").c_str(), FindExInfoBasic, static_cast<WIN32_FIND_DATAA*>(findData),
+        FindExSearchNameMatch, NULL, FIND_FIRST_EX_LARGE_FETCH);
+    first = true;
+    return handle != INVALID_HANDLE_VALUE;
+}
+
+// FindFirstFileExA has already returned the first entry. FIND_FIRST_EX_LARGE_FETCH returns many entries per call, so
+// only the opening and closing calls are counted.
+bool DirectoryWalker::Listing::next() {
+    WIN32_FIND_DATAA* data = static_cast<WIN32_FIND_DATAA*>(findData);
+    while (handle != INVALID_HANDLE_VALUE) {
+        if (!first && !FindNextFileA(handle, data)) {
+            close();
+            return false;
+        }
+        first = false;
+        if (!isDotEntry(data->cFileName)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+const char* DirectoryWalker::Listing::name() const {
+    return static_cast<const WIN32_FIND_DATAA*>(findData)->cFileName;
+}
+
+DirectoryWalker::EntryType DirectoryWalker::Listing::type() const {
+    return (static_cast<const WIN32_FIND_DATAA*>(findData)->dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) != 0 ? EntryType::DIRECTORY : EntryType::OTHER;
+}
+
+void DirectoryWalker::Listing::readMetadata(Entry& entry) const {
+    const WIN32_FIND_DATAA* data = static_cast<const WIN32_FIND_DATAA*>(findData);
+    entry.isDirectory = (data->dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) != 0;
+    entry.size = (static_cast<std::uint64_t>(data->nFileSizeHigh) << 32) | data->nFileSizeLow;
+    entry.modificationTime = fileTimeToNanoseconds(data->ftLastWriteTime);
+    entry.attributes = data->dwFileAttributes;
+}
+
+void DirectoryWalker::Listing::close() {
+    if (handle != INVALID_HANDLE_VALUE) {
+        INSTRUMENT_COUNT(SYSTEM_CALLS, 1);
+        FindClose(handle);
+        handle = INVALID_HANDLE_VALUE;
+    }
+}
+
+bool DirectoryWalker::readDirectory(const std::string& directoryPath, std::vector<Entry>& entries, bool) {
+    INSTRUMENT_SCOPE("DirectoryWalker::readDirectory");
+    std::size_t firstEntry = entries.size();
+    Listing listing;
+    if (!listing.open(directoryPath)) {
+        return false;
+    }
+    while (listing.next()) {
+        entries.push_back({ listing.name(), false, 0, 0, 0 });
+        listing.readMetadata(entries.back());
+    }
+    INSTRUMENT_COUNT(ENTRIES_VISITED, entries.size() - firstEntry);
+    return true;
+}
+#else
+#ifdef __linux__
+DirectoryWalker::Listing::Listing() : fd(-1), ownsDescriptor(false), current(nullptr), currentType(DT_UNKNOWN), bufferOffset(0), bufferSize(0) {}
+#else
+DirectoryWalker::Listing::Listing() : fd(-1), ownsDescriptor(false), current(nullptr), directory(nullptr) {}
+#endif
+
+DirectoryWalker::Listing::~Listing() {
+    close();
+}
+
+bool DirectoryWalker::Listing::open(const std::string& directoryPath) {
+    close();
+    INSTRUMENT_COUNT(SYSTEM_CALLS, 1);
+    int directoryFd = ::open(directoryPath.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (directoryFd < 0) {
+        return false;
+    }
+    if (!open(directoryFd)) {
+        ::close(directoryFd);
+        return false;
+    }
+    ownsDescriptor = true;
+    return true;
+}
+
+bool DirectoryWalker::Listing::open(int directoryFd) {
+    close();
+    if (directoryFd < 0) {
+        return false;
+    }
+#ifndef __linux__
+    // The stream reads a duplicate, which closedir closes, so the descriptor stays usable for the *at calls. readdir
+    // is buffered, so the stream is counted as one call.
+    INSTRUMENT_COUNT(SYSTEM_CALLS, 1);
+    int listFd = dup(directoryFd);
+    directory = listFd >= 0 ? fdopendir(listFd) : nullptr;
+    if (directory == nullptr) {
+        if (listFd >= 0) {
+            ::close(listFd);
+        }
+        return false;
+    }
+#endif
+    fd = directoryFd;
+    return true;
+}
+
+int DirectoryWalker::Listing::descriptor() const {
+    return fd;
+}
+
+bool DirectoryWalker::Listing::next() {
+#ifdef __linux__
+    while (fd >= 0) {
+        if (bufferOffset == bufferSize) {
+            INSTRUMENT_COUNT(SYSTEM_CALLS, 1);
+            long bytesRead = syscall(SYS_getdents64, fd, buffer, sizeof(buffer));
+            if (bytesRead <= 0) {
+                return false;
+            }
+            bufferOffset = 0;
+            bufferSize = static_cast<std::size_t>(bytesRead);
+        }
+        const LinuxDirent64* dirent = reinterpret_cast<const LinuxDirent64*>(buffer + bufferOffset);
+        bufferOffset += dirent->d_reclen;
+        if (!isDotEntry(dirent->d_name)) {
+            current = dirent->d_name;
+            currentType = dirent->d_type;
+            return true;
+        }
+    }
+#else
+    while (directory != nullptr) {
+        struct dirent* dirent = readdir(static_cast<DIR*>(directory));
+        if (dirent == nullptr) {
+            return false;
+        }
+        if (!isDotEntry(dirent->d_name)) {
+            current = dirent->d_name;
+            return true;
+        }
+    }
+#endif
+    return false;
+}
+
+const char* DirectoryWalker::Listing::name() const {
+    return current;
+}
+
+// readdir does not report the type everywhere, so outside Linux every entry needs a stat.
+DirectoryWalker::EntryType DirectoryWalker::Listing::type() const {
+#ifdef __linux__
+    if (currentType == DT_UNKNOWN) {
+        return EntryType::UNKNOWN;
+    }
+    return currentType == DT_DIR ? EntryType::DIRECTORY : EntryType::OTHER;
+#else
+    return EntryType::UNKNOWN;
+#endif
+}
+
+void DirectoryWalker::Listing::close() {
+#ifdef __linux__
+    bufferOffset = 0;
+    bufferSize = 0;
+#else
+    if (directory != nullptr) {
+        closedir(static_cast<DIR*>(directory));
+        directory = nullptr;
+    }
+#endif
+    if (ownsDescriptor) {
+        INSTRUMENT_COUNT(SYSTEM_CALLS, 1);
+        ::close(fd);
+    }
+    fd = -1;
+    ownsDescriptor = false;
+    current = nullptr;
+}
+
+bool DirectoryWalker::readDirectory(const std::string& directoryPath, std::vector<Entry>& entries, bool withMetadata) {
+    INSTRUMENT_SCOPE("DirectoryWalker::readDirectory");
+    std::size_t firstEntry = entries.size();
+    Listing listing;
+    if (!listing.open(directoryPath)) {
+        return false;
+    }
+
+    std::vector<std::size_t> unstatted;
+    while (listing.next()) {
+        EntryType type = listing.type();
+        entries.push_back({ listing.name(), type == EntryType::DIRECTORY, 0, 0, 0 });
+        if (withMetadata || type == EntryType::UNKNOWN) {
+            unstatted.push_back(entries.size() - 1);
+        }
+    }
+
+    // The names are stable once the listing is complete, so a large directory has its metadata fetched in one batch.
+    int directoryFd = listing.descriptor();
+    if (unstatted.size() >= AsyncIoEngine::BATCH_THRESHOLD && AsyncIoEngine::isKernelQueueAvailable()) {
+        AsyncIoEngine& engine = AsyncIoEngine::forCurrentThread();
+        for (std::size_t index : unstatted) {
+            AsyncIoEngine::Request request{ AsyncIoEngine::Operation::STAT };
+            request.directoryFd = directoryFd;
+            request.path = entries[index].name.c_str();
+            request.metadata = &entries[index];
+            engine.submit(request);
+        }
+        std::vector<AsyncIoEngine::Completion> completions;
+        while (engine.outstanding() > 0) {
+            engine.wait(completions, engine.outstanding());
+        }
+    } else {
+        INSTRUMENT_COUNT(SYSTEM_CALLS, unstatted.size());
+        for (std::size_t index : unstatted) {
+            struct stat status;
+            if (fstatat(directoryFd, entries[index].name.c_str(), &status, AT_SYMLINK_NOFOLLOW) == 0) {
+                fillMetadata(status, entries[index]);
+            }
+        }
+    }
+
+    INSTRUMENT_COUNT(ENTRIES_VISITED, entries.size() - firstEntry);
+    return true;
+}
+#endif
+
+bool DirectoryWalker::readNames(const std::string& directoryPath, NameList& names) {
+    INSTRUMENT_SCOPE("DirectoryWalker::readNames");
+    std::size_t firstEntry = names.size();
+    Listing listing;
+    if (!listing.open(directoryPath)) {
+        return false;
+    }
+    addNames(listing, names);
+    INSTRUMENT_COUNT(ENTRIES_VISITED, names.size() - firstEntry);
+    return true;
+}
\ No newline at end of file
@@ -0,0 +1,441 @@
+#include "Directory_Watcher.h"
+
+#include <algorithm>
+#include <unordered_map>
+
+#ifdef _WIN32
+#include <windows.h>
+#elif defined(__linux__)
+#include <cerrno>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+#endif
+
+const std::size_t DirectoryWatcher::DEFAULT_BYTE_BUDGET;
+const std::size_t DirectoryWatcher::DEFAULT_MAX_DIRECTORIES;
+
+#ifdef _WIN32
+struct DirectoryWatcher::Backend {
+    struct Watch {
+        HANDLE directory;
+        OVERLAPPED overlapped;
+        std::string path;
+        bool closing;
+        DWORD buffer[16 * 1024];
+    };
+
+    HANDLE completionPort = NULL;
+    ULONG_PTR nextKey = 1;
+    std::unordered_map<ULONG_PTR, std::unique_ptr<Watch>> watches;
+    std::unordered_map<std::string, ULONG_PTR> keysByPath;
+
+    bool issue(Watch& watch) {
+        ZeroMemory(&watch.overlapped, sizeof(watch.overlapped));
+        return ReadDirectoryChangesW(watch.directory, watch.buffer, sizeof(watch.buffer), FALSE,
+            FILE_NOTIFY_CHANGE_FILE_NAME | FILE_NOTIFY_CHANGE_DIR_NAME | FILE_NOTIFY_CHANGE_SIZE | FILE_NOTIFY_CHANGE_LAST_WRITE | FILE_NOTIFY_CHANGE_ATTRIBUTES,
+            NULL, &watch.overlapped, NULL) != 0;
+    }
+};
+#elif defined(__linux__)
+struct DirectoryWatcher::Backend {
+    int inotifyFd = -1;
+    int wakePipe[2] = { -1, -1 };
+    // inotify hands out the same descriptor for every path of one directory, such as a bind mount and its source.
+    std::unordered_map<int, std::vector<std::string>> pathsByWatch;
+    std::unordered_map<std::string, int> watchesByPath;
+};
+#else
+struct DirectoryWatcher::Backend {
+};
+#endif
+
+DirectoryWatcher& DirectoryWatcher::instance() {
+    static DirectoryWatcher watcher;
+    return watcher;
+}
+
+DirectoryWatcher::DirectoryWatcher() : cache(DEFAULT_BYTE_BUDGET, DEFAULT_MAX_DIRECTORIES), backend(new Backend()), stopping(false),
+    eventsProcessed(0), overflows(0), rescans(0) {
+#ifdef _WIN32
+    backend->completionPort = CreateIoCompletionPort(INVALID_HANDLE_VALUE, NULL, 0, 1);
+    if (backend->completionPort != NULL) {
+        thread = std::thread(&DirectoryWatcher::run, this);
+    }
+#elif defined(__linux__)
+    backend->inotifyFd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (backend->inotifyFd >= 0 && pipe2(backend->wakePipe, O_NONBLOCK | O_CLOEXEC) == 0) {
+        thread = std::thread(&DirectoryWatcher::run, this);
+    } else if (backend->inotifyFd >= 0) {
+        close(backend->inotifyFd);
+        backend->inotifyFd = -1;
+    }
+#endif
+}
+
+DirectoryWatcher::~DirectoryWatcher() {
+    stopping = true;
+#ifdef _WIN32
+    if (thread.joinable()) {
+        PostQueuedCompletionStatus(backend->completionPort, 0, 0, NULL);
+        thread.join();
+    }
+
+    // The kernel writes into the watch buffers until the cancelled requests complete.
+    std::size_t pending = 0;
+    for (auto& watch : backend->watches) {
+        if (CancelIoEx(watch.second->directory, &watch.second->overlapped) || GetLastError() != ERROR_NOT_FOUND) {
+            ++pending;
+        }
+    }
+    DWORD bytes;
+    ULONG_PTR key;
+    LPOVERLAPPED overlapped;
+    while (pending > 0 && (GetQueuedCompletionStatus(backend->completionPort, &bytes, &key, &overlapped, 1000) || overlapped != NULL)) {
+        --pending;
+    }
+    for (auto& watch : backend->watches) {
+        CloseHandle(watch.second->directory);
+    }
+    if (backend->completionPort != NULL) {
+        CloseHandle(backend->completionPort);
+    }
+#elif defined(__linux__)
+    if (thread.joinable()) {
+        char wake = 1;
+        ssize_t written = write(backend->wakePipe[1], &wake, 1);
+        (void)written;
+        thread.join();
+    }
+    if (backend->inotifyFd >= 0) {
+        close(backend->inotifyFd);
+        close(backend->wakePipe[0]);
+        close(backend->wakePipe[1]);
+    }
+#endif
+}
+
+bool DirectoryWatcher::list(const std::string& directoryPath, const Reader& reader, std::vector<DirectoryWalker::Entry>& entries) {
+    if (cache.get(directoryPath, entries)) {
+        return true;
+    }
+
+    entries.clear();
+    bool watching = thread.joinable() && watch(directoryPath);
+    // A change reported while the directory is read may or may not be in the entries, so the listing is then not cached.
+    if (watching) {
+        cache.beginLoad(directoryPath);
+    }
+    if (!reader(entries)) {
+        if (watching) {
+            cache.abandonLoad(directoryPath);
+            unwatch(directoryPath);
+        }
+        return false;
+    }
+
+    if (watching) {
+        std::vector<std::string> evicted;
+        if (!cache.finishLoad(directoryPath, entries, evicted)) {
+            // Another reader may have cached the directory meanwhile; without the watch its listing would go stale.
+            cache.erase(directoryPath);
+            evicted.push_back(directoryPath);
+        }
+        for (const std::string& path : evicted) {
+            unwatch(path);
+        }
+    }
+    return true;
+}
+
+bool DirectoryWatcher::visit(const std::string& directoryPath, const DirectoryCache::Consumer& consumer) {
+    return cache.visit(directoryPath, consumer);
+}
+
+bool DirectoryWatcher::isCached(const std::string& directoryPath) {
+    return cache.contains(directoryPath);
+}
+
+DirectoryWatcher::Stats DirectoryWatcher::stats() {
+    Stats result;
+    result.cache = cache.stats();
+    {
+        std::lock_guard<std::mutex> lock(watchMutex);
+#ifdef _WIN32
+        result.watchedDirectories = backend->keysByPath.size();
+#elif defined(__linux__)
+        result.watchedDirectories = backend->watchesByPath.size();
+#else
+        result.watchedDirectories = 0;
+#endif
+    }
+    result.eventsProcessed = eventsProcessed.load();
+    result.overflows = overflows.load();
+    result.rescans = rescans.load();
+    result.active = thread.joinable();
+    return result;
+}
+
+void DirectoryWatcher::applyCreated(const std::string& directoryPath, const std::string& name, bool isDirectory) {
+    DirectoryWalker::Entry entry{ name, isDirectory, 0, 0, 0 };
+    DirectoryWalker::readMetadata(DirectoryWalker::joinPath(directoryPath, name), entry);
+    for (const std::string& evicted : cache.addEntry(directoryPath, entry)) {
+        unwatch(evicted);
+    }
+}
+
+void DirectoryWatcher::rescan(const std::string& directoryPath) {
+    std::vector<DirectoryWalker::Entry> entries;
+    rescans.fetch_add(1, std::memory_order_relaxed);
+    if (!DirectoryWalker::readDirectory(directoryPath, entries, true)) {
+        cache.erase(directoryPath);
+        unwatch(directoryPath);
+        return;
+    }
+    for (const std::string& evicted : cache.put(directoryPath, std::move(entries))) {
+        unwatch(evicted);
+    }
+}
+
+void DirectoryWatcher::rescanAll() {
+    for (const std::string& directoryPath : cache.directories()) {
+        rescan(directoryPath);
+    }
+}
+
+#ifdef _WIN32
+bool DirectoryWatcher::watch(const std::string& directoryPath) {
+    std::lock_guard<std::mutex> lock(watchMutex);
+    if (backend->keysByPath.count(directoryPath) > 0) {
+        return true;
+    }
+
+    std::unique_ptr<Backend::Watch> watch(new Backend::Watch());
+    watch->directory = CreateFileA(directoryPath.c_str(), FILE_LIST_DIRECTORY, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+        NULL, OPEN_EXISTING, FILE_FLAG_BACKUP_SEMANTICS | FILE_FLAG_OVERLAPPED, NULL);
+    if (watch->directory == INVALID_HANDLE_VALUE) {
+        return false;
+    }
+    watch->path = directoryPath;
+    watch->closing = false;
+
+    ULONG_PTR key = backend->nextKey++;
+    if (CreateIoCompletionPort(watch->directory, backend->completionPort, key, 0) == NULL || !backend->issue(*watch)) {
+        CloseHandle(watch->directory);
+        return false;
+    }
+
+    backend->keysByPath[directoryPath] = key;
+    backend->watches[key] = std::move(watch);
+    return true;
+}
+
+void DirectoryWatcher::unwatch(const std::string& directoryPath) {
+    std::lock_guard<std::mutex> lock(watchMutex);
+    auto key = backend->keysByPath.find(directoryPath);
+    if (key == backend->keysByPath.end()) {
+        return;
+    }
+
+    // The watch is released by the background thread once the cancelled request completes.
+    Backend::Watch& watch = *backend->watches[key->second];
+    watch.closing = true;
+    CancelIoEx(watch.directory, &watch.overlapped);
+    backend->keysByPath.erase(key);
+}
+
+void DirectoryWatcher::run() {
+    while (true) {
+        DWORD bytes = 0;
+        ULONG_PTR key = 0;
+        LPOVERLAPPED overlapped = NULL;
+        BOOL succeeded = GetQueuedCompletionStatus(backend->completionPort, &bytes, &key, &overlapped, INFINITE);
+        if (stopping) {
+            return;
+        }
+        if (overlapped == NULL) {
+            continue;
+        }
+
+        Backend::Watch* watch;
+        {
+            std::lock_guard<std::mutex> lock(watchMutex);
+            auto found = backend->watches.find(key);
+            if (found == backend->watches.end()) {
+                continue;
+            }
+            watch = found->second.get();
+            if (watch->closing || !succeeded) {
+                if (!watch->closing) {
+                    backend->keysByPath.erase(watch->path);
+                }
+                CloseHandle(watch->directory);
+                std::string path = watch->path;
+                bool wasClosing = watch->closing;
+                backend->watches.erase(found);
+                if (!wasClosing) {
+                    cache.erase(path);
+                }
+                continue;
+            }
+        }
+
+        if (bytes == 0) {
+            // The notification buffer overflowed and the individual changes are lost.
+            overflows.fetch_add(1, std::memory_order_relaxed);
+            rescan(watch->path);
+        } else {
+            const unsigned char* record = reinterpret_cast<const unsigned char*>(watch->buffer);
+            while (true) {
+                const FILE_NOTIFY_INFORMATION* information = reinterpret_cast<const FILE_NOTIFY_INFORMATION*>(record);
+                int wideLength = static_cast<int>(information->FileNameLength / sizeof(WCHAR));
+                int length = WideCharToMultiByte(CP_ACP, 0, information->FileName, wideLength, NULL, 0, NULL, NULL);
+                std::string name(length, '\0');
+                WideCharToMultiByte(CP_ACP, 0, information->FileName, wideLength, &name[0], length, NULL, NULL);
+                eventsProcessed.fetch_add(1, std::memory_order_relaxed);
+
+                switch (information->Action) {
+                case FILE_ACTION_ADDED:
+                case FILE_ACTION_RENAMED_NEW_NAME:
+                case FILE_ACTION_MODIFIED: {
+                    DWORD attributes = GetFileAttributesA(DirectoryWalker::joinPath(watch->path, name).c_str());
+                    if (attributes != INVALID_FILE_ATTRIBUTES) {
+                        applyCreated(watch->path, name, (attributes & FILE_ATTRIBUTE_DIRECTORY) != 0);
+                    }
+                    break;
+                }
+                case FILE_ACTION_REMOVED:
+                case FILE_ACTION_RENAMED_OLD_NAME:
+                    cache.removeEntry(watch->path, name);
+                    break;
+                }
+
+                if (information->NextEntryOffset == 0) {
+                    break;
+                }
+                record += information->NextEntryOffset;
+            }
+        }
+
+        std::lock_guard<std::mutex> lock(watchMutex);
+        if (!watch->closing && !backend->issue(*watch)) {
+            backend->keysByPath.erase(watch->path);
+            cache.erase(watch->path);
+            CloseHandle(watch->directory);
+            backend->watches.erase(key);
+        }
+    }
+}
+#elif defined(__linux__)
+bool DirectoryWatcher::watch(const std::string& directoryPath) {
+    std::lock_guard<std::mutex> lock(watchMutex);
+    if (backend->watchesByPath.count(directoryPath) > 0) {
+        return true;
+    }
+
+    // IN_MODIFY reports writes to files that are still open, which IN_CLOSE_WRITE alone would only report at the end.
+    int watchDescriptor = inotify_add_watch(backend->inotifyFd, directoryPath.c_str(), IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO |
+        IN_ATTRIB | IN_MODIFY | IN_CLOSE_WRITE | IN_DELETE_SELF | IN_MOVE_SELF | IN_ONLYDIR);
+    if (watchDescriptor < 0) {
+        return false;
+    }
+
+    backend->pathsByWatch[watchDescriptor].push_back(directoryPath);
+    backend->watchesByPath[directoryPath] = watchDescriptor;
+    return true;
+}
+
+void DirectoryWatcher::unwatch(const std::string& directoryPath) {
+    std::lock_guard<std::mutex> lock(watchMutex);
+    auto watch = backend->watchesByPath.find(directoryPath);
+    if (watch == backend->watchesByPath.end()) {
+        return;
+    }
+
+    // The kernel watch is removed with the last path that shares it.
+    auto paths = backend->pathsByWatch.find(watch->second);
+    if (paths != backend->pathsByWatch.end()) {
+        std::vector<std::string>& sharing = paths->second;
+        sharing.erase(std::remove(sharing.begin(), sharing.end(), directoryPath), sharing.end());
+        if (sharing.empty()) {
+            inotify_rm_watch(backend->inotifyFd, watch->second);
+            backend->pathsByWatch.erase(paths);
+        }
+    }
+    backend->watchesByPath.erase(watch);
+}
+
+void DirectoryWatcher::run() {
+    alignas(struct inotify_event) char buffer[64 * 1024];
+    struct pollfd descriptors[2] = { { backend->inotifyFd, POLLIN, 0 }, { backend->wakePipe[0], POLLIN, 0 } };
+
+    while (!stopping) {
+        if (poll(descriptors, 2, -1) < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return;
+        }
+        if (stopping) {
+            return;
+        }
+
+        while (true) {
+            ssize_t length = read(backend->inotifyFd, buffer, sizeof(buffer));
+            if (length <= 0) {
+                break;
+            }
+
+            for (ssize_t offset = 0; offset < length;) {
+                const struct inotify_event* event = reinterpret_cast<const struct inotify_event*>(buffer + offset);
+                offset += sizeof(struct inotify_event) + event->len;
+                eventsProcessed.fetch_add(1, std::memory_order_relaxed);
+
+                if (event->mask & IN_Q_OVERFLOW) {
+                    overflows.fetch_add(1, std::memory_order_relaxed);
+                    rescanAll();
+                    continue;
+                }
+
+                std::vector<std::string> directoryPaths;
+                {
+                    std::lock_guard<std::mutex> lock(watchMutex);
+                    auto found = backend->pathsByWatch.find(event->wd);
+                    if (found == backend->pathsByWatch.end()) {
+                        continue;
+                    }
+                    directoryPaths = found->second;
+                }
+
+                for (const std::string& directoryPath : directoryPaths) {
+                    if (event->mask & (IN_IGNORED | IN_DELETE_SELF | IN_MOVE_SELF)) {
+                        cache.erase(directoryPath);
+                        unwatch(directoryPath);
+                    } else if (event->len == 0) {
+                        continue;
+                    } else if (event->mask & (IN_DELETE | IN_MOVED_FROM)) {
+                        cache.removeEntry(directoryPath, event->name);
+                    } else if (event->mask & (IN_CREATE | IN_MOVED_TO | IN_ATTRIB | IN_MODIFY | IN_CLOSE_WRITE)) {
+                        applyCreated(directoryPath, event->name, (event->mask & IN_ISDIR) != 0);
+                    }
+                }
+            }
+        }
+
+        char wake[64];
+        while (read(backend->wakePipe[0], wake, sizeof(wake)) > 0) {
+        }
+    }
+}
+#else
+bool DirectoryWatcher::watch(const std::string&) {
+    return false;
+}
+
+void DirectoryWatcher::unwatch(const std::string&) {
+}
+
+void DirectoryWatcher::run() {
+}
+#endif
\ No newline at end of file
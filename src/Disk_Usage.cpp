@@ -0,0 +1,234 @@
+#include "Disk_Usage.h"
+#include "Directory_Walker.h"
+#include "Instrumentation.h"
+#include "Thread_Pool.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <memory>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/stat.h>
+#endif
+
+const std::size_t DiskUsage::DEFAULT_TOP_COUNT;
+
+namespace {
+    // Beyond this many directories waiting in the pool, a worker reads the subdirectories it finds itself, depth first.
+    const std::size_t MAX_QUEUED_DIRECTORIES = 4096;
+
+    // A directory lives until its own read and all of its subdirectories are finished.
+    struct Node {
+        Node* parent;
+        std::string name;
+        std::atomic<std::uint64_t> bytes{0};
+        std::atomic<std::uint64_t> files{0};
+        std::atomic<std::size_t> pending{1};
+
+        Node(Node* parent, std::string name) : parent(parent), name(std::move(name)) {}
+    };
+
+    // One per worker, aligned to a cache line so neighbouring workers never share one.
+    struct alignas(64) Accumulator {
+        std::uint64_t files = 0;
+        std::uint64_t bytes = 0;
+        std::uint64_t directories = 0;
+        std::size_t unreadable = 0;
+        std::vector<DiskUsage::Subtree> largest;
+    };
+
+    struct UsageState {
+        ThreadPool pool;
+        std::size_t topCount;
+        std::vector<Accumulator> accumulators;
+        std::atomic<std::size_t> queued{0};
+
+        UsageState(unsigned threadCount, std::size_t topCount) : pool(threadCount), topCount(topCount), accumulators(pool.size() + 1) {}
+
+        // The last accumulator belongs to the calling thread, which reads the root directory and may be a worker of
+        // another pool.
+        Accumulator& local() {
+            int index = pool.currentWorkerIndex();
+            return accumulators[index >= 0 ? static_cast<std::size_t>(index) : accumulators.size() - 1];
+        }
+    };
+
+#ifdef _WIN32
+    const bool APPARENT_SIZES = true;
+
+    // Sums the files of a directory into bytes and files, and collects its subdirectories with their own sizes.
+    bool listDirectory(const std::string& path, std::vector<DirectoryWalker::Entry>& subdirectories,
+        std::uint64_t& bytes, std::uint64_t& files) {
+        std::vector<DirectoryWalker::Entry> entries;
+        bool readable = DirectoryWalker::readDirectory(path, entries, true);
+        for (DirectoryWalker::Entry& entry : entries) {
+            if (entry.isDirectory && !(entry.attributes & FILE_ATTRIBUTE_REPARSE_POINT)) {
+                subdirectories.push_back(std::move(entry));
+            } else {
+                bytes += entry.size;
+                ++files;
+            }
+        }
+        return readable;
+    }
+#else
+    const bool APPARENT_SIZES = false;
+
+    // Sums the files of a directory into bytes and files, and collects its subdirectories with their own sizes. The
+    // sizes are the allocated blocks, so sparse files count what they occupy. A file with several links counts its share
+    // under each name, which adds up to its blocks once when all of its names lie in the tree and needs no memory.
+    bool listDirectory(const std::string& path, std::vector<DirectoryWalker::Entry>& subdirectories,
+        std::uint64_t& bytes, std::uint64_t& files) {
+        DirectoryWalker::Listing listing;
+        if (!listing.open(path)) {
+            return false;
+        }
+
+        std::size_t entries = 0;
+        while (listing.next()) {
+            const char* name = listing.name();
+            ++entries;
+            struct stat status;
+            if (fstatat(listing.descriptor(), name, &status, AT_SYMLINK_NOFOLLOW) != 0) {
+                continue;
+            }
+            std::uint64_t allocated = static_cast<std::uint64_t>(status.st_blocks) * 512;
+            if (S_ISDIR(status.st_mode)) {
+                subdirectories.push_back({ name, true, allocated, 0, status.st_mode });
+                continue;
+            }
+            ++files;
+            bytes += status.st_nlink > 1 ? allocated / status.st_nlink : allocated;
+        }
+        INSTRUMENT_COUNT(SYSTEM_CALLS, entries);
+        INSTRUMENT_COUNT(ENTRIES_VISITED, entries);
+        return true;
+    }
+#endif
+
+    bool isLarger(const DiskUsage::Subtree& left, const DiskUsage::Subtree& right) {
+        return left.bytes > right.bytes;
+    }
+
+    std::string pathOf(const Node* node) {
+        std::vector<const Node*> chain;
+        for (; node != nullptr; node = node->parent) {
+            chain.push_back(node);
+        }
+        std::string path = chain.back()->name;
+        for (auto it = chain.rbegin() + 1; it != chain.rend(); ++it) {
+            path = DirectoryWalker::joinPath(path, (*it)->name);
+        }
+        return path;
+    }
+
+    // The heap is a min-heap on the size, so its front is the subtree to replace. The path is only built for
+    // subtrees that make it into the heap.
+    void offer(UsageState& state, Accumulator& accumulator, const Node* node, std::uint64_t bytes, std::uint64_t files) {
+        std::vector<DiskUsage::Subtree>& heap = accumulator.largest;
+        if (state.topCount == 0 || (heap.size() == state.topCount && bytes <= heap.front().bytes)) {
+            return;
+        }
+        if (heap.size() == state.topCount) {
+            std::pop_heap(heap.begin(), heap.end(), isLarger);
+            heap.pop_back();
+        }
+        heap.push_back({ pathOf(node), bytes, files });
+        std::push_heap(heap.begin(), heap.end(), isLarger);
+    }
+
+    void finishNode(UsageState& state, Node* node) {
+        Accumulator& accumulator = state.local();
+        while (node != nullptr && node->pending.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+            std::uint64_t bytes = node->bytes.load(std::memory_order_relaxed);
+            std::uint64_t files = node->files.load(std::memory_order_relaxed);
+            offer(state, accumulator, node, bytes, files);
+
+            Node* parent = node->parent;
+            if (parent != nullptr) {
+                parent->bytes.fetch_add(bytes, std::memory_order_relaxed);
+                parent->files.fetch_add(files, std::memory_order_relaxed);
+            }
+            delete node;
+            node = parent;
+        }
+    }
+
+    void readTree(UsageState& state, Node* root);
+
+    // Reads a directory and hands its subdirectories to the pool, or to the stack of the calling task once the pool
+    // holds MAX_QUEUED_DIRECTORIES. A directory's path is formed from its ancestors when it is read, not when it is found.
+    void readNode(UsageState& state, Node* node, std::vector<Node*>& stack) {
+        Accumulator& accumulator = state.local();
+        std::vector<DirectoryWalker::Entry> subdirectories;
+        std::uint64_t bytes = 0;
+        std::uint64_t files = 0;
+        if (!listDirectory(pathOf(node), subdirectories, bytes, files)) {
+            ++accumulator.unreadable;
+        }
+        ++accumulator.directories;
+
+        for (DirectoryWalker::Entry& subdirectory : subdirectories) {
+            // The space of a directory itself counts towards its own subtree.
+            Node* child = new Node(node, std::move(subdirectory.name));
+            child->bytes.store(subdirectory.size, std::memory_order_relaxed);
+            accumulator.bytes += subdirectory.size;
+            node->pending.fetch_add(1, std::memory_order_relaxed);
+            if (state.queued.load(std::memory_order_relaxed) < MAX_QUEUED_DIRECTORIES) {
+                state.queued.fetch_add(1, std::memory_order_relaxed);
+                state.pool.submit([&state, child] {
+                    state.queued.fetch_sub(1, std::memory_order_relaxed);
+                    readTree(state, child);
+                });
+            } else {
+                stack.push_back(child);
+            }
+        }
+
+        accumulator.bytes += bytes;
+        accumulator.files += files;
+        node->bytes.fetch_add(bytes, std::memory_order_relaxed);
+        node->files.fetch_add(files, std::memory_order_relaxed);
+        finishNode(state, node);
+    }
+
+    void readTree(UsageState& state, Node* root) {
+        std::vector<Node*> stack{ root };
+        while (!stack.empty()) {
+            Node* node = stack.back();
+            stack.pop_back();
+            readNode(state, node, stack);
+        }
+    }
+}
+
+DiskUsage::Result DiskUsage::measure(const std::string& rootPath, std::size_t topCount, unsigned threadCount) {
+    INSTRUMENT_SCOPE("DiskUsage::measure");
+    auto start = std::chrono::steady_clock::now();
+    UsageState state(threadCount, topCount);
+
+    readTree(state, new Node(nullptr, rootPath));
+    state.pool.wait();
+
+    Result result = {};
+    result.apparentSizes = APPARENT_SIZES;
+    for (Accumulator& accumulator : state.accumulators) {
+        result.files += accumulator.files;
+        result.bytes += accumulator.bytes;
+        result.directories += accumulator.directories;
+        result.unreadableDirectories += accumulator.unreadable;
+        result.largest.insert(result.largest.end(), std::make_move_iterator(accumulator.largest.begin()),
+            std::make_move_iterator(accumulator.largest.end()));
+    }
+    std::sort(result.largest.begin(), result.largest.end(), isLarger);
+    if (result.largest.size() > topCount) {
+        result.largest.resize(topCount);
+    }
+
+    result.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    return result;
+}
\ No newline at end of file
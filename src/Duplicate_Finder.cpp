@@ -0,0 +1,249 @@
+#include "Duplicate_Finder.h"
+#include "Directory_Walker.h"
+#include "Fast_Hash.h"
+#include "Instrumentation.h"
+#include "Mapped_File.h"
+#include "Path_Arena.h"
+#include "Path_Builder.h"
+#include "Thread_Pool.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <tuple>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <sys/stat.h>
+#endif
+
+const std::size_t DuplicateFinder::PARTIAL_BLOCK_SIZE;
+
+namespace {
+    // Small batches keep the queue short while still spreading a stage over all workers.
+    const std::size_t FILES_PER_TASK = 64;
+
+    struct Candidate {
+        // Points into SearchState::paths, so it is NUL-terminated.
+        std::string_view path;
+        std::uint64_t size;
+        std::uint64_t device;
+        std::uint64_t fileIndex;
+        std::uint64_t hash;
+        bool readable;
+    };
+
+    struct SearchState {
+        ThreadPool pool;
+        std::mutex mutex;
+        std::vector<Candidate> files;
+        PathArena paths;
+        std::atomic<std::size_t> unreadable{0};
+        std::atomic<std::uint64_t> bytesHashed{0};
+
+        explicit SearchState(unsigned threadCount) : pool(threadCount) {}
+    };
+
+#ifdef _WIN32
+    bool isRegularFile(const DirectoryWalker::Entry& entry) {
+        return !entry.isDirectory && !(entry.attributes & FILE_ATTRIBUTE_REPARSE_POINT);
+    }
+
+    bool isFollowableDirectory(const DirectoryWalker::Entry& entry) {
+        return entry.isDirectory && !(entry.attributes & FILE_ATTRIBUTE_REPARSE_POINT);
+    }
+
+    bool readIdentity(Candidate& candidate) {
+        HANDLE file = CreateFileA(candidate.path.data(), 0, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, NULL, OPEN_EXISTING,
+            FILE_FLAG_BACKUP_SEMANTICS, NULL);
+        if (file == INVALID_HANDLE_VALUE) {
+            return false;
+        }
+        BY_HANDLE_FILE_INFORMATION information;
+        bool known = GetFileInformationByHandle(file, &information) != 0;
+        CloseHandle(file);
+        if (known) {
+            candidate.device = information.dwVolumeSerialNumber;
+            candidate.fileIndex = (static_cast<std::uint64_t>(information.nFileIndexHigh) << 32) | information.nFileIndexLow;
+        }
+        return known;
+    }
+#else
+    bool isRegularFile(const DirectoryWalker::Entry& entry) {
+        return S_ISREG(entry.attributes);
+    }
+
+    bool isFollowableDirectory(const DirectoryWalker::Entry& entry) {
+        return entry.isDirectory;
+    }
+
+    bool readIdentity(Candidate& candidate) {
+        struct stat status;
+        if (stat(candidate.path.data(), &status) != 0) {
+            return false;
+        }
+        candidate.device = static_cast<std::uint64_t>(status.st_dev);
+        candidate.fileIndex = static_cast<std::uint64_t>(status.st_ino);
+        return true;
+    }
+#endif
+
+    void collectDirectory(SearchState& state, const std::string& path) {
+        std::vector<DirectoryWalker::Entry> entries;
+        if (!DirectoryWalker::readDirectory(path, entries, true)) {
+            state.unreadable.fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+
+        std::vector<const DirectoryWalker::Entry*> files;
+        for (const DirectoryWalker::Entry& entry : entries) {
+            if (isFollowableDirectory(entry)) {
+                std::string child = DirectoryWalker::joinPath(path, entry.name);
+                state.pool.submit([&state, child] { collectDirectory(state, child); });
+            } else if (isRegularFile(entry) && entry.size > 0) {
+                files.push_back(&entry);
+            }
+        }
+
+        // The paths of the files are formed in one buffer and copied into the shared arena, instead of one string each.
+        PathBuilder filePath(path);
+        std::size_t directoryLength = filePath.size();
+        std::lock_guard<std::mutex> lock(state.mutex);
+        for (const DirectoryWalker::Entry* entry : files) {
+            filePath.truncate(directoryLength);
+            filePath.push(entry->name);
+            state.files.push_back({ state.paths.store(filePath.view()), entry->size, 0, 0, 0, true });
+        }
+    }
+
+    // Hashes both ends of the file; a file no larger than the two blocks is hashed completely, which makes the
+    // partial hash its full hash.
+    void hashPartial(SearchState& state, Candidate& candidate) {
+        MappedFile file;
+        candidate.readable = readIdentity(candidate) && file.open(candidate.path.data()) && file.size() == candidate.size;
+        if (!candidate.readable) {
+            return;
+        }
+
+        const std::size_t block = DuplicateFinder::PARTIAL_BLOCK_SIZE;
+        FastHash hash(candidate.size);
+        if (file.size() <= 2 * block) {
+            hash.update(file.data(), file.size());
+        } else {
+            hash.update(file.data(), block);
+            hash.update(file.data() + file.size() - block, block);
+        }
+        candidate.hash = hash.digest();
+        state.bytesHashed.fetch_add(std::min<std::uint64_t>(file.size(), 2 * block), std::memory_order_relaxed);
+    }
+
+    void hashFull(SearchState& state, Candidate& candidate) {
+        MappedFile file;
+        candidate.readable = file.open(candidate.path.data()) && file.size() == candidate.size;
+        if (candidate.readable) {
+            candidate.hash = FastHash::hash(file.data(), file.size(), candidate.size);
+            state.bytesHashed.fetch_add(file.size(), std::memory_order_relaxed);
+        }
+    }
+
+    template <typename Function>
+    void forEachCandidate(SearchState& state, std::vector<Candidate*>& candidates, Function function) {
+        for (std::size_t begin = 0; begin < candidates.size(); begin += FILES_PER_TASK) {
+            std::size_t end = std::min(begin + FILES_PER_TASK, candidates.size());
+            state.pool.submit([&state, &candidates, function, begin, end] {
+                for (std::size_t index = begin; index < end; ++index) {
+                    function(state, *candidates[index]);
+                }
+            });
+        }
+        state.pool.wait();
+    }
+
+    // Keeps the readable candidates that share their size and hash with at least one other candidate.
+    std::vector<Candidate*> keepShared(std::vector<Candidate*> candidates, SearchState& state) {
+        std::vector<Candidate*> shared;
+        for (Candidate* candidate : candidates) {
+            state.unreadable.fetch_add(candidate->readable ? 0 : 1, std::memory_order_relaxed);
+        }
+        candidates.erase(std::remove_if(candidates.begin(), candidates.end(), [](const Candidate* candidate) { return !candidate->readable; }),
+            candidates.end());
+        std::sort(candidates.begin(), candidates.end(), [](const Candidate* left, const Candidate* right) {
+            return std::tie(left->size, left->hash) < std::tie(right->size, right->hash);
+        });
+
+        for (std::size_t begin = 0, end = 0; begin < candidates.size(); begin = end) {
+            while (end < candidates.size() && candidates[end]->size == candidates[begin]->size && candidates[end]->hash == candidates[begin]->hash) {
+                ++end;
+            }
+            if (end - begin > 1) {
+                shared.insert(shared.end(), candidates.begin() + begin, candidates.begin() + end);
+            }
+        }
+        return shared;
+    }
+}
+
+DuplicateFinder::Result DuplicateFinder::find(const std::string& rootPath, unsigned threadCount) {
+    INSTRUMENT_SCOPE("DuplicateFinder::find");
+    auto start = std::chrono::steady_clock::now();
+    SearchState state(threadCount);
+    Result result = {};
+
+    collectDirectory(state, rootPath);
+    state.pool.wait();
+    result.filesScanned = state.files.size();
+
+    std::vector<Candidate*> candidates;
+    std::sort(state.files.begin(), state.files.end(), [](const Candidate& left, const Candidate& right) { return left.size < right.size; });
+    for (std::size_t begin = 0, end = 0; begin < state.files.size(); begin = end) {
+        while (end < state.files.size() && state.files[end].size == state.files[begin].size) {
+            ++end;
+        }
+        for (std::size_t index = begin; end - begin > 1 && index < end; ++index) {
+            candidates.push_back(&state.files[index]);
+        }
+    }
+    result.sizeCandidates = candidates.size();
+
+    forEachCandidate(state, candidates, hashPartial);
+
+    // Hard links share their identity; only one path of each file stays a candidate.
+    std::sort(candidates.begin(), candidates.end(), [](const Candidate* left, const Candidate* right) {
+        return std::tie(left->device, left->fileIndex, left->path) < std::tie(right->device, right->fileIndex, right->path);
+    });
+    candidates.erase(std::unique(candidates.begin(), candidates.end(), [](const Candidate* left, const Candidate* right) {
+        return left->readable && right->readable && left->device == right->device && left->fileIndex == right->fileIndex;
+    }), candidates.end());
+
+    candidates = keepShared(std::move(candidates), state);
+    result.partialCandidates = candidates.size();
+
+    std::vector<Candidate*> large;
+    for (Candidate* candidate : candidates) {
+        if (candidate->size > 2 * PARTIAL_BLOCK_SIZE) {
+            large.push_back(candidate);
+        }
+    }
+    forEachCandidate(state, large, hashFull);
+    candidates = keepShared(std::move(candidates), state);
+
+    for (std::size_t begin = 0, end = 0; begin < candidates.size(); begin = end) {
+        Group group = { candidates[begin]->size, {} };
+        while (end < candidates.size() && candidates[end]->size == group.size && candidates[end]->hash == candidates[begin]->hash) {
+            group.paths.emplace_back(candidates[end++]->path);
+        }
+        std::sort(group.paths.begin(), group.paths.end());
+        result.reclaimableBytes += group.size * (group.paths.size() - 1);
+        result.groups.push_back(std::move(group));
+    }
+    std::stable_sort(result.groups.begin(), result.groups.end(), [](const Group& left, const Group& right) {
+        return left.size * (left.paths.size() - 1) > right.size * (right.paths.size() - 1);
+    });
+
+    result.unreadableFiles = state.unreadable.load();
+    result.bytesHashed = state.bytesHashed.load();
+    result.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    return result;
+}
\ No newline at end of file
@@ -0,0 +1,222 @@
+#include "Entry_Table.h"
+#include "Instrumentation.h"
+#include "Thread_Pool.h"
+
+#include <algorithm>
+#include <cctype>
+#include <cstring>
+#include <numeric>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/stat.h>
+#endif
+
+const std::size_t EntryTable::PARALLEL_THRESHOLD;
+const std::size_t EntryTable::STAT_BATCH_SIZE;
+
+namespace {
+    // Sorts contiguous parts on the pool, then merges neighbouring parts in parallel rounds.
+    template <typename Compare>
+    void parallelSort(std::vector<std::uint32_t>& values, Compare compare, unsigned threadCount) {
+        ThreadPool pool(threadCount);
+        std::size_t partCount = std::min<std::size_t>(pool.size(), values.size() / (EntryTable::PARALLEL_THRESHOLD / 4) + 1);
+        std::vector<std::size_t> bounds;
+        for (std::size_t part = 0; part <= partCount; ++part) {
+            bounds.push_back(values.size() * part / partCount);
+        }
+
+        for (std::size_t part = 0; part < partCount; ++part) {
+            pool.submit([&values, &bounds, compare, part] {
+                std::sort(values.begin() + bounds[part], values.begin() + bounds[part + 1], compare);
+            });
+        }
+        pool.wait();
+
+        for (std::size_t width = 1; width < partCount; width *= 2) {
+            for (std::size_t part = 0; part + width < partCount; part += 2 * width) {
+                std::size_t last = std::min(part + 2 * width, partCount);
+                pool.submit([&values, &bounds, compare, part, width, last] {
+                    std::inplace_merge(values.begin() + bounds[part], values.begin() + bounds[part + width], values.begin() + bounds[last], compare);
+                });
+            }
+            pool.wait();
+        }
+    }
+
+}
+
+#ifdef _WIN32
+bool EntryTable::load(const std::string& directoryPath, unsigned) {
+    INSTRUMENT_SCOPE("EntryTable::load");
+    clear();
+    DirectoryWalker::Listing listing;
+    if (!listing.open(directoryPath)) {
+        return false;
+    }
+    DirectoryWalker::Entry entry;
+    while (listing.next()) {
+        listing.readMetadata(entry);
+        append(listing.name(), std::strlen(listing.name()), entry.isDirectory, entry.size, entry.modificationTime, entry.attributes);
+    }
+    INSTRUMENT_COUNT(ENTRIES_VISITED, nameOffsets.size());
+    return true;
+}
+#else
+bool EntryTable::load(const std::string& directoryPath, unsigned threadCount) {
+    INSTRUMENT_SCOPE("EntryTable::load");
+    clear();
+    DirectoryWalker::Listing listing;
+    if (!listing.open(directoryPath)) {
+        return false;
+    }
+
+    // The names are collected first, so the metadata can be fetched in independent batches.
+    while (listing.next()) {
+        append(listing.name(), std::strlen(listing.name()), listing.type() == DirectoryWalker::EntryType::DIRECTORY, 0, 0, 0);
+    }
+
+    int directoryFd = listing.descriptor();
+    auto statBatch = [this, directoryFd](std::size_t begin, std::size_t end) {
+        INSTRUMENT_COUNT(SYSTEM_CALLS, end - begin);
+        for (std::size_t index = begin; index < end; ++index) {
+            const char* entryName = names.data() + nameOffsets[index];
+#if defined(__linux__) && defined(STATX_TYPE)
+            struct statx status;
+            if (statx(directoryFd, entryName, AT_SYMLINK_NOFOLLOW | AT_STATX_DONT_SYNC, STATX_TYPE | STATX_MODE | STATX_SIZE | STATX_MTIME, &status) == 0) {
+                directoryFlags[index] = S_ISDIR(status.stx_mode);
+                sizes[index] = status.stx_size;
+                modificationTimes[index] = static_cast<std::int64_t>(status.stx_mtime.tv_sec) * 1000000000LL + status.stx_mtime.tv_nsec;
+                attributeValues[index] = status.stx_mode;
+            }
+#else
+            struct stat status;
+            if (fstatat(directoryFd, entryName, &status, AT_SYMLINK_NOFOLLOW) == 0) {
+                directoryFlags[index] = S_ISDIR(status.st_mode);
+                sizes[index] = static_cast<std::uint64_t>(status.st_size);
+                modificationTimes[index] = static_cast<std::int64_t>(status.st_mtim.tv_sec) * 1000000000LL + status.st_mtim.tv_nsec;
+                attributeValues[index] = status.st_mode;
+            }
+#endif
+        }
+    };
+
+    std::size_t entryCount = nameOffsets.size();
+    if (entryCount < PARALLEL_THRESHOLD) {
+        statBatch(0, entryCount);
+    } else {
+        ThreadPool pool(threadCount);
+        for (std::size_t begin = 0; begin < entryCount; begin += STAT_BATCH_SIZE) {
+            std::size_t end = std::min(begin + STAT_BATCH_SIZE, entryCount);
+            pool.submit([&statBatch, begin, end] { statBatch(begin, end); });
+        }
+        pool.wait();
+    }
+
+    INSTRUMENT_COUNT(ENTRIES_VISITED, entryCount);
+    return true;
+}
+#endif
+
+void EntryTable::assign(const std::vector<DirectoryWalker::Entry>& entries) {
+    clear();
+    for (const DirectoryWalker::Entry& entry : entries) {
+        append(entry.name.data(), entry.name.size(), entry.isDirectory, entry.size, entry.modificationTime, entry.attributes);
+    }
+}
+
+void EntryTable::sort(SortKey key, bool descending, unsigned threadCount) {
+    INSTRUMENT_SCOPE("EntryTable::sort");
+    std::iota(order.begin(), order.end(), 0);
+    if (key == SortKey::NONE) {
+        if (descending) {
+            std::reverse(order.begin(), order.end());
+        }
+        return;
+    }
+
+    auto compare = [this, key, descending](std::uint32_t left, std::uint32_t right) {
+        if (key == SortKey::SIZE && sizes[left] != sizes[right]) {
+            return descending ? sizes[left] > sizes[right] : sizes[left] < sizes[right];
+        }
+        if (key == SortKey::TIME && modificationTimes[left] != modificationTimes[right]) {
+            return descending ? modificationTimes[left] > modificationTimes[right] : modificationTimes[left] < modificationTimes[right];
+        }
+        return key == SortKey::NAME && descending ? nameLess(right, left) : nameLess(left, right);
+    };
+
+    if (order.size() < PARALLEL_THRESHOLD) {
+        std::sort(order.begin(), order.end(), compare);
+    } else {
+        parallelSort(order, compare, threadCount);
+    }
+}
+
+std::size_t EntryTable::count() const {
+    return order.size();
+}
+
+std::string_view EntryTable::name(std::size_t position) const {
+    std::uint32_t index = order[position];
+    return std::string_view(names.data() + nameOffsets[index], nameLengths[index]);
+}
+
+bool EntryTable::isDirectory(std::size_t position) const {
+    return directoryFlags[order[position]] != 0;
+}
+
+std::uint64_t EntryTable::size(std::size_t position) const {
+    return sizes[order[position]];
+}
+
+std::int64_t EntryTable::modificationTime(std::size_t position) const {
+    return modificationTimes[order[position]];
+}
+
+std::uint32_t EntryTable::attributes(std::size_t position) const {
+    return attributeValues[order[position]];
+}
+
+void EntryTable::clear() {
+    names.clear();
+    nameOffsets.clear();
+    nameLengths.clear();
+    directoryFlags.clear();
+    sizes.clear();
+    modificationTimes.clear();
+    attributeValues.clear();
+    order.clear();
+}
+
+// Names are stored with a terminating NUL, so they can be passed to the system calls straight from the arena.
+void EntryTable::append(const char* name, std::size_t length, bool isDirectory, std::uint64_t size, std::int64_t modificationTime, std::uint32_t attributes) {
+    nameOffsets.push_back(static_cast<std::uint32_t>(names.size()));
+    nameLengths.push_back(static_cast<std::uint16_t>(length));
+    names.insert(names.end(), name, name + length);
+    names.push_back('\0');
+    directoryFlags.push_back(isDirectory ? 1 : 0);
+    sizes.push_back(size);
+    modificationTimes.push_back(modificationTime);
+    attributeValues.push_back(attributes);
+    order.push_back(static_cast<std::uint32_t>(order.size()));
+}
+
+// Windows compares names without regard to case, like Explorer; elsewhere names are compared byte by byte.
+bool EntryTable::nameLess(std::uint32_t left, std::uint32_t right) const {
+    const char* leftName = names.data() + nameOffsets[left];
+    const char* rightName = names.data() + nameOffsets[right];
+#ifdef _WIN32
+    std::size_t length = std::min(nameLengths[left], nameLengths[right]);
+    for (std::size_t index = 0; index < length; ++index) {
+        int leftChar = std::tolower(static_cast<unsigned char>(leftName[index]));
+        int rightChar = std::tolower(static_cast<unsigned char>(rightName[index]));
+        if (leftChar != rightChar) {
+            return leftChar < rightChar;
+        }
+    }
+    return nameLengths[left] < nameLengths[right];
+#else
+    int result = std::memcmp(leftName, rightName, std::min(nameLengths[left], nameLengths[right]));
+    return result != 0 ? result < 0 : nameLengths[left] < nameLengths[right];
+#endif
+}
\ No newline at end of file
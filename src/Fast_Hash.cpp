@@ -0,0 +1,129 @@
+#include "Fast_Hash.h"
+
+#include <cstring>
+
+namespace {
+    const std::uint64_t PRIME1 = 11400714785074694791ULL;
+    const std::uint64_t PRIME2 = 14029467366897019727ULL;
+    const std::uint64_t PRIME3 = 1609587929392839161ULL;
+    const std::uint64_t PRIME4 = 9650029242287828579ULL;
+    const std::uint64_t PRIME5 = 2870177450012600261ULL;
+
+    std::uint64_t rotateLeft(std::uint64_t value, int bits) {
+        return (value << bits) | (value >> (64 - bits));
+    }
+
+    // memcpy compiles to a single unaligned load; the hash is defined on little-endian input.
+    std::uint64_t read64(const unsigned char* data) {
+        std::uint64_t value;
+        std::memcpy(&value, data, sizeof(value));
+        return value;
+    }
+
+    std::uint32_t read32(const unsigned char* data) {
+        std::uint32_t value;
+        std::memcpy(&value, data, sizeof(value));
+        return value;
+    }
+
+    std::uint64_t accumulate(std::uint64_t accumulator, std::uint64_t input) {
+        accumulator += input * PRIME2;
+        return rotateLeft(accumulator, 31) * PRIME1;
+    }
+
+    std::uint64_t mergeRound(std::uint64_t hash, std::uint64_t accumulator) {
+        hash ^= accumulate(0, accumulator);
+        return hash * PRIME1 + PRIME4;
+    }
+
+    void consumeStripes(std::uint64_t* accumulators, const unsigned char*& data, const unsigned char* end) {
+        std::uint64_t v1 = accumulators[0];
+        std::uint64_t v2 = accumulators[1];
+        std::uint64_t v3 = accumulators[2];
+        std::uint64_t v4 = accumulators[3];
+        for (; end - data >= 32; data += 32) {
+            v1 = accumulate(v1, read64(data));
+            v2 = accumulate(v2, read64(data + 8));
+            v3 = accumulate(v3, read64(data + 16));
+            v4 = accumulate(v4, read64(data + 24));
+        }
+        accumulators[0] = v1;
+        accumulators[1] = v2;
+        accumulators[2] = v3;
+        accumulators[3] = v4;
+    }
+}
+
+FastHash::FastHash(std::uint64_t seed) : seed(seed), totalLength(0), bufferedSize(0) {
+    accumulators[0] = seed + PRIME1 + PRIME2;
+    accumulators[1] = seed + PRIME2;
+    accumulators[2] = seed;
+    accumulators[3] = seed - PRIME1;
+}
+
+void FastHash::update(const void* data, std::size_t size) {
+    const unsigned char* input = static_cast<const unsigned char*>(data);
+    const unsigned char* end = input + size;
+    totalLength += size;
+
+    if (bufferedSize + size < sizeof(buffer)) {
+        std::memcpy(buffer + bufferedSize, input, size);
+        bufferedSize += size;
+        return;
+    }
+
+    if (bufferedSize > 0) {
+        std::size_t fill = sizeof(buffer) - bufferedSize;
+        std::memcpy(buffer + bufferedSize, input, fill);
+        input += fill;
+        const unsigned char* stripe = buffer;
+        consumeStripes(accumulators, stripe, buffer + sizeof(buffer));
+        bufferedSize = 0;
+    }
+
+    consumeStripes(accumulators, input, end);
+    bufferedSize = static_cast<std::size_t>(end - input);
+    std::memcpy(buffer, input, bufferedSize);
+}
+
+std::uint64_t FastHash::digest() const {
+    std::uint64_t hash;
+    if (totalLength >= sizeof(buffer)) {
+        hash = rotateLeft(accumulators[0], 1) + rotateLeft(accumulators[1], 7) + rotateLeft(accumulators[2], 12) + rotateLeft(accumulators[3], 18);
+        for (std::uint64_t accumulator : accumulators) {
+            hash = mergeRound(hash, accumulator);
+        }
+    } else {
+        hash = seed + PRIME5;
+    }
+    hash += totalLength;
+
+    const unsigned char* data = buffer;
+    const unsigned char* end = buffer + bufferedSize;
+    for (; end - data >= 8; data += 8) {
+        hash ^= accumulate(0, read64(data));
+        hash = rotateLeft(hash, 27) * PRIME1 + PRIME4;
+    }
+    if (end - data >= 4) {
+        hash ^= read32(data) * PRIME1;
+        hash = rotateLeft(hash, 23) * PRIME2 + PRIME3;
+        data += 4;
+    }
+    for (; data < end; ++data) {
+        hash ^= *data * PRIME5;
+        hash = rotateLeft(hash, 11) * PRIME1;
+    }
+
+    hash ^= hash >> 33;
+    hash *= PRIME2;
+    hash ^= hash >> 29;
+    hash *= PRIME3;
+    hash ^= hash >> 32;
+    return hash;
+}
+
+std::uint64_t FastHash::hash(const void* data, std::size_t size, std::uint64_t seed) {
+    FastHash state(seed);
+    state.update(data, size);
+    return state.digest();
+}
\ No newline at end of file
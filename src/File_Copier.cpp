@@ -0,0 +1,570 @@
+#include "File_Copier.h"
+#include "Directory_Walker.h"
+#include "Instrumentation.h"
+#include "Mapped_File.h"
+#include "Thread_Pool.h"
+
+#include <chrono>
+#include <condition_variable>
+#include <cstring>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <cerrno>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#ifdef __linux__
+#include <linux/fs.h>
+#include <sys/ioctl.h>
+#include <sys/sendfile.h>
+#endif
+#endif
+
+const std::size_t FileCopier::BUFFER_SIZE;
+
+namespace {
+    struct TreeCopy {
+        ThreadPool pool;
+        FileCopier::Progress& progress;
+        bool replaceExisting;
+        std::mutex failureMutex;
+        std::string firstFailure;
+
+        TreeCopy(unsigned threadCount, FileCopier::Progress& progress, bool replaceExisting)
+            : pool(threadCount), progress(progress), replaceExisting(replaceExisting) {}
+
+        void fail(const std::string& path) {
+            progress.failures.fetch_add(1, std::memory_order_relaxed);
+            std::lock_guard<std::mutex> lock(failureMutex);
+            if (firstFailure.empty()) {
+                firstFailure = path;
+            }
+        }
+    };
+
+#ifdef _WIN32
+    struct CopyContext {
+        FileCopier::Progress* progress;
+        LONGLONG reported;
+    };
+
+    DWORD CALLBACK reportProgress(LARGE_INTEGER, LARGE_INTEGER transferred, LARGE_INTEGER, LARGE_INTEGER, DWORD, DWORD, HANDLE, HANDLE, LPVOID data) {
+        CopyContext* context = static_cast<CopyContext*>(data);
+        if (context->progress != nullptr) {
+            context->progress->bytesCopied.fetch_add(static_cast<std::uint64_t>(transferred.QuadPart - context->reported), std::memory_order_relaxed);
+        }
+        context->reported = transferred.QuadPart;
+        return PROGRESS_CONTINUE;
+    }
+
+    bool isLink(const DirectoryWalker::Entry&) {
+        return false;
+    }
+
+    bool copyLink(const std::string&, const std::string&, bool) {
+        return false;
+    }
+
+    bool sameLinkTarget(const std::string&, const std::string&) {
+        return true;
+    }
+
+    bool makeDirectory(const std::string& source, const std::string& destination, std::uint32_t, bool mergeExisting) {
+        return CreateDirectoryExA(source.c_str(), destination.c_str(), NULL) || (mergeExisting && GetLastError() == ERROR_ALREADY_EXISTS);
+    }
+
+    // Junctions and directory symlinks may point back into the tree, so they are not followed.
+    bool isFollowableDirectory(const DirectoryWalker::Entry& entry) {
+        return entry.isDirectory && !(entry.attributes & FILE_ATTRIBUTE_REPARSE_POINT);
+    }
+#else
+    bool isLink(const DirectoryWalker::Entry& entry) {
+        return S_ISLNK(entry.attributes);
+    }
+
+    bool readLinkTarget(const std::string& path, std::vector<char>& target) {
+        target.resize(4096);
+        ssize_t length = readlink(path.c_str(), target.data(), target.size());
+        if (length < 0 || static_cast<std::size_t>(length) >= target.size()) {
+            return false;
+        }
+        target.resize(static_cast<std::size_t>(length) + 1);
+        target[length] = '\0';
+        return true;
+    }
+
+    bool copyLink(const std::string& source, const std::string& destination, bool replaceExisting) {
+        std::vector<char> target;
+        if (!readLinkTarget(source, target)) {
+            return false;
+        }
+        if (replaceExisting) {
+            unlink(destination.c_str());
+        }
+        return symlink(target.data(), destination.c_str()) == 0;
+    }
+
+    bool sameLinkTarget(const std::string& source, const std::string& destination) {
+        std::vector<char> sourceTarget;
+        std::vector<char> destinationTarget;
+        return readLinkTarget(source, sourceTarget) && readLinkTarget(destination, destinationTarget) && sourceTarget == destinationTarget;
+    }
+
+    bool makeDirectory(const std::string&, const std::string& destination, std::uint32_t mode, bool mergeExisting) {
+        // The owner keeps write access, otherwise the files could not be copied into a read-only directory.
+        return mkdir(destination.c_str(), (mode & 07777) | 0700) == 0 || (mergeExisting && errno == EEXIST);
+    }
+
+    bool isFollowableDirectory(const DirectoryWalker::Entry& entry) {
+        return entry.isDirectory;
+    }
+
+    bool writeAll(int fd, const char* data, std::size_t size) {
+        while (size > 0) {
+            INSTRUMENT_COUNT(SYSTEM_CALLS, 1);
+            ssize_t written = write(fd, data, size);
+            if (written < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                return false;
+            }
+            INSTRUMENT_COUNT(BYTES_WRITTEN, written);
+            data += written;
+            size -= static_cast<std::size_t>(written);
+        }
+        return true;
+    }
+
+    // A reader thread fills one buffer while the calling thread writes the other, so reading and writing overlap.
+    bool copyBuffered(int input, int output, FileCopier::Progress* progress) {
+        struct Buffer {
+            std::vector<char> data;
+            ssize_t size = 0;
+            bool full = false;
+        };
+        Buffer buffers[2];
+        buffers[0].data.resize(FileCopier::BUFFER_SIZE);
+        buffers[1].data.resize(FileCopier::BUFFER_SIZE);
+
+        std::mutex mutex;
+        std::condition_variable changed;
+        bool failed = false;
+
+        std::thread reader([&] {
+            for (std::size_t block = 0;; ++block) {
+                Buffer& buffer = buffers[block % 2];
+                {
+                    std::unique_lock<std::mutex> lock(mutex);
+                    changed.wait(lock, [&] { return !buffer.full || failed; });
+                    if (failed) {
+                        return;
+                    }
+                }
+
+                ssize_t size;
+                do {
+                    INSTRUMENT_COUNT(SYSTEM_CALLS, 1);
+                    size = read(input, buffer.data.data(), buffer.data.size());
+                } while (size < 0 && errno == EINTR);
+                INSTRUMENT_COUNT(BYTES_READ, size > 0 ? size : 0);
+
+                {
+                    std::lock_guard<std::mutex> lock(mutex);
+                    failed = failed || size < 0;
+                    buffer.size = size > 0 ? size : 0;
+                    buffer.full = true;
+                }
+                changed.notify_all();
+                if (size <= 0) {
+                    return;
+                }
+            }
+        });
+
+        for (std::size_t block = 0;; ++block) {
+            Buffer& buffer = buffers[block % 2];
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                changed.wait(lock, [&] { return buffer.full || failed; });
+                if (failed || buffer.size == 0) {
+                    break;
+                }
+            }
+
+            bool written = writeAll(output, buffer.data.data(), static_cast<std::size_t>(buffer.size));
+            if (written && progress != nullptr) {
+                progress->bytesCopied.fetch_add(static_cast<std::uint64_t>(buffer.size), std::memory_order_relaxed);
+            }
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                failed = failed || !written;
+                buffer.full = false;
+            }
+            changed.notify_all();
+        }
+
+        reader.join();
+        return !failed;
+    }
+
+#ifdef __linux__
+    bool isUnsupported(int error) {
+        return error == EXDEV || error == ENOSYS || error == EINVAL || error == EOPNOTSUPP || error == ENOTSUP || error == EPERM;
+    }
+
+    // Returns 1 on success, 0 if the kernel path is not available for this pair of files and -1 on failure.
+    int copyInKernel(int input, int output, std::uint64_t size, FileCopier::Progress* progress) {
+        std::uint64_t copied = 0;
+        bool useSendfile = false;
+        while (copied < size) {
+            std::size_t chunk = size - copied > (1u << 30) ? (1u << 30) : static_cast<std::size_t>(size - copied);
+            INSTRUMENT_COUNT(SYSTEM_CALLS, 1);
+            ssize_t result = useSendfile ? sendfile(output, input, nullptr, chunk) : copy_file_range(input, nullptr, output, nullptr, chunk, 0);
+            if (result < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                if (copied == 0 && isUnsupported(errno)) {
+                    if (useSendfile) {
+                        return 0;
+                    }
+                    useSendfile = true;
+                    continue;
+                }
+                return -1;
+            }
+            if (result == 0) {
+                break;
+            }
+            copied += static_cast<std::uint64_t>(result);
+            INSTRUMENT_COUNT(BYTES_READ, result);
+            INSTRUMENT_COUNT(BYTES_WRITTEN, result);
+            if (progress != nullptr) {
+                progress->bytesCopied.fetch_add(static_cast<std::uint64_t>(result), std::memory_order_relaxed);
+            }
+        }
+        return 1;
+    }
+#endif
+#endif
+
+    struct TreeMeasure {
+        ThreadPool pool;
+        std::atomic<std::size_t> files{0};
+        std::atomic<std::size_t> directories{0};
+        std::atomic<std::uint64_t> bytes{0};
+
+        explicit TreeMeasure(unsigned threadCount) : pool(threadCount) {}
+    };
+
+    struct TreeVerify {
+        ThreadPool pool;
+        std::atomic<bool> failed{false};
+        std::mutex mismatchMutex;
+        std::string mismatch;
+
+        explicit TreeVerify(unsigned threadCount) : pool(threadCount) {}
+
+        void fail(const std::string& path) {
+            std::lock_guard<std::mutex> lock(mismatchMutex);
+            if (!failed.exchange(true)) {
+                mismatch = path;
+            }
+        }
+    };
+
+    // Compares two files byte for byte. Both are mapped, so the comparison reads each page once without a copy.
+    bool sameContents(const std::string& source, const std::string& destination) {
+        MappedFile original;
+        MappedFile copy;
+        if (!original.open(source) || !copy.open(destination) || original.size() != copy.size()) {
+            return false;
+        }
+        INSTRUMENT_COUNT(BYTES_READ, original.size() + copy.size());
+        return original.size() == 0 || std::memcmp(original.data(), copy.data(), original.size()) == 0;
+    }
+
+    void measureDirectory(TreeMeasure& state, const std::string& path) {
+        std::vector<DirectoryWalker::Entry> entries;
+        DirectoryWalker::readDirectory(path, entries, true);
+        state.directories.fetch_add(1, std::memory_order_relaxed);
+
+        std::size_t files = 0;
+        std::uint64_t bytes = 0;
+        for (const DirectoryWalker::Entry& entry : entries) {
+            if (entry.isDirectory && isFollowableDirectory(entry)) {
+                std::string child = DirectoryWalker::joinPath(path, entry.name);
+                state.pool.submit([&state, child] { measureDirectory(state, child); });
+            } else if (!entry.isDirectory) {
+                ++files;
+                bytes += entry.size;
+            }
+        }
+        state.files.fetch_add(files, std::memory_order_relaxed);
+        state.bytes.fetch_add(bytes, std::memory_order_relaxed);
+    }
+
+    void verifyDirectory(TreeVerify& state, const std::string& source, const std::string& destination) {
+        if (state.failed.load(std::memory_order_relaxed)) {
+            return;
+        }
+
+        std::vector<DirectoryWalker::Entry> sourceEntries;
+        std::vector<DirectoryWalker::Entry> destinationEntries;
+        if (!DirectoryWalker::readDirectory(source, sourceEntries, true) || !DirectoryWalker::readDirectory(destination, destinationEntries, true)) {
+            state.fail(destination);
+            return;
+        }
+
+        std::unordered_map<std::string, const DirectoryWalker::Entry*> copies;
+        for (const DirectoryWalker::Entry& entry : destinationEntries) {
+            copies.emplace(entry.name, &entry);
+        }
+
+        for (const DirectoryWalker::Entry& entry : sourceEntries) {
+            std::string destinationPath = DirectoryWalker::joinPath(destination, entry.name);
+            auto copy = copies.find(entry.name);
+            if (copy == copies.end() || copy->second->isDirectory != entry.isDirectory || isLink(*copy->second) != isLink(entry) ||
+                (!entry.isDirectory && !isLink(entry) && copy->second->size != entry.size)) {
+                state.fail(destinationPath);
+                return;
+            }
+            std::string sourcePath = DirectoryWalker::joinPath(source, entry.name);
+            if (isLink(entry)) {
+                if (!sameLinkTarget(sourcePath, destinationPath)) {
+                    state.fail(destinationPath);
+                    return;
+                }
+            } else if (!entry.isDirectory) {
+                state.pool.submit([&state, sourcePath, destinationPath] {
+                    if (!state.failed.load(std::memory_order_relaxed) && !sameContents(sourcePath, destinationPath)) {
+                        state.fail(destinationPath);
+                    }
+                });
+            } else if (isFollowableDirectory(entry)) {
+                state.pool.submit([&state, sourcePath, destinationPath] { verifyDirectory(state, sourcePath, destinationPath); });
+            }
+        }
+    }
+
+    void copyEntry(TreeCopy& state, const std::string& source, const std::string& destination, const DirectoryWalker::Entry& entry);
+
+    void copyDirectory(TreeCopy& state, const std::string& source, const std::string& destination, std::uint32_t attributes) {
+        if (!makeDirectory(source, destination, attributes, state.replaceExisting)) {
+            state.fail(destination);
+            return;
+        }
+        state.progress.directoriesCreated.fetch_add(1, std::memory_order_relaxed);
+
+        std::vector<DirectoryWalker::Entry> entries;
+        if (!DirectoryWalker::readDirectory(source, entries, true)) {
+            state.fail(source);
+            return;
+        }
+        for (const DirectoryWalker::Entry& entry : entries) {
+            copyEntry(state, DirectoryWalker::joinPath(source, entry.name), DirectoryWalker::joinPath(destination, entry.name), entry);
+        }
+    }
+
+    void copyEntry(TreeCopy& state, const std::string& source, const std::string& destination, const DirectoryWalker::Entry& entry) {
+        if (isLink(entry)) {
+            if (copyLink(source, destination, state.replaceExisting)) {
+                state.progress.filesCopied.fetch_add(1, std::memory_order_relaxed);
+            } else {
+                state.fail(source);
+            }
+        } else if (entry.isDirectory) {
+            if (!isFollowableDirectory(entry)) {
+                state.fail(source);
+                return;
+            }
+            std::uint32_t attributes = entry.attributes;
+            state.pool.submit([&state, source, destination, attributes] { copyDirectory(state, source, destination, attributes); });
+        } else {
+            state.pool.submit([&state, source, destination] {
+                if (FileCopier::copyFile(source, destination, &state.progress, state.replaceExisting)) {
+                    state.progress.filesCopied.fetch_add(1, std::memory_order_relaxed);
+                } else {
+                    state.fail(source);
+                }
+            });
+        }
+    }
+}
+
+#ifdef _WIN32
+bool FileCopier::copyFile(const std::string& source, const std::string& destination, Progress* progress, bool replaceExisting) {
+    CopyContext context = { progress, 0 };
+    DWORD flags = replaceExisting ? 0 : COPY_FILE_FAIL_IF_EXISTS;
+    bool copied = CopyFileExA(source.c_str(), destination.c_str(), reportProgress, &context, NULL, flags) != 0;
+    INSTRUMENT_COUNT(SYSTEM_CALLS, 1);
+    INSTRUMENT_COUNT(BYTES_READ, context.reported);
+    INSTRUMENT_COUNT(BYTES_WRITTEN, context.reported);
+    return copied;
+}
+#else
+bool FileCopier::copyFile(const std::string& source, const std::string& destination, Progress* progress, bool replaceExisting) {
+    // Opening, stat and closing both files; the data transfer counts its own calls.
+    INSTRUMENT_COUNT(SYSTEM_CALLS, 5);
+    // O_NONBLOCK keeps a FIFO from blocking the open; it is rejected below like every other special file.
+    int input = open(source.c_str(), O_RDONLY | O_NONBLOCK | O_CLOEXEC);
+    if (input < 0) {
+        return false;
+    }
+    struct stat status;
+    if (fstat(input, &status) != 0 || !S_ISREG(status.st_mode)) {
+        close(input);
+        return false;
+    }
+    // Without replacing, O_EXCL makes an existing destination fail the open, so nothing that was there is touched.
+    int flags = O_WRONLY | O_CREAT | O_CLOEXEC | (replaceExisting ? O_TRUNC : O_EXCL);
+    int output = open(destination.c_str(), flags, status.st_mode & 07777);
+    if (output < 0) {
+        close(input);
+        return false;
+    }
+
+    bool copied = false;
+#ifdef __linux__
+    // Files such as those in /proc report a size of 0, so they always take the read/write path.
+    if (status.st_size > 0) {
+        INSTRUMENT_COUNT(SYSTEM_CALLS, 1);
+        if (ioctl(output, FICLONE, input) == 0) {
+            copied = true;
+            if (progress != nullptr) {
+                progress->bytesCopied.fetch_add(static_cast<std::uint64_t>(status.st_size), std::memory_order_relaxed);
+            }
+        } else {
+            int result = copyInKernel(input, output, static_cast<std::uint64_t>(status.st_size), progress);
+            if (result < 0) {
+                close(input);
+                close(output);
+                unlink(destination.c_str());
+                return false;
+            }
+            copied = result > 0;
+        }
+    }
+#endif
+    // One read tells an empty file apart from one that only reports a size of 0, so an empty file needs no reader
+    // thread.
+    bool failed = false;
+    if (!copied && status.st_size == 0) {
+        char probe[512];
+        ssize_t size;
+        do {
+            INSTRUMENT_COUNT(SYSTEM_CALLS, 1);
+            size = read(input, probe, sizeof(probe));
+        } while (size < 0 && errno == EINTR);
+        INSTRUMENT_COUNT(BYTES_READ, size > 0 ? size : 0);
+        if (size == 0) {
+            copied = true;
+        } else if (size < 0 || !writeAll(output, probe, static_cast<std::size_t>(size))) {
+            failed = true;
+        } else if (progress != nullptr) {
+            progress->bytesCopied.fetch_add(static_cast<std::uint64_t>(size), std::memory_order_relaxed);
+        }
+    }
+    if (!copied && !failed) {
+        copied = copyBuffered(input, output, progress);
+    }
+
+    if (copied) {
+        struct timespec times[2] = { status.st_atim, status.st_mtim };
+        fchmod(output, status.st_mode & 07777);
+        futimens(output, times);
+    }
+    close(input);
+    if (close(output) != 0) {
+        copied = false;
+    }
+    if (!copied) {
+        unlink(destination.c_str());
+    }
+    return copied;
+}
+#endif
+
+FileCopier::Result FileCopier::copy(const std::string& source, const std::string& destination, unsigned threadCount, Progress* progress,
+    bool replaceExisting) {
+    INSTRUMENT_SCOPE("FileCopier::copy");
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    Progress localProgress;
+    Progress& counters = progress != nullptr ? *progress : localProgress;
+    Result result = {};
+
+    DirectoryWalker::Entry entry{};
+    if (!DirectoryWalker::readMetadata(source, entry)) {
+        counters.failures.fetch_add(1, std::memory_order_relaxed);
+        result.firstFailure = source;
+    } else if (entry.isDirectory || isLink(entry)) {
+        TreeCopy state(threadCount, counters, replaceExisting);
+        if (entry.isDirectory) {
+            copyDirectory(state, source, destination, entry.attributes);
+        } else {
+            copyEntry(state, source, destination, entry);
+        }
+        state.pool.wait();
+        result.firstFailure = state.firstFailure;
+    } else if (copyFile(source, destination, &counters, replaceExisting)) {
+        counters.filesCopied.fetch_add(1, std::memory_order_relaxed);
+    } else {
+        counters.failures.fetch_add(1, std::memory_order_relaxed);
+        result.firstFailure = source;
+    }
+
+    result.bytesCopied = counters.bytesCopied.load();
+    result.filesCopied = counters.filesCopied.load();
+    result.directoriesCreated = counters.directoriesCreated.load();
+    result.failures = counters.failures.load();
+    result.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    return result;
+}
+
+FileCopier::Totals FileCopier::measure(const std::string& path, unsigned threadCount) {
+    INSTRUMENT_SCOPE("FileCopier::measure");
+    DirectoryWalker::Entry entry{};
+    if (!DirectoryWalker::readMetadata(path, entry)) {
+        return { 0, 0, 0 };
+    }
+    if (!entry.isDirectory) {
+        return { 1, 0, entry.size };
+    }
+
+    TreeMeasure state(threadCount);
+    measureDirectory(state, path);
+    state.pool.wait();
+    return { state.files.load(), state.directories.load(), state.bytes.load() };
+}
+
+bool FileCopier::verify(const std::string& source, const std::string& destination, std::string& mismatch, unsigned threadCount) {
+    INSTRUMENT_SCOPE("FileCopier::verify");
+    DirectoryWalker::Entry original{};
+    DirectoryWalker::Entry copy{};
+    if (!DirectoryWalker::readMetadata(source, original) || !DirectoryWalker::readMetadata(destination, copy) ||
+        original.isDirectory != copy.isDirectory || isLink(original) != isLink(copy) ||
+        (!original.isDirectory && !isLink(original) && original.size != copy.size)) {
+        mismatch = destination;
+        return false;
+    }
+    if (!original.isDirectory) {
+        bool same = isLink(original) ? sameLinkTarget(source, destination) : sameContents(source, destination);
+        if (!same) {
+            mismatch = destination;
+        }
+        return same;
+    }
+
+    TreeVerify state(threadCount);
+    verifyDirectory(state, source, destination);
+    state.pool.wait();
+    mismatch = state.mismatch;
+    return !state.failed.load();
+}
\ No newline at end of file
@@ -1,264 +1,1152 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <ctime>
+#include <future>
 #include <iostream>
+#include <mutex>
+#ifdef _WIN32
 #include <windows.h>
 #include <shellapi.h>
+#else
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
 #include "File_Manager.h"
+#include "Bulk_Operation.h"
 #include "Colored_Console.h"
+#include "Directory_Archive.h"
+#include "Directory_Cursor.h"
+#include "Directory_Index.h"
+#include "Directory_Snapshot.h"
+#include "Disk_Usage.h"
+#include "Directory_Walker.h"
+#include "Directory_Watcher.h"
+#include "Duplicate_Finder.h"
+#include "File_Copier.h"
+#include "Instrumentation.h"
+#include "Interrupt_Scope.h"
+#include "Name_Search.h"
+#include "Output_Sink.h"
+#include "Text_Search.h"
+#include "Tree_Deleter.h"
+#include "Tree_Permissions.h"
+
+namespace {
+    // The tree file keeps the line endings a text-mode std::ofstream produced.
+#ifdef _WIN32
+    const char LINE_BREAK[] = "\r\n";
+#else
+    const char LINE_BREAK[] = "\n";
+#endif
+
+    DirectoryIndex& directoryIndex() {
+        static DirectoryIndex index;
+        return index;
+    }
+
+    // Commands of a batch run concurrently and share the one index, which is not safe for concurrent use.
+    std::mutex& indexMutex() {
+        static std::mutex mutex;
+        return mutex;
+    }
+
+    std::string trimTrailingSeparators(const std::string& path) {
+        std::size_t length = path.size();
+        while (length > 1 && FilesystemBackend::isSeparator(path[length - 1]) && path[length - 2] != ':') {
+            --length;
+        }
+        return path.substr(0, length);
+    }
+
+    // Makes sure the mapped index covers the directory, loading the index rooted at the directory itself if there is one.
+    bool openIndexFor(const std::string& directoryPath) {
+        DirectoryIndex& index = directoryIndex();
+        if (index.isOpen() && index.findDirectory(directoryPath) != DirectoryIndex::NO_ENTRY) {
+            return true;
+        }
+        return index.open(directoryPath);
+    }
+
+    void writeStructureLine(OutputSink& output, std::string& indentation, std::size_t depth, const char* name, std::size_t nameLength) {
+        if (indentation.size() < depth * 2) {
+            indentation.resize(depth * 2, ' ');
+        }
+        output.write(indentation.data(), depth * 2);
+        if (depth > 0) {
+            output.write("|-- ", 4);
+        }
+        output.write(name, nameLength);
+        output.write(LINE_BREAK, sizeof(LINE_BREAK) - 1);
+    }
+
+    // Returns the entries of a directory from the watched cache, falling back to the filesystem. The index is not used
+    // here: it cannot tell that a file was written, so its sizes would need a stat per entry anyway, and a listing with
+    // getdents and fstatat relative to the directory is cheaper than a stat of every joined path.
+    bool loadListing(const std::string& directoryPath, std::vector<DirectoryWalker::Entry>& entries) {
+        return DirectoryWatcher::instance().list(directoryPath, [&directoryPath](std::vector<DirectoryWalker::Entry>& loaded) {
+            return DirectoryWalker::readDirectory(directoryPath, loaded, true);
+        }, entries);
+    }
+
+    void printCopyProgress(const FileCopier::Progress& progress, const FileCopier::Totals& totals, double seconds) {
+        std::uint64_t bytes = progress.bytesCopied.load(std::memory_order_relaxed);
+        ColoredConsole::out() << "\rCopying: " << progress.filesCopied.load(std::memory_order_relaxed) << " of " << totals.files << " files, "
+            << FileManager::formatSize(bytes) << " of " << FileManager::formatSize(totals.bytes);
+        if (totals.bytes > 0) {
+            ColoredConsole::out() << " (" << bytes * 100 / totals.bytes << "%)";
+        }
+        if (seconds > 0) {
+            ColoredConsole::out() << ", " << FileManager::formatSize(static_cast<std::uint64_t>(bytes / seconds)) << "/s";
+        }
+        ColoredConsole::out() << "      " << std::flush;
+    }
+
+    // A rename cannot move between volumes or filesystems, so the tree is copied, compared with the source and only
+    // then deleted. Like the rename, the copy never replaces or merges into anything at the destination.
+    void moveAcrossDevices(const std::string& source, const std::string& destination) {
+        if (FilesystemBackend::exists(destination)) {
+            ColoredConsole::setConsoleColor(ERROR_COLOR);
+            ColoredConsole::out() << "\nFailed to move " << source << " to " << destination << ". The destination already exists." << std::endl << std::endl;
+            ColoredConsole::setConsoleColor(DEFAULT_COLOR);
+            return;
+        }
+
+        FileCopier::Totals totals = FileCopier::measure(source);
+        FileCopier::Progress progress;
+        auto start = std::chrono::steady_clock::now();
+        std::future<FileCopier::Result> copy = std::async(std::launch::async, [&] {
+            return FileCopier::copy(source, destination, 0, &progress, false);
+        });
+
+        // A redirected output is read after the command, so it only gets the outcome, not the progress lines.
+        bool showProgress = !ColoredConsole::isRedirected();
+        if (showProgress) {
+            ColoredConsole::out() << std::endl;
+        }
+        while (copy.wait_for(std::chrono::milliseconds(250)) != std::future_status::ready) {
+            if (showProgress) {
+                printCopyProgress(progress, totals, std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count());
+            }
+        }
+        FileCopier::Result result = copy.get();
+        if (showProgress) {
+            printCopyProgress(progress, totals, result.seconds);
+            ColoredConsole::out() << std::endl;
+        }
+
+        if (result.failures > 0) {
+            ColoredConsole::setConsoleColor(ERROR_COLOR);
+            ColoredConsole::out() << "\nFailed to move " << source << " to " << destination << ". Could not copy " << result.failures << " item(s), first: "
+                << result.firstFailure << ". The source was kept." << std::endl << std::endl;
+            ColoredConsole::setConsoleColor(DEFAULT_COLOR);
+            return;
+        }
+
+        std::string mismatch;
+        if (!FileCopier::verify(source, destination, mismatch)) {
+            ColoredConsole::setConsoleColor(ERROR_COLOR);
+            ColoredConsole::out() << "\nFailed to move " << source << " to " << destination << ". The copy does not match the source at " << mismatch
+                << ". The source was kept." << std::endl << std::endl;
+            ColoredConsole::setConsoleColor(DEFAULT_COLOR);
+            return;
+        }
+
+        if (TreeDeleter::remove(source).failures > 0) {
+            ColoredConsole::setConsoleColor(ERROR_COLOR);
+            ColoredConsole::out() << "\nCopied " << source << " to " << destination << ", but failed to delete the source." << std::endl << std::endl;
+            ColoredConsole::setConsoleColor(DEFAULT_COLOR);
+            return;
+        }
+
+        double seconds = result.seconds > 0 ? result.seconds : 1e-9;
+        ColoredConsole::setConsoleColor(SUCCESS_COLOR);
+        ColoredConsole::out() << "\nMoved " << source << " to " << destination << " across volumes: " << result.filesCopied << " files, "
+            << FileManager::formatSize(result.bytesCopied) << " in " << result.seconds << " s ("
+            << FileManager::formatSize(static_cast<std::uint64_t>(result.bytesCopied / seconds)) << "/s)" << std::endl << std::endl;
+        ColoredConsole::setConsoleColor(DEFAULT_COLOR);
+    }
+
+    // Expands a pattern, reporting why it could not be expanded or that it matched nothing.
+    bool expandPattern(const std::string& pattern, std::vector<BulkOperation::Item>& items) {
+        std::string error;
+        if (!BulkOperation::expand(pattern, items, error)) {
+            ColoredConsole::setConsoleColor(ERROR_COLOR);
+            ColoredConsole::out() << "\nInvalid pattern " << pattern << ": " << error << std::endl << std::endl;
+            ColoredConsole::setConsoleColor(DEFAULT_COLOR);
+            return false;
+        }
+        if (items.empty()) {
+            ColoredConsole::setConsoleColor(ERROR_COLOR);
+            ColoredConsole::out() << "\nNo files or directories match " << pattern << std::endl << std::endl;
+            ColoredConsole::setConsoleColor(DEFAULT_COLOR);
+            return false;
+        }
+        return true;
+    }
+
+    // Checks the targets of a rename or move before anything is changed, so a collision leaves every file in place.
+    bool reportCollisions(const std::vector<BulkOperation::Item>& items, const std::string& targetDirectory, const char* verb) {
+        std::vector<std::string> examples;
+        std::size_t collisions = BulkOperation::findCollisions(items, targetDirectory, examples);
+        if (collisions == 0) {
+            return false;
+        }
+        ColoredConsole::setConsoleColor(ERROR_COLOR);
+        ColoredConsole::out() << "\nNothing was " << verb << ". " << collisions << " collision(s):" << std::endl;
+        for (const std::string& example : examples) {
+            ColoredConsole::out() << "  " << example << std::endl;
+        }
+        if (collisions > examples.size()) {
+            ColoredConsole::out() << "  ..." << std::endl;
+        }
+        ColoredConsole::out() << std::endl;
+        ColoredConsole::setConsoleColor(DEFAULT_COLOR);
+        return true;
+    }
+
+    void printBulkResult(const BulkOperation::Result& result, const char* verb, const std::string& pattern) {
+        if (result.failed == 0) {
+            ColoredConsole::setConsoleColor(SUCCESS_COLOR);
+            ColoredConsole::out() << "\n" << verb << " " << result.succeeded << " item(s) matching " << pattern << " in " << result.seconds << " s"
+                << std::endl << std::endl;
+            ColoredConsole::setConsoleColor(DEFAULT_COLOR);
+            return;
+        }
+        ColoredConsole::setConsoleColor(ERROR_COLOR);
+        ColoredConsole::out() << "\n" << verb << " " << result.succeeded << " item(s) matching " << pattern << ", " << result.failed << " failed:" << std::endl;
+        for (const std::string& failure : result.failures) {
+            ColoredConsole::out() << "  " << failure << std::endl;
+        }
+        if (result.failed > result.failures.size()) {
+            ColoredConsole::out() << "  ..." << std::endl;
+        }
+        ColoredConsole::out() << std::endl;
+        ColoredConsole::setConsoleColor(DEFAULT_COLOR);
+    }
+
+    // The single-file variant of moveAcrossDevices, used for every match of a pattern: the pool already runs one
+    // match per worker, so each copy runs on the calling thread.
+    bool moveMatchAcrossDevices(const std::string& source, const std::string& destination) {
+        std::string mismatch;
+        return FileCopier::copy(source, destination, 1, nullptr, false).failures == 0 && FileCopier::verify(source, destination, mismatch, 1) &&
+            TreeDeleter::remove(source, 1).failures == 0;
+    }
+
+    // Formats a duration with three significant digits in the largest unit that keeps it at least 1.
+    std::string formatDuration(std::uint64_t nanoseconds) {
+        static const char* const UNITS[] = { "ns", "us", "ms", "s" };
+        double value = static_cast<double>(nanoseconds);
+        std::size_t unit = 0;
+        while (value >= 1000 && unit < 3) {
+            value /= 1000;
+            ++unit;
+        }
+        char text[32];
+        std::snprintf(text, sizeof(text), unit == 0 ? "%.0f %s" : "%.3g %s", value, UNITS[unit]);
+        return text;
+    }
+
+    // A paged listing is written whenever this much has been formatted, so the console never waits for all of it.
+    const std::size_t LISTING_WRITE_SIZE = 256 * 1024;
+
+    void writeListing(std::string& listing) {
+        ColoredConsole::out().write(listing.data(), static_cast<std::streamsize>(listing.size()));
+        ColoredConsole::out().flush();
+        listing.clear();
+    }
+
+    // FindFirstFileA reports "." and ".." for every directory except a drive root; the listings do not store them. They
+    // head the first page only.
+    void appendDotEntries(std::string& listing, const std::string& absolutePath, bool longFormat, std::size_t offset) {
+        if (offset == 0 && !longFormat && !(absolutePath.size() >= 2 && absolutePath.size() <= 3 && absolutePath[1] == ':')) {
+            listing += ". [DIR]\n.. [DIR]\n";
+        }
+    }
+
+    // The entries of a directory were often modified within the same minute, so the formatted time is kept until the
+    // minute changes instead of calling localtime for every entry.
+    const char* formatMinute(std::int64_t modificationTime) {
+        thread_local std::int64_t cachedMinute = -1;
+        thread_local char cachedTime[32] = "";
+        std::int64_t seconds = modificationTime / 1000000000LL;
+        if (seconds / 60 != cachedMinute || seconds < 0) {
+            std::time_t time = static_cast<std::time_t>(seconds);
+            cachedMinute = seconds / 60;
+            cachedTime[0] = '\0';
+            if (std::tm* local = std::localtime(&time)) {
+                std::strftime(cachedTime, sizeof(cachedTime), "%Y-%m-%d %H:%M", local);
+            }
+        }
+        return cachedTime;
+    }
+
+    void appendListingLine(std::string& listing, std::string_view name, bool isDirectory, std::uint64_t size, std::int64_t modificationTime, bool longFormat) {
+        if (longFormat) {
+            char columns[64];
+            std::snprintf(columns, sizeof(columns), "%12s  %16s  ", isDirectory ? "<DIR>" : FileManager::formatSize(size).c_str(), formatMinute(modificationTime));
+            listing += columns;
+            listing.append(name.data(), name.size());
+        } else {
+            listing.append(name.data(), name.size());
+            if (isDirectory) {
+                listing += " [DIR]";
+            }
+        }
+        listing += '\n';
+    }
+
+    // Ends a listing with a note when it stopped before the last entry.
+    void finishListing(std::string& listing, std::size_t offset, std::size_t end, bool more, bool interrupted) {
+        if (interrupted) {
+            listing += "\nInterrupted after " + std::to_string(end - offset) + " entries.\n";
+        } else if (more) {
+            listing += "\nShowed entries " + std::to_string(offset + 1) + " to " + std::to_string(end) + ". Use --offset=" +
+                std::to_string(end) + " to see more.\n";
+        }
+        listing += '\n';
+        writeListing(listing);
+    }
+
+    void streamListing(const std::string& absolutePath, bool longFormat, std::size_t offset, std::size_t end, const InterruptScope& interrupt) {
+        DirectoryCursor cursor;
+        if (!cursor.open(absolutePath)) {
+            ColoredConsole::setConsoleColor(ERROR_COLOR);
+            ColoredConsole::out() << "\nFailed to list files and directories in " << absolutePath << std::endl << std::endl;
+            ColoredConsole::setConsoleColor(DEFAULT_COLOR);
+            return;
+        }
+        cursor.skip(offset);
+
+        std::string listing = "\n";
+        appendDotEntries(listing, absolutePath, longFormat, offset);
+        std::vector<DirectoryCursor::Entry> batch;
+        std::size_t position = offset;
+        while (position < end && !interrupt.requested() && cursor.next(batch, std::min(DirectoryCursor::BATCH_SIZE, end - position), longFormat)) {
+            for (const DirectoryCursor::Entry& entry : batch) {
+                appendListingLine(listing, entry.name, entry.isDirectory, entry.size, entry.modificationTime, longFormat);
+            }
+            position += batch.size();
+            writeListing(listing);
+        }
+        bool more = position == end && cursor.next(batch, 1, false);
+        finishListing(listing, offset, position, more, interrupt.requested());
+    }
+}
 
 std::string FileManager::currentDirectory;
 
+bool FileManager::updateCurrentDirectory() {
+    return FilesystemBackend::getCurrentDirectory(currentDirectory);
+}
+
 void FileManager::displayCurrentDirectory() {
-    char currentDir[MAX_PATH];
-    if (GetCurrentDirectoryA(MAX_PATH, currentDir) > 0) {
-        currentDirectory = currentDir;
+    INSTRUMENT_SCOPE("FileManager::displayCurrentDirectory");
+    if (updateCurrentDirectory()) {
         ColoredConsole::setConsoleColor(PATH_COLOR);
-        std::cout << currentDir << "> ";
+        ColoredConsole::out() << currentDirectory << "> ";
         ColoredConsole::setConsoleColor(DEFAULT_COLOR);
     } else {
         ColoredConsole::setConsoleColor(ERROR_COLOR);
-        std::cout << "\nFailed to retrieve current directory." << std::endl << std::endl;
+        ColoredConsole::out() << "\nFailed to retrieve current directory." << std::endl << std::endl;
         ColoredConsole::setConsoleColor(DEFAULT_COLOR);
     }
 }
 
 std::string FileManager::getAbsolutePath(const std::string& path) {
     if (path.empty() || path[0] == '.') {
-        return currentDirectory + "\\" + path;
+        return currentDirectory + FilesystemBackend::separator() + path;
     }
 
     return path;
 }
 
 void FileManager::navigateDirectory(const std::string& directoryPath) {
-    if (!SetCurrentDirectoryA(directoryPath.c_str())) {
+    INSTRUMENT_SCOPE("FileManager::navigateDirectory");
+    if (!FilesystemBackend::setCurrentDirectory(directoryPath)) {
         ColoredConsole::setConsoleColor(ERROR_COLOR);
-        std::cout << "\nFailed to change directory to: " << directoryPath << std::endl << std::endl;
+        ColoredConsole::out() << "\nFailed to change directory to: " << directoryPath << std::endl << std::endl;
         ColoredConsole::setConsoleColor(DEFAULT_COLOR);
+        return;
+    }
+
+    // Warm the watched cache, so the listings of the new directory are served from memory.
+    std::string newDirectory;
+    if (FilesystemBackend::getCurrentDirectory(newDirectory)) {
+        std::vector<DirectoryWalker::Entry> entries;
+        loadListing(trimTrailingSeparators(newDirectory), entries);
     }
 }
 
 void FileManager::createFile(const std::string& fileName) {
-    std::ifstream file(fileName);
-    if (file) {
+    INSTRUMENT_SCOPE("FileManager::createFile");
+    FilesystemBackend::Status status = FilesystemBackend::createFile(fileName);
+    if (status == FilesystemBackend::Status::ALREADY_EXISTS) {
         ColoredConsole::setConsoleColor(ERROR_COLOR);
-        std::cout << "\nFailed to create file. The file with the same name already exists." << std::endl << std::endl;
+        ColoredConsole::out() << "\nFailed to create file. The file with the same name already exists." << std::endl << std::endl;
         ColoredConsole::setConsoleColor(DEFAULT_COLOR);
 
         return;
     }
 
-    HANDLE hFile = CreateFileA(fileName.c_str(), GENERIC_READ | GENERIC_WRITE, 0, NULL, CREATE_NEW, FILE_ATTRIBUTE_NORMAL, NULL);
-    if (hFile != INVALID_HANDLE_VALUE) {
+    if (status == FilesystemBackend::Status::OK) {
         ColoredConsole::setConsoleColor(SUCCESS_COLOR);
-        std::cout << "\nCreated file: " << fileName << std::endl << std::endl;
+        ColoredConsole::out() << "\nCreated file: " << fileName << std::endl << std::endl;
         ColoredConsole::setConsoleColor(DEFAULT_COLOR);
-        CloseHandle(hFile);
     } else {
         ColoredConsole::setConsoleColor(ERROR_COLOR);
-        std::cout << "\nFailed to create file: " << fileName << std::endl << std::endl;
+        ColoredConsole::out() << "\nFailed to create file: " << fileName << std::endl << std::endl;
         ColoredConsole::setConsoleColor(DEFAULT_COLOR);
     }
 }
 
 void FileManager::createDirectory(const std::string& directoryName) {
+    INSTRUMENT_SCOPE("FileManager::createDirectory");
     std::string absolutePath = getAbsolutePath(directoryName);
-    DWORD fileAttributes = GetFileAttributesA(absolutePath.c_str());
-
-    if (fileAttributes != INVALID_FILE_ATTRIBUTES && (fileAttributes & FILE_ATTRIBUTE_DIRECTORY)) {
+    if (FilesystemBackend::isDirectory(absolutePath)) {
         ColoredConsole::setConsoleColor(ERROR_COLOR);
-        std::cout << "\nFailed to create directory. The directory with the same name already exists." << std::endl << std::endl;
+        ColoredConsole::out() << "\nFailed to create directory. The directory with the same name already exists." << std::endl << std::endl;
         ColoredConsole::setConsoleColor(DEFAULT_COLOR);
         return;
     }
 
-    if (CreateDirectoryA(absolutePath.c_str(), NULL)) {
+    if (FilesystemBackend::createDirectory(absolutePath) == FilesystemBackend::Status::OK) {
         ColoredConsole::setConsoleColor(SUCCESS_COLOR);
-        std::cout << "\nCreated directory: " << absolutePath << std::endl << std::endl;
+        ColoredConsole::out() << "\nCreated directory: " << absolutePath << std::endl << std::endl;
         ColoredConsole::setConsoleColor(DEFAULT_COLOR);
     } else {
         ColoredConsole::setConsoleColor(ERROR_COLOR);
-        std::cout << "\nFailed to create directory: " << absolutePath << std::endl << std::endl;
+        ColoredConsole::out() << "\nFailed to create directory: " << absolutePath << std::endl << std::endl;
         ColoredConsole::setConsoleColor(DEFAULT_COLOR);
     }
 }
 
 void FileManager::renameFileOrDirectory(const std::string& currentName, const std::string& newName) {
-    DWORD currentAttributes = GetFileAttributesA(currentName.c_str());
-    if (currentAttributes == INVALID_FILE_ATTRIBUTES) {
+    INSTRUMENT_SCOPE("FileManager::renameFileOrDirectory");
+    FilesystemBackend::Metadata current;
+    if (!FilesystemBackend::getMetadata(currentName, current)) {
         ColoredConsole::setConsoleColor(ERROR_COLOR);
-        std::cout << "\nThe file or directory '" << currentName << "' does not exist." << std::endl << std::endl;
+        ColoredConsole::out() << "\nThe file or directory '" << currentName << "' does not exist." << std::endl << std::endl;
         ColoredConsole::setConsoleColor(DEFAULT_COLOR);
         return;
     }
 
-    DWORD newAttributes = GetFileAttributesA(newName.c_str());
-    if (newAttributes != INVALID_FILE_ATTRIBUTES) {
+    // The backend refuses to replace an existing target, so the check and the rename cannot race.
+    FilesystemBackend::Status status = FilesystemBackend::rename(currentName, newName);
+    if (status == FilesystemBackend::Status::ALREADY_EXISTS) {
         ColoredConsole::setConsoleColor(ERROR_COLOR);
-        std::cout << "\nFailed to rename. The file or directory with the name '" << newName << "' already exists." << std::endl << std::endl;
+        ColoredConsole::out() << "\nFailed to rename. The file or directory with the name '" << newName << "' already exists." << std::endl << std::endl;
         ColoredConsole::setConsoleColor(DEFAULT_COLOR);
         return;
     }
 
-    if (currentAttributes & FILE_ATTRIBUTE_DIRECTORY) {
-        if (MoveFileExA(currentName.c_str(), newName.c_str(), MOVEFILE_REPLACE_EXISTING)) {
+    if (current.isDirectory) {
+        if (status == FilesystemBackend::Status::OK) {
             ColoredConsole::setConsoleColor(SUCCESS_COLOR);
-            std::cout << "\nRenamed directory '" << currentName << "' to '" << newName << "'" << std::endl << std::endl;
+            ColoredConsole::out() << "\nRenamed directory '" << currentName << "' to '" << newName << "'" << std::endl << std::endl;
             ColoredConsole::setConsoleColor(DEFAULT_COLOR);
         }
         else {
             ColoredConsole::setConsoleColor(ERROR_COLOR);
-            std::cout << "\nFailed to rename directory '" << currentName << "' to '" << newName << "'" << std::endl << std::endl;
+            ColoredConsole::out() << "\nFailed to rename directory '" << currentName << "' to '" << newName << "'" << std::endl << std::endl;
             ColoredConsole::setConsoleColor(DEFAULT_COLOR);
         }
     }
     else {
-        if (MoveFileA(currentName.c_str(), newName.c_str())) {
+        if (status == FilesystemBackend::Status::OK) {
             ColoredConsole::setConsoleColor(SUCCESS_COLOR);
-            std::cout << "\nRenamed file '" << currentName << "' to '" << newName << "'" << std::endl << std::endl;
+            ColoredConsole::out() << "\nRenamed file '" << currentName << "' to '" << newName << "'" << std::endl << std::endl;
             ColoredConsole::setConsoleColor(DEFAULT_COLOR);
         }
         else {
             ColoredConsole::setConsoleColor(ERROR_COLOR);
-            std::cout << "\nFailed to rename file '" << currentName << "' to '" << newName << "'" << std::endl << std::endl;
+            ColoredConsole::out() << "\nFailed to rename file '" << currentName << "' to '" << newName << "'" << std::endl << std::endl;
             ColoredConsole::setConsoleColor(DEFAULT_COLOR);
         }
     }
 }
 
-void FileManager::deleteFileOrDirectory(const std::string& name) {
-    if (DeleteFileA(name.c_str())) {
+void FileManager::deleteFileOrDirectory(const std::string& name, bool recursive, bool dryRun) {
+    INSTRUMENT_SCOPE("FileManager::deleteFileOrDirectory");
+    if (recursive || dryRun) {
+        TreeDeleter::Result result = TreeDeleter::remove(name, 0, dryRun);
+        if (dryRun) {
+            ColoredConsole::setConsoleColor(DEFAULT_COLOR);
+            ColoredConsole::out() << "\nWould delete " << result.filesDeleted << " files and " << result.directoriesDeleted << " directories from " << name
+                << ", freeing " << formatSize(result.bytesFreed) << "." << std::endl;
+            if (result.failures > 0) {
+                ColoredConsole::out() << result.failures << " item(s) could not be read, first: " << result.firstFailure << std::endl;
+            }
+            ColoredConsole::out() << std::endl;
+        } else if (result.failures == 0) {
+            ColoredConsole::setConsoleColor(SUCCESS_COLOR);
+            ColoredConsole::out() << "\nDeleted " << name << ": " << result.filesDeleted << " files and " << result.directoriesDeleted << " directories in "
+                << result.seconds << " s" << std::endl << std::endl;
+            ColoredConsole::setConsoleColor(DEFAULT_COLOR);
+        } else {
+            ColoredConsole::setConsoleColor(ERROR_COLOR);
+            ColoredConsole::out() << "\nFailed to delete " << result.failures << " item(s) in " << name << ", first: " << result.firstFailure << " ("
+                << result.filesDeleted << " files and " << result.directoriesDeleted << " directories deleted)" << std::endl << std::endl;
+            ColoredConsole::setConsoleColor(DEFAULT_COLOR);
+        }
+        return;
+    }
+
+    if (FilesystemBackend::removeFile(name) == FilesystemBackend::Status::OK) {
         ColoredConsole::setConsoleColor(SUCCESS_COLOR);
-        std::cout << "\nDeleted file: " << name << std::endl << std::endl;
+        ColoredConsole::out() << "\nDeleted file: " << name << std::endl << std::endl;
         ColoredConsole::setConsoleColor(DEFAULT_COLOR);
-    } else if (RemoveDirectoryA(name.c_str())) {
+    } else if (FilesystemBackend::removeDirectory(name) == FilesystemBackend::Status::OK) {
         ColoredConsole::setConsoleColor(SUCCESS_COLOR);
-        std::cout << "\nDeleted directory: " << name << std::endl << std::endl;
+        ColoredConsole::out() << "\nDeleted directory: " << name << std::endl << std::endl;
         ColoredConsole::setConsoleColor(DEFAULT_COLOR);
     } else {
         ColoredConsole::setConsoleColor(ERROR_COLOR);
-        std::cout << "\nFailed to delete file or directory: " << name << std::endl << std::endl;
+        ColoredConsole::out() << "\nFailed to delete file or directory: " << name << std::endl << std::endl;
         ColoredConsole::setConsoleColor(DEFAULT_COLOR);
     }
 }
 
 void FileManager::moveFileOrDirectory(const std::string& source, const std::string& destination) {
-    DWORD destinationAttributes = GetFileAttributesA(destination.c_str());
-    if (destinationAttributes == INVALID_FILE_ATTRIBUTES || !(destinationAttributes & FILE_ATTRIBUTE_DIRECTORY)) {
+    INSTRUMENT_SCOPE("FileManager::moveFileOrDirectory");
+    if (!FilesystemBackend::isDirectory(destination)) {
         ColoredConsole::setConsoleColor(ERROR_COLOR);
-        std::cout << "\nFailed to move " << source << " to " << destination << ". The destination directory does not exist." << std::endl << std::endl;
+        ColoredConsole::out() << "\nFailed to move " << source << " to " << destination << ". The destination directory does not exist." << std::endl << std::endl;
         ColoredConsole::setConsoleColor(DEFAULT_COLOR);
         return;
     }
 
-    std::string sourceFileName = FileManager::getFileNameFromPath(source);
+    std::string_view sourceFileName = FileManager::getFileNameFromPath(source);
     std::string fullDestinationPath = FileManager::combinePaths(destination, sourceFileName);
 
-    if (MoveFileA(source.c_str(), fullDestinationPath.c_str())) {
+    FilesystemBackend::Status status = FilesystemBackend::rename(source, fullDestinationPath);
+    if (status == FilesystemBackend::Status::OK) {
         ColoredConsole::setConsoleColor(SUCCESS_COLOR);
-        std::cout << "\nMoved " << source << " to " << fullDestinationPath << std::endl << std::endl;
+        ColoredConsole::out() << "\nMoved " << source << " to " << fullDestinationPath << std::endl << std::endl;
         ColoredConsole::setConsoleColor(DEFAULT_COLOR);
     }
+    else if (status == FilesystemBackend::Status::CROSS_DEVICE) {
+        moveAcrossDevices(source, fullDestinationPath);
+    }
     else {
         ColoredConsole::setConsoleColor(ERROR_COLOR);
-        std::cout << "\nFailed to move " << source << " to " << fullDestinationPath << std::endl << std::endl;
+        ColoredConsole::out() << "\nFailed to move " << source << " to " << fullDestinationPath << std::endl << std::endl;
+        ColoredConsole::setConsoleColor(DEFAULT_COLOR);
+    }
+}
+
+void FileManager::copyFileOrDirectory(const std::string& source, const std::string& destination) {
+    INSTRUMENT_SCOPE("FileManager::copyFileOrDirectory");
+    std::string target = destination;
+    if (FilesystemBackend::isDirectory(destination)) {
+        target = combinePaths(destination, getFileNameFromPath(trimTrailingSeparators(source)));
+    }
+
+    std::string sourcePrefix = trimTrailingSeparators(source) + FilesystemBackend::separator();
+    if (target == source || target.compare(0, sourcePrefix.size(), sourcePrefix) == 0) {
+        ColoredConsole::setConsoleColor(ERROR_COLOR);
+        ColoredConsole::out() << "\nFailed to copy " << source << " to " << target << ". A directory cannot be copied into itself." << std::endl << std::endl;
+        ColoredConsole::setConsoleColor(DEFAULT_COLOR);
+        return;
+    }
+
+    FileCopier::Result result = FileCopier::copy(source, target);
+    if (result.failures == 0) {
+        double seconds = result.seconds > 0 ? result.seconds : 1e-9;
+        ColoredConsole::setConsoleColor(SUCCESS_COLOR);
+        ColoredConsole::out() << "\nCopied " << source << " to " << target << ": " << result.filesCopied << " files, " << formatSize(result.bytesCopied)
+            << " in " << result.seconds << " s (" << formatSize(static_cast<std::uint64_t>(result.bytesCopied / seconds)) << "/s)" << std::endl << std::endl;
+        ColoredConsole::setConsoleColor(DEFAULT_COLOR);
+    } else {
+        ColoredConsole::setConsoleColor(ERROR_COLOR);
+        ColoredConsole::out() << "\nFailed to copy " << result.failures << " item(s) from " << source << " to " << target << ", first: " << result.firstFailure
+            << " (" << result.filesCopied << " files copied)" << std::endl << std::endl;
+        ColoredConsole::setConsoleColor(DEFAULT_COLOR);
+    }
+}
+
+void FileManager::renameMatching(const std::string& expression, const std::string& directoryPath) {
+    INSTRUMENT_SCOPE("FileManager::renameMatching");
+    std::vector<BulkOperation::Item> items;
+    std::string error;
+    if (!BulkOperation::expandSubstitution(expression, directoryPath, items, error)) {
+        ColoredConsole::setConsoleColor(ERROR_COLOR);
+        ColoredConsole::out() << "\nInvalid substitution " << expression << ": " << error << std::endl << std::endl;
+        ColoredConsole::setConsoleColor(DEFAULT_COLOR);
+        return;
+    }
+    if (items.empty()) {
+        ColoredConsole::setConsoleColor(ERROR_COLOR);
+        ColoredConsole::out() << "\nNo names in " << directoryPath << " are changed by " << expression << std::endl << std::endl;
+        ColoredConsole::setConsoleColor(DEFAULT_COLOR);
+        return;
+    }
+    if (reportCollisions(items, directoryPath, "renamed")) {
+        return;
+    }
+
+    BulkOperation::Result result = BulkOperation::rename(items);
+    printBulkResult(result, "Renamed", expression);
+}
+
+void FileManager::deleteMatching(const std::string& pattern, bool recursive, bool dryRun) {
+    INSTRUMENT_SCOPE("FileManager::deleteMatching");
+    std::vector<BulkOperation::Item> items;
+    if (!expandPattern(pattern, items)) {
+        return;
+    }
+
+    if (dryRun) {
+        std::atomic<std::uint64_t> files{0};
+        std::atomic<std::uint64_t> directories{0};
+        std::atomic<std::uint64_t> bytes{0};
+        BulkOperation::Result result = BulkOperation::run(items, [&](const BulkOperation::Item& item) {
+            TreeDeleter::Result measured = TreeDeleter::remove(item.source, 1, true);
+            files.fetch_add(measured.filesDeleted, std::memory_order_relaxed);
+            directories.fetch_add(measured.directoriesDeleted, std::memory_order_relaxed);
+            bytes.fetch_add(measured.bytesFreed, std::memory_order_relaxed);
+            return measured.failures == 0;
+        });
+        ColoredConsole::setConsoleColor(DEFAULT_COLOR);
+        ColoredConsole::out() << "\nWould delete " << files.load() << " files and " << directories.load() << " directories from " << items.size()
+            << " item(s) matching " << pattern << ", freeing " << formatSize(bytes.load()) << "." << std::endl;
+        if (result.failed > 0) {
+            ColoredConsole::out() << result.failed << " item(s) could not be read completely, first: " << result.failures.front() << std::endl;
+        }
+        ColoredConsole::out() << std::endl;
+        return;
+    }
+
+    // Without -r only files and empty directories are deleted; a link is deleted itself, never its target.
+    BulkOperation::Result result = BulkOperation::run(items, [recursive](const BulkOperation::Item& item) {
+        FilesystemBackend::Metadata metadata;
+        if (!FilesystemBackend::getMetadata(item.source, metadata)) {
+            return false;
+        }
+        if (!metadata.isDirectory) {
+            return FilesystemBackend::removeFile(item.source) == FilesystemBackend::Status::OK;
+        }
+        if (recursive && !metadata.isLink) {
+            return TreeDeleter::remove(item.source, 1).failures == 0;
+        }
+        return FilesystemBackend::removeDirectory(item.source) == FilesystemBackend::Status::OK;
+    });
+    printBulkResult(result, "Deleted", pattern);
+}
+
+void FileManager::moveMatching(const std::string& pattern, const std::string& destination) {
+    INSTRUMENT_SCOPE("FileManager::moveMatching");
+    if (!FilesystemBackend::isDirectory(destination)) {
+        ColoredConsole::setConsoleColor(ERROR_COLOR);
+        ColoredConsole::out() << "\nFailed to move " << pattern << " to " << destination << ". The destination directory does not exist." << std::endl << std::endl;
         ColoredConsole::setConsoleColor(DEFAULT_COLOR);
+        return;
+    }
+
+    std::vector<BulkOperation::Item> items;
+    if (!expandPattern(pattern, items)) {
+        return;
+    }
+    BulkOperation::setTargets(items, destination);
+    if (reportCollisions(items, destination, "moved")) {
+        return;
     }
+
+    BulkOperation::Result result = BulkOperation::rename(items, [](const BulkOperation::Item& item) {
+        return moveMatchAcrossDevices(item.source, item.target);
+    });
+    printBulkResult(result, "Moved", pattern);
 }
 
-std::string FileManager::getFileNameFromPath(const std::string& filePath) {
-    std::size_t found = filePath.find_last_of("/\\");
-    if (found != std::string::npos) {
-        return filePath.substr(found + 1);
+std::string_view FileManager::getFileNameFromPath(std::string_view filePath) {
+    for (std::size_t index = filePath.size(); index > 0; --index) {
+        if (FilesystemBackend::isSeparator(filePath[index - 1])) {
+            return filePath.substr(index);
+        }
     }
     return filePath;
 }
 
-std::string FileManager::combinePaths(const std::string& path1, const std::string& path2) {
-    if (path1.empty()) {
-        return path2;
+std::string FileManager::combinePaths(std::string_view path1, std::string_view path2) {
+    // One allocation of the final size, whichever arguments are empty.
+    std::string combined;
+    combined.reserve(path1.size() + 1 + path2.size());
+    combined.append(path1.data(), path1.size());
+    if (!path1.empty() && !path2.empty() && !FilesystemBackend::isSeparator(path1.back())) {
+        combined += FilesystemBackend::separator();
+    }
+    combined.append(path2.data(), path2.size());
+    return combined;
+}
+
+void FileManager::listFilesAndDirectories(const std::string& directoryPath, EntryTable::SortKey sortKey, bool descending, bool longFormat,
+    std::size_t offset, std::size_t limit) {
+    INSTRUMENT_SCOPE("FileManager::listFilesAndDirectories");
+    std::string absolutePath = trimTrailingSeparators(getAbsolutePath(directoryPath));
+    std::size_t end = limit > 0 && offset + limit > offset ? offset + limit : static_cast<std::size_t>(-1);
+    InterruptScope interrupt;
+    EntryTable table;
+
+    // A cached listing goes straight into the table instead of through a copy of every entry.
+    bool cached = DirectoryWatcher::instance().visit(absolutePath, [&table](const std::vector<DirectoryWalker::Entry>& entries) {
+        table.assign(entries);
+    });
+
+    // An unsorted listing of a directory that is not cached is streamed: each batch is read and shown before the next
+    // one is read, so the first page appears at once and memory does not grow with the directory.
+    if (!cached && sortKey == EntryTable::SortKey::NONE && !descending) {
+        streamListing(absolutePath, longFormat, offset, end, interrupt);
+        return;
+    }
+    if (!cached && !table.load(absolutePath)) {
+        ColoredConsole::setConsoleColor(ERROR_COLOR);
+        ColoredConsole::out() << "\nFailed to list files and directories in " << absolutePath << std::endl << std::endl;
+        ColoredConsole::setConsoleColor(DEFAULT_COLOR);
+        return;
+    }
+    table.sort(sortKey, descending);
+
+    // Only the requested page is formatted, one batch at a time, so Ctrl-C stops a long listing between two writes.
+    std::string listing = "\n";
+    appendDotEntries(listing, absolutePath, longFormat, offset);
+    std::size_t last = std::min(end, table.count());
+    std::size_t position = offset;
+    for (; position < last && !interrupt.requested(); ++position) {
+        appendListingLine(listing, table.name(position), table.isDirectory(position), table.size(position), table.modificationTime(position), longFormat);
+        if (listing.size() >= LISTING_WRITE_SIZE) {
+            writeListing(listing);
+        }
+    }
+    finishListing(listing, offset, position, position < table.count(), interrupt.requested());
+}
+
+void FileManager::showDirectoryCacheStats() {
+    INSTRUMENT_SCOPE("FileManager::showDirectoryCacheStats");
+    DirectoryWatcher::Stats stats = DirectoryWatcher::instance().stats();
+    std::size_t lookups = stats.cache.hits + stats.cache.misses;
+
+    ColoredConsole::out() << "\nDirectory watcher:  " << (stats.active ? "active" : "inactive, listings are read from disk") << std::endl;
+    ColoredConsole::out() << "Cached directories: " << stats.cache.directories << " (" << stats.watchedDirectories << " watched)" << std::endl;
+    ColoredConsole::out() << "Cached entries:     " << stats.cache.entries << std::endl;
+    ColoredConsole::out() << "Memory:             " << stats.cache.bytes / 1024 << " KiB of " << stats.cache.budget / 1024 << " KiB" << std::endl;
+    ColoredConsole::out() << "Hits / misses:      " << stats.cache.hits << " / " << stats.cache.misses;
+    if (lookups > 0) {
+        ColoredConsole::out() << " (" << stats.cache.hits * 100 / lookups << "% hit rate)";
+    }
+    ColoredConsole::out() << std::endl;
+    ColoredConsole::out() << "Events processed:   " << stats.eventsProcessed << std::endl;
+    ColoredConsole::out() << "Overflows:          " << stats.overflows << " (" << stats.rescans << " directories rescanned)" << std::endl;
+    ColoredConsole::out() << "Evictions:          " << stats.cache.evictions << std::endl << std::endl;
+}
+
+void FileManager::showInstrumentationStats() {
+    if (!Instrumentation::isEnabled()) {
+        ColoredConsole::out() << "\nInstrumentation was compiled out of this build." << std::endl << std::endl;
+        return;
+    }
+
+    std::vector<Instrumentation::Summary> summaries = Instrumentation::summarize();
+    ColoredConsole::out() << std::endl;
+    if (summaries.empty()) {
+        ColoredConsole::out() << "No commands were timed yet." << std::endl;
+    }
+    else {
+        char line[160];
+        std::snprintf(line, sizeof(line), "%-44s %8s %10s %10s %10s %10s %10s", "Scope", "Calls", "p50", "p90", "p99", "Max", "Total");
+        ColoredConsole::setConsoleColor(PATH_COLOR);
+        ColoredConsole::out() << line << std::endl;
+        ColoredConsole::setConsoleColor(DEFAULT_COLOR);
+        for (const Instrumentation::Summary& summary : summaries) {
+            std::snprintf(line, sizeof(line), "%-44s %8llu %10s %10s %10s %10s %10s", summary.name.c_str(), static_cast<unsigned long long>(summary.count),
+                formatDuration(summary.p50).c_str(), formatDuration(summary.p90).c_str(), formatDuration(summary.p99).c_str(),
+                formatDuration(summary.max).c_str(), formatDuration(summary.totalNanoseconds).c_str());
+            ColoredConsole::out() << line << std::endl;
+        }
     }
-    if (path2.empty()) {
-        return path1;
+
+    ColoredConsole::out() << std::endl;
+    for (std::size_t counter = 0; counter < Instrumentation::COUNTER_COUNT; ++counter) {
+        Instrumentation::Counter current = static_cast<Instrumentation::Counter>(counter);
+        std::uint64_t total = Instrumentation::total(current);
+        std::string name = std::string(Instrumentation::counterName(current)) + ":";
+        ColoredConsole::out() << name << std::string(name.size() < 20 ? 20 - name.size() : 1, ' ') << total;
+        if (current == Instrumentation::Counter::BYTES_READ || current == Instrumentation::Counter::BYTES_WRITTEN) {
+            ColoredConsole::out() << " (" << formatSize(total) << ")";
+        }
+        ColoredConsole::out() << std::endl;
     }
-    char lastChar = path1.back();
-    if (lastChar != '/' && lastChar != '\\') {
-        return path1 + '\\' + path2;
+    ColoredConsole::out() << std::endl;
+}
+
+void FileManager::findText(const std::string& pattern, const std::string& directoryPath) {
+    INSTRUMENT_SCOPE("FileManager::findText");
+    std::string rootPath = trimTrailingSeparators(directoryPath);
+    std::string lastPath;
+
+    ColoredConsole::out() << std::endl;
+    TextSearch::Stats stats = TextSearch::search(rootPath, pattern, 0, [&](const TextSearch::Match& match) {
+        // Files are flushed as a whole, so matches appear as soon as their file is done without flushing every line.
+        if (*match.path != lastPath) {
+            ColoredConsole::out() << std::flush;
+            lastPath = *match.path;
+        }
+        ColoredConsole::setConsoleColor(PATH_COLOR);
+        ColoredConsole::out() << *match.path;
+        ColoredConsole::setConsoleColor(DEFAULT_COLOR);
+        ColoredConsole::out() << ":" << match.lineNumber << ": " << match.line << '\n';
+    });
+
+    double seconds = stats.seconds > 0 ? stats.seconds : 1e-9;
+    ColoredConsole::setConsoleColor(stats.matches > 0 ? SUCCESS_COLOR : DEFAULT_COLOR);
+    ColoredConsole::out() << "\n" << stats.matches << " matching lines in " << stats.matchingFiles << " files. Scanned " << stats.filesScanned << " files, "
+        << formatSize(stats.bytesScanned) << " in " << stats.seconds << " s (" << formatSize(static_cast<std::uint64_t>(stats.bytesScanned / seconds))
+        << "/s, " << TextSearch::kernelName() << ")";
+    if (stats.binaryFiles > 0 || stats.unreadableFiles > 0) {
+        ColoredConsole::out() << ", skipped " << stats.binaryFiles << " binary and " << stats.unreadableFiles << " unreadable files";
     }
-    return path1 + path2;
+    ColoredConsole::out() << "." << std::endl << std::endl;
+    ColoredConsole::setConsoleColor(DEFAULT_COLOR);
 }
 
-void FileManager::listFilesAndDirectories(const std::string& directoryPath) {
-    std::string absolutePath = getAbsolutePath(directoryPath);
-    WIN32_FIND_DATAA findData;
-    HANDLE hFind = FindFirstFileA((absolutePath + "\\*").c_str(), &findData);
+void FileManager::findFiles(const std::string& pattern, bool isRegex, const std::string& directoryPath) {
+    INSTRUMENT_SCOPE("FileManager::findFiles");
+    PatternMatcher matcher;
+    std::string error;
+    if (!matcher.compile(pattern, isRegex ? PatternMatcher::Syntax::REGEX : PatternMatcher::Syntax::GLOB, error)) {
+        ColoredConsole::setConsoleColor(ERROR_COLOR);
+        ColoredConsole::out() << "\nInvalid pattern " << pattern << ": " << error << std::endl << std::endl;
+        ColoredConsole::setConsoleColor(DEFAULT_COLOR);
+        return;
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    std::string rootPath = trimTrailingSeparators(directoryPath);
+    std::size_t matchCount = 0;
+    std::string source;
 
-    if (hFind != INVALID_HANDLE_VALUE) {
-        std::cout << std::endl;
+    // An index built with the index command is brought up to date, which only stats the directories to catch up. A
+    // tree without one is walked; a search never creates an index of its own.
+    std::lock_guard<std::mutex> lock(indexMutex());
+    DirectoryIndex& index = directoryIndex();
+    DirectoryIndex::RefreshStats refresh = {};
+    bool indexed = openIndexFor(rootPath) && index.update(index.rootPath(), 0, &refresh);
+    std::uint32_t directory = indexed ? index.findDirectory(rootPath) : DirectoryIndex::NO_ENTRY;
 
-        do {
-            std::cout << findData.cFileName << ((findData.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) ? " [DIR]" : "") << std::endl;
-        } while (FindNextFileA(hFind, &findData));
-        FindClose(hFind);
-        std::cout << std::endl;
+    ColoredConsole::out() << std::endl;
+    if (directory != DirectoryIndex::NO_ENTRY) {
+        std::vector<std::uint32_t> matches = NameSearch::searchIndex(index, directory, matcher);
+        for (std::uint32_t entry : matches) {
+            ColoredConsole::out() << index.pathOf(entry) << (index.isDirectory(entry) ? " [DIR]" : "") << '\n';
+        }
+        matchCount = matches.size();
+        source = "index, " + std::to_string(refresh.directoriesRead) + " directories re-read";
+    } else if (NameSearch::searchTree(rootPath, matcher, 0, [&](std::string_view path, bool isDirectory) {
+        ColoredConsole::out() << path << (isDirectory ? " [DIR]" : "") << '\n';
+        ++matchCount;
+    })) {
+        source = "directory walk";
     } else {
         ColoredConsole::setConsoleColor(ERROR_COLOR);
-        std::cout << "\nFailed to list files and directories in " << absolutePath << std::endl << std::endl;
+        ColoredConsole::out() << "Failed to search " << rootPath << std::endl << std::endl;
+        ColoredConsole::setConsoleColor(DEFAULT_COLOR);
+        return;
+    }
+
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    ColoredConsole::setConsoleColor(matchCount > 0 ? SUCCESS_COLOR : DEFAULT_COLOR);
+    ColoredConsole::out() << "\n" << matchCount << " matches in " << seconds << " s (" << source << ")." << std::endl << std::endl;
+    ColoredConsole::setConsoleColor(DEFAULT_COLOR);
+}
+
+void FileManager::findDuplicates(const std::string& directoryPath) {
+    INSTRUMENT_SCOPE("FileManager::findDuplicates");
+    DuplicateFinder::Result result = DuplicateFinder::find(trimTrailingSeparators(directoryPath));
+
+    ColoredConsole::out() << std::endl;
+    for (const DuplicateFinder::Group& group : result.groups) {
+        ColoredConsole::setConsoleColor(PATH_COLOR);
+        ColoredConsole::out() << group.paths.size() << " copies of " << formatSize(group.size) << ":" << '\n';
         ColoredConsole::setConsoleColor(DEFAULT_COLOR);
+        for (const std::string& path : group.paths) {
+            ColoredConsole::out() << "  " << path << '\n';
+        }
+    }
+
+    ColoredConsole::out() << "\nScanned " << result.filesScanned << " files in " << result.seconds << " s: " << result.sizeCandidates << " share a size, "
+        << result.partialCandidates << " share their first and last " << DuplicateFinder::PARTIAL_BLOCK_SIZE / 1024 << " KiB, "
+        << formatSize(result.bytesHashed) << " hashed";
+    if (result.unreadableFiles > 0) {
+        ColoredConsole::out() << ", " << result.unreadableFiles << " unreadable";
+    }
+    ColoredConsole::out() << "." << std::endl;
+
+    ColoredConsole::setConsoleColor(result.groups.empty() ? DEFAULT_COLOR : SUCCESS_COLOR);
+    ColoredConsole::out() << result.groups.size() << " groups of duplicates, " << formatSize(result.reclaimableBytes) << " can be reclaimed." << std::endl << std::endl;
+    ColoredConsole::setConsoleColor(DEFAULT_COLOR);
+}
+
+void FileManager::showDiskUsage(const std::string& directoryPath) {
+    INSTRUMENT_SCOPE("FileManager::showDiskUsage");
+    DiskUsage::Result result = DiskUsage::measure(trimTrailingSeparators(directoryPath));
+
+    ColoredConsole::out() << std::endl;
+    for (const DiskUsage::Subtree& subtree : result.largest) {
+        std::string size = formatSize(subtree.bytes);
+        ColoredConsole::out() << std::string(size.size() < 12 ? 12 - size.size() : 0, ' ') << size << "  " << subtree.path << '\n';
     }
+
+    ColoredConsole::setConsoleColor(result.unreadableDirectories > 0 ? ERROR_COLOR : SUCCESS_COLOR);
+    ColoredConsole::out() << "\n" << formatSize(result.bytes) << (result.apparentSizes ? " (apparent size)" : " on disk") << " in " << result.files
+        << " files and " << result.directories << " directories, measured in "
+        << result.seconds << " s";
+    if (result.unreadableDirectories > 0) {
+        ColoredConsole::out() << ". " << result.unreadableDirectories << " directories could not be read";
+    }
+    ColoredConsole::out() << "." << std::endl << std::endl;
+    ColoredConsole::setConsoleColor(DEFAULT_COLOR);
 }
 
-void FileManager::createDirectoryStructureFile(const std::string& outputFile) {
-    std::ofstream file(outputFile);
-    if (!file) {
+void FileManager::createDirectoryStructureFile(const std::string& outputFile, unsigned threadCount) {
+    INSTRUMENT_SCOPE("FileManager::createDirectoryStructureFile");
+    OutputSink file;
+    if (!file.open(outputFile)) {
         ColoredConsole::setConsoleColor(ERROR_COLOR);
-        std::cout << "\nFailed to create directory structure file." << std::endl << std::endl;
+        ColoredConsole::out() << "\nFailed to create directory structure file." << std::endl << std::endl;
         ColoredConsole::setConsoleColor(DEFAULT_COLOR);
         return;
     }
 
-    createDirectoryStructureFileHelper(currentDirectory, file, "", "");
+    writeDirectoryStructure(currentDirectory, file, threadCount);
 
-    file.close();
+    if (!file.close()) {
+        ColoredConsole::setConsoleColor(ERROR_COLOR);
+        ColoredConsole::out() << "\nFailed to write directory structure file." << std::endl << std::endl;
+        ColoredConsole::setConsoleColor(DEFAULT_COLOR);
+        return;
+    }
 
     ColoredConsole::setConsoleColor(SUCCESS_COLOR);
-    std::cout << "\nDirectory structure file created successfully." << std::endl << std::endl;
+    ColoredConsole::out() << "\nDirectory structure file created successfully." << std::endl << std::endl;
+    ColoredConsole::setConsoleColor(DEFAULT_COLOR);
+}
+
+bool FileManager::writeDirectoryStructure(const std::string& directoryPath, OutputSink& output, unsigned threadCount) {
+    INSTRUMENT_SCOPE("FileManager::writeDirectoryStructure");
+    std::string indentation;
+    std::string rootPath = trimTrailingSeparators(directoryPath);
+
+    // A warm index only needs one stat per directory to catch up; the unchanged directories are not read again.
+    std::unique_lock<std::mutex> lock(indexMutex());
+    if (openIndexFor(rootPath)) {
+        DirectoryIndex& index = directoryIndex();
+        std::string indexedRoot = index.rootPath();
+        if (index.update(indexedRoot, threadCount)) {
+            std::uint32_t directory = index.findDirectory(rootPath);
+            if (directory != DirectoryIndex::NO_ENTRY) {
+                index.walk(directory, [&](std::size_t depth, std::uint32_t entry) {
+                    std::string_view itemName = index.name(entry);
+                    writeStructureLine(output, indentation, depth, itemName.data(), itemName.size());
+                });
+                return true;
+            }
+        }
+    }
+    lock.unlock();
+
+    return DirectoryWalker::walk(rootPath, threadCount, [&](std::size_t depth, std::string_view itemName, bool) {
+        writeStructureLine(output, indentation, depth, itemName.data(), itemName.size());
+    });
+}
+
+void FileManager::updateDirectoryIndex(unsigned threadCount) {
+    INSTRUMENT_SCOPE("FileManager::updateDirectoryIndex");
+    DirectoryIndex::RefreshStats stats;
+    std::string rootPath = trimTrailingSeparators(currentDirectory);
+
+    std::lock_guard<std::mutex> lock(indexMutex());
+    if (directoryIndex().update(rootPath, threadCount, &stats)) {
+        ColoredConsole::setConsoleColor(SUCCESS_COLOR);
+        ColoredConsole::out() << "\nIndexed " << stats.entryCount << " entries of " << rootPath << " in " << stats.seconds << " s ("
+            << stats.directoriesRead << " directories read, " << stats.directoriesReused << " unchanged)." << std::endl << std::endl;
+        ColoredConsole::setConsoleColor(DEFAULT_COLOR);
+    } else {
+        ColoredConsole::setConsoleColor(ERROR_COLOR);
+        ColoredConsole::out() << "\nFailed to index " << rootPath << std::endl << std::endl;
+        ColoredConsole::setConsoleColor(DEFAULT_COLOR);
+    }
+}
+
+void FileManager::createSnapshot(const std::string& snapshotFile, unsigned threadCount) {
+    INSTRUMENT_SCOPE("FileManager::createSnapshot");
+    DirectorySnapshot::CreateResult result;
+    std::string rootPath = trimTrailingSeparators(currentDirectory);
+    if (!DirectorySnapshot::create(rootPath, getAbsolutePath(snapshotFile), threadCount, result)) {
+        ColoredConsole::setConsoleColor(ERROR_COLOR);
+        ColoredConsole::out() << "\nFailed to create snapshot " << snapshotFile << " of " << rootPath << std::endl << std::endl;
+        ColoredConsole::setConsoleColor(DEFAULT_COLOR);
+        return;
+    }
+
+    ColoredConsole::setConsoleColor(result.unreadable > 0 ? ERROR_COLOR : SUCCESS_COLOR);
+    ColoredConsole::out() << "\nSnapshot of " << result.files << " files and " << result.directories << " directories written to " << snapshotFile
+        << " in " << result.seconds << " s (" << formatSize(result.bytesHashed) << " hashed";
+    if (result.unreadable > 0) {
+        ColoredConsole::out() << ", " << result.unreadable << " entries could not be read";
+    }
+    ColoredConsole::out() << ")." << std::endl << std::endl;
     ColoredConsole::setConsoleColor(DEFAULT_COLOR);
 }
 
-void FileManager::createDirectoryStructureFileHelper(const std::string& directoryPath, std::ofstream& outputFile, const std::string& indentation, const std::string& prefix) {
-    WIN32_FIND_DATAA findData;
-    HANDLE hFind = FindFirstFileA((directoryPath + "\\*").c_str(), &findData);
-    if (hFind != INVALID_HANDLE_VALUE) {
-        do {
-            std::string itemName = findData.cFileName;
-            if (itemName != "." && itemName != "..") {
-                std::string itemPath = directoryPath + "\\" + itemName;
-                if (findData.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) {
-                    outputFile << indentation << prefix << itemName << std::endl;
-                    createDirectoryStructureFileHelper(itemPath, outputFile, indentation + "  ", "|-- ");
-                }
-                else {
-                    outputFile << indentation << prefix << itemName << std::endl;
-                }
+void FileManager::diffSnapshots(const std::string& beforeFile, const std::string& afterFile) {
+    INSTRUMENT_SCOPE("FileManager::diffSnapshots");
+    DirectorySnapshot before;
+    DirectorySnapshot after;
+    if (!before.open(beforeFile) || !after.open(afterFile)) {
+        ColoredConsole::setConsoleColor(ERROR_COLOR);
+        ColoredConsole::out() << "\nFailed to read snapshot " << (before.entryCount() == 0 ? beforeFile : afterFile) << std::endl << std::endl;
+        ColoredConsole::setConsoleColor(DEFAULT_COLOR);
+        return;
+    }
+
+    // The differences are collected into one buffer and written at once, like a listing.
+    std::string listing = "\n";
+    DirectorySnapshot::DiffResult result = DirectorySnapshot::diff(before, after,
+        [&listing](DirectorySnapshot::Change change, std::string_view path, bool isDirectory, std::size_t entries) {
+            listing += change == DirectorySnapshot::Change::ADDED ? "+ " : change == DirectorySnapshot::Change::REMOVED ? "- " : "M ";
+            listing.append(path.data(), path.size());
+            if (isDirectory) {
+                listing += FilesystemBackend::separator();
+                listing += " (" + std::to_string(entries) + " entries)";
             }
-        } while (FindNextFileA(hFind, &findData));
-        FindClose(hFind);
+            listing += '\n';
+        });
+    ColoredConsole::out().write(listing.data(), static_cast<std::streamsize>(listing.size()));
+
+    bool changed = result.added + result.removed + result.modified > 0;
+    ColoredConsole::setConsoleColor(changed ? SUCCESS_COLOR : DEFAULT_COLOR);
+    ColoredConsole::out() << (changed ? "" : "No changes. ") << result.added << " added, " << result.removed << " removed, " << result.modified
+        << " modified. Compared " << result.directoriesCompared << " directories and skipped " << result.subtreesSkipped << " unchanged subtrees in "
+        << result.seconds << " s." << std::endl << std::endl;
+    ColoredConsole::setConsoleColor(DEFAULT_COLOR);
+}
+
+void FileManager::packDirectory(const std::string& directoryPath, const std::string& archivePath, unsigned threadCount) {
+    INSTRUMENT_SCOPE("FileManager::packDirectory");
+    DirectoryArchive::PackResult result;
+    std::string rootPath = trimTrailingSeparators(directoryPath);
+    if (!DirectoryArchive::pack(rootPath, archivePath, threadCount, result)) {
+        ColoredConsole::setConsoleColor(ERROR_COLOR);
+        ColoredConsole::out() << "\nFailed to pack " << rootPath << " into " << archivePath << std::endl << std::endl;
+        ColoredConsole::setConsoleColor(DEFAULT_COLOR);
+        return;
+    }
+
+    ColoredConsole::setConsoleColor(result.unreadable > 0 ? ERROR_COLOR : SUCCESS_COLOR);
+    ColoredConsole::out() << "\nPacked " << result.files << " files and " << result.directories << " directories into " << archivePath
+        << " in " << result.seconds << " s (" << formatSize(result.bytes) << " in " << result.blocks << " blocks, compressed to "
+        << formatSize(result.compressedBytes) << ", archive size " << formatSize(result.archiveBytes);
+    if (result.skipped > 0) {
+        ColoredConsole::out() << ", " << result.skipped << " links and special files skipped";
+    }
+    if (result.unreadable > 0) {
+        ColoredConsole::out() << ", " << result.unreadable << " entries could not be read";
+    }
+    ColoredConsole::out() << ")." << std::endl << std::endl;
+    ColoredConsole::setConsoleColor(DEFAULT_COLOR);
+}
+
+void FileManager::unpackArchive(const std::string& archivePath, const std::string& destination, const std::string& entryPath) {
+    INSTRUMENT_SCOPE("FileManager::unpackArchive");
+    DirectoryArchive::UnpackResult result;
+    if (!DirectoryArchive::unpack(archivePath, destination, entryPath, 0, result)) {
+        ColoredConsole::setConsoleColor(ERROR_COLOR);
+        if (entryPath.empty()) {
+            ColoredConsole::out() << "\nFailed to read archive " << archivePath << std::endl << std::endl;
+        } else {
+            ColoredConsole::out() << "\nFailed to read " << entryPath << " from archive " << archivePath << std::endl << std::endl;
+        }
+        ColoredConsole::setConsoleColor(DEFAULT_COLOR);
+        return;
+    }
+
+    if (result.failures == 0) {
+        ColoredConsole::setConsoleColor(SUCCESS_COLOR);
+        ColoredConsole::out() << "\nUnpacked " << result.files << " files and " << result.directories << " directories into " << destination << ": "
+            << formatSize(result.bytes) << " in " << result.seconds << " s." << std::endl << std::endl;
+        ColoredConsole::setConsoleColor(DEFAULT_COLOR);
+    } else {
+        ColoredConsole::setConsoleColor(ERROR_COLOR);
+        ColoredConsole::out() << "\nFailed to unpack " << result.failures << " item(s) into " << destination << ", first: " << result.firstFailure
+            << " (" << result.files << " files unpacked)" << std::endl << std::endl;
+        ColoredConsole::setConsoleColor(DEFAULT_COLOR);
     }
 }
 
-void FileManager::setFileOrDirectoryPermissions(const std::string& name, const DWORD& permissions) {
-    if (SetFileAttributesA(name.c_str(), permissions)) {
+void FileManager::setFileOrDirectoryPermissions(const std::string& name, FilesystemBackend::Access access) {
+    INSTRUMENT_SCOPE("FileManager::setFileOrDirectoryPermissions");
+    FilesystemBackend::Metadata metadata;
+    if (FilesystemBackend::getMetadata(name, metadata) &&
+        FilesystemBackend::setPermissions(name, FilesystemBackend::permissionsForAccess(metadata.attributes, access)) == FilesystemBackend::Status::OK) {
         ColoredConsole::setConsoleColor(SUCCESS_COLOR);
-        std::cout << "\nPermissions set successfully for " << name << std::endl << std::endl;
+        ColoredConsole::out() << "\nPermissions set successfully for " << name << std::endl << std::endl;
         ColoredConsole::setConsoleColor(DEFAULT_COLOR);
     }
     else {
         ColoredConsole::setConsoleColor(ERROR_COLOR);
-        std::cout << "\nFailed to set permissions for " << name << std::endl << std::endl;
+        ColoredConsole::out() << "\nFailed to set permissions for " << name << std::endl << std::endl;
+        ColoredConsole::setConsoleColor(DEFAULT_COLOR);
+    }
+}
+
+void FileManager::setPermissionsMatching(const std::string& pattern, FilesystemBackend::Access access) {
+    INSTRUMENT_SCOPE("FileManager::setPermissionsMatching");
+    std::vector<BulkOperation::Item> items;
+    if (!expandPattern(pattern, items)) {
+        return;
+    }
+
+    BulkOperation::Result result = BulkOperation::setPermissions(items, access);
+    printBulkResult(result, "Set permissions of", pattern);
+}
+
+void FileManager::setPermissionsRecursively(const std::string& path, FilesystemBackend::Access access) {
+    INSTRUMENT_SCOPE("FileManager::setPermissionsRecursively");
+    TreePermissions::Result result = TreePermissions::apply(path, access);
+    if (result.failures == 0) {
+        ColoredConsole::setConsoleColor(SUCCESS_COLOR);
+        ColoredConsole::out() << "\nPermissions set for " << path << ": " << result.changed << " entries changed, " << result.unchanged
+            << " already matched";
+        if (result.skipped > 0) {
+            ColoredConsole::out() << ", " << result.skipped << " links skipped";
+        }
+        ColoredConsole::out() << " in " << result.seconds << " s." << std::endl << std::endl;
+        ColoredConsole::setConsoleColor(DEFAULT_COLOR);
+    } else {
+        ColoredConsole::setConsoleColor(ERROR_COLOR);
+        ColoredConsole::out() << "\nFailed to set permissions of " << result.failures << " item(s) under " << path << ", first: " << result.firstFailure
+            << " (" << result.changed << " entries changed)" << std::endl << std::endl;
         ColoredConsole::setConsoleColor(DEFAULT_COLOR);
     }
 }
 
+std::string FileManager::formatSize(std::uint64_t bytes) {
+    const char* units[] = { "B", "KiB", "MiB", "GiB", "TiB", "PiB" };
+    double value = static_cast<double>(bytes);
+    int unit = 0;
+    while (value >= 1024 && unit < 5) {
+        value /= 1024;
+        ++unit;
+    }
+
+    char text[32];
+    std::snprintf(text, sizeof(text), unit == 0 ? "%.0f %s" : "%.1f %s", value, units[unit]);
+    return text;
+}
+
 void FileManager::openFileExplorer(const std::string& directoryPath) {
+    INSTRUMENT_SCOPE("FileManager::openFileExplorer");
+#ifdef _WIN32
     int wideCharLen = MultiByteToWideChar(CP_UTF8, 0, directoryPath.c_str(), -1, nullptr, 0);
     std::wstring wideDirectoryPath(wideCharLen, L'\0');
     MultiByteToWideChar(CP_UTF8, 0, directoryPath.c_str(), -1, &wideDirectoryPath[0], wideCharLen);
@@ -272,7 +1160,23 @@ void FileManager::openFileExplorer(const std::string& directoryPath) {
 
     if (ShellExecuteEx(&shellInfo) == FALSE) {
         ColoredConsole::setConsoleColor(ERROR_COLOR);
-        std::cout << "\nFailed to open File Explorer." << std::endl << std::endl;
+        ColoredConsole::out() << "\nFailed to open File Explorer." << std::endl << std::endl;
+        ColoredConsole::setConsoleColor(DEFAULT_COLOR);
+    }
+#else
+    // The browser is started in a grandchild, so it is reparented to init and never left as a zombie of this process.
+    pid_t child = fork();
+    if (child == 0) {
+        if (fork() == 0) {
+            execlp("xdg-open", "xdg-open", directoryPath.c_str(), static_cast<char*>(nullptr));
+            _exit(127);
+        }
+        _exit(0);
+    }
+    if (child < 0 || waitpid(child, nullptr, 0) != child) {
+        ColoredConsole::setConsoleColor(ERROR_COLOR);
+        ColoredConsole::out() << "\nFailed to open the file browser." << std::endl << std::endl;
         ColoredConsole::setConsoleColor(DEFAULT_COLOR);
     }
+#endif
 }
\ No newline at end of file
@@ -0,0 +1,348 @@
+#include "Filesystem_Backend.h"
+#include "Instrumentation.h"
+
+#include <cerrno>
+#include <cstdio>
+#include <vector>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#ifdef __linux__
+#include <sys/syscall.h>
+#endif
+#endif
+
+#if defined(__linux__) && !defined(RENAME_NOREPLACE)
+#define RENAME_NOREPLACE (1 << 0)
+#endif
+
+namespace {
+#ifdef _WIN32
+    FilesystemBackend::Status lastStatus() {
+        return FilesystemBackend::statusOfError(static_cast<int>(GetLastError()));
+    }
+
+    FilesystemBackend::Status statusOf(BOOL succeeded) {
+        return succeeded ? FilesystemBackend::Status::OK : lastStatus();
+    }
+#else
+    FilesystemBackend::Status lastStatus() {
+        return FilesystemBackend::statusOfError(errno);
+    }
+
+    FilesystemBackend::Status statusOf(int result) {
+        return result == 0 ? FilesystemBackend::Status::OK : lastStatus();
+    }
+#endif
+}
+
+#ifdef _WIN32
+bool FilesystemBackend::getMetadata(const std::string& path, Metadata& metadata) {
+    WIN32_FILE_ATTRIBUTE_DATA data;
+    INSTRUMENT_COUNT(SYSTEM_CALLS, 1);
+    if (!GetFileAttributesExA(path.c_str(), GetFileExInfoStandard, &data)) {
+        return false;
+    }
+    // FILETIME counts 100 ns intervals since 1601-01-01.
+    std::int64_t ticks = (static_cast<std::int64_t>(data.ftLastWriteTime.dwHighDateTime) << 32) | data.ftLastWriteTime.dwLowDateTime;
+    metadata.isDirectory = (data.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) != 0;
+    metadata.isLink = (data.dwFileAttributes & FILE_ATTRIBUTE_REPARSE_POINT) != 0;
+    metadata.size = (static_cast<std::uint64_t>(data.nFileSizeHigh) << 32) | data.nFileSizeLow;
+    metadata.modificationTime = (ticks - 116444736000000000LL) * 100;
+    metadata.attributes = data.dwFileAttributes;
+    return true;
+}
+
+bool FilesystemBackend::isDirectory(const std::string& path) {
+    INSTRUMENT_COUNT(SYSTEM_CALLS, 1);
+    DWORD attributes = GetFileAttributesA(path.c_str());
+    return attributes != INVALID_FILE_ATTRIBUTES && (attributes & FILE_ATTRIBUTE_DIRECTORY) != 0;
+}
+
+bool FilesystemBackend::exists(const std::string& path) {
+    INSTRUMENT_COUNT(SYSTEM_CALLS, 1);
+    return GetFileAttributesA(path.c_str()) != INVALID_FILE_ATTRIBUTES;
+}
+
+FilesystemBackend::Status FilesystemBackend::createFile(const std::string& path) {
+    INSTRUMENT_COUNT(SYSTEM_CALLS, 2);
+    HANDLE hFile = CreateFileA(path.c_str(), GENERIC_READ | GENERIC_WRITE, 0, NULL, CREATE_NEW, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (hFile == INVALID_HANDLE_VALUE) {
+        return lastStatus();
+    }
+    CloseHandle(hFile);
+    return Status::OK;
+}
+
+FilesystemBackend::Status FilesystemBackend::createDirectory(const std::string& path) {
+    INSTRUMENT_COUNT(SYSTEM_CALLS, 1);
+    return statusOf(CreateDirectoryA(path.c_str(), NULL));
+}
+
+FilesystemBackend::Status FilesystemBackend::rename(const std::string& source, const std::string& target) {
+    // Without MOVEFILE_REPLACE_EXISTING an existing target fails with ERROR_ALREADY_EXISTS, atomically.
+    INSTRUMENT_COUNT(SYSTEM_CALLS, 1);
+    return statusOf(MoveFileA(source.c_str(), target.c_str()));
+}
+
+FilesystemBackend::Status FilesystemBackend::removeFile(const std::string& path) {
+    INSTRUMENT_COUNT(SYSTEM_CALLS, 1);
+    return statusOf(DeleteFileA(path.c_str()));
+}
+
+FilesystemBackend::Status FilesystemBackend::removeDirectory(const std::string& path) {
+    INSTRUMENT_COUNT(SYSTEM_CALLS, 1);
+    return statusOf(RemoveDirectoryA(path.c_str()));
+}
+
+FilesystemBackend::Status FilesystemBackend::statusOfError(int error) {
+    switch (static_cast<DWORD>(error)) {
+    case ERROR_FILE_NOT_FOUND:
+    case ERROR_PATH_NOT_FOUND:
+        return Status::NOT_FOUND;
+    case ERROR_FILE_EXISTS:
+    case ERROR_ALREADY_EXISTS:
+        return Status::ALREADY_EXISTS;
+    case ERROR_NOT_SAME_DEVICE:
+        return Status::CROSS_DEVICE;
+    case ERROR_DIR_NOT_EMPTY:
+        return Status::NOT_EMPTY;
+    case ERROR_ACCESS_DENIED:
+    case ERROR_SHARING_VIOLATION:
+        return Status::ACCESS_DENIED;
+    default:
+        return Status::FAILED;
+    }
+}
+
+FilesystemBackend::Status FilesystemBackend::setPermissions(const std::string& path, std::uint32_t attributes) {
+    INSTRUMENT_COUNT(SYSTEM_CALLS, 1);
+    return statusOf(SetFileAttributesA(path.c_str(), attributes));
+}
+
+std::uint32_t FilesystemBackend::permissionsForAccess(std::uint32_t attributes, Access access) {
+    // SetFileAttributesA rejects the directory flag, which GetFileAttributesA reports for directories.
+    std::uint32_t current = permissionsOf(attributes);
+    // The read-only attribute of a directory only marks it as customized in Explorer, so it is left alone.
+    if ((attributes & FILE_ATTRIBUTE_DIRECTORY) != 0) {
+        return current;
+    }
+    bool readOnly = access.kind == Access::Kind::READ || (access.kind == Access::Kind::MODE && (access.mode & 0200) == 0);
+    if (readOnly) {
+        return current | FILE_ATTRIBUTE_READONLY;
+    }
+    return current & ~static_cast<std::uint32_t>(FILE_ATTRIBUTE_READONLY);
+}
+
+std::uint32_t FilesystemBackend::permissionsOf(std::uint32_t attributes) {
+    return attributes & ~static_cast<std::uint32_t>(FILE_ATTRIBUTE_DIRECTORY);
+}
+
+bool FilesystemBackend::isLink(std::uint32_t attributes) {
+    return (attributes & FILE_ATTRIBUTE_REPARSE_POINT) != 0;
+}
+
+bool FilesystemBackend::getCurrentDirectory(std::string& path) {
+    char currentDir[MAX_PATH];
+    if (GetCurrentDirectoryA(MAX_PATH, currentDir) == 0) {
+        return false;
+    }
+    path = currentDir;
+    return true;
+}
+
+bool FilesystemBackend::setCurrentDirectory(const std::string& path) {
+    return SetCurrentDirectoryA(path.c_str()) != 0;
+}
+
+char FilesystemBackend::separator() {
+    return '\\';
+}
+
+bool FilesystemBackend::isSeparator(char c) {
+    return c == '\\' || c == '/';
+}
+#else
+bool FilesystemBackend::getMetadata(const std::string& path, Metadata& metadata) {
+    INSTRUMENT_COUNT(SYSTEM_CALLS, 1);
+#if defined(__linux__) && defined(STATX_TYPE)
+    // statx asks for the four fields the tool uses, so network filesystems need not fetch the rest.
+    struct statx status;
+    if (statx(AT_FDCWD, path.c_str(), AT_SYMLINK_NOFOLLOW | AT_STATX_DONT_SYNC, STATX_TYPE | STATX_MODE | STATX_SIZE | STATX_MTIME, &status) != 0) {
+        return false;
+    }
+    metadata.isDirectory = S_ISDIR(status.stx_mode);
+    metadata.isLink = S_ISLNK(status.stx_mode);
+    metadata.size = status.stx_size;
+    metadata.modificationTime = static_cast<std::int64_t>(status.stx_mtime.tv_sec) * 1000000000LL + status.stx_mtime.tv_nsec;
+    metadata.attributes = status.stx_mode;
+#else
+    struct stat status;
+    if (lstat(path.c_str(), &status) != 0) {
+        return false;
+    }
+    metadata.isDirectory = S_ISDIR(status.st_mode);
+    metadata.isLink = S_ISLNK(status.st_mode);
+    metadata.size = static_cast<std::uint64_t>(status.st_size);
+    metadata.modificationTime = static_cast<std::int64_t>(status.st_mtim.tv_sec) * 1000000000LL + status.st_mtim.tv_nsec;
+    metadata.attributes = status.st_mode;
+#endif
+    return true;
+}
+
+bool FilesystemBackend::isDirectory(const std::string& path) {
+    struct stat status;
+    INSTRUMENT_COUNT(SYSTEM_CALLS, 1);
+    return ::stat(path.c_str(), &status) == 0 && S_ISDIR(status.st_mode);
+}
+
+bool FilesystemBackend::exists(const std::string& path) {
+    struct stat status;
+    INSTRUMENT_COUNT(SYSTEM_CALLS, 1);
+    return lstat(path.c_str(), &status) == 0;
+}
+
+FilesystemBackend::Status FilesystemBackend::createFile(const std::string& path) {
+    INSTRUMENT_COUNT(SYSTEM_CALLS, 2);
+    int fd = open(path.c_str(), O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, 0666);
+    if (fd < 0) {
+        return lastStatus();
+    }
+    close(fd);
+    return Status::OK;
+}
+
+FilesystemBackend::Status FilesystemBackend::createDirectory(const std::string& path) {
+    INSTRUMENT_COUNT(SYSTEM_CALLS, 1);
+    return statusOf(mkdir(path.c_str(), 0777));
+}
+
+FilesystemBackend::Status FilesystemBackend::rename(const std::string& source, const std::string& target) {
+    INSTRUMENT_COUNT(SYSTEM_CALLS, 1);
+#if defined(__linux__) && defined(SYS_renameat2)
+    if (syscall(SYS_renameat2, AT_FDCWD, source.c_str(), AT_FDCWD, target.c_str(), RENAME_NOREPLACE) == 0) {
+        return Status::OK;
+    }
+    // Kernels before 3.15 and some filesystems do not support the flag; they fall back to the two-step check below.
+    if (errno != EINVAL && errno != ENOSYS) {
+        return lastStatus();
+    }
+#endif
+    if (exists(target)) {
+        return Status::ALREADY_EXISTS;
+    }
+    INSTRUMENT_COUNT(SYSTEM_CALLS, 1);
+    return statusOf(std::rename(source.c_str(), target.c_str()));
+}
+
+FilesystemBackend::Status FilesystemBackend::removeFile(const std::string& path) {
+    INSTRUMENT_COUNT(SYSTEM_CALLS, 1);
+    return statusOf(unlink(path.c_str()));
+}
+
+FilesystemBackend::Status FilesystemBackend::removeDirectory(const std::string& path) {
+    INSTRUMENT_COUNT(SYSTEM_CALLS, 1);
+    if (rmdir(path.c_str()) == 0) {
+        return Status::OK;
+    }
+    // POSIX allows EEXIST in place of ENOTEMPTY for a directory with entries.
+    return errno == EEXIST ? Status::NOT_EMPTY : lastStatus();
+}
+
+FilesystemBackend::Status FilesystemBackend::statusOfError(int error) {
+    switch (error) {
+    case ENOENT:
+    case ENOTDIR:
+        return Status::NOT_FOUND;
+    case EEXIST:
+        return Status::ALREADY_EXISTS;
+    case EXDEV:
+        return Status::CROSS_DEVICE;
+    case ENOTEMPTY:
+        return Status::NOT_EMPTY;
+    case EACCES:
+    case EPERM:
+    case EROFS:
+        return Status::ACCESS_DENIED;
+    default:
+        return Status::FAILED;
+    }
+}
+
+FilesystemBackend::Status FilesystemBackend::setPermissions(const std::string& path, std::uint32_t attributes) {
+    INSTRUMENT_COUNT(SYSTEM_CALLS, 1);
+    return statusOf(chmod(path.c_str(), static_cast<mode_t>(attributes & 07777)));
+}
+
+std::uint32_t FilesystemBackend::permissionsForAccess(std::uint32_t attributes, Access access) {
+    std::uint32_t mode = attributes & 07777;
+    switch (access.kind) {
+    case Access::Kind::READ:
+        return mode & ~static_cast<std::uint32_t>(S_IWUSR | S_IWGRP | S_IWOTH);
+    case Access::Kind::WRITE:
+        return mode | S_IWUSR;
+    case Access::Kind::MODIFY:
+        // The group's write bit sits one position to the right of its read bit. Others are never given write access.
+        return mode | S_IWUSR | ((mode & S_IRGRP) >> 1);
+    default:
+        return access.mode & 07777;
+    }
+}
+
+std::uint32_t FilesystemBackend::permissionsOf(std::uint32_t attributes) {
+    return attributes & 07777;
+}
+
+bool FilesystemBackend::isLink(std::uint32_t attributes) {
+    return S_ISLNK(attributes);
+}
+
+bool FilesystemBackend::getCurrentDirectory(std::string& path) {
+    std::vector<char> buffer(256);
+    while (getcwd(buffer.data(), buffer.size()) == nullptr) {
+        if (errno != ERANGE) {
+            return false;
+        }
+        buffer.resize(buffer.size() * 2);
+    }
+    path = buffer.data();
+    return true;
+}
+
+bool FilesystemBackend::setCurrentDirectory(const std::string& path) {
+    return chdir(path.c_str()) == 0;
+}
+
+char FilesystemBackend::separator() {
+    return '/';
+}
+
+bool FilesystemBackend::isSeparator(char c) {
+    return c == '/';
+}
+#endif
+
+bool FilesystemBackend::parseAccess(const std::string& text, Access& access) {
+    if (text == "read") {
+        access = { Access::Kind::READ, 0 };
+        return true;
+    }
+    if (text == "write") {
+        access = { Access::Kind::WRITE, 0 };
+        return true;
+    }
+    if (text == "modify") {
+        access = { Access::Kind::MODIFY, 0 };
+        return true;
+    }
+    // An octal mode of up to four digits, as chmod takes it.
+    if (text.empty() || text.size() > 4 || text.find_first_not_of("01234567") != std::string::npos) {
+        return false;
+    }
+    access = { Access::Kind::MODE, static_cast<std::uint32_t>(std::stoul(text, nullptr, 8)) };
+    return true;
+}
\ No newline at end of file
@@ -0,0 +1,392 @@
+#include "Instrumentation.h"
+#include "Output_Sink.h"
+
+#include <cstdio>
+#include <memory>
+#include <mutex>
+
+namespace {
+    // Only the owning thread writes these, so a relaxed load and store is enough and avoids a locked instruction.
+    void bump(std::atomic<std::uint64_t>& value, std::uint64_t amount) {
+        value.store(value.load(std::memory_order_relaxed) + amount, std::memory_order_relaxed);
+    }
+
+    struct Histogram {
+        std::atomic<std::uint64_t> buckets[Instrumentation::BUCKET_COUNT];
+        std::atomic<std::uint64_t> count;
+        std::atomic<std::uint64_t> totalNanoseconds;
+
+        Histogram() : count(0), totalNanoseconds(0) {
+            for (std::atomic<std::uint64_t>& bucket : buckets) {
+                bucket.store(0, std::memory_order_relaxed);
+            }
+        }
+    };
+
+    // A histogram merged from several threads, or a snapshot of one taken at a reset.
+    struct MergedHistogram {
+        std::uint64_t buckets[Instrumentation::BUCKET_COUNT] = {};
+        std::uint64_t count = 0;
+        std::uint64_t totalNanoseconds = 0;
+
+        void add(const Histogram& histogram) {
+            for (std::size_t bucket = 0; bucket < Instrumentation::BUCKET_COUNT; ++bucket) {
+                buckets[bucket] += histogram.buckets[bucket].load(std::memory_order_relaxed);
+            }
+            count += histogram.count.load(std::memory_order_relaxed);
+            totalNanoseconds += histogram.totalNanoseconds.load(std::memory_order_relaxed);
+        }
+
+        void add(const MergedHistogram& histogram) {
+            for (std::size_t bucket = 0; bucket < Instrumentation::BUCKET_COUNT; ++bucket) {
+                buckets[bucket] += histogram.buckets[bucket];
+            }
+            count += histogram.count;
+            totalNanoseconds += histogram.totalNanoseconds;
+        }
+    };
+
+    struct TraceEvent {
+        std::size_t scope;
+        std::uint32_t thread;
+        std::int64_t start;
+        std::int64_t duration;
+    };
+
+    struct ThreadState;
+
+    // Never destroyed, so threads that exit during static destruction can still fold their state into it.
+    struct Registry {
+        std::mutex mutex;
+        std::vector<ThreadState*> threads;
+        std::uint32_t nextThread = 1;
+
+        std::atomic<std::size_t> scopeCount{0};
+        const char* scopeNames[Instrumentation::MAX_SCOPES] = {};
+
+        // Totals of exited threads, and the totals at the last reset.
+        std::uint64_t retiredCounters[Instrumentation::COUNTER_COUNT] = {};
+        std::unique_ptr<MergedHistogram> retiredHistograms[Instrumentation::MAX_SCOPES];
+        std::uint64_t baselineCounters[Instrumentation::COUNTER_COUNT] = {};
+        std::unique_ptr<MergedHistogram> baselineHistograms[Instrumentation::MAX_SCOPES];
+
+        std::atomic<bool> tracing{false};
+        std::chrono::steady_clock::time_point traceStart;
+        std::string tracePath;
+        std::atomic<std::size_t> traceEvents{0};
+        std::vector<TraceEvent> retiredEvents;
+    };
+
+    Registry& registry() {
+        static Registry* instance = new Registry();
+        return *instance;
+    }
+
+    struct ThreadState {
+        std::atomic<std::uint64_t> counters[Instrumentation::COUNTER_COUNT];
+        std::atomic<Histogram*> histograms[Instrumentation::MAX_SCOPES];
+        std::uint32_t thread;
+        std::mutex eventsMutex;
+        std::vector<TraceEvent> events;
+
+        ThreadState() {
+            for (std::atomic<std::uint64_t>& counter : counters) {
+                counter.store(0, std::memory_order_relaxed);
+            }
+            for (std::atomic<Histogram*>& histogram : histograms) {
+                histogram.store(nullptr, std::memory_order_relaxed);
+            }
+            Registry& state = registry();
+            std::lock_guard<std::mutex> lock(state.mutex);
+            thread = state.nextThread++;
+            state.threads.push_back(this);
+        }
+
+        ~ThreadState() {
+            Registry& state = registry();
+            std::lock_guard<std::mutex> lock(state.mutex);
+            for (std::size_t counter = 0; counter < Instrumentation::COUNTER_COUNT; ++counter) {
+                state.retiredCounters[counter] += counters[counter].load(std::memory_order_relaxed);
+            }
+            for (std::size_t scope = 0; scope < Instrumentation::MAX_SCOPES; ++scope) {
+                std::unique_ptr<Histogram> histogram(histograms[scope].load(std::memory_order_acquire));
+                if (histogram) {
+                    if (!state.retiredHistograms[scope]) {
+                        state.retiredHistograms[scope] = std::make_unique<MergedHistogram>();
+                    }
+                    state.retiredHistograms[scope]->add(*histogram);
+                }
+            }
+            {
+                std::lock_guard<std::mutex> eventsLock(eventsMutex);
+                state.retiredEvents.insert(state.retiredEvents.end(), events.begin(), events.end());
+            }
+            for (std::size_t index = 0; index < state.threads.size(); ++index) {
+                if (state.threads[index] == this) {
+                    state.threads[index] = state.threads.back();
+                    state.threads.pop_back();
+                    break;
+                }
+            }
+        }
+    };
+
+    ThreadState& localState() {
+        thread_local ThreadState state;
+        return state;
+    }
+
+    // Requires the registry mutex.
+    std::uint64_t mergeCounter(Registry& state, std::size_t counter) {
+        std::uint64_t total = state.retiredCounters[counter];
+        for (ThreadState* thread : state.threads) {
+            total += thread->counters[counter].load(std::memory_order_relaxed);
+        }
+        return total;
+    }
+
+    // Requires the registry mutex.
+    MergedHistogram mergeHistogram(Registry& state, std::size_t scope) {
+        MergedHistogram merged;
+        if (state.retiredHistograms[scope]) {
+            merged.add(*state.retiredHistograms[scope]);
+        }
+        for (ThreadState* thread : state.threads) {
+            Histogram* histogram = thread->histograms[scope].load(std::memory_order_acquire);
+            if (histogram != nullptr) {
+                merged.add(*histogram);
+            }
+        }
+        return merged;
+    }
+
+    std::uint64_t percentile(const MergedHistogram& histogram, std::uint64_t perMille) {
+        std::uint64_t rank = (histogram.count * perMille + 999) / 1000;
+        std::uint64_t seen = 0;
+        for (std::size_t bucket = 0; bucket < Instrumentation::BUCKET_COUNT; ++bucket) {
+            seen += histogram.buckets[bucket];
+            if (seen >= rank && seen > 0) {
+                return Instrumentation::valueOf(bucket);
+            }
+        }
+        return 0;
+    }
+
+    void writeJsonString(OutputSink& output, const char* text) {
+        output.put('"');
+        for (; *text != '\0'; ++text) {
+            if (*text == '"' || *text == '\\') {
+                output.put('\\');
+            }
+            output.put(*text);
+        }
+        output.put('"');
+    }
+
+    // Trace timestamps are microseconds with nanosecond decimals.
+    void writeMicroseconds(OutputSink& output, std::int64_t nanoseconds) {
+        char text[32];
+        int length = std::snprintf(text, sizeof(text), "%lld.%03lld", static_cast<long long>(nanoseconds / 1000), static_cast<long long>(nanoseconds % 1000));
+        output.write(text, static_cast<std::size_t>(length));
+    }
+}
+
+const std::size_t Instrumentation::COUNTER_COUNT;
+const std::size_t Instrumentation::MAX_SCOPES;
+const unsigned Instrumentation::SUB_BUCKET_BITS;
+const std::size_t Instrumentation::BUCKET_COUNT;
+const std::size_t Instrumentation::MAX_TRACE_EVENTS;
+
+std::size_t Instrumentation::registerScope(const char* name) {
+    Registry& state = registry();
+    std::lock_guard<std::mutex> lock(state.mutex);
+    std::size_t count = state.scopeCount.load(std::memory_order_relaxed);
+    for (std::size_t scope = 0; scope < count; ++scope) {
+        if (std::string(state.scopeNames[scope]) == name) {
+            return scope;
+        }
+    }
+    if (count == MAX_SCOPES) {
+        return MAX_SCOPES;
+    }
+    state.scopeNames[count] = name;
+    state.scopeCount.store(count + 1, std::memory_order_release);
+    return count;
+}
+
+void Instrumentation::add(Counter counter, std::uint64_t amount) {
+    bump(localState().counters[static_cast<std::size_t>(counter)], amount);
+}
+
+void Instrumentation::record(std::size_t scopeId, std::chrono::steady_clock::time_point start, std::chrono::steady_clock::time_point end) {
+    if (scopeId >= MAX_SCOPES) {
+        return;
+    }
+    ThreadState& thread = localState();
+    Histogram* histogram = thread.histograms[scopeId].load(std::memory_order_relaxed);
+    if (histogram == nullptr) {
+        histogram = new Histogram();
+        thread.histograms[scopeId].store(histogram, std::memory_order_release);
+    }
+
+    std::int64_t duration = std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count();
+    std::uint64_t nanoseconds = duration > 0 ? static_cast<std::uint64_t>(duration) : 0;
+    bump(histogram->buckets[bucketOf(nanoseconds)], 1);
+    bump(histogram->count, 1);
+    bump(histogram->totalNanoseconds, nanoseconds);
+
+    Registry& state = registry();
+    if (state.tracing.load(std::memory_order_acquire) && start >= state.traceStart) {
+        if (state.traceEvents.fetch_add(1, std::memory_order_relaxed) < MAX_TRACE_EVENTS) {
+            std::int64_t offset = std::chrono::duration_cast<std::chrono::nanoseconds>(start - state.traceStart).count();
+            std::lock_guard<std::mutex> lock(thread.eventsMutex);
+            thread.events.push_back({ scopeId, thread.thread, offset, duration });
+        }
+    }
+}
+
+std::vector<Instrumentation::Summary> Instrumentation::summarize() {
+    Registry& state = registry();
+    std::lock_guard<std::mutex> lock(state.mutex);
+    std::vector<Summary> summaries;
+    std::size_t count = state.scopeCount.load(std::memory_order_relaxed);
+    for (std::size_t scope = 0; scope < count; ++scope) {
+        MergedHistogram merged = mergeHistogram(state, scope);
+        if (state.baselineHistograms[scope]) {
+            const MergedHistogram& baseline = *state.baselineHistograms[scope];
+            for (std::size_t bucket = 0; bucket < BUCKET_COUNT; ++bucket) {
+                merged.buckets[bucket] -= baseline.buckets[bucket];
+            }
+            merged.count -= baseline.count;
+            merged.totalNanoseconds -= baseline.totalNanoseconds;
+        }
+        if (merged.count == 0) {
+            continue;
+        }
+
+        std::uint64_t max = 0;
+        for (std::size_t bucket = BUCKET_COUNT; bucket > 0; --bucket) {
+            if (merged.buckets[bucket - 1] != 0) {
+                max = valueOf(bucket - 1);
+                break;
+            }
+        }
+        summaries.push_back({ state.scopeNames[scope], merged.count, merged.totalNanoseconds, percentile(merged, 500), percentile(merged, 900),
+            percentile(merged, 990), max });
+    }
+    return summaries;
+}
+
+std::uint64_t Instrumentation::total(Counter counter) {
+    Registry& state = registry();
+    std::lock_guard<std::mutex> lock(state.mutex);
+    std::size_t index = static_cast<std::size_t>(counter);
+    return mergeCounter(state, index) - state.baselineCounters[index];
+}
+
+const char* Instrumentation::counterName(Counter counter) {
+    switch (counter) {
+    case Counter::SYSTEM_CALLS:
+        return "System calls";
+    case Counter::BYTES_READ:
+        return "Bytes read";
+    case Counter::BYTES_WRITTEN:
+        return "Bytes written";
+    case Counter::ENTRIES_VISITED:
+        return "Entries visited";
+    }
+    return "";
+}
+
+void Instrumentation::reset() {
+    Registry& state = registry();
+    std::lock_guard<std::mutex> lock(state.mutex);
+    for (std::size_t counter = 0; counter < COUNTER_COUNT; ++counter) {
+        state.baselineCounters[counter] = mergeCounter(state, counter);
+    }
+    std::size_t count = state.scopeCount.load(std::memory_order_relaxed);
+    for (std::size_t scope = 0; scope < count; ++scope) {
+        state.baselineHistograms[scope] = std::make_unique<MergedHistogram>(mergeHistogram(state, scope));
+    }
+}
+
+void Instrumentation::startTrace(const std::string& path) {
+    Registry& state = registry();
+    std::lock_guard<std::mutex> lock(state.mutex);
+    state.tracePath = path;
+    state.traceStart = std::chrono::steady_clock::now();
+    state.traceEvents.store(0, std::memory_order_relaxed);
+    state.tracing.store(true, std::memory_order_release);
+}
+
+bool Instrumentation::stopTrace() {
+    Registry& state = registry();
+    if (!state.tracing.exchange(false, std::memory_order_acq_rel)) {
+        return true;
+    }
+
+    std::vector<TraceEvent> events;
+    std::vector<const char*> names;
+    std::string path;
+    {
+        std::lock_guard<std::mutex> lock(state.mutex);
+        events.swap(state.retiredEvents);
+        for (ThreadState* thread : state.threads) {
+            std::lock_guard<std::mutex> eventsLock(thread->eventsMutex);
+            events.insert(events.end(), thread->events.begin(), thread->events.end());
+            thread->events.clear();
+        }
+        names.assign(state.scopeNames, state.scopeNames + state.scopeCount.load(std::memory_order_relaxed));
+        path = state.tracePath;
+    }
+
+    OutputSink output;
+    if (!output.open(path)) {
+        return false;
+    }
+    output.write("{\"traceEvents\":[\n");
+    for (std::size_t index = 0; index < events.size(); ++index) {
+        const TraceEvent& event = events[index];
+        output.write(index == 0 ? "{\"name\":" : ",\n{\"name\":");
+        writeJsonString(output, names[event.scope]);
+        output.write(",\"ph\":\"X\",\"ts\":");
+        writeMicroseconds(output, event.start);
+        output.write(",\"dur\":");
+        writeMicroseconds(output, event.duration);
+        output.write(",\"pid\":1,\"tid\":" + std::to_string(event.thread) + "}");
+    }
+    std::size_t recorded = state.traceEvents.load(std::memory_order_relaxed);
+    std::size_t dropped = recorded > MAX_TRACE_EVENTS ? recorded - MAX_TRACE_EVENTS : 0;
+    output.write("\n],\"displayTimeUnit\":\"ms\",\"otherData\":{\"droppedEvents\":" + std::to_string(dropped) + "}}\n");
+    return output.close();
+}
+
+bool Instrumentation::isEnabled() {
+    return INSTRUMENTATION_ENABLED != 0;
+}
+
+std::size_t Instrumentation::bucketOf(std::uint64_t value) {
+    const std::uint64_t subBuckets = std::uint64_t(1) << SUB_BUCKET_BITS;
+    if (value < subBuckets) {
+        return static_cast<std::size_t>(value);
+    }
+    unsigned highestBit = 0;
+    for (unsigned step = 32; step > 0; step /= 2) {
+        if ((value >> (highestBit + step)) != 0) {
+            highestBit += step;
+        }
+    }
+    unsigned shift = highestBit - (SUB_BUCKET_BITS - 1);
+    std::uint64_t top = value >> shift;
+    return static_cast<std::size_t>((shift + 1) * (subBuckets / 2) + (top - subBuckets / 2));
+}
+
+std::uint64_t Instrumentation::valueOf(std::size_t bucket) {
+    const std::size_t halfBuckets = std::size_t(1) << (SUB_BUCKET_BITS - 1);
+    if (bucket < 2 * halfBuckets) {
+        return bucket;
+    }
+    unsigned shift = static_cast<unsigned>(bucket / halfBuckets - 1);
+    std::uint64_t lower = static_cast<std::uint64_t>(halfBuckets + bucket % halfBuckets) << shift;
+    return lower + ((std::uint64_t(1) << shift) >> 1);
+}
\ No newline at end of file
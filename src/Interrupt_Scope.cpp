@@ -0,0 +1,67 @@
+#include "Interrupt_Scope.h"
+
+#include <atomic>
+#include <mutex>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <csignal>
+#endif
+
+namespace {
+    // Written from a signal handler, which may only touch lock-free atomics.
+    std::atomic<bool> interrupted{false};
+    std::mutex scopeMutex;
+    unsigned scopeCount = 0;
+
+#ifdef _WIN32
+    BOOL WINAPI handleControl(DWORD type) {
+        if (type != CTRL_C_EVENT && type != CTRL_BREAK_EVENT) {
+            return FALSE;
+        }
+        interrupted.store(true);
+        return TRUE;
+    }
+#else
+    struct sigaction previousAction;
+
+    void handleInterrupt(int) {
+        interrupted.store(true);
+    }
+#endif
+}
+
+InterruptScope::InterruptScope() {
+    std::lock_guard<std::mutex> lock(scopeMutex);
+    if (scopeCount++ > 0) {
+        return;
+    }
+    interrupted.store(false);
+#ifdef _WIN32
+    SetConsoleCtrlHandler(handleControl, TRUE);
+#else
+    // SA_RESTART keeps the system calls of other threads from failing with EINTR.
+    struct sigaction action = {};
+    action.sa_handler = handleInterrupt;
+    sigemptyset(&action.sa_mask);
+    action.sa_flags = SA_RESTART;
+    sigaction(SIGINT, &action, &previousAction);
+#endif
+}
+
+InterruptScope::~InterruptScope() {
+    std::lock_guard<std::mutex> lock(scopeMutex);
+    if (--scopeCount > 0) {
+        return;
+    }
+#ifdef _WIN32
+    SetConsoleCtrlHandler(handleControl, FALSE);
+#else
+    sigaction(SIGINT, &previousAction, nullptr);
+#endif
+}
+
+bool InterruptScope::requested() const {
+    return interrupted.load(std::memory_order_relaxed);
+}
\ No newline at end of file
@@ -0,0 +1,114 @@
+#include "Mapped_File.h"
+#include "Instrumentation.h"
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#ifdef _WIN32
+MappedFile::MappedFile() : base(nullptr), mappedSize(0), fileHandle(INVALID_HANDLE_VALUE), mappingHandle(NULL) {}
+#else
+MappedFile::MappedFile() : base(nullptr), mappedSize(0), fd(-1) {}
+#endif
+
+MappedFile::~MappedFile() {
+    close();
+}
+
+bool MappedFile::open(const std::string& path) {
+    return open(path.c_str());
+}
+
+bool MappedFile::open(const char* path) {
+    close();
+    // Opening, the size query, mapping and closing.
+    INSTRUMENT_COUNT(SYSTEM_CALLS, 4);
+#ifdef _WIN32
+    fileHandle = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, NULL, OPEN_EXISTING,
+        FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+    if (fileHandle == INVALID_HANDLE_VALUE) {
+        return false;
+    }
+    LARGE_INTEGER fileSize;
+    if (!GetFileSizeEx(fileHandle, &fileSize)) {
+        close();
+        return false;
+    }
+    if (fileSize.QuadPart == 0) {
+        return true;
+    }
+    mappingHandle = CreateFileMappingA(fileHandle, NULL, PAGE_READONLY, 0, 0, NULL);
+    if (mappingHandle == NULL) {
+        close();
+        return false;
+    }
+    base = static_cast<const char*>(MapViewOfFile(mappingHandle, FILE_MAP_READ, 0, 0, 0));
+    mappedSize = static_cast<std::size_t>(fileSize.QuadPart);
+#else
+    // O_NONBLOCK keeps a FIFO from blocking the open; it is rejected below like every other special file.
+    fd = ::open(path, O_RDONLY | O_NONBLOCK | O_CLOEXEC);
+    if (fd < 0) {
+        return false;
+    }
+    struct stat status;
+    if (fstat(fd, &status) != 0 || !S_ISREG(status.st_mode)) {
+        close();
+        return false;
+    }
+    if (status.st_size == 0) {
+        return true;
+    }
+    void* address = mmap(nullptr, static_cast<std::size_t>(status.st_size), PROT_READ, MAP_SHARED, fd, 0);
+    base = address != MAP_FAILED ? static_cast<const char*>(address) : nullptr;
+    mappedSize = static_cast<std::size_t>(status.st_size);
+    if (base != nullptr) {
+        madvise(address, mappedSize, MADV_SEQUENTIAL);
+    }
+#endif
+    if (base == nullptr) {
+        close();
+        return false;
+    }
+    // The pages are read when the caller touches them; the whole view is counted here, when it is mapped.
+    INSTRUMENT_COUNT(BYTES_READ, mappedSize);
+    return true;
+}
+
+void MappedFile::close() {
+#ifdef _WIN32
+    if (base != nullptr) {
+        UnmapViewOfFile(base);
+    }
+    if (mappingHandle != NULL) {
+        CloseHandle(mappingHandle);
+        mappingHandle = NULL;
+    }
+    if (fileHandle != INVALID_HANDLE_VALUE) {
+        CloseHandle(fileHandle);
+        fileHandle = INVALID_HANDLE_VALUE;
+    }
+#else
+    if (base != nullptr) {
+        munmap(const_cast<char*>(base), mappedSize);
+    }
+    if (fd >= 0) {
+        ::close(fd);
+        fd = -1;
+    }
+#endif
+    base = nullptr;
+    mappedSize = 0;
+}
+
+const char* MappedFile::data() const {
+    return base;
+}
+
+std::size_t MappedFile::size() const {
+    return mappedSize;
+}
\ No newline at end of file
@@ -0,0 +1,74 @@
+#include "Name_Search.h"
+#include "Directory_Index.h"
+#include "Directory_Walker.h"
+#include "Instrumentation.h"
+#include "Thread_Pool.h"
+
+#include <algorithm>
+
+const std::uint32_t NameSearch::CHUNK_SIZE;
+
+namespace {
+    struct Range {
+        std::uint32_t begin;
+        std::uint32_t end;
+    };
+
+    // The children of consecutive entries are consecutive, so every level below the directory is a single range.
+    std::vector<Range> levelRanges(const DirectoryIndex& index, std::uint32_t directory) {
+        std::vector<Range> levels;
+        Range level = { index.firstChild(directory), index.firstChild(directory) + index.childCount(directory) };
+        while (level.begin < level.end) {
+            levels.push_back(level);
+            Range next = { DirectoryIndex::NO_ENTRY, 0 };
+            for (std::uint32_t entry = level.begin; entry < level.end; ++entry) {
+                if (index.isDirectory(entry) && index.childCount(entry) > 0) {
+                    next.begin = std::min(next.begin, index.firstChild(entry));
+                    next.end = std::max(next.end, index.firstChild(entry) + index.childCount(entry));
+                }
+            }
+            level = next;
+        }
+        return levels;
+    }
+}
+
+std::vector<std::uint32_t> NameSearch::searchIndex(const DirectoryIndex& index, std::uint32_t directory, const PatternMatcher& matcher, unsigned threadCount) {
+    INSTRUMENT_SCOPE("NameSearch::searchIndex");
+    std::vector<Range> chunks;
+    for (const Range& level : levelRanges(index, directory)) {
+        for (std::uint32_t begin = level.begin; begin < level.end; begin += std::min(CHUNK_SIZE, level.end - begin)) {
+            chunks.push_back({ begin, begin + std::min(CHUNK_SIZE, level.end - begin) });
+        }
+    }
+
+    std::vector<std::vector<std::uint32_t>> chunkMatches(chunks.size());
+    {
+        ThreadPool pool(threadCount);
+        for (std::size_t chunk = 0; chunk < chunks.size(); ++chunk) {
+            pool.submit([&index, &matcher, &chunks, &chunkMatches, chunk] {
+                for (std::uint32_t entry = chunks[chunk].begin; entry < chunks[chunk].end; ++entry) {
+                    if (matcher.matches(index.name(entry))) {
+                        chunkMatches[chunk].push_back(entry);
+                    }
+                }
+            });
+        }
+        pool.wait();
+    }
+
+    std::vector<std::uint32_t> matches;
+    for (const std::vector<std::uint32_t>& found : chunkMatches) {
+        matches.insert(matches.end(), found.begin(), found.end());
+    }
+    return matches;
+}
+
+bool NameSearch::searchTree(const std::string& rootPath, const PatternMatcher& matcher, unsigned threadCount, const Visitor& visitor) {
+    INSTRUMENT_SCOPE("NameSearch::searchTree");
+    return DirectoryWalker::walkPaths(rootPath, threadCount, [&](std::string_view path, std::string_view name, bool isDirectory) {
+        if (matcher.matches(name)) {
+            visitor(path, isDirectory);
+        }
+    });
+}
\ No newline at end of file
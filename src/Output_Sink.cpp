@@ -0,0 +1,182 @@
+#include "Output_Sink.h"
+#include "Instrumentation.h"
+
+#include <cstring>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <cerrno>
+#include <fcntl.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#endif
+
+const std::size_t OutputSink::DEFAULT_BUFFER_SIZE;
+
+OutputSink::OutputSink(std::size_t bufferSize) : buffer(bufferSize > 0 ? bufferSize : 1), used(0), writeCalls(0), vectoredWrites(true), failed(false) {
+#ifdef _WIN32
+    handle = INVALID_HANDLE_VALUE;
+#else
+    fd = -1;
+#endif
+}
+
+OutputSink::~OutputSink() {
+    close();
+}
+
+bool OutputSink::open(const std::string& path) {
+    close();
+    used = 0;
+    failed = false;
+
+#ifdef _WIN32
+    handle = CreateFileA(path.c_str(), GENERIC_WRITE, 0, NULL, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+    failed = handle == INVALID_HANDLE_VALUE;
+#else
+    fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    failed = fd < 0;
+#endif
+
+    return !failed;
+}
+
+void OutputSink::setVectoredWrites(bool enabled) {
+    vectoredWrites = enabled;
+}
+
+void OutputSink::write(const char* data, std::size_t size) {
+    if (size <= buffer.size() - used) {
+        std::memcpy(buffer.data() + used, data, size);
+        used += size;
+        return;
+    }
+
+#ifndef _WIN32
+    if (vectoredWrites) {
+        writeBuffered(data, size);
+        return;
+    }
+#endif
+
+    while (size > 0) {
+        std::size_t chunk = buffer.size() - used;
+        if (chunk > size) {
+            chunk = size;
+        }
+        std::memcpy(buffer.data() + used, data, chunk);
+        used += chunk;
+        data += chunk;
+        size -= chunk;
+        if (used == buffer.size()) {
+            writeBuffered(nullptr, 0);
+        }
+    }
+}
+
+void OutputSink::write(const std::string& text) {
+    write(text.data(), text.size());
+}
+
+void OutputSink::put(char character) {
+    if (used == buffer.size()) {
+        writeBuffered(nullptr, 0);
+    }
+    buffer[used++] = character;
+}
+
+bool OutputSink::flush() {
+    if (used > 0) {
+        writeBuffered(nullptr, 0);
+    }
+    return !failed;
+}
+
+bool OutputSink::close() {
+#ifdef _WIN32
+    if (handle == INVALID_HANDLE_VALUE) {
+        return !failed;
+    }
+    flush();
+    if (!CloseHandle(handle)) {
+        failed = true;
+    }
+    handle = INVALID_HANDLE_VALUE;
+#else
+    if (fd < 0) {
+        return !failed;
+    }
+    flush();
+    if (::close(fd) != 0) {
+        failed = true;
+    }
+    fd = -1;
+#endif
+    return !failed;
+}
+
+bool OutputSink::good() const {
+    return !failed;
+}
+
+std::size_t OutputSink::writeCallCount() const {
+    return writeCalls;
+}
+
+bool OutputSink::writeBuffered(const char* extra, std::size_t extraSize) {
+    const char* data = buffer.data();
+    std::size_t size = used;
+    used = 0;
+
+    if (failed) {
+        return false;
+    }
+
+#ifdef _WIN32
+    while (size > 0) {
+        DWORD written = 0;
+        DWORD chunk = size > 0x40000000 ? 0x40000000 : static_cast<DWORD>(size);
+        ++writeCalls;
+        INSTRUMENT_COUNT(SYSTEM_CALLS, 1);
+        if (!WriteFile(handle, data, chunk, &written, NULL) || written == 0) {
+            failed = true;
+            return false;
+        }
+        INSTRUMENT_COUNT(BYTES_WRITTEN, written);
+        data += written;
+        size -= written;
+    }
+    (void)extra;
+    (void)extraSize;
+#else
+    struct iovec vectors[2] = { { const_cast<char*>(data), size }, { const_cast<char*>(extra), extraSize } };
+    int first = size > 0 ? 0 : 1;
+    int last = extraSize > 0 ? 2 : 1;
+    while (first < last) {
+        ++writeCalls;
+        INSTRUMENT_COUNT(SYSTEM_CALLS, 1);
+        ssize_t written = writev(fd, vectors + first, last - first);
+        if (written < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            failed = true;
+            return false;
+        }
+
+        std::size_t remaining = static_cast<std::size_t>(written);
+        INSTRUMENT_COUNT(BYTES_WRITTEN, remaining);
+        while (first < last && remaining >= vectors[first].iov_len) {
+            remaining -= vectors[first].iov_len;
+            ++first;
+        }
+        if (first < last) {
+            vectors[first].iov_base = static_cast<char*>(vectors[first].iov_base) + remaining;
+            vectors[first].iov_len -= remaining;
+        }
+    }
+#endif
+
+    return true;
+}
\ No newline at end of file
@@ -0,0 +1,33 @@
+#include "Path_Arena.h"
+
+#include <cstring>
+
+const std::size_t PathArena::BLOCK_SIZE;
+
+std::string_view PathArena::store(std::string_view path) {
+    std::size_t length = path.size() + 1;
+    if (capacity - used < length) {
+        std::size_t size = length > BLOCK_SIZE ? length : BLOCK_SIZE;
+        blocks.emplace_back(new char[size]);
+        blockBytes += size;
+        used = 0;
+        capacity = size;
+    }
+
+    char* copy = blocks.back().get() + used;
+    std::memcpy(copy, path.data(), path.size());
+    copy[path.size()] = '\0';
+    used += length;
+    return std::string_view(copy, path.size());
+}
+
+void PathArena::clear() {
+    blocks.clear();
+    blockBytes = 0;
+    used = 0;
+    capacity = 0;
+}
+
+std::size_t PathArena::bytes() const {
+    return blockBytes;
+}
\ No newline at end of file
@@ -0,0 +1,35 @@
+#include "Path_Builder.h"
+#include "Filesystem_Backend.h"
+
+PathBuilder::PathBuilder(std::string_view path) : buffer(path) {
+}
+
+void PathBuilder::assign(std::string_view path) {
+    buffer.assign(path.data(), path.size());
+}
+
+std::size_t PathBuilder::push(std::string_view name) {
+    std::size_t length = buffer.size();
+    if (!buffer.empty() && !FilesystemBackend::isSeparator(buffer.back())) {
+        buffer += FilesystemBackend::separator();
+    }
+    buffer.append(name.data(), name.size());
+    return length;
+}
+
+void PathBuilder::truncate(std::size_t length) {
+    // Shrinking a std::string never releases its capacity, so the next push reuses the memory.
+    buffer.resize(length);
+}
+
+std::string_view PathBuilder::view() const {
+    return buffer;
+}
+
+const char* PathBuilder::c_str() const {
+    return buffer.c_str();
+}
+
+std::size_t PathBuilder::size() const {
+    return buffer.size();
+}
\ No newline at end of file
@@ -0,0 +1,126 @@
+#include "Pattern_Matcher.h"
+
+#include <cctype>
+
+namespace {
+    char fold(char character, bool caseSensitive) {
+        return caseSensitive ? character : static_cast<char>(std::tolower(static_cast<unsigned char>(character)));
+    }
+}
+
+bool PatternMatcher::compile(const std::string& pattern, Syntax patternSyntax, std::string& error) {
+#ifdef _WIN32
+    caseSensitive = false;
+#else
+    caseSensitive = true;
+#endif
+    syntax = patternSyntax;
+    expression.reset();
+    source.clear();
+
+    if (syntax == Syntax::REGEX) {
+        std::regex::flag_type flags = std::regex::ECMAScript | std::regex::optimize;
+        if (!caseSensitive) {
+            flags |= std::regex::icase;
+        }
+        try {
+            expression = std::make_shared<const std::regex>(pattern, flags);
+        } catch (const std::regex_error& exception) {
+            error = exception.what();
+            return false;
+        }
+        source = pattern;
+        return true;
+    }
+
+    for (char character : pattern) {
+        source += fold(character, caseSensitive);
+    }
+    return true;
+}
+
+bool PatternMatcher::matches(std::string_view name) const {
+    if (syntax == Syntax::REGEX) {
+        return expression != nullptr && std::regex_search(name.data(), name.data() + name.size(), *expression);
+    }
+    return matchGlob(name);
+}
+
+const std::string& PatternMatcher::pattern() const {
+    return source;
+}
+
+// Backtracks only to the most recent "*", which keeps the match linear for the patterns used on file names.
+bool PatternMatcher::matchGlob(std::string_view name) const {
+    std::size_t position = 0;
+    std::size_t index = 0;
+    std::size_t starPosition = std::string::npos;
+    std::size_t starIndex = 0;
+
+    while (index < name.size()) {
+        char character = fold(name[index], caseSensitive);
+        if (position < source.size() && source[position] == '*') {
+            starPosition = position++;
+            starIndex = index;
+            continue;
+        }
+
+        std::size_t next = position;
+        bool matched = false;
+        if (position < source.size()) {
+            if (source[position] == '?') {
+                matched = true;
+                ++next;
+            } else if (source[position] == '[') {
+                matched = matchClass(next, character);
+            } else {
+                matched = source[position] == character;
+                ++next;
+            }
+        }
+
+        if (matched) {
+            position = next;
+            ++index;
+        } else if (starPosition != std::string::npos) {
+            position = starPosition + 1;
+            index = ++starIndex;
+        } else {
+            return false;
+        }
+    }
+
+    while (position < source.size() && source[position] == '*') {
+        ++position;
+    }
+    return position == source.size();
+}
+
+// An unterminated "[" is matched as a literal character.
+bool PatternMatcher::matchClass(std::size_t& position, char character) const {
+    std::size_t current = position + 1;
+    bool negated = current < source.size() && (source[current] == '!' || source[current] == '^');
+    if (negated) {
+        ++current;
+    }
+
+    bool matched = false;
+    std::size_t first = current;
+    while (current < source.size() && (source[current] != ']' || current == first)) {
+        char low = source[current];
+        char high = low;
+        if (current + 2 < source.size() && source[current + 1] == '-' && source[current + 2] != ']') {
+            high = source[current + 2];
+            current += 2;
+        }
+        matched = matched || (low <= character && character <= high);
+        ++current;
+    }
+
+    if (current >= source.size()) {
+        ++position;
+        return character == '[';
+    }
+    position = current + 1;
+    return matched != negated;
+}
\ No newline at end of file
@@ -0,0 +1,278 @@
+#include "Text_Search.h"
+#include "Directory_Walker.h"
+#include "Instrumentation.h"
+#include "Mapped_File.h"
+#include "Thread_Pool.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstring>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#if defined(__x86_64__) || defined(_M_X64)
+#define TEXT_SEARCH_X86 1
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+#endif
+
+#if defined(TEXT_SEARCH_X86) && (defined(__GNUC__) || defined(__clang__))
+#define TARGET_AVX2 __attribute__((target("avx2")))
+#else
+#define TARGET_AVX2
+#endif
+
+const std::size_t TextSearch::MAX_LINE_LENGTH;
+
+namespace {
+    using Kernel = const char* (*)(const char*, std::size_t, const char*, std::size_t);
+
+    // Files scanned or waiting to be reported at the same time; bounds the memory held by unreported matches.
+    const std::size_t MAX_FILES_IN_FLIGHT = 4096;
+    const std::size_t BINARY_PROBE_SIZE = 8192;
+
+    const char* findScalar(const char* data, std::size_t size, const char* pattern, std::size_t patternLength) {
+        if (patternLength == 0) {
+            return data;
+        }
+        if (patternLength > size) {
+            return nullptr;
+        }
+        const char* last = data + size - patternLength + 1;
+        for (const char* candidate = data; candidate < last; ++candidate) {
+            candidate = static_cast<const char*>(std::memchr(candidate, pattern[0], static_cast<std::size_t>(last - candidate)));
+            if (candidate == nullptr) {
+                return nullptr;
+            }
+            if (std::memcmp(candidate + 1, pattern + 1, patternLength - 1) == 0) {
+                return candidate;
+            }
+        }
+        return nullptr;
+    }
+
+#ifdef TEXT_SEARCH_X86
+    unsigned countTrailingZeros(unsigned mask) {
+#ifdef _MSC_VER
+        unsigned long index;
+        _BitScanForward(&index, mask);
+        return index;
+#else
+        return static_cast<unsigned>(__builtin_ctz(mask));
+#endif
+    }
+
+    // The block loads read patternLength - 1 bytes past the candidate, so the last blocks go to the scalar kernel.
+    const char* findSse2(const char* data, std::size_t size, const char* pattern, std::size_t patternLength) {
+        if (patternLength < 2 || patternLength > size) {
+            return findScalar(data, size, pattern, patternLength);
+        }
+        const __m128i first = _mm_set1_epi8(pattern[0]);
+        const __m128i last = _mm_set1_epi8(pattern[patternLength - 1]);
+
+        std::size_t offset = 0;
+        for (; offset + patternLength - 1 + 16 <= size; offset += 16) {
+            __m128i blockFirst = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + offset));
+            __m128i blockLast = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + offset + patternLength - 1));
+            unsigned mask = static_cast<unsigned>(_mm_movemask_epi8(_mm_and_si128(_mm_cmpeq_epi8(blockFirst, first), _mm_cmpeq_epi8(blockLast, last))));
+            while (mask != 0) {
+                const char* candidate = data + offset + countTrailingZeros(mask);
+                if (std::memcmp(candidate + 1, pattern + 1, patternLength - 2) == 0) {
+                    return candidate;
+                }
+                mask &= mask - 1;
+            }
+        }
+        return findScalar(data + offset, size - offset, pattern, patternLength);
+    }
+
+    TARGET_AVX2 const char* findAvx2(const char* data, std::size_t size, const char* pattern, std::size_t patternLength) {
+        if (patternLength < 2 || patternLength > size) {
+            return findScalar(data, size, pattern, patternLength);
+        }
+        const __m256i first = _mm256_set1_epi8(pattern[0]);
+        const __m256i last = _mm256_set1_epi8(pattern[patternLength - 1]);
+
+        std::size_t offset = 0;
+        for (; offset + patternLength - 1 + 32 <= size; offset += 32) {
+            __m256i blockFirst = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + offset));
+            __m256i blockLast = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + offset + patternLength - 1));
+            unsigned mask = static_cast<unsigned>(_mm256_movemask_epi8(_mm256_and_si256(_mm256_cmpeq_epi8(blockFirst, first), _mm256_cmpeq_epi8(blockLast, last))));
+            while (mask != 0) {
+                const char* candidate = data + offset + countTrailingZeros(mask);
+                if (std::memcmp(candidate + 1, pattern + 1, patternLength - 2) == 0) {
+                    return candidate;
+                }
+                mask &= mask - 1;
+            }
+        }
+        return findSse2(data + offset, size - offset, pattern, patternLength);
+    }
+
+    bool hasAvx2() {
+#ifdef _MSC_VER
+        int info[4];
+        __cpuid(info, 1);
+        bool osSavesYmm = (info[2] & (1 << 27)) && (info[2] & (1 << 28)) && (_xgetbv(0) & 6) == 6;
+        __cpuidex(info, 7, 0);
+        return osSavesYmm && (info[1] & (1 << 5));
+#else
+        return __builtin_cpu_supports("avx2");
+#endif
+    }
+#endif
+
+    struct KernelChoice {
+        Kernel kernel;
+        const char* name;
+    };
+
+    const KernelChoice& selectedKernel() {
+#ifdef TEXT_SEARCH_X86
+        static const KernelChoice choice = hasAvx2() ? KernelChoice{ findAvx2, "AVX2" } : KernelChoice{ findSse2, "SSE2" };
+#else
+        static const KernelChoice choice = { findScalar, "scalar" };
+#endif
+        return choice;
+    }
+
+    struct FileMatch {
+        std::uint64_t lineNumber;
+        std::string line;
+    };
+
+    struct FileSlot {
+        std::string path;
+        std::vector<FileMatch> matches;
+        std::uint64_t bytes = 0;
+        bool binary = false;
+        bool unreadable = false;
+        bool done = false;
+    };
+
+    // The pool is declared last, so it joins its workers before the mutex and the condition variable they use go away.
+    struct SearchState {
+        std::mutex mutex;
+        std::condition_variable finished;
+        ThreadPool pool;
+
+        explicit SearchState(unsigned threadCount) : pool(threadCount) {}
+    };
+
+    void scanFile(FileSlot& slot, const std::string& pattern, Kernel kernel) {
+        MappedFile file;
+        if (!file.open(slot.path)) {
+            slot.unreadable = true;
+            return;
+        }
+
+        const char* data = file.data();
+        const char* end = data + file.size();
+        slot.bytes = file.size();
+        if (data == nullptr || std::memchr(data, '\0', std::min(file.size(), BINARY_PROBE_SIZE)) != nullptr) {
+            slot.binary = data != nullptr;
+            return;
+        }
+
+        // Lines are only counted up to each match, so a file without matches is read by the kernel alone.
+        const char* counted = data;
+        std::uint64_t lineNumber = 1;
+        for (const char* position = data; position < end;) {
+            const char* found = kernel(position, static_cast<std::size_t>(end - position), pattern.data(), pattern.size());
+            if (found == nullptr) {
+                break;
+            }
+
+            const char* lineStart = found;
+            while (lineStart > counted && lineStart[-1] != '\n') {
+                --lineStart;
+            }
+            lineNumber += static_cast<std::uint64_t>(std::count(counted, lineStart, '\n'));
+
+            const char* lineEnd = static_cast<const char*>(std::memchr(found, '\n', static_cast<std::size_t>(end - found)));
+            if (lineEnd == nullptr) {
+                lineEnd = end;
+            }
+            const char* shownEnd = lineEnd > lineStart && lineEnd[-1] == '\r' ? lineEnd - 1 : lineEnd;
+            std::size_t shownLength = std::min(static_cast<std::size_t>(shownEnd - lineStart), TextSearch::MAX_LINE_LENGTH);
+            slot.matches.push_back({ lineNumber, std::string(lineStart, shownLength) });
+
+            counted = lineEnd < end ? lineEnd + 1 : end;
+            lineNumber += lineEnd < end ? 1 : 0;
+            position = counted;
+        }
+    }
+}
+
+const char* TextSearch::find(const char* data, std::size_t size, const char* pattern, std::size_t patternLength) {
+    return selectedKernel().kernel(data, size, pattern, patternLength);
+}
+
+const char* TextSearch::kernelName() {
+    return selectedKernel().name;
+}
+
+TextSearch::Stats TextSearch::search(const std::string& rootPath, const std::string& pattern, unsigned threadCount, const Visitor& visitor) {
+    INSTRUMENT_SCOPE("TextSearch::search");
+    auto start = std::chrono::steady_clock::now();
+    Stats stats = {};
+    Kernel kernel = selectedKernel().kernel;
+    SearchState state(threadCount);
+    std::deque<std::unique_ptr<FileSlot>> slots;
+
+    // Reports the finished files at the front of the queue, waiting for the front file while more than keep files are queued.
+    auto report = [&](std::size_t keep) {
+        while (!slots.empty()) {
+            FileSlot& slot = *slots.front();
+            {
+                std::unique_lock<std::mutex> lock(state.mutex);
+                if (slots.size() > keep) {
+                    state.finished.wait(lock, [&slot] { return slot.done; });
+                } else if (!slot.done) {
+                    return;
+                }
+            }
+
+            stats.filesScanned += slot.unreadable ? 0 : 1;
+            stats.unreadableFiles += slot.unreadable ? 1 : 0;
+            stats.binaryFiles += slot.binary ? 1 : 0;
+            stats.bytesScanned += slot.bytes;
+            stats.matches += slot.matches.size();
+            stats.matchingFiles += slot.matches.empty() ? 0 : 1;
+            for (FileMatch& fileMatch : slot.matches) {
+                visitor({ &slot.path, fileMatch.lineNumber, std::move(fileMatch.line) });
+            }
+            slots.pop_front();
+        }
+    };
+
+    // A file's path is copied once, into its slot.
+    DirectoryWalker::walkPaths(rootPath, threadCount, [&](std::string_view path, std::string_view, bool isDirectory) {
+        if (isDirectory) {
+            return;
+        }
+
+        slots.push_back(std::unique_ptr<FileSlot>(new FileSlot()));
+        FileSlot* slot = slots.back().get();
+        slot->path.assign(path.data(), path.size());
+        state.pool.submit([&state, &pattern, slot, kernel] {
+            scanFile(*slot, pattern, kernel);
+            // Notified under the lock: once it is released, search() may return and destroy the state.
+            std::lock_guard<std::mutex> lock(state.mutex);
+            slot->done = true;
+            state.finished.notify_all();
+        });
+
+        report(MAX_FILES_IN_FLIGHT);
+    });
+    report(0);
+
+    stats.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    return stats;
+}
\ No newline at end of file
@@ -0,0 +1,153 @@
+#include "Thread_Pool.h"
+
+namespace {
+    thread_local const ThreadPool* currentPool = nullptr;
+    thread_local int currentIndex = -1;
+}
+
+ThreadPool::ThreadPool(unsigned threadCount) : queuedTasks(0), pendingTasks(0), nextQueue(0), stopping(false) {
+    if (threadCount == 0) {
+        threadCount = defaultThreadCount();
+    }
+
+    for (unsigned i = 0; i < threadCount; ++i) {
+        queues.push_back(std::make_unique<WorkerQueue>());
+    }
+    for (unsigned i = 0; i < threadCount; ++i) {
+        workers.emplace_back(&ThreadPool::workerLoop, this, i);
+    }
+}
+
+ThreadPool::~ThreadPool() {
+    // A task exception nobody waited for is dropped here, since a destructor must not throw.
+    waitForTasks();
+    {
+        std::lock_guard<std::mutex> lock(stateMutex);
+        stopping = true;
+    }
+    workAvailable.notify_all();
+    for (std::thread& worker : workers) {
+        worker.join();
+    }
+}
+
+void ThreadPool::submit(std::function<void()> task) {
+    unsigned index;
+    if (currentPool == this) {
+        index = static_cast<unsigned>(currentIndex);
+    } else {
+        index = nextQueue.fetch_add(1, std::memory_order_relaxed) % queues.size();
+    }
+
+    pendingTasks.fetch_add(1, std::memory_order_relaxed);
+    queuedTasks.fetch_add(1, std::memory_order_release);
+    try {
+        std::lock_guard<std::mutex> lock(queues[index]->mutex);
+        queues[index]->tasks.push_back(std::move(task));
+    } catch (...) {
+        // A task that was never queued must not keep wait() blocked.
+        queuedTasks.fetch_sub(1, std::memory_order_relaxed);
+        if (pendingTasks.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+            std::lock_guard<std::mutex> lock(stateMutex);
+            allDone.notify_all();
+        }
+        throw;
+    }
+    {
+        std::lock_guard<std::mutex> lock(stateMutex);
+    }
+    workAvailable.notify_one();
+}
+
+void ThreadPool::wait() {
+    std::exception_ptr exception = waitForTasks();
+    if (exception) {
+        std::rethrow_exception(exception);
+    }
+}
+
+unsigned ThreadPool::size() const {
+    return static_cast<unsigned>(workers.size());
+}
+
+int ThreadPool::currentWorkerIndex() const {
+    return currentPool == this ? currentIndex : -1;
+}
+
+unsigned ThreadPool::defaultThreadCount() {
+    unsigned count = std::thread::hardware_concurrency();
+    return count > 0 ? count : 1;
+}
+
+std::exception_ptr ThreadPool::waitForTasks() {
+    std::unique_lock<std::mutex> lock(stateMutex);
+    allDone.wait(lock, [this] { return pendingTasks.load(std::memory_order_acquire) == 0; });
+    std::exception_ptr exception = firstException;
+    firstException = nullptr;
+    return exception;
+}
+
+bool ThreadPool::popLocal(unsigned index, std::function<void()>& task) {
+    WorkerQueue& queue = *queues[index];
+    std::lock_guard<std::mutex> lock(queue.mutex);
+    if (queue.tasks.empty()) {
+        return false;
+    }
+    task = std::move(queue.tasks.back());
+    queue.tasks.pop_back();
+    return true;
+}
+
+bool ThreadPool::steal(unsigned index, std::function<void()>& task) {
+    for (std::size_t offset = 1; offset < queues.size(); ++offset) {
+        WorkerQueue& victim = *queues[(index + offset) % queues.size()];
+        std::unique_lock<std::mutex> lock(victim.mutex, std::try_to_lock);
+        if (!lock.owns_lock() || victim.tasks.empty()) {
+            continue;
+        }
+        task = std::move(victim.tasks.front());
+        victim.tasks.pop_front();
+        return true;
+    }
+    return false;
+}
+
+void ThreadPool::workerLoop(unsigned index) {
+    currentPool = this;
+    currentIndex = static_cast<int>(index);
+
+    std::function<void()> task;
+    while (true) {
+        if (popLocal(index, task) || steal(index, task)) {
+            queuedTasks.fetch_sub(1, std::memory_order_relaxed);
+            try {
+                task();
+            } catch (...) {
+                // The first exception is kept for wait(); the task still counts as finished, so nobody waits forever.
+                std::lock_guard<std::mutex> lock(stateMutex);
+                if (!firstException) {
+                    firstException = std::current_exception();
+                }
+            }
+            task = nullptr;
+
+            if (pendingTasks.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+                std::lock_guard<std::mutex> lock(stateMutex);
+                allDone.notify_all();
+            }
+            continue;
+        }
+
+        std::unique_lock<std::mutex> lock(stateMutex);
+        if (queuedTasks.load(std::memory_order_acquire) > 0) {
+            // A task is being pushed or sits behind a contended queue lock; retry without sleeping.
+            lock.unlock();
+            std::this_thread::yield();
+            continue;
+        }
+        if (stopping) {
+            return;
+        }
+        workAvailable.wait(lock);
+    }
+}
\ No newline at end of file
@@ -0,0 +1,324 @@
+#include "Tree_Deleter.h"
+#include "Async_Io_Engine.h"
+#include "Descriptor_Budget.h"
+#include "Directory_Walker.h"
+#include "Instrumentation.h"
+#include "Thread_Pool.h"
+
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <vector>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace {
+    // A directory stays alive until its own read and every subdirectory have finished.
+    struct Node {
+        Node* parent;
+        std::string path;
+#ifndef _WIN32
+        // The directory is opened by relativePath from the descriptor of its anchor, the nearest ancestor that kept one.
+        Node* anchor = nullptr;
+        std::string relativePath;
+        int fd = -1;
+        bool holdsSlot = false;
+#endif
+        std::atomic<std::size_t> pending{1};
+        std::atomic<bool> failed{false};
+
+        Node(Node* parent, std::string path) : parent(parent), path(std::move(path)) {}
+
+#ifndef _WIN32
+        // A directory left in place after a failure still gives back its descriptor.
+        ~Node() {
+            if (fd >= 0) {
+                close(fd);
+            }
+            if (holdsSlot) {
+                DescriptorBudget::instance().release();
+            }
+        }
+#endif
+    };
+
+    struct DeleteState {
+        ThreadPool pool;
+        bool dryRun;
+        std::atomic<std::size_t> files{0};
+        std::atomic<std::size_t> directories{0};
+        std::atomic<std::uint64_t> bytes{0};
+        std::atomic<std::size_t> failures{0};
+        std::mutex failureMutex;
+        std::string firstFailure;
+
+        DeleteState(unsigned threadCount, bool dryRun) : pool(threadCount), dryRun(dryRun) {}
+
+        void fail(const std::string& path) {
+            failures.fetch_add(1, std::memory_order_relaxed);
+            std::lock_guard<std::mutex> lock(failureMutex);
+            if (firstFailure.empty()) {
+                firstFailure = path;
+            }
+        }
+    };
+
+    void readNode(DeleteState& state, Node* node);
+    bool removeEmptyDirectory(DeleteState& state, Node* node);
+
+    // A directory whose contents could not be deleted is left in place without counting a second failure.
+    void finishNode(DeleteState& state, Node* node) {
+        while (node != nullptr && node->pending.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+            Node* parent = node->parent;
+            bool removed = !node->failed.load(std::memory_order_acquire) && removeEmptyDirectory(state, node);
+            if (!removed && parent != nullptr) {
+                parent->failed.store(true, std::memory_order_release);
+            }
+            delete node;
+            node = parent;
+        }
+    }
+
+    void queueChild(DeleteState& state, Node* node, const std::string& name) {
+        Node* child = new Node(node, DirectoryWalker::joinPath(node->path, name));
+#ifndef _WIN32
+        child->anchor = node->fd >= 0 ? node : node->anchor;
+        child->relativePath = node->fd >= 0 ? name : DirectoryWalker::joinPath(node->relativePath, name);
+#endif
+        node->pending.fetch_add(1, std::memory_order_relaxed);
+        state.pool.submit([&state, child] { readNode(state, child); });
+    }
+
+#ifdef _WIN32
+    bool clearReadOnly(const std::string& path, DWORD attributes) {
+        return !(attributes & FILE_ATTRIBUTE_READONLY) || SetFileAttributesA(path.c_str(), attributes & ~FILE_ATTRIBUTE_READONLY);
+    }
+
+    bool removeFile(DeleteState& state, const std::string& path, DWORD attributes, std::uint64_t size) {
+        if (!state.dryRun) {
+            INSTRUMENT_COUNT(SYSTEM_CALLS, 1);
+            bool removed = clearReadOnly(path, attributes) &&
+                ((attributes & FILE_ATTRIBUTE_DIRECTORY) ? RemoveDirectoryA(path.c_str()) : DeleteFileA(path.c_str()));
+            if (!removed) {
+                state.fail(path);
+                return false;
+            }
+        }
+        if (attributes & FILE_ATTRIBUTE_DIRECTORY) {
+            state.directories.fetch_add(1, std::memory_order_relaxed);
+        } else {
+            state.files.fetch_add(1, std::memory_order_relaxed);
+            state.bytes.fetch_add(size, std::memory_order_relaxed);
+        }
+        return true;
+    }
+
+    void readNode(DeleteState& state, Node* node) {
+        std::vector<DirectoryWalker::Entry> entries;
+        if (!DirectoryWalker::readDirectory(node->path, entries)) {
+            state.fail(node->path);
+            node->failed.store(true, std::memory_order_release);
+        }
+
+        for (const DirectoryWalker::Entry& entry : entries) {
+            // Junctions and directory symlinks are removed as links; their targets are left alone.
+            if (entry.isDirectory && !(entry.attributes & FILE_ATTRIBUTE_REPARSE_POINT)) {
+                queueChild(state, node, entry.name);
+            } else if (!removeFile(state, DirectoryWalker::joinPath(node->path, entry.name), entry.attributes, entry.size)) {
+                node->failed.store(true, std::memory_order_release);
+            }
+        }
+        finishNode(state, node);
+    }
+
+    bool removeEmptyDirectory(DeleteState& state, Node* node) {
+        return removeFile(state, node->path, GetFileAttributesA(node->path.c_str()) | FILE_ATTRIBUTE_DIRECTORY, 0);
+    }
+#else
+    bool isDirectoryAt(int directoryFd, const char* name, DirectoryWalker::EntryType type, struct stat& status, bool& statted) {
+        if (type != DirectoryWalker::EntryType::UNKNOWN) {
+            return type == DirectoryWalker::EntryType::DIRECTORY;
+        }
+        INSTRUMENT_COUNT(SYSTEM_CALLS, 1);
+        statted = fstatat(directoryFd, name, &status, AT_SYMLINK_NOFOLLOW) == 0;
+        return statted && S_ISDIR(status.st_mode);
+    }
+
+    void unlinkFailed(DeleteState& state, Node* node, const std::string& name) {
+        state.fail(DirectoryWalker::joinPath(node->path, name));
+        node->failed.store(true, std::memory_order_release);
+    }
+
+    // A directory with many files hands all of their unlinks to the kernel queue at once instead of one system call each.
+    void unlinkFiles(DeleteState& state, Node* node, const std::vector<std::pair<std::string, DirectoryWalker::EntryType>>& entries,
+        const std::vector<std::size_t>& files) {
+        if (files.size() < AsyncIoEngine::BATCH_THRESHOLD || !AsyncIoEngine::isKernelQueueAvailable()) {
+            INSTRUMENT_COUNT(SYSTEM_CALLS, files.size());
+            for (std::size_t index : files) {
+                if (unlinkat(node->fd, entries[index].first.c_str(), 0) != 0) {
+                    unlinkFailed(state, node, entries[index].first);
+                } else {
+                    state.files.fetch_add(1, std::memory_order_relaxed);
+                }
+            }
+            return;
+        }
+
+        AsyncIoEngine& engine = AsyncIoEngine::forCurrentThread();
+        for (std::size_t index : files) {
+            AsyncIoEngine::Request request{ AsyncIoEngine::Operation::UNLINK };
+            request.userData = index;
+            request.directoryFd = node->fd;
+            request.path = entries[index].first.c_str();
+            engine.submit(request);
+        }
+
+        std::vector<AsyncIoEngine::Completion> completions;
+        while (engine.outstanding() > 0) {
+            engine.wait(completions, engine.outstanding());
+        }
+        for (const AsyncIoEngine::Completion& completion : completions) {
+            if (completion.result < 0) {
+                unlinkFailed(state, node, entries[completion.userData].first);
+            } else {
+                state.files.fetch_add(1, std::memory_order_relaxed);
+            }
+        }
+    }
+
+    // A directory with subdirectories keeps its descriptor until they are removed while the budget has a slot, and
+    // regardless of the budget once its path from the anchor is long enough to make the opens below it expensive.
+    void keepDescriptor(Node* node, bool hasSubdirectories) {
+        if (hasSubdirectories) {
+            node->holdsSlot = DescriptorBudget::instance().tryAcquire();
+            if (node->holdsSlot || node->relativePath.size() >= DescriptorBudget::MAX_RELATIVE_PATH) {
+                return;
+            }
+        }
+        INSTRUMENT_COUNT(SYSTEM_CALLS, 1);
+        close(node->fd);
+        node->fd = -1;
+    }
+
+    void readNode(DeleteState& state, Node* node) {
+        int anchorFd = node->anchor != nullptr ? node->anchor->fd : AT_FDCWD;
+        INSTRUMENT_COUNT(SYSTEM_CALLS, 1);
+        node->fd = openat(anchorFd, node->relativePath.c_str(), O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+        DirectoryWalker::Listing listing;
+        if (!listing.open(node->fd)) {
+            if (node->fd >= 0) {
+                INSTRUMENT_COUNT(SYSTEM_CALLS, 1);
+                close(node->fd);
+                node->fd = -1;
+            }
+            state.fail(node->path);
+            node->failed.store(true, std::memory_order_release);
+            finishNode(state, node);
+            return;
+        }
+
+        // The listing is read completely before anything is unlinked, so the directory stream never sees its own deletions.
+        std::vector<std::pair<std::string, DirectoryWalker::EntryType>> entries;
+        while (listing.next()) {
+            entries.emplace_back(listing.name(), listing.type());
+        }
+        listing.close();
+        INSTRUMENT_COUNT(ENTRIES_VISITED, entries.size());
+
+        std::vector<std::size_t> files;
+        std::vector<std::size_t> directories;
+        for (std::size_t index = 0; index < entries.size(); ++index) {
+            const auto& entry = entries[index];
+            const char* name = entry.first.c_str();
+            struct stat status;
+            bool statted = false;
+            if (isDirectoryAt(node->fd, name, entry.second, status, statted)) {
+                directories.push_back(index);
+                continue;
+            }
+
+            if (!state.dryRun) {
+                files.push_back(index);
+                continue;
+            }
+            INSTRUMENT_COUNT(SYSTEM_CALLS, statted ? 0 : 1);
+            if (statted || fstatat(node->fd, name, &status, AT_SYMLINK_NOFOLLOW) == 0) {
+                state.bytes.fetch_add(static_cast<std::uint64_t>(status.st_size), std::memory_order_relaxed);
+            }
+            state.files.fetch_add(1, std::memory_order_relaxed);
+        }
+        unlinkFiles(state, node, entries, files);
+
+        // The subdirectories are queued once the descriptor is settled, since they are opened relative to it or its anchor.
+        keepDescriptor(node, !directories.empty());
+        for (std::size_t index : directories) {
+            queueChild(state, node, entries[index].first);
+        }
+        finishNode(state, node);
+    }
+
+    // Runs after every child has finished, so the descriptor of the anchor is still open.
+    bool removeEmptyDirectory(DeleteState& state, Node* node) {
+        if (node->fd >= 0) {
+            close(node->fd);
+            node->fd = -1;
+        }
+        if (node->holdsSlot) {
+            DescriptorBudget::instance().release();
+            node->holdsSlot = false;
+        }
+        if (!state.dryRun) {
+            int anchorFd = node->anchor != nullptr ? node->anchor->fd : AT_FDCWD;
+            INSTRUMENT_COUNT(SYSTEM_CALLS, 1);
+            if (unlinkat(anchorFd, node->relativePath.c_str(), AT_REMOVEDIR) != 0) {
+                state.fail(node->path);
+                return false;
+            }
+        }
+        state.directories.fetch_add(1, std::memory_order_relaxed);
+        return true;
+    }
+#endif
+}
+
+TreeDeleter::Result TreeDeleter::remove(const std::string& path, unsigned threadCount, bool dryRun) {
+    INSTRUMENT_SCOPE("TreeDeleter::remove");
+    auto start = std::chrono::steady_clock::now();
+    DeleteState state(threadCount, dryRun);
+
+    DirectoryWalker::Entry entry{};
+    if (!DirectoryWalker::readMetadata(path, entry)) {
+        state.fail(path);
+    }
+#ifdef _WIN32
+    else if (!entry.isDirectory || (entry.attributes & FILE_ATTRIBUTE_REPARSE_POINT)) {
+        removeFile(state, path, entry.attributes, entry.size);
+    }
+#else
+    else if (!entry.isDirectory) {
+        if (!dryRun && unlink(path.c_str()) != 0) {
+            state.fail(path);
+        } else {
+            state.files.fetch_add(1, std::memory_order_relaxed);
+            state.bytes.fetch_add(dryRun ? entry.size : 0, std::memory_order_relaxed);
+        }
+    }
+#endif
+    else {
+        Node* root = new Node(nullptr, path);
+#ifndef _WIN32
+        root->relativePath = path;
+#endif
+        readNode(state, root);
+        state.pool.wait();
+    }
+
+    return { state.files.load(), state.directories.load(), state.bytes.load(), state.failures.load(), state.firstFailure,
+        std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count() };
+}
\ No newline at end of file
@@ -0,0 +1,312 @@
+#include "Tree_Permissions.h"
+#include "Async_Io_Engine.h"
+#include "Descriptor_Budget.h"
+#include "Directory_Walker.h"
+#include "Instrumentation.h"
+#include "Thread_Pool.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <vector>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace {
+    // The entries of a directory are changed in batches, so a directory of a million files is spread over all workers.
+    const std::size_t ENTRIES_PER_TASK = 256;
+
+    // A directory stays alive until its own batches and every subdirectory have finished.
+    struct Node {
+        Node* parent;
+        std::string path;
+#ifdef _WIN32
+        std::vector<DirectoryWalker::Entry> entries;
+#else
+        // The directory is opened by relativePath from the descriptor of its anchor, the nearest ancestor that kept one.
+        Node* anchor = nullptr;
+        std::string relativePath;
+        std::vector<std::string> names;
+        int fd = -1;
+        bool holdsSlot = false;
+#endif
+        std::atomic<std::size_t> pending{1};
+
+        Node(Node* parent, std::string path) : parent(parent), path(std::move(path)) {}
+
+#ifndef _WIN32
+        ~Node() {
+            if (fd >= 0) {
+                close(fd);
+            }
+            if (holdsSlot) {
+                DescriptorBudget::instance().release();
+            }
+        }
+#endif
+    };
+
+    struct PermitState {
+        ThreadPool pool;
+        FilesystemBackend::Access access;
+        std::atomic<std::size_t> changed{0};
+        std::atomic<std::size_t> unchanged{0};
+        std::atomic<std::size_t> skipped{0};
+        std::atomic<std::size_t> failures{0};
+        std::mutex failureMutex;
+        std::string firstFailure;
+
+        PermitState(unsigned threadCount, FilesystemBackend::Access access) : pool(threadCount), access(access) {}
+
+        void fail(const std::string& path) {
+            failures.fetch_add(1, std::memory_order_relaxed);
+            std::lock_guard<std::mutex> lock(failureMutex);
+            if (firstFailure.empty()) {
+                firstFailure = path;
+            }
+        }
+    };
+
+    void readNode(PermitState& state, Node* node);
+
+    void finishNode(Node* node) {
+        while (node != nullptr && node->pending.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+            Node* parent = node->parent;
+            delete node;
+            node = parent;
+        }
+    }
+
+    void queueChild(PermitState& state, Node* node, const std::string& name) {
+        Node* child = new Node(node, DirectoryWalker::joinPath(node->path, name));
+#ifndef _WIN32
+        child->anchor = node->fd >= 0 ? node : node->anchor;
+        child->relativePath = node->fd >= 0 ? name : DirectoryWalker::joinPath(node->relativePath, name);
+#endif
+        node->pending.fetch_add(1, std::memory_order_relaxed);
+        state.pool.submit([&state, child] { readNode(state, child); });
+    }
+
+    // The tree already runs on a worker pool, so a change runs synchronously on the calling worker.
+    bool changePermissions(int directoryFd, const char* path, std::uint32_t permissions) {
+        AsyncIoEngine::Request request{ AsyncIoEngine::Operation::CHMOD };
+        request.directoryFd = directoryFd;
+        request.path = path;
+        request.mode = permissions;
+        return AsyncIoEngine::execute(request) >= 0;
+    }
+
+#ifdef _WIN32
+    void applyBatch(PermitState& state, Node* node, std::size_t begin, std::size_t end) {
+        for (std::size_t index = begin; index < end; ++index) {
+            const DirectoryWalker::Entry& entry = node->entries[index];
+            // Junctions and directory symlinks are left alone, and so are the directories they point to.
+            if (entry.attributes & FILE_ATTRIBUTE_REPARSE_POINT) {
+                state.skipped.fetch_add(1, std::memory_order_relaxed);
+                continue;
+            }
+            // The attributes come with the listing, so an entry that already has them costs no system call at all.
+            std::uint32_t target = FilesystemBackend::permissionsForAccess(entry.attributes, state.access);
+            std::string path = DirectoryWalker::joinPath(node->path, entry.name);
+            if (target == FilesystemBackend::permissionsOf(entry.attributes)) {
+                state.unchanged.fetch_add(1, std::memory_order_relaxed);
+            } else if (changePermissions(AsyncIoEngine::CURRENT_DIRECTORY, path.c_str(), target)) {
+                state.changed.fetch_add(1, std::memory_order_relaxed);
+            } else {
+                state.fail(path);
+            }
+            if (entry.isDirectory) {
+                queueChild(state, node, entry.name);
+            }
+        }
+        finishNode(node);
+    }
+
+    void readNode(PermitState& state, Node* node) {
+        if (!DirectoryWalker::readDirectory(node->path, node->entries)) {
+            state.fail(node->path);
+        }
+        // Queued last to first, so the worker that pops its own queue from the back changes them in directory order.
+        for (std::size_t end = node->entries.size(); end > 0;) {
+            std::size_t begin = (end - 1) / ENTRIES_PER_TASK * ENTRIES_PER_TASK;
+            node->pending.fetch_add(1, std::memory_order_relaxed);
+            state.pool.submit([&state, node, begin, end] { applyBatch(state, node, begin, end); });
+            end = begin;
+        }
+        finishNode(node);
+    }
+#else
+    // Reads the modes of a range of entries relative to the directory descriptor and changes the ones that differ. A
+    // range of BATCH_THRESHOLD entries or more is read in one batch on the kernel queue. Returns the subdirectories.
+    void applyEntries(PermitState& state, Node* node, std::size_t begin, std::size_t end, std::vector<std::size_t>& directories) {
+        std::size_t count = end - begin;
+        std::vector<DirectoryWalker::Entry> metadata(count);
+        std::vector<int> results(count, 0);
+        AsyncIoEngine::Request request{ AsyncIoEngine::Operation::STAT };
+        request.directoryFd = node->fd;
+        if (count >= AsyncIoEngine::BATCH_THRESHOLD && AsyncIoEngine::isKernelQueueAvailable()) {
+            AsyncIoEngine& engine = AsyncIoEngine::forCurrentThread();
+            for (std::size_t offset = 0; offset < count; ++offset) {
+                request.userData = offset;
+                request.path = node->names[begin + offset].c_str();
+                request.metadata = &metadata[offset];
+                engine.submit(request);
+            }
+            std::vector<AsyncIoEngine::Completion> completions;
+            while (engine.outstanding() > 0) {
+                engine.wait(completions, engine.outstanding());
+            }
+            for (const AsyncIoEngine::Completion& completion : completions) {
+                results[completion.userData] = completion.result;
+            }
+        } else {
+            for (std::size_t offset = 0; offset < count; ++offset) {
+                request.path = node->names[begin + offset].c_str();
+                request.metadata = &metadata[offset];
+                results[offset] = AsyncIoEngine::execute(request);
+            }
+        }
+
+        for (std::size_t offset = 0; offset < count; ++offset) {
+            const std::string& name = node->names[begin + offset];
+            std::uint32_t attributes = metadata[offset].attributes;
+            if (results[offset] < 0) {
+                state.fail(DirectoryWalker::joinPath(node->path, name));
+                continue;
+            }
+            // fchmodat follows symbolic links, so changing one would change a file that may lie outside the tree.
+            if (S_ISLNK(attributes)) {
+                state.skipped.fetch_add(1, std::memory_order_relaxed);
+                continue;
+            }
+
+            std::uint32_t target = FilesystemBackend::permissionsForAccess(attributes, state.access);
+            if (target == FilesystemBackend::permissionsOf(attributes)) {
+                state.unchanged.fetch_add(1, std::memory_order_relaxed);
+            } else if (changePermissions(node->fd, name.c_str(), target)) {
+                state.changed.fetch_add(1, std::memory_order_relaxed);
+            } else {
+                state.fail(DirectoryWalker::joinPath(node->path, name));
+            }
+            if (S_ISDIR(attributes)) {
+                directories.push_back(begin + offset);
+            }
+        }
+    }
+
+    // Runs while the directory holds a slot, so its descriptor stays open for the batches and the subdirectories.
+    void applyBatch(PermitState& state, Node* node, std::size_t begin, std::size_t end) {
+        std::vector<std::size_t> directories;
+        applyEntries(state, node, begin, end, directories);
+        for (std::size_t index : directories) {
+            queueChild(state, node, node->names[index]);
+        }
+        finishNode(node);
+    }
+
+    // A directory with subdirectories keeps its descriptor for them while it holds a slot, and regardless of the budget
+    // once its path from the anchor is long enough to make the opens below it expensive.
+    void settleDescriptor(Node* node, bool hasSubdirectories) {
+        if (hasSubdirectories && (node->holdsSlot || node->relativePath.size() >= DescriptorBudget::MAX_RELATIVE_PATH)) {
+            return;
+        }
+        if (node->holdsSlot) {
+            DescriptorBudget::instance().release();
+            node->holdsSlot = false;
+        }
+        INSTRUMENT_COUNT(SYSTEM_CALLS, 1);
+        close(node->fd);
+        node->fd = -1;
+    }
+
+    void readNode(PermitState& state, Node* node) {
+        int anchorFd = node->anchor != nullptr ? node->anchor->fd : AT_FDCWD;
+        INSTRUMENT_COUNT(SYSTEM_CALLS, 1);
+        node->fd = openat(anchorFd, node->relativePath.c_str(), O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+        DirectoryWalker::Listing listing;
+        if (!listing.open(node->fd)) {
+            state.fail(node->path);
+            finishNode(node);
+            return;
+        }
+
+        bool mayHaveSubdirectories = false;
+        while (listing.next()) {
+            node->names.emplace_back(listing.name());
+            mayHaveSubdirectories = mayHaveSubdirectories || listing.type() != DirectoryWalker::EntryType::OTHER;
+        }
+        listing.close();
+        INSTRUMENT_COUNT(ENTRIES_VISITED, node->names.size());
+
+        // The batches of a large directory need its descriptor until the last one is done, so they take a slot. Without
+        // one, the directory is changed by this task alone.
+        bool split = node->names.size() > ENTRIES_PER_TASK;
+        if (split || mayHaveSubdirectories) {
+            node->holdsSlot = DescriptorBudget::instance().tryAcquire();
+        }
+        if (split && node->holdsSlot) {
+            // Queued last to first, so the worker that pops its own queue from the back changes them in directory order.
+            for (std::size_t end = node->names.size(); end > 0;) {
+                std::size_t begin = (end - 1) / ENTRIES_PER_TASK * ENTRIES_PER_TASK;
+                node->pending.fetch_add(1, std::memory_order_relaxed);
+                state.pool.submit([&state, node, begin, end] { applyBatch(state, node, begin, end); });
+                end = begin;
+            }
+            finishNode(node);
+            return;
+        }
+
+        std::vector<std::size_t> directories;
+        applyEntries(state, node, 0, node->names.size(), directories);
+        // The subdirectories are queued once the descriptor is settled, since they are opened relative to it or its anchor.
+        settleDescriptor(node, !directories.empty());
+        for (std::size_t index : directories) {
+            queueChild(state, node, node->names[index]);
+        }
+        node->names = std::vector<std::string>();
+        finishNode(node);
+    }
+#endif
+}
+
+TreePermissions::Result TreePermissions::apply(const std::string& path, FilesystemBackend::Access access, unsigned threadCount) {
+    INSTRUMENT_SCOPE("TreePermissions::apply");
+    auto start = std::chrono::steady_clock::now();
+    PermitState state(threadCount, access);
+
+    // The root is changed by its path; everything below it relative to the descriptor of its directory.
+    FilesystemBackend::Metadata metadata;
+    if (!FilesystemBackend::getMetadata(path, metadata)) {
+        state.fail(path);
+    } else if (metadata.isLink) {
+        state.skipped.fetch_add(1, std::memory_order_relaxed);
+    } else {
+        std::uint32_t target = FilesystemBackend::permissionsForAccess(metadata.attributes, access);
+        if (target == FilesystemBackend::permissionsOf(metadata.attributes)) {
+            state.unchanged.fetch_add(1, std::memory_order_relaxed);
+        } else if (FilesystemBackend::setPermissions(path, target) == FilesystemBackend::Status::OK) {
+            state.changed.fetch_add(1, std::memory_order_relaxed);
+        } else {
+            state.fail(path);
+        }
+
+        if (metadata.isDirectory) {
+            Node* root = new Node(nullptr, path);
+#ifndef _WIN32
+            root->relativePath = path;
+#endif
+            readNode(state, root);
+            state.pool.wait();
+        }
+    }
+
+    return { state.changed.load(), state.unchanged.load(), state.skipped.load(), state.failures.load(), state.firstFailure,
+        std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count() };
+}
\ No newline at end of file
@@ -0,0 +1,198 @@
+#ifndef ASYNC_IO_ENGINE_H
+#define ASYNC_IO_ENGINE_H
+
+#include "Directory_Walker.h"
+
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+class ThreadPool;
+
+/**
+ * @class AsyncIoEngine
+ * @brief Submits file operations in batches and reports their completions.
+ *
+ * On Linux the operations are placed in an io_uring submission queue and handed to the kernel with one system call
+ * per batch, so a thousand unlinks or stats cost one io_uring_enter instead of a thousand system calls. The ring is
+ * set up with raw system calls and probed for the supported operations; an operation the kernel cannot run
+ * asynchronously, and every operation on systems without io_uring, is run on a small worker pool instead. io_uring
+ * has no opcode for a permission change, so CHMOD always takes the pool. The completions of both paths are returned
+ * by the same wait call.
+ *
+ * On Windows the pool runs the path-based operations (stat, rename, unlink, remove directory and attribute changes)
+ * through the Win32 API; the descriptor-based operations are not available there.
+ *
+ * An engine is meant to be used by one thread at a time. The paths and buffers of a request must stay valid until its
+ * completion has been returned.
+ */
+class AsyncIoEngine {
+public:
+    /**
+     * Default number of submission queue entries.
+     */
+    static const unsigned DEFAULT_QUEUE_DEPTH = 256;
+
+    /**
+     * Number of requests from which a batch is worth handing to the kernel queue. The kernel runs path operations such
+     * as statx and unlinkat on its own worker threads, and for a handful of requests that hand-off costs more than
+     * calling the operations directly.
+     */
+    static const std::size_t BATCH_THRESHOLD = 64;
+
+    /**
+     * Directory descriptor meaning the current working directory, like AT_FDCWD.
+     */
+    static const int CURRENT_DIRECTORY = -100;
+
+    /**
+     * Flag for RENAME that fails the rename with EEXIST, or ERROR_ALREADY_EXISTS on Windows, instead of replacing an
+     * existing target. Kernels and filesystems that cannot check atomically fail it with EINVAL.
+     */
+    static const int NO_REPLACE = 1;
+
+    /**
+     * The operations an engine can run.
+     */
+    enum class Operation {
+        STAT,
+        OPEN,
+        CLOSE,
+        READ,
+        WRITE,
+        RENAME,
+        UNLINK,
+        REMOVE_DIRECTORY,
+        CHMOD
+    };
+
+    /**
+     * A single operation. Only the fields used by the operation need to be set.
+     */
+    struct Request {
+        Operation operation;
+        /** Value returned with the completion. */
+        std::uint64_t userData = 0;
+        /** Directory the path is relative to; ignored on Windows. */
+        int directoryFd = CURRENT_DIRECTORY;
+        const char* path = nullptr;
+        /** Directory the new path of a rename is relative to; ignored on Windows. */
+        int newDirectoryFd = CURRENT_DIRECTORY;
+        const char* newPath = nullptr;
+        /** Open flags for OPEN; NO_REPLACE or zero for RENAME. */
+        int flags = 0;
+        /** Permission bits for OPEN and CHMOD; file attributes for CHMOD on Windows. */
+        std::uint32_t mode = 0;
+        /** File descriptor for CLOSE, READ and WRITE. */
+        int fd = -1;
+        void* buffer = nullptr;
+        std::uint32_t length = 0;
+        std::uint64_t offset = 0;
+        /** Receives the metadata of a STAT, which does not follow symbolic links. */
+        DirectoryWalker::Entry* metadata = nullptr;
+    };
+
+    /**
+     * The outcome of a request.
+     */
+    struct Completion {
+        std::uint64_t userData;
+        /** The result of the operation, or a negative error code: -errno on POSIX, -GetLastError() on Windows. */
+        int result;
+    };
+
+    /**
+     * Creates an engine, setting up an io_uring where the kernel supports one.
+     *
+     * @param queueDepth The number of requests that can be in flight in the kernel at once.
+     */
+    explicit AsyncIoEngine(unsigned queueDepth = DEFAULT_QUEUE_DEPTH);
+
+    /**
+     * Waits for the requests in flight and releases the ring.
+     */
+    ~AsyncIoEngine();
+
+    AsyncIoEngine(const AsyncIoEngine&) = delete;
+    AsyncIoEngine& operator=(const AsyncIoEngine&) = delete;
+
+    /**
+     * Queues a request. Queued requests go to the kernel when the queue is full or on flush and wait.
+     *
+     * @param request The request to queue.
+     */
+    void submit(const Request& request);
+
+    /**
+     * Hands all queued requests to the kernel without waiting for them.
+     */
+    void flush();
+
+    /**
+     * Flushes the queue and waits until at least the given number of completions is available, or until nothing is
+     * in flight anymore, then returns every available completion.
+     *
+     * @param completions The vector the completions are appended to.
+     * @param minimum The number of completions to wait for.
+     * @return The number of completions appended.
+     */
+    std::size_t wait(std::vector<Completion>& completions, std::size_t minimum = 1);
+
+    /**
+     * Returns the number of requests submitted whose completion has not been returned yet.
+     *
+     * @return The number of outstanding requests.
+     */
+    std::size_t outstanding() const;
+
+    /**
+     * Returns whether requests are handed to the kernel queue.
+     *
+     * @return True if an io_uring is in use, false if every request runs on the worker pool.
+     */
+    bool usesKernelQueue() const;
+
+    /**
+     * Returns whether the kernel offers an io_uring that supports stat and unlink, checked once per process.
+     *
+     * @return True if io_uring can be used, false otherwise.
+     */
+    static bool isKernelQueueAvailable();
+
+    /**
+     * Returns the engine of the calling thread, created on first use and released when the thread exits. Callers
+     * collect all of their completions before returning, so unrelated code on the same thread can share the engine.
+     *
+     * @return The engine of the calling thread.
+     */
+    static AsyncIoEngine& forCurrentThread();
+
+    /**
+     * Runs a request synchronously on the calling thread.
+     *
+     * @param request The request to run.
+     * @return The result of the operation, or a negative error code.
+     */
+    static int execute(const Request& request);
+
+private:
+    struct Ring;
+
+    void runOnPool(const Request& request);
+    std::size_t takeFallbackCompletions(std::vector<Completion>& completions);
+
+    std::unique_ptr<Ring> ring;
+    std::size_t ringOutstanding;
+    mutable std::mutex fallbackMutex;
+    std::condition_variable fallbackDone;
+    std::deque<Completion> fallbackCompletions;
+    std::size_t fallbackInFlight;
+    // Declared last, so its workers are joined before the state they report to is destroyed.
+    std::unique_ptr<ThreadPool> pool;
+};
+
+#endif
\ No newline at end of file
@@ -0,0 +1,69 @@
+#ifndef BATCH_RUNNER_H
+#define BATCH_RUNNER_H
+
+#include <cstddef>
+#include <functional>
+#include <string>
+#include <vector>
+
+/**
+ * @class BatchRunner
+ * @brief Runs the commands of a script, concurrently where they cannot affect each other.
+ *
+ * Every command declares the paths it reads and the paths it writes. Two paths overlap if they are equal or one is a
+ * directory containing the other, compared component by component without touching the disk; a relative path and an
+ * absolute path are always taken to overlap, since the script may change the directory they are relative to. A
+ * command waits for every earlier command that writes a path overlapping one of its paths, or reads a path
+ * overlapping one it writes; all other commands run at the same time on a worker pool.
+ *
+ * Barrier commands, such as changing the directory, run alone on the calling thread after everything before them has
+ * finished. The output of every other command is captured and printed in script order, so a script prints the same
+ * text as when its commands run one after another.
+ */
+class BatchRunner {
+public:
+    /**
+     * A parsed command of a script.
+     */
+    struct Command {
+        /** The line of the script the command was read from. */
+        std::size_t lineNumber = 0;
+        /** Runs the command, writing its output to ColoredConsole::out(). */
+        std::function<void()> action;
+        std::vector<std::string> reads;
+        std::vector<std::string> writes;
+        /** Whether the command has to run alone, after all earlier commands and before all later ones. */
+        bool barrier = false;
+    };
+
+    /**
+     * Summary of a run.
+     */
+    struct Result {
+        std::size_t commands;
+        std::size_t barriers;
+        /** The number of commands that had to wait for an earlier one. */
+        std::size_t dependentCommands;
+        double seconds;
+    };
+
+    /**
+     * Runs commands, printing their output to std::cout in the order of the commands.
+     *
+     * @param commands The commands in script order.
+     * @param threadCount The number of commands run at the same time. Zero selects the number of hardware threads.
+     * @return The summary of the run.
+     */
+    static Result run(const std::vector<Command>& commands, unsigned threadCount = 0);
+
+    /**
+     * Returns whether two paths may name the same file or one may contain the other.
+     *
+     * @param left The first path, absolute or relative to the current directory.
+     * @param right The second path, absolute or relative to the current directory.
+     * @return True if the paths overlap or their relation cannot be decided lexically, false otherwise.
+     */
+    static bool overlaps(const std::string& left, const std::string& right);
+};
+
+#endif
\ No newline at end of file
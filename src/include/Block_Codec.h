@@ -0,0 +1,50 @@
+#ifndef BLOCK_CODEC_H
+#define BLOCK_CODEC_H
+
+#include <cstddef>
+#include <vector>
+
+/**
+ * @class BlockCodec
+ * @brief A fast LZ77 compressor for independent blocks of up to a few megabytes.
+ *
+ * The format follows the LZ4 block format: a sequence starts with a token holding the number of literals and the
+ * length of the match that follows them, each extended by 255-valued bytes when it does not fit into four bits, then
+ * the literals, then a two-byte little-endian match distance. The last sequence has literals only. Matches are found
+ * through a single hash table of four-byte prefixes, which trades ratio for a speed that keeps up with the disk.
+ *
+ * Every block is self-contained, so blocks can be compressed and decompressed on different threads and any block can
+ * be decompressed without the ones before it.
+ */
+class BlockCodec {
+public:
+    /**
+     * Returns the largest compressed size of a block, reached for incompressible input.
+     *
+     * @param size The size of the input.
+     * @return The size of the output buffer compress needs.
+     */
+    static std::size_t maxCompressedSize(std::size_t size);
+
+    /**
+     * Compresses a block.
+     *
+     * @param input The data to compress.
+     * @param size The size of the data.
+     * @param output Receives the compressed block, replacing its contents. Its capacity is reused.
+     */
+    static void compress(const char* input, std::size_t size, std::vector<char>& output);
+
+    /**
+     * Decompresses a block. Damaged input is detected and never read or written out of bounds.
+     *
+     * @param input The compressed block.
+     * @param size The size of the compressed block.
+     * @param output The buffer receiving the data.
+     * @param outputSize The exact size of the decompressed data.
+     * @return True if the block decompressed to exactly outputSize bytes, false if it is damaged.
+     */
+    static bool decompress(const char* input, std::size_t size, char* output, std::size_t outputSize);
+};
+
+#endif
\ No newline at end of file
@@ -0,0 +1,154 @@
+#ifndef BULK_OPERATION_H
+#define BULK_OPERATION_H
+
+#include "Filesystem_Backend.h"
+
+#include <cstddef>
+#include <functional>
+#include <string>
+#include <vector>
+
+/**
+ * @class BulkOperation
+ * @brief Expands a glob or a substitution into many files and applies one operation to all of them in parallel.
+ *
+ * A pattern is expanded once: the directory part is taken literally and its entries are matched against the glob in
+ * the last path component. The targets of a rename or move are then checked against each other and against the
+ * target directory before anything is touched, so a collision stops the whole operation instead of leaving it half
+ * done. The operation itself runs in batches on a worker pool, or, for renames and permission changes, as one batch
+ * on an AsyncIoEngine, and the outcome is counted rather than reported file by file.
+ */
+class BulkOperation {
+public:
+    /**
+     * Number of collisions and failures kept for the report.
+     */
+    static const std::size_t MAX_REPORTED = 10;
+
+    /**
+     * Number of items processed by one task.
+     */
+    static const std::size_t BATCH_SIZE = 64;
+
+    /**
+     * A file to operate on and, for renames and moves, its new path.
+     */
+    struct Item {
+        std::string source;
+        std::string target;
+    };
+
+    /**
+     * Summary of a run.
+     */
+    struct Result {
+        std::size_t succeeded;
+        std::size_t failed;
+        /** Up to MAX_REPORTED paths that failed. */
+        std::vector<std::string> failures;
+        double seconds;
+    };
+
+    /**
+     * Returns whether the last component of a path contains glob characters.
+     *
+     * @param path The path to test.
+     * @return True if the path is a pattern, false if it names a single file.
+     */
+    static bool isPattern(const std::string& path);
+
+    /**
+     * Returns whether an argument is a substitution of the form s/regex/replacement/flags. Any punctuation character
+     * can stand in for the slash.
+     *
+     * @param expression The argument to test.
+     * @return True if the argument is a substitution, false otherwise.
+     */
+    static bool isSubstitution(const std::string& expression);
+
+    /**
+     * Returns the directory part of a path or pattern.
+     *
+     * @param path The path.
+     * @return Everything before the last path separator, or an empty string for the current directory.
+     */
+    static std::string directoryOf(const std::string& path);
+
+    /**
+     * Lists the entries of a directory whose names match a glob.
+     *
+     * @param pattern The directory followed by a glob, such as "*.log". Only the last component may be a glob.
+     * @param items Receives one item per match, with an empty target.
+     * @param error Receives the reason if the pattern cannot be expanded.
+     * @return True if the pattern was expanded, even to no matches, false otherwise.
+     */
+    static bool expand(const std::string& pattern, std::vector<Item>& items, std::string& error);
+
+    /**
+     * Lists the entries of a directory whose names a substitution changes, with their new paths.
+     *
+     * The regular expression uses the ECMAScript syntax and the replacement may refer to groups as $1, $2 and so on.
+     * Only the first match in a name is replaced unless the flags contain "g"; "i" ignores case.
+     *
+     * @param expression The substitution, such as s/(.*)\.tmp/$1.bak/.
+     * @param directoryPath The directory whose entries are renamed.
+     * @param items Receives one item per changed name.
+     * @param error Receives the reason if the substitution is invalid.
+     * @return True if the substitution was expanded, even to no matches, false otherwise.
+     */
+    static bool expandSubstitution(const std::string& expression, const std::string& directoryPath, std::vector<Item>& items, std::string& error);
+
+    /**
+     * Sets the target of every item to the same name inside a directory.
+     *
+     * @param items The items to move.
+     * @param destinationDirectory The directory the items are moved into.
+     */
+    static void setTargets(std::vector<Item>& items, const std::string& destinationDirectory);
+
+    /**
+     * Checks the targets of a rename or move: no two items may share a target, no target may already exist in the
+     * target directory, and no directory may be moved into itself.
+     *
+     * @param items The items with their targets.
+     * @param targetDirectory The directory all targets are in.
+     * @param examples Receives up to MAX_REPORTED descriptions of collisions.
+     * @return The number of collisions.
+     */
+    static std::size_t findCollisions(const std::vector<Item>& items, const std::string& targetDirectory, std::vector<std::string>& examples);
+
+    /**
+     * Applies an operation to every item on a worker pool.
+     *
+     * @param items The items.
+     * @param operation Returns true if the operation succeeded for an item. It is called from several threads at once.
+     * @param threadCount The number of worker threads. Zero selects the number of hardware threads.
+     * @return The counts of succeeded and failed items.
+     */
+    static Result run(const std::vector<Item>& items, const std::function<bool(const Item&)>& operation, unsigned threadCount = 0);
+
+    /**
+     * Renames every item to its target through the AsyncIoEngine of the calling thread, in one batch on the kernel
+     * queue where there is one. An existing target is never replaced. Where the engine cannot rule that out
+     * atomically, the item is renamed through FilesystemBackend::rename instead.
+     *
+     * @param items The items with their targets.
+     * @param acrossDevices Moves an item whose target is on another filesystem and returns true if it succeeded. It
+     *                      is called from several threads at once. Without it such items fail.
+     * @return The counts of succeeded and failed items.
+     */
+    static Result rename(const std::vector<Item>& items, const std::function<bool(const Item&)>& acrossDevices = nullptr);
+
+    /**
+     * Grants an access to every item through the AsyncIoEngine of the calling thread. The modes are read in one batch,
+     * on the kernel queue where there is one, and only the items whose mode differs are changed. Symbolic links are
+     * left alone, since changing one would change its target, and count as succeeded.
+     *
+     * @param items The items.
+     * @param access The access to grant.
+     * @return The counts of succeeded and failed items.
+     */
+    static Result setPermissions(const std::vector<Item>& items, FilesystemBackend::Access access);
+};
+
+#endif
\ No newline at end of file
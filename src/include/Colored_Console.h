@@ -1,30 +1,85 @@
 #ifndef COLORED_CONSOLE_H
 #define COLORED_CONSOLE_H
 
-#include <windows.h>
+#include <cstdint>
+#include <ostream>
 
-const WORD DEFAULT_COLOR = FOREGROUND_INTENSITY | FOREGROUND_RED | FOREGROUND_GREEN | FOREGROUND_BLUE;
-const WORD SUCCESS_COLOR = FOREGROUND_INTENSITY | FOREGROUND_GREEN;
-const WORD ERROR_COLOR = FOREGROUND_INTENSITY | FOREGROUND_RED;
-const WORD PATH_COLOR = FOREGROUND_INTENSITY;
-const WORD HEADING_COLOR = FOREGROUND_INTENSITY | FOREGROUND_RED | FOREGROUND_GREEN | FOREGROUND_BLUE | BACKGROUND_BLUE | BACKGROUND_RED;
+/**
+ * Console colors use the bit layout of the Windows console attributes, which are passed to the console unchanged.
+ * Other systems translate them to ANSI escape sequences.
+ */
+const std::uint16_t COLOR_BLUE = 0x0001;
+const std::uint16_t COLOR_GREEN = 0x0002;
+const std::uint16_t COLOR_RED = 0x0004;
+const std::uint16_t COLOR_INTENSITY = 0x0008;
+const std::uint16_t BACKGROUND_SHIFT = 4;
+
+const std::uint16_t DEFAULT_COLOR = COLOR_INTENSITY | COLOR_RED | COLOR_GREEN | COLOR_BLUE;
+const std::uint16_t SUCCESS_COLOR = COLOR_INTENSITY | COLOR_GREEN;
+const std::uint16_t ERROR_COLOR = COLOR_INTENSITY | COLOR_RED;
+const std::uint16_t PATH_COLOR = COLOR_INTENSITY;
+const std::uint16_t HEADING_COLOR = DEFAULT_COLOR | (COLOR_BLUE | COLOR_RED) << BACKGROUND_SHIFT;
 
 /**
  * @class ColoredConsole
  * @brief A class for manipulating the colors of the console output.
  *
  * The ColoredConsole class provides functionality to change the color of the console output.
+ *
+ * When the standard output is a console, std::cout is replaced by a buffered renderer: text and color changes are
+ * appended to a lock-free single-producer queue, and a render thread writes everything queued so far in one call,
+ * turning color changes into escape sequences (or console attributes on Windows) only where the color of the written
+ * text actually changes. Writing to the console therefore never waits for the terminal, and std::endl costs no system
+ * call. When the standard output is a file or a pipe, std::cout is left unbuffered and colors are ignored.
+ *
+ * The queue has a single producer: only the thread running the session writes to std::cout, and other threads use
+ * redirectOutput.
  */
 class ColoredConsole {
 public:
     /**
-	 * @brief Sets the color of the console output.
-	 * @param color The color to be set, defined by a combination of color attributes from the Windows API.
-	 *
-	 * This function sets the color or the background color of the console output to the specified color. The color is defined by 
-	 * a combination of color attributes from the Windows API.
-	 */
-	static void setConsoleColor(WORD color);
+     * @brief Sets the color of the console output.
+     * @param color The color to be set, defined by a combination of the COLOR_ constants.
+     *
+     * This function sets the color or the background color of the console output to the specified color. The color is defined by 
+     * a combination of the COLOR_ constants; the bits above BACKGROUND_SHIFT select the background. DEFAULT_COLOR restores
+     * the colors of the terminal on systems other than Windows.
+     */
+    static void setConsoleColor(std::uint16_t color);
+
+    /**
+     * @brief Enables or disables color changes for the whole process.
+     * @param enabled False to make setConsoleColor do nothing, for example when the output is not read by a person.
+     */
+    static void setColorsEnabled(bool enabled);
+
+    /**
+     * @brief Waits until everything written to the console so far has been rendered.
+     *
+     * Called before reading input or running a program that writes to the same terminal, so the prompt and the
+     * earlier output appear first. Does nothing when the standard output is not a console.
+     */
+    static void flush();
+
+    /**
+     * @brief Returns the stream the calling thread writes its output to.
+     * @return The stream set by redirectOutput, or std::cout.
+     */
+    static std::ostream& out();
+
+    /**
+     * @brief Sends the output of the calling thread to another stream, so concurrent commands do not interleave.
+     * @param stream The stream receiving the output, or nullptr to return to std::cout.
+     *
+     * Color changes are skipped while the output is redirected, because they would apply to the console, not the stream.
+     */
+    static void redirectOutput(std::ostream* stream);
+
+    /**
+     * @brief Returns whether the output of the calling thread is redirected.
+     * @return True if the calling thread writes to a stream set by redirectOutput, false otherwise.
+     */
+    static bool isRedirected();
 };
 
 #endif
\ No newline at end of file
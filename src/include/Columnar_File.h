@@ -0,0 +1,172 @@
+#ifndef COLUMNAR_FILE_H
+#define COLUMNAR_FILE_H
+
+#include "Mapped_File.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+/**
+ * @class ColumnarFile
+ * @brief The file layout shared by the DirectoryIndex and the DirectorySnapshot: one column per field, each holding a
+ * value for every entry, so a mapped file is read in place without parsing.
+ *
+ * The header holds an eight-byte magic, the format version, the entry count and the offset and size of every column.
+ * Every column starts on an eight-byte boundary. Columns of fixed-size values hold one value per entry; byte columns,
+ * such as the packed names, have any size.
+ */
+class ColumnarFile {
+public:
+    /**
+     * Longest name stored; longer names are truncated.
+     */
+    static const std::size_t MAX_NAME_LENGTH = 0xFFFF;
+
+    /**
+     * The names of the entries, packed back to back into one byte column with an offset and a length column.
+     */
+    struct NameColumns {
+        std::vector<std::uint64_t> offsets;
+        std::vector<std::uint16_t> lengths;
+        std::string characters;
+
+        /**
+         * Appends the name of the next entry.
+         *
+         * @param name The name, truncated to MAX_NAME_LENGTH bytes.
+         */
+        void append(std::string_view name);
+    };
+
+    /**
+     * Collects the columns of a file and writes them in the order they were added.
+     */
+    class Writer {
+    public:
+        /**
+         * @param magic The eight bytes identifying the format.
+         * @param version The version of the format.
+         * @param entryCount The number of entries in every column of fixed-size values.
+         */
+        Writer(const char* magic, std::uint32_t version, std::uint32_t entryCount);
+
+        /**
+         * Adds a column of fixed-size values. The values must stay alive until write returns.
+         *
+         * @param column The values.
+         */
+        template <typename T>
+        void add(const std::vector<T>& column) {
+            add(reinterpret_cast<const char*>(column.data()), column.size() * sizeof(T));
+        }
+
+        /**
+         * Adds a byte column. The bytes must stay alive until write returns.
+         *
+         * @param data The first byte.
+         * @param size The number of bytes.
+         */
+        void add(const char* data, std::uint64_t size);
+
+        /**
+         * Writes the header and the columns.
+         *
+         * @param path The path of the file.
+         * @return True if the file was written, false otherwise.
+         */
+        bool write(const std::string& path) const;
+
+    private:
+        char magic[8];
+        std::uint32_t version;
+        std::uint32_t entryCount;
+        std::vector<const char*> columnData;
+        std::vector<std::uint64_t> columnSizes;
+    };
+
+    ColumnarFile();
+    ColumnarFile(const ColumnarFile&) = delete;
+    ColumnarFile& operator=(const ColumnarFile&) = delete;
+
+    /**
+     * Maps a file and checks its header, replacing the current mapping.
+     *
+     * @param path The path of the file.
+     * @param magic The eight bytes identifying the format.
+     * @param version The version of the format.
+     * @param valueSizes The size of a value for every column, or zero for a byte column.
+     * @param columnCount The number of columns.
+     * @return True if the file has the format, at least one entry, and columns of the expected sizes inside the file;
+     * false otherwise.
+     */
+    bool open(const std::string& path, const char* magic, std::uint32_t version, const std::size_t* valueSizes, std::size_t columnCount);
+
+    /**
+     * Unmaps the file.
+     */
+    void close();
+
+    /**
+     * Returns whether a file is mapped.
+     *
+     * @return True if open succeeded and close has not been called since.
+     */
+    bool isOpen() const;
+
+    /**
+     * Returns the number of entries.
+     *
+     * @return The entry count of the header.
+     */
+    std::uint32_t entryCount() const;
+
+    /**
+     * Returns a column of fixed-size values.
+     *
+     * @param column The position of the column.
+     * @return The first value, inside the mapping.
+     */
+    template <typename T>
+    const T* values(std::size_t column) const {
+        return reinterpret_cast<const T*>(file.data() + columnOffsets[column]);
+    }
+
+    /**
+     * Returns a byte column.
+     *
+     * @param column The position of the column.
+     * @return A view of the column inside the mapping.
+     */
+    std::string_view bytes(std::size_t column) const;
+
+    /**
+     * Checks that every name lies inside its byte column.
+     *
+     * @param offsetColumn The column of the name offsets.
+     * @param lengthColumn The column of the name lengths.
+     * @param characterColumn The byte column of the names.
+     * @return True if every name is inside the column, false otherwise.
+     */
+    bool hasValidNames(std::size_t offsetColumn, std::size_t lengthColumn, std::size_t characterColumn) const;
+
+    /**
+     * Checks the child ranges of a breadth-first layout: the children of an entry follow it and end within the file,
+     * so a walk along them always moves forward and stays in bounds.
+     *
+     * @param firstChildColumn The column of the first children.
+     * @param childCountColumn The column of the child counts.
+     * @return True if every range is valid, false otherwise.
+     */
+    bool hasValidChildRanges(std::size_t firstChildColumn, std::size_t childCountColumn) const;
+
+private:
+    MappedFile file;
+    std::uint32_t count;
+    const std::uint64_t* columnOffsets;
+    const std::uint64_t* columnSizes;
+};
+
+#endif
\ No newline at end of file
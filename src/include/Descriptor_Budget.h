@@ -0,0 +1,70 @@
+#ifndef DESCRIPTOR_BUDGET_H
+#define DESCRIPTOR_BUDGET_H
+
+#include <atomic>
+#include <cstddef>
+
+/**
+ * @class DescriptorBudget
+ * @brief A process-wide limit on the directory descriptors that traversals keep open.
+ *
+ * Traversals open every directory relative to the descriptor of an ancestor, so the kernel resolves one component per
+ * directory instead of the whole path. Each descriptor kept open for the subdirectories takes a slot of this budget.
+ * Without a free slot, a directory is closed right after it is read, and its subdirectories are opened by their path
+ * relative to the nearest ancestor that is still open.
+ *
+ * The budget is half of the soft limit on open files, so the traversals of concurrent commands never exhaust the
+ * descriptors the rest of the program needs.
+ */
+class DescriptorBudget {
+public:
+    /**
+     * Longest path a directory is opened by relative to an open ancestor. A directory this far from its ancestor keeps
+     * its descriptor even without a free slot, which bounds the lookups of an open and keeps the paths of arbitrarily
+     * deep trees far below PATH_MAX.
+     */
+    static const std::size_t MAX_RELATIVE_PATH = 1024;
+
+    /**
+     * Returns the budget shared by the whole process.
+     *
+     * @return The budget.
+     */
+    static DescriptorBudget& instance();
+
+    DescriptorBudget(const DescriptorBudget&) = delete;
+    DescriptorBudget& operator=(const DescriptorBudget&) = delete;
+
+    /**
+     * Takes a slot if one is free.
+     *
+     * @return True if a slot was taken, false if the budget is exhausted.
+     */
+    bool tryAcquire();
+
+    /**
+     * Returns a slot taken by tryAcquire.
+     */
+    void release();
+
+    /**
+     * Returns the number of slots.
+     *
+     * @return The number of descriptors traversals may keep open together.
+     */
+    std::size_t limit() const;
+
+private:
+    /**
+     * Used when the limit on open files cannot be read.
+     */
+    static const std::size_t DEFAULT_LIMIT = 256;
+    static const std::size_t MINIMUM_LIMIT = 16;
+
+    DescriptorBudget();
+
+    std::size_t slots;
+    std::atomic<std::size_t> used;
+};
+
+#endif
\ No newline at end of file
@@ -0,0 +1,90 @@
+#ifndef DIRECTORY_ARCHIVE_H
+#define DIRECTORY_ARCHIVE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+/**
+ * @class DirectoryArchive
+ * @brief Packs a directory tree into one seekable, compressed file and unpacks it again.
+ *
+ * The contents of all files are concatenated in the order of a depth-first traversal and cut into blocks of
+ * BLOCK_SIZE bytes, which are compressed independently with the BlockCodec on a worker pool. Many small files share a
+ * block, so they compress together and cost no per-file overhead in the archive. An index at the end of the file
+ * lists every block with its position, and every entry with its path, size, permissions, modification time and the
+ * position of its contents among the concatenated bytes. The index is found through a fixed-size footer, so any file
+ * can be extracted by reading the footer, the index and the one contiguous range of blocks that hold the file.
+ *
+ * Unpacking creates the directories first, preallocates the files that span several blocks, and then decompresses the
+ * blocks in parallel, each writing the parts of the files it holds. A file contained in a single block is created,
+ * written and closed by that block's task with a single open.
+ *
+ * Paths are stored relative to the packed directory with '/' separators, so an archive made on one system unpacks on
+ * another. Symbolic links and special files are skipped. Unpacking rejects any path that would leave the destination.
+ */
+class DirectoryArchive {
+public:
+    /**
+     * Number of uncompressed bytes in every block but the last.
+     */
+    static const std::size_t BLOCK_SIZE = 1 << 20;
+
+    /**
+     * Summary of a pack.
+     */
+    struct PackResult {
+        std::size_t files;
+        std::size_t directories;
+        /** Symbolic links and special files, which are not packed. */
+        std::size_t skipped;
+        /** Files and directories that could not be read completely. A file that could not be read is stored as zeros. */
+        std::size_t unreadable;
+        std::size_t blocks;
+        std::uint64_t bytes;
+        /** The size of the blocks as stored, without the header, the index and the footer. */
+        std::uint64_t compressedBytes;
+        /** The size of the whole archive file. */
+        std::uint64_t archiveBytes;
+        double seconds;
+    };
+
+    /**
+     * Summary of an unpack.
+     */
+    struct UnpackResult {
+        std::size_t files;
+        std::size_t directories;
+        std::size_t failures;
+        std::uint64_t bytes;
+        std::string firstFailure;
+        double seconds;
+    };
+
+    /**
+     * Packs a directory tree.
+     *
+     * @param rootPath The path of the directory to pack.
+     * @param archivePath The path of the archive. If it lies inside the tree, it is left out of the archive.
+     * @param threadCount The number of worker threads. Zero selects the number of hardware threads.
+     * @param result Receives the counters of the pack.
+     * @return True if the archive was written, false if the directory could not be read or the archive not written.
+     */
+    static bool pack(const std::string& rootPath, const std::string& archivePath, unsigned threadCount, PackResult& result);
+
+    /**
+     * Unpacks an archive, or a single file or directory of it.
+     *
+     * @param archivePath The path of the archive.
+     * @param destination The directory to unpack into. It is created if needed; existing files are replaced.
+     * @param entryPath The path of the file or directory to extract, relative to the packed directory, or an empty
+     * string to extract everything. The entry keeps its path below the destination.
+     * @param threadCount The number of worker threads. Zero selects the number of hardware threads.
+     * @param result Receives the counters of the unpack; failures lists the files that could not be written.
+     * @return True if the archive could be read and contains the entry, false otherwise.
+     */
+    static bool unpack(const std::string& archivePath, const std::string& destination, const std::string& entryPath, unsigned threadCount,
+        UnpackResult& result);
+};
+
+#endif
\ No newline at end of file
@@ -0,0 +1,184 @@
+#ifndef DIRECTORY_CACHE_H
+#define DIRECTORY_CACHE_H
+
+#include "Directory_Walker.h"
+
+#include <cstddef>
+#include <functional>
+#include <list>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+/**
+ * @class DirectoryCache
+ * @brief A thread-safe, memory-bounded cache of directory listings.
+ *
+ * The DirectoryCache class keeps the entries of recently listed directories in memory. It evicts the least recently
+ * used directories when the estimated memory use exceeds the byte budget or the number of cached directories exceeds
+ * the directory limit. Single entries can be added and removed in place, so a change notification does not force the
+ * whole directory to be read again.
+ *
+ * A directory that is being read is marked with beginLoad. A change reported for it before finishLoad marks the
+ * listing as outdated, and finishLoad then does not store it, so a change that happens during the read is never lost.
+ */
+class DirectoryCache {
+public:
+    /**
+     * Counters describing the cache.
+     */
+    struct Stats {
+        std::size_t directories;
+        std::size_t entries;
+        std::size_t bytes;
+        std::size_t budget;
+        std::size_t hits;
+        std::size_t misses;
+        std::size_t evictions;
+    };
+
+    /**
+     * Receives a cached listing while the cache is locked.
+     */
+    using Consumer = std::function<void(const std::vector<DirectoryWalker::Entry>& entries)>;
+
+    /**
+     * Creates an empty cache.
+     *
+     * @param byteBudget The maximum estimated memory used by the cached listings.
+     * @param maxDirectories The maximum number of cached directories.
+     */
+    DirectoryCache(std::size_t byteBudget, std::size_t maxDirectories);
+
+    /**
+     * Copies the cached listing of a directory and marks it as recently used.
+     *
+     * @param directoryPath The path of the directory.
+     * @param entries The vector receiving the entries.
+     * @return True on a cache hit, false otherwise.
+     */
+    bool get(const std::string& directoryPath, std::vector<DirectoryWalker::Entry>& entries);
+
+    /**
+     * Passes the cached listing of a directory to a consumer without copying it and marks it as recently used. The
+     * cache stays locked while the consumer runs, so it must not call back into the cache.
+     *
+     * @param directoryPath The path of the directory.
+     * @param consumer The callback receiving the entries.
+     * @return True on a cache hit, false otherwise.
+     */
+    bool visit(const std::string& directoryPath, const Consumer& consumer);
+
+    /**
+     * Returns whether a directory is cached without counting a hit or a miss.
+     *
+     * @param directoryPath The path of the directory.
+     * @return True if the directory is cached, false otherwise.
+     */
+    bool contains(const std::string& directoryPath);
+
+    /**
+     * Stores the listing of a directory, replacing an older one.
+     *
+     * @param directoryPath The path of the directory.
+     * @param entries The entries of the directory.
+     * @return The paths of the directories no longer cached, including the directory itself if its listing alone exceeds the budget.
+     */
+    std::vector<std::string> put(const std::string& directoryPath, std::vector<DirectoryWalker::Entry> entries);
+
+    /**
+     * Marks a directory as being read, so that changes reported before finishLoad are remembered.
+     *
+     * @param directoryPath The path of the directory.
+     */
+    void beginLoad(const std::string& directoryPath);
+
+    /**
+     * Stores the listing of a directory marked with beginLoad, unless a change was reported for the directory since.
+     *
+     * @param directoryPath The path of the directory.
+     * @param entries The entries read after beginLoad.
+     * @param evicted Receives the paths of the directories no longer cached, as returned by put.
+     * @return True if the listing was stored, false if it was outdated or exceeds the budget on its own.
+     */
+    bool finishLoad(const std::string& directoryPath, std::vector<DirectoryWalker::Entry> entries, std::vector<std::string>& evicted);
+
+    /**
+     * Removes the mark of beginLoad from a directory that could not be read.
+     *
+     * @param directoryPath The path of the directory.
+     */
+    void abandonLoad(const std::string& directoryPath);
+
+    /**
+     * Adds an entry to a cached directory, replacing an entry with the same name. Uncached directories are ignored.
+     *
+     * @param directoryPath The path of the directory.
+     * @param entry The entry to add.
+     * @return The paths of the directories evicted to keep the cache within its budget.
+     */
+    std::vector<std::string> addEntry(const std::string& directoryPath, const DirectoryWalker::Entry& entry);
+
+    /**
+     * Removes an entry from a cached directory. Uncached directories are ignored.
+     *
+     * @param directoryPath The path of the directory.
+     * @param name The name of the entry to remove.
+     */
+    void removeEntry(const std::string& directoryPath, const std::string& name);
+
+    /**
+     * Drops a directory from the cache.
+     *
+     * @param directoryPath The path of the directory.
+     */
+    void erase(const std::string& directoryPath);
+
+    /**
+     * Returns the paths of all cached directories.
+     *
+     * @return The paths of the cached directories.
+     */
+    std::vector<std::string> directories();
+
+    /**
+     * Returns the current counters.
+     *
+     * @return The counters.
+     */
+    Stats stats();
+
+private:
+    struct Slot {
+        std::vector<DirectoryWalker::Entry> entries;
+        std::size_t bytes;
+        std::list<std::string>::iterator usage;
+    };
+
+    // A directory between beginLoad and finishLoad, possibly read by several threads at once.
+    struct Load {
+        std::size_t readers;
+        bool changed;
+    };
+
+    static std::size_t estimateBytes(const DirectoryWalker::Entry& entry);
+    void store(const std::string& directoryPath, std::vector<DirectoryWalker::Entry> entries, std::vector<std::string>& evicted);
+    void evictOver(std::size_t bytes, const std::string& keptPath, std::vector<std::string>& evicted);
+    void markChanged(const std::string& directoryPath);
+    void eraseSlot(std::unordered_map<std::string, Slot>::iterator slot);
+
+    std::mutex mutex;
+    std::unordered_map<std::string, Slot> slots;
+    std::unordered_map<std::string, Load> loads;
+    std::list<std::string> usageOrder;
+    std::size_t byteBudget;
+    std::size_t maxDirectories;
+    std::size_t usedBytes;
+    std::size_t entryCount;
+    std::size_t hits;
+    std::size_t misses;
+    std::size_t evictions;
+};
+
+#endif
\ No newline at end of file
@@ -0,0 +1,80 @@
+#ifndef DIRECTORY_CURSOR_H
+#define DIRECTORY_CURSOR_H
+
+#include "Directory_Walker.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+/**
+ * @class DirectoryCursor
+ * @brief Reads the entries of one directory lazily, a batch at a time, in the order of the filesystem.
+ *
+ * The cursor keeps the directory open between batches and continues where the previous batch ended, so a listing can
+ * show the first entries of a directory with millions of files before the rest has been read, and stop at any point.
+ * Memory use depends on the batch size only: the names of a batch share one buffer that is reused by the next batch,
+ * and the metadata is read only for the entries of the batch, and only when asked for.
+ *
+ * The entries come from a DirectoryWalker::Listing, which on Linux reads them with getdents64 into a fixed buffer.
+ */
+class DirectoryCursor {
+public:
+    /**
+     * Number of entries a listing reads and renders at a time.
+     */
+    static const std::size_t BATCH_SIZE = 1024;
+
+    /**
+     * An entry of a batch.
+     */
+    struct Entry {
+        std::string_view name;
+        bool isDirectory;
+        std::uint64_t size;
+        std::int64_t modificationTime;
+    };
+
+    /**
+     * Opens a directory and places the cursor before its first entry.
+     *
+     * @param directoryPath The path of the directory.
+     * @return True if the directory could be opened, false otherwise.
+     */
+    bool open(const std::string& directoryPath);
+
+    /**
+     * Moves the cursor past entries without reading their metadata.
+     *
+     * @param count The number of entries to skip.
+     * @return The number of entries skipped, less than count at the end of the directory.
+     */
+    std::size_t skip(std::size_t count);
+
+    /**
+     * Reads the next entries. "." and ".." are left out.
+     *
+     * @param batch Receives the entries; their names are valid until the next call.
+     * @param maxEntries The largest number of entries to read.
+     * @param withMetadata Whether to read the size and the modification time of every entry. The type of an entry is
+     * always read.
+     * @return True if at least one entry was read, false at the end of the directory.
+     */
+    bool next(std::vector<Entry>& batch, std::size_t maxEntries, bool withMetadata);
+
+    /**
+     * Closes the directory. The cursor can be opened again.
+     */
+    void close();
+
+private:
+    void readMetadata(Entry& entry, bool withMetadata) const;
+
+    DirectoryWalker::Listing listing;
+    std::string names;
+    std::vector<std::size_t> nameOffsets;
+};
+
+#endif
\ No newline at end of file
@@ -0,0 +1,217 @@
+#ifndef DIRECTORY_INDEX_H
+#define DIRECTORY_INDEX_H
+
+#include "Columnar_File.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <string_view>
+
+/**
+ * @class DirectoryIndex
+ * @brief A persistent, memory-mapped index of a directory tree.
+ *
+ * The index stores every entry below a root directory in a columnar file: parent indices, name offsets and lengths,
+ * sizes, modification times, attributes and child ranges each live in their own array, and all names share one
+ * string block. Entry 0 is the root directory and the children of every directory occupy a contiguous range in
+ * filesystem order, so listing a directory or walking the tree touches only a few cache lines per entry.
+ *
+ * The index file lives in the user cache directory and is mapped read-only. A refresh compares the modification time
+ * of every indexed directory with the filesystem and re-reads only the directories that changed; the metadata of
+ * files in unchanged directories is reused as it is.
+ */
+class DirectoryIndex {
+public:
+    /**
+     * Index value used for missing entries.
+     */
+    static const std::uint32_t NO_ENTRY = 0xFFFFFFFFu;
+
+    /**
+     * Counters describing the last build or refresh.
+     */
+    struct RefreshStats {
+        std::size_t directoriesRead;
+        std::size_t directoriesReused;
+        std::size_t entryCount;
+        double seconds;
+    };
+
+    /**
+     * Callback receiving the entries of the index in depth-first order.
+     *
+     * @param depth The nesting level of the entry, 0 for the entries of the root directory.
+     * @param index The index of the entry.
+     */
+    using Visitor = std::function<void(std::size_t depth, std::uint32_t index)>;
+
+    DirectoryIndex();
+    ~DirectoryIndex();
+
+    DirectoryIndex(const DirectoryIndex&) = delete;
+    DirectoryIndex& operator=(const DirectoryIndex&) = delete;
+
+    /**
+     * Returns the path of the index file for a root directory.
+     *
+     * @param rootPath The path of the indexed root directory.
+     * @return The path of the index file in the user cache directory.
+     */
+    static std::string indexFilePath(const std::string& rootPath);
+
+    /**
+     * Maps the existing index file of a root directory.
+     *
+     * @param rootPath The path of the indexed root directory.
+     * @return True if a valid index for the root directory was found, false otherwise.
+     */
+    bool open(const std::string& rootPath);
+
+    /**
+     * Builds the index of a root directory from scratch, or refreshes it incrementally when this object already holds
+     * the index of the same root directory, and maps the result. A refresh that finds no changed directory keeps the
+     * mapped file as it is and writes nothing.
+     *
+     * @param rootPath The path of the root directory to index.
+     * @param threadCount The number of threads used to read the directories. Zero selects the number of hardware threads.
+     * @param stats Optional counters receiving the amount of work done.
+     * @return True if the index is current and mapped, false otherwise.
+     */
+    bool update(const std::string& rootPath, unsigned threadCount = 0, RefreshStats* stats = nullptr);
+
+    /**
+     * Unmaps the index.
+     */
+    void close();
+
+    /**
+     * Returns whether an index is mapped.
+     *
+     * @return True if an index is mapped, false otherwise.
+     */
+    bool isOpen() const;
+
+    /**
+     * Returns the root directory of the mapped index.
+     *
+     * @return The path of the indexed root directory.
+     */
+    const std::string& rootPath() const;
+
+    /**
+     * Returns the number of entries in the index, including the root directory.
+     *
+     * @return The number of entries.
+     */
+    std::uint32_t entryCount() const;
+
+    /**
+     * Returns the name of an entry. The root directory has an empty name.
+     *
+     * @param index The index of the entry.
+     * @return A view of the name inside the mapped index.
+     */
+    std::string_view name(std::uint32_t index) const;
+
+    /**
+     * Returns the index of the directory containing an entry. The root directory is its own parent.
+     *
+     * @param index The index of the entry.
+     * @return The index of the parent directory.
+     */
+    std::uint32_t parent(std::uint32_t index) const;
+
+    /**
+     * Returns the size of an entry in bytes.
+     *
+     * @param index The index of the entry.
+     * @return The size in bytes.
+     */
+    std::uint64_t size(std::uint32_t index) const;
+
+    /**
+     * Returns the last modification time of an entry.
+     *
+     * @param index The index of the entry.
+     * @return The modification time in nanoseconds since the Unix epoch.
+     */
+    std::int64_t modificationTime(std::uint32_t index) const;
+
+    /**
+     * Returns the raw platform attributes of an entry: dwFileAttributes on Windows, st_mode elsewhere.
+     *
+     * @param index The index of the entry.
+     * @return The attributes.
+     */
+    std::uint32_t attributes(std::uint32_t index) const;
+
+    /**
+     * Returns whether an entry is a directory.
+     *
+     * @param index The index of the entry.
+     * @return True if the entry is a directory, false otherwise.
+     */
+    bool isDirectory(std::uint32_t index) const;
+
+    /**
+     * Returns the index of the first child of a directory.
+     *
+     * @param index The index of the directory.
+     * @return The index of the first child. The children occupy childCount(index) consecutive entries.
+     */
+    std::uint32_t firstChild(std::uint32_t index) const;
+
+    /**
+     * Returns the number of children of a directory.
+     *
+     * @param index The index of the directory.
+     * @return The number of children, 0 for files.
+     */
+    std::uint32_t childCount(std::uint32_t index) const;
+
+    /**
+     * Finds the entry of a directory below the root directory.
+     *
+     * @param directoryPath The absolute path of the directory.
+     * @return The index of the directory, or NO_ENTRY if the path is not indexed.
+     */
+    std::uint32_t findDirectory(const std::string& directoryPath) const;
+
+    /**
+     * Rebuilds the path of an entry.
+     *
+     * @param index The index of the entry.
+     * @return The path of the entry, starting with the root directory.
+     */
+    std::string pathOf(std::uint32_t index) const;
+
+    /**
+     * Visits the entries below a directory in the same depth-first order as DirectoryWalker::walk.
+     *
+     * @param directory The index of the directory to start from.
+     * @param visitor The callback invoked for every entry below the directory.
+     */
+    void walk(std::uint32_t directory, const Visitor& visitor) const;
+
+private:
+    bool map(const std::string& path, const std::string& expectedRoot);
+
+    std::string indexedRoot;
+    ColumnarFile file;
+
+    std::uint32_t count;
+    const std::uint32_t* parents;
+    const std::uint64_t* nameOffsets;
+    const std::uint16_t* nameLengths;
+    const std::uint64_t* sizes;
+    const std::int64_t* modificationTimes;
+    const std::uint32_t* attributeValues;
+    const std::uint8_t* flags;
+    const std::uint32_t* firstChildren;
+    const std::uint32_t* childCounts;
+    const char* names;
+};
+
+#endif
\ No newline at end of file
@@ -0,0 +1,137 @@
+#ifndef DIRECTORY_SNAPSHOT_H
+#define DIRECTORY_SNAPSHOT_H
+
+#include "Columnar_File.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <string_view>
+
+/**
+ * @class DirectorySnapshot
+ * @brief A compact binary record of a directory tree that can be compared with another one in time proportional to
+ * the differences.
+ *
+ * A snapshot stores the name, size, modification time and hash of every entry below a root directory in the columnar
+ * layout of the DirectoryIndex: the children of every directory occupy a contiguous range, sorted by name. The hash
+ * of a file is the hash of its contents; the hash of a directory covers the names, types, sizes and hashes of its
+ * children, which makes the directories a Merkle tree. Two directories with equal hashes have identical contents, so
+ * a comparison skips an unchanged subtree after a single comparison, however large it is.
+ *
+ * Modification times are recorded but left out of the hashes, so touching a file without changing it is not a change.
+ */
+class DirectorySnapshot {
+public:
+    /**
+     * Summary of the creation of a snapshot.
+     */
+    struct CreateResult {
+        std::size_t files;
+        std::size_t directories;
+        std::size_t unreadable;
+        std::uint64_t bytesHashed;
+        double seconds;
+    };
+
+    /**
+     * The kinds of differences between two snapshots. An entry that changed between file and directory is reported as
+     * removed and added.
+     */
+    enum class Change {
+        ADDED,
+        REMOVED,
+        MODIFIED
+    };
+
+    /**
+     * Summary of a comparison.
+     */
+    struct DiffResult {
+        std::size_t added;
+        std::size_t removed;
+        std::size_t modified;
+        std::size_t directoriesCompared;
+        std::size_t subtreesSkipped;
+        double seconds;
+    };
+
+    /**
+     * Callback receiving the differences in depth-first order.
+     *
+     * @param change The kind of difference.
+     * @param path The path of the entry relative to the root of the snapshots, valid during the call.
+     * @param isDirectory Whether the entry is a directory.
+     * @param entries The number of entries added or removed with it: 1 for a file, 1 plus its contents for a directory.
+     */
+    using ChangeVisitor = std::function<void(Change change, std::string_view path, bool isDirectory, std::size_t entries)>;
+
+    DirectorySnapshot() = default;
+    DirectorySnapshot(const DirectorySnapshot&) = delete;
+    DirectorySnapshot& operator=(const DirectorySnapshot&) = delete;
+
+    /**
+     * Reads and hashes a directory tree and writes its snapshot.
+     *
+     * @param rootPath The path of the root directory.
+     * @param snapshotPath The path of the snapshot file. If it lies inside the tree, it is left out of the snapshot.
+     * @param threadCount The number of worker threads. Zero selects the number of hardware threads.
+     * @param result Receives the counters of the snapshot.
+     * @return True if the snapshot was written, false if the root directory could not be read or the file not written.
+     */
+    static bool create(const std::string& rootPath, const std::string& snapshotPath, unsigned threadCount, CreateResult& result);
+
+    /**
+     * Maps a snapshot file.
+     *
+     * @param snapshotPath The path of the snapshot file.
+     * @return True if the file holds a valid snapshot, false otherwise.
+     */
+    bool open(const std::string& snapshotPath);
+
+    /**
+     * Returns the root directory the snapshot was taken of.
+     *
+     * @return A view of the path inside the mapped snapshot.
+     */
+    std::string_view rootPath() const;
+
+    /**
+     * Returns the number of entries, including the root directory.
+     *
+     * @return The number of entries.
+     */
+    std::uint32_t entryCount() const;
+
+    /**
+     * Compares two snapshots. Subtrees with equal hashes are skipped without being visited.
+     *
+     * @param before The older snapshot.
+     * @param after The newer snapshot.
+     * @param visitor The callback invoked for every difference.
+     * @return The counters of the comparison.
+     */
+    static DiffResult diff(const DirectorySnapshot& before, const DirectorySnapshot& after, const ChangeVisitor& visitor);
+
+private:
+    std::string_view name(std::uint32_t index) const;
+    bool isDirectory(std::uint32_t index) const;
+    bool sameContents(std::uint32_t index, const DirectorySnapshot& other, std::uint32_t otherIndex) const;
+
+    ColumnarFile file;
+    std::uint32_t count = 0;
+    const std::uint64_t* nameOffsets = nullptr;
+    const std::uint16_t* nameLengths = nullptr;
+    const std::uint64_t* sizes = nullptr;
+    const std::int64_t* modificationTimes = nullptr;
+    const std::uint64_t* hashes = nullptr;
+    const std::uint8_t* flags = nullptr;
+    const std::uint32_t* firstChildren = nullptr;
+    const std::uint32_t* childCounts = nullptr;
+    const std::uint32_t* descendantCounts = nullptr;
+    const char* names = nullptr;
+    std::string_view root;
+};
+
+#endif
\ No newline at end of file
@@ -0,0 +1,274 @@
+#ifndef DIRECTORY_WALKER_H
+#define DIRECTORY_WALKER_H
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+/**
+ * @class DirectoryWalker
+ * @brief A multi-threaded directory tree walker.
+ *
+ * The DirectoryWalker class enumerates a directory tree on a work-stealing thread pool, one task per directory, and
+ * reports the entries to a visitor in the same depth-first order as a single-threaded recursive walk. The calling
+ * thread consumes the directories as soon as they are read, so output starts before the whole tree is enumerated.
+ *
+ * Directories are read with FindFirstFileExA on Windows and with getdents64 (opendir/readdir on other POSIX systems)
+ * everywhere else. On Linux with io_uring the metadata of the entries of a large directory is fetched in one batch
+ * through the AsyncIoEngine of the reading thread.
+ *
+ * A walk keeps the names of a directory in one NameList buffer, so it allocates per directory rather than per entry.
+ * On POSIX systems a walk opens every directory with openat relative to the descriptor of an open ancestor, usually
+ * its parent, so each open resolves a single component however deep the tree is, and paths longer than PATH_MAX are
+ * walked as well. The descriptors kept open are bounded by the DescriptorBudget.
+ */
+class DirectoryWalker {
+public:
+    /**
+     * A single entry of a directory.
+     *
+     * The metadata fields are filled on Windows, where the enumeration returns them for free, and on POSIX systems
+     * only when they are requested explicitly, because they cost an extra fstatat per entry there.
+     */
+    struct Entry {
+        std::string name;
+        bool isDirectory;
+        std::uint64_t size;
+        /** Last modification time in nanoseconds since the Unix epoch. */
+        std::int64_t modificationTime;
+        /** Raw platform attributes: dwFileAttributes on Windows, st_mode elsewhere. */
+        std::uint32_t attributes;
+    };
+
+    /**
+     * The type of an entry as far as the listing reports it, without a stat.
+     */
+    enum class EntryType {
+        /** The filesystem does not report types in its listings; a stat tells. */
+        UNKNOWN,
+        DIRECTORY,
+        /** A file, a symbolic link or anything else that is not a directory. */
+        OTHER
+    };
+
+    /**
+     * Reads the entries of one directory in filesystem order, skipping "." and "..". Every listing in the tool goes
+     * through this class.
+     *
+     * On Linux the names come from getdents64 into a 64 KiB buffer inside the object, so a listing allocates nothing;
+     * other POSIX systems use readdir on a duplicate of the descriptor. On Windows FindFirstFileExA also returns the
+     * metadata of every entry, which readMetadata hands out.
+     */
+    class Listing {
+    public:
+        Listing();
+        ~Listing();
+        Listing(const Listing&) = delete;
+        Listing& operator=(const Listing&) = delete;
+
+        /**
+         * Opens a directory, closing the previous one.
+         *
+         * @param directoryPath The path of the directory.
+         * @return True if the directory could be opened, false otherwise.
+         */
+        bool open(const std::string& directoryPath);
+
+#ifndef _WIN32
+        /**
+         * Lists a directory the caller has opened, closing the previous one. The descriptor stays the caller's.
+         *
+         * @param directoryFd The descriptor of the directory.
+         * @return True if the directory can be listed, false otherwise.
+         */
+        bool open(int directoryFd);
+
+        /**
+         * Returns the descriptor of the directory, for the *at system calls on its entries.
+         *
+         * @return The descriptor, or -1 if no directory is open.
+         */
+        int descriptor() const;
+#else
+        /**
+         * Copies the metadata the enumeration returned for the current entry.
+         *
+         * @param entry The entry receiving the type, size, modification time and attributes. The name is left unchanged.
+         */
+        void readMetadata(Entry& entry) const;
+#endif
+
+        /**
+         * Moves to the next entry.
+         *
+         * @return True if there is one, false at the end of the directory.
+         */
+        bool next();
+
+        /**
+         * Returns the name of the current entry.
+         *
+         * @return The NUL-terminated name, valid until the next call to next.
+         */
+        const char* name() const;
+
+        /**
+         * Returns the type of the current entry as reported by the listing.
+         *
+         * @return The type, UNKNOWN where the listing does not report it.
+         */
+        EntryType type() const;
+
+        /**
+         * Closes the directory. Called by open and the destructor.
+         */
+        void close();
+
+    private:
+#ifdef _WIN32
+        void* handle;
+        void* findData;
+        bool first;
+#else
+        int fd;
+        bool ownsDescriptor;
+        const char* current;
+#ifdef __linux__
+        unsigned char currentType;
+        std::size_t bufferOffset;
+        std::size_t bufferSize;
+        alignas(8) char buffer[64 * 1024];
+#else
+        void* directory;
+#endif
+#endif
+    };
+
+    /**
+     * The names and types of the entries of a directory, packed into one buffer.
+     */
+    struct NameList {
+        /** The names back to back, each followed by a NUL. */
+        std::vector<char> characters;
+        std::vector<std::uint32_t> offsets;
+        std::vector<bool> directoryFlags;
+
+        /**
+         * Returns the number of entries.
+         *
+         * @return The number of entries.
+         */
+        std::size_t size() const;
+
+        /**
+         * Returns the name of an entry.
+         *
+         * @param index The position of the entry.
+         * @return The name, valid until the list changes. Its data is NUL-terminated.
+         */
+        std::string_view name(std::size_t index) const;
+
+        /**
+         * Returns whether an entry is a directory.
+         *
+         * @param index The position of the entry.
+         * @return True for directories, false otherwise.
+         */
+        bool isDirectory(std::size_t index) const;
+
+        /**
+         * Appends an entry.
+         *
+         * @param name The name of the entry.
+         * @param isDirectory Whether the entry is a directory.
+         */
+        void add(std::string_view name, bool isDirectory);
+
+        /**
+         * Removes every entry, keeping the buffers.
+         */
+        void clear();
+    };
+
+    /**
+     * Callback receiving the entries in depth-first order.
+     *
+     * @param depth The nesting level of the entry, 0 for the entries of the root directory.
+     * @param name The name of the entry, valid during the call.
+     * @param isDirectory Whether the entry is a directory.
+     */
+    using Visitor = std::function<void(std::size_t depth, std::string_view name, bool isDirectory)>;
+
+    /**
+     * Walks the directory tree rooted at the given path.
+     *
+     * @param rootPath The path of the root directory.
+     * @param threadCount The number of worker threads. Zero selects the number of hardware threads.
+     * @param visitor The callback invoked for every entry below the root.
+     * @return True if the root directory could be read, false otherwise.
+     */
+    static bool walk(const std::string& rootPath, unsigned threadCount, const Visitor& visitor);
+
+    /**
+     * Callback receiving the entries in depth-first order with their full paths.
+     *
+     * @param path The path of the entry, starting with the root path, valid during the call.
+     * @param name The name of the entry, the end of path.
+     * @param isDirectory Whether the entry is a directory.
+     */
+    using PathVisitor = std::function<void(std::string_view path, std::string_view name, bool isDirectory)>;
+
+    /**
+     * Walks the directory tree rooted at the given path like walk, forming the path of every entry in one buffer that
+     * is truncated back to the parent directory instead of copying a path per entry.
+     *
+     * @param rootPath The path of the root directory.
+     * @param threadCount The number of worker threads. Zero selects the number of hardware threads.
+     * @param visitor The callback invoked for every entry below the root.
+     * @return True if the root directory could be read, false otherwise.
+     */
+    static bool walkPaths(const std::string& rootPath, unsigned threadCount, const PathVisitor& visitor);
+
+    /**
+     * Reads the entries of a single directory, skipping "." and "..".
+     *
+     * @param directoryPath The path of the directory to read.
+     * @param entries The vector receiving the entries in filesystem order.
+     * @param withMetadata Whether the size, modification time and attributes of every entry are needed.
+     * @return True if the directory could be read, false otherwise.
+     */
+    static bool readDirectory(const std::string& directoryPath, std::vector<Entry>& entries, bool withMetadata = false);
+
+    /**
+     * Reads the names and types of the entries of a single directory, skipping "." and "..". Unlike readDirectory, this
+     * allocates nothing per entry once the list has grown to the size of the directory.
+     *
+     * @param directoryPath The path of the directory to read.
+     * @param names The list receiving the entries in filesystem order.
+     * @return True if the directory could be read, false otherwise.
+     */
+    static bool readNames(const std::string& directoryPath, NameList& names);
+
+    /**
+     * Reads the metadata of a single file or directory without following symbolic links.
+     *
+     * @param path The path of the file or directory.
+     * @param entry The entry receiving the metadata. The name is left unchanged.
+     * @return True if the metadata could be read, false otherwise.
+     */
+    static bool readMetadata(const std::string& path, Entry& entry);
+
+    /**
+     * Joins a directory path and an entry name with the platform path separator.
+     *
+     * @param directoryPath The path of the directory.
+     * @param name The name of the entry.
+     * @return The path of the entry.
+     */
+    static std::string joinPath(std::string_view directoryPath, std::string_view name);
+};
+
+#endif
\ No newline at end of file
@@ -0,0 +1,130 @@
+#ifndef DIRECTORY_WATCHER_H
+#define DIRECTORY_WATCHER_H
+
+#include "Directory_Cache.h"
+#include "Directory_Walker.h"
+
+#include <atomic>
+#include <cstddef>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+/**
+ * @class DirectoryWatcher
+ * @brief Keeps a cache of directory listings current by subscribing to filesystem change events.
+ *
+ * Every directory listed through the watcher is watched (inotify on Linux, ReadDirectoryChangesW on Windows) and
+ * stored in a DirectoryCache. A background thread applies creations, deletions and renames to the cached listings as
+ * they happen, so repeated listings of a hot directory are served from memory. When the kernel reports that events
+ * were lost, the thread reads every cached directory again. On systems without a supported notification API the
+ * watcher stays inactive and every listing goes to the filesystem.
+ */
+class DirectoryWatcher {
+public:
+    /**
+     * Default memory budget of the cached listings.
+     */
+    static const std::size_t DEFAULT_BYTE_BUDGET = 64 * 1024 * 1024;
+
+    /**
+     * Default maximum number of watched directories.
+     */
+    static const std::size_t DEFAULT_MAX_DIRECTORIES = 4096;
+
+    /**
+     * Counters describing the watcher and its cache.
+     */
+    struct Stats {
+        DirectoryCache::Stats cache;
+        std::size_t watchedDirectories;
+        std::size_t eventsProcessed;
+        std::size_t overflows;
+        std::size_t rescans;
+        bool active;
+    };
+
+    /**
+     * Callback filling the entries of a directory on a cache miss.
+     *
+     * @param entries The vector receiving the entries.
+     * @return True if the directory could be read, false otherwise.
+     */
+    using Reader = std::function<bool(std::vector<DirectoryWalker::Entry>& entries)>;
+
+    /**
+     * Returns the process-wide watcher, starting its thread on first use.
+     *
+     * @return The watcher.
+     */
+    static DirectoryWatcher& instance();
+
+    /**
+     * Stops the background thread and removes all watches.
+     */
+    ~DirectoryWatcher();
+
+    DirectoryWatcher(const DirectoryWatcher&) = delete;
+    DirectoryWatcher& operator=(const DirectoryWatcher&) = delete;
+
+    /**
+     * Returns the entries of a directory from the cache, or reads them with the given reader and starts watching the
+     * directory. The watch is installed before the directory is read, so no change can slip in between.
+     *
+     * @param directoryPath The absolute path of the directory.
+     * @param reader The callback used on a cache miss.
+     * @param entries The vector receiving the entries.
+     * @return True if the entries are available, false if the reader failed.
+     */
+    bool list(const std::string& directoryPath, const Reader& reader, std::vector<DirectoryWalker::Entry>& entries);
+
+    /**
+     * Passes the cached entries of a directory to a consumer without copying them. Nothing is read on a miss.
+     *
+     * @param directoryPath The absolute path of the directory.
+     * @param consumer The callback receiving the entries; it must not use the watcher.
+     * @return True on a cache hit, false otherwise.
+     */
+    bool visit(const std::string& directoryPath, const DirectoryCache::Consumer& consumer);
+
+    /**
+     * Returns whether a directory is currently cached, without counting a hit or a miss.
+     *
+     * @param directoryPath The absolute path of the directory.
+     * @return True if the directory is cached, false otherwise.
+     */
+    bool isCached(const std::string& directoryPath);
+
+    /**
+     * Returns the current counters.
+     *
+     * @return The counters.
+     */
+    Stats stats();
+
+private:
+    struct Backend;
+
+    DirectoryWatcher();
+
+    bool watch(const std::string& directoryPath);
+    void unwatch(const std::string& directoryPath);
+    void run();
+    void applyCreated(const std::string& directoryPath, const std::string& name, bool isDirectory);
+    void rescan(const std::string& directoryPath);
+    void rescanAll();
+
+    DirectoryCache cache;
+    std::unique_ptr<Backend> backend;
+    std::mutex watchMutex;
+    std::thread thread;
+    std::atomic<bool> stopping;
+    std::atomic<std::size_t> eventsProcessed;
+    std::atomic<std::size_t> overflows;
+    std::atomic<std::size_t> rescans;
+};
+
+#endif
\ No newline at end of file
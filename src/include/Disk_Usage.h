@@ -0,0 +1,67 @@
+#ifndef DISK_USAGE_H
+#define DISK_USAGE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/**
+ * @class DiskUsage
+ * @brief Sums the sizes of a directory tree and finds its largest subtrees.
+ *
+ * Every directory is read by its own task on a worker pool. The sizes of its files are summed in a local variable, and
+ * the total of a directory is added to its parent once, when the last of its subdirectories finishes. Each worker
+ * keeps its own counters and its own bounded heap of the largest subtrees, which are merged after the walk, so the
+ * per-file work touches no shared state.
+ *
+ * A directory is freed as soon as it is complete. Once a fixed number of directories wait in the pool, a worker reads
+ * the subdirectories it finds itself, depth first, so the directories held at once are bounded by that number plus
+ * the subdirectories of the directories on the current paths, not by the size of the tree.
+ *
+ * On POSIX systems the sizes are the allocated blocks, as du reports them. A file with several hard links counts an
+ * equal share of its blocks under each name, so it is counted once without remembering which files were seen.
+ * Windows reports apparent sizes.
+ */
+class DiskUsage {
+public:
+    /**
+     * Number of largest subtrees reported when no count is given.
+     */
+    static const std::size_t DEFAULT_TOP_COUNT = 20;
+
+    /**
+     * A directory and the total size of its contents.
+     */
+    struct Subtree {
+        std::string path;
+        std::uint64_t bytes;
+        std::uint64_t files;
+    };
+
+    /**
+     * Summary of a measurement.
+     */
+    struct Result {
+        std::uint64_t bytes;
+        std::uint64_t files;
+        std::uint64_t directories;
+        std::size_t unreadableDirectories;
+        std::vector<Subtree> largest;
+        double seconds;
+        /** True if the sizes are apparent file sizes rather than the space allocated on disk. */
+        bool apparentSizes;
+    };
+
+    /**
+     * Measures a directory tree. Links and junctions are counted but not followed.
+     *
+     * @param rootPath The path of the directory to measure.
+     * @param topCount The number of largest subtrees to report, the root included.
+     * @param threadCount The number of worker threads. Zero selects the number of hardware threads.
+     * @return The totals and the largest subtrees, largest first.
+     */
+    static Result measure(const std::string& rootPath, std::size_t topCount = DEFAULT_TOP_COUNT, unsigned threadCount = 0);
+};
+
+#endif
\ No newline at end of file
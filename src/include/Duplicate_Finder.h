@@ -0,0 +1,57 @@
+#ifndef DUPLICATE_FINDER_H
+#define DUPLICATE_FINDER_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/**
+ * @class DuplicateFinder
+ * @brief Finds files with identical contents in a directory tree.
+ *
+ * The search narrows the candidates in stages, each of which runs on a worker pool whose size bounds the number of
+ * files being read at once. Files are first grouped by size, then by a hash of their first and last 4 KiB, and only
+ * the files still sharing a group are hashed completely with FastHash. Hard links to the same file are counted once,
+ * because deleting one of them frees no space.
+ */
+class DuplicateFinder {
+public:
+    /**
+     * Number of bytes hashed at each end of a file in the partial stage.
+     */
+    static const std::size_t PARTIAL_BLOCK_SIZE = 4096;
+
+    /**
+     * Files with the same size and the same full hash.
+     */
+    struct Group {
+        std::uint64_t size;
+        std::vector<std::string> paths;
+    };
+
+    /**
+     * Summary of a search.
+     */
+    struct Result {
+        std::vector<Group> groups;
+        std::size_t filesScanned;
+        std::size_t sizeCandidates;
+        std::size_t partialCandidates;
+        std::size_t unreadableFiles;
+        std::uint64_t bytesHashed;
+        std::uint64_t reclaimableBytes;
+        double seconds;
+    };
+
+    /**
+     * Finds the duplicate files below a directory. Empty files, links and special files are ignored.
+     *
+     * @param rootPath The path of the directory to search.
+     * @param threadCount The number of worker threads. Zero selects the number of hardware threads.
+     * @return The groups of duplicates, the group freeing the most space first, and the counters of every stage.
+     */
+    static Result find(const std::string& rootPath, unsigned threadCount = 0);
+};
+
+#endif
\ No newline at end of file
@@ -0,0 +1,133 @@
+#ifndef ENTRY_TABLE_H
+#define ENTRY_TABLE_H
+
+#include "Directory_Walker.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+/**
+ * @class EntryTable
+ * @brief The entries of one directory with their metadata, stored column by column.
+ *
+ * Names are appended to a single character arena and every metadata field lives in its own array, so loading a
+ * directory costs a few amortized vector growths instead of one allocation per entry, and sorting by size or time
+ * touches only the column it compares. Sorting permutes an index array, never the columns themselves.
+ *
+ * On Linux the names are read with getdents64 and the metadata is fetched afterwards with statx, relative to the open
+ * directory and in batches spread over a worker pool when the directory is large. On Windows the enumeration returns
+ * the metadata with the names.
+ */
+class EntryTable {
+public:
+    /**
+     * The column an EntryTable is sorted by.
+     */
+    enum class SortKey {
+        NONE,
+        NAME,
+        SIZE,
+        TIME
+    };
+
+    /**
+     * Number of entries from which metadata batches and sorting are spread over a worker pool.
+     */
+    static const std::size_t PARALLEL_THRESHOLD = 16384;
+
+    /**
+     * Number of entries whose metadata is read by one task.
+     */
+    static const std::size_t STAT_BATCH_SIZE = 4096;
+
+    /**
+     * Reads a directory with the metadata of all of its entries, replacing the current contents.
+     *
+     * @param directoryPath The path of the directory.
+     * @param threadCount The number of worker threads for large directories. Zero selects the number of hardware threads.
+     * @return True if the directory could be read, false otherwise.
+     */
+    bool load(const std::string& directoryPath, unsigned threadCount = 0);
+
+    /**
+     * Replaces the current contents with already loaded entries, for example from the directory cache.
+     *
+     * @param entries The entries, including their metadata.
+     */
+    void assign(const std::vector<DirectoryWalker::Entry>& entries);
+
+    /**
+     * Orders the entries. Equal keys keep their name order; NONE restores the filesystem order.
+     *
+     * @param key The column to sort by.
+     * @param descending Whether the largest, newest or last name comes first.
+     * @param threadCount The number of worker threads for large directories. Zero selects the number of hardware threads.
+     */
+    void sort(SortKey key, bool descending = false, unsigned threadCount = 0);
+
+    /**
+     * Returns the number of entries.
+     *
+     * @return The number of entries.
+     */
+    std::size_t count() const;
+
+    /**
+     * Returns the name of an entry.
+     *
+     * @param position The position of the entry in the current order.
+     * @return The name, valid until the table changes.
+     */
+    std::string_view name(std::size_t position) const;
+
+    /**
+     * Returns whether an entry is a directory.
+     *
+     * @param position The position of the entry in the current order.
+     * @return True for directories, false otherwise.
+     */
+    bool isDirectory(std::size_t position) const;
+
+    /**
+     * Returns the size of an entry in bytes.
+     *
+     * @param position The position of the entry in the current order.
+     * @return The size.
+     */
+    std::uint64_t size(std::size_t position) const;
+
+    /**
+     * Returns the last modification time of an entry.
+     *
+     * @param position The position of the entry in the current order.
+     * @return The time in nanoseconds since the Unix epoch.
+     */
+    std::int64_t modificationTime(std::size_t position) const;
+
+    /**
+     * Returns the raw platform attributes of an entry: dwFileAttributes on Windows, st_mode elsewhere.
+     *
+     * @param position The position of the entry in the current order.
+     * @return The attributes.
+     */
+    std::uint32_t attributes(std::size_t position) const;
+
+private:
+    void clear();
+    void append(const char* name, std::size_t length, bool isDirectory, std::uint64_t size, std::int64_t modificationTime, std::uint32_t attributes);
+    bool nameLess(std::uint32_t left, std::uint32_t right) const;
+
+    std::vector<char> names;
+    std::vector<std::uint32_t> nameOffsets;
+    std::vector<std::uint16_t> nameLengths;
+    std::vector<std::uint8_t> directoryFlags;
+    std::vector<std::uint64_t> sizes;
+    std::vector<std::int64_t> modificationTimes;
+    std::vector<std::uint32_t> attributeValues;
+    std::vector<std::uint32_t> order;
+};
+
+#endif
\ No newline at end of file
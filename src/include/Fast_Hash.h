@@ -0,0 +1,56 @@
+#ifndef FAST_HASH_H
+#define FAST_HASH_H
+
+#include <cstddef>
+#include <cstdint>
+
+/**
+ * @class FastHash
+ * @brief A streaming 64-bit non-cryptographic hash (XXH64).
+ *
+ * The input is consumed in 32-byte stripes by four independent accumulators, which the processor keeps in flight at
+ * the same time, so hashing runs at several bytes per cycle. The result equals the reference XXH64 for the same seed.
+ */
+class FastHash {
+public:
+    /**
+     * Starts a new hash.
+     *
+     * @param seed The seed of the hash.
+     */
+    explicit FastHash(std::uint64_t seed = 0);
+
+    /**
+     * Adds data to the hash.
+     *
+     * @param data The data to add.
+     * @param size The number of bytes to add.
+     */
+    void update(const void* data, std::size_t size);
+
+    /**
+     * Returns the hash of the data added so far. More data may be added afterwards.
+     *
+     * @return The hash value.
+     */
+    std::uint64_t digest() const;
+
+    /**
+     * Hashes a buffer in one call.
+     *
+     * @param data The data to hash.
+     * @param size The number of bytes to hash.
+     * @param seed The seed of the hash.
+     * @return The hash value.
+     */
+    static std::uint64_t hash(const void* data, std::size_t size, std::uint64_t seed = 0);
+
+private:
+    std::uint64_t seed;
+    std::uint64_t accumulators[4];
+    std::uint64_t totalLength;
+    unsigned char buffer[32];
+    std::size_t bufferedSize;
+};
+
+#endif
\ No newline at end of file
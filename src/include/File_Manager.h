@@ -1,9 +1,15 @@
 #ifndef FILE_MANAGER_H
 #define FILE_MANAGER_H
 
+#include <cstddef>
+#include <cstdint>
 #include <iostream>
 #include <fstream>
-#include <windows.h>
+#include <string_view>
+#include "Entry_Table.h"
+#include "Filesystem_Backend.h"
+
+class OutputSink;
 
 /**
  * @class FileManager
@@ -13,11 +19,8 @@
  * operations. It provides functionality for creating, deleting, renaming, and navigating files and directories. It also
  * offers methods for obtaining file information, manipulating file permissions, and interacting with the file system.
  *
- * The class utilizes the Windows API to perform low-level file system operations. It abstracts these operations into convenient functions
- * that can be used in C++ applications to manage files and directories efficiently.
- *
- * Note that the FileManager class assumes a Windows environment due to its reliance on the Windows API. It may not be
- * compatible with other operating systems.
+ * The class performs the low-level file system operations through the FilesystemBackend, which implements them with the
+ * Windows API on Windows and with the POSIX calls on Linux and other systems, so the same commands run on both.
  */
 class FileManager {
 public:
@@ -26,6 +29,13 @@ public:
      */
     static std::string currentDirectory;
 
+    /**
+     * Reads the working directory of the process into currentDirectory.
+     *
+     * @return True if the working directory could be read, false otherwise.
+     */
+    static bool updateCurrentDirectory();
+
     /**
      * Displays the current directory in the console.
      */
@@ -72,8 +82,10 @@ public:
      * Deletes a file or directory.
      *
      * @param name The name of the file or directory to delete.
+     * @param recursive If true, a directory is deleted together with its contents.
+     * @param dryRun If true, nothing is deleted and the number of entries and bytes that would be freed is shown.
      */
-    static void deleteFileOrDirectory(const std::string& name);
+    static void deleteFileOrDirectory(const std::string& name, bool recursive = false, bool dryRun = false);
     
     /**
      * Moves a file or directory to a new location.
@@ -83,45 +95,197 @@ public:
      */
     static void moveFileOrDirectory(const std::string& source, const std::string& destination);
     
+    /**
+     * Copies a file or a directory tree. If the destination is an existing directory, the source is copied into it.
+     *
+     * @param source The path of the file or directory to copy.
+     * @param destination The destination path or directory.
+     */
+    static void copyFileOrDirectory(const std::string& source, const std::string& destination);
+    
+    /**
+     * Renames every entry of a directory whose name a substitution such as s/(.*)\.tmp/$1.bak/ changes. The new names
+     * are checked for collisions first; if there is any, nothing is renamed.
+     *
+     * @param expression The substitution applied to the names.
+     * @param directoryPath The directory whose entries are renamed.
+     */
+    static void renameMatching(const std::string& expression, const std::string& directoryPath);
+    
+    /**
+     * Deletes every file or directory matching a glob pattern.
+     *
+     * @param pattern The directory followed by a glob, such as "logs\*.log".
+     * @param recursive If true, matching directories are deleted together with their contents.
+     * @param dryRun If true, nothing is deleted and the number of entries and bytes that would be freed is shown.
+     */
+    static void deleteMatching(const std::string& pattern, bool recursive = false, bool dryRun = false);
+    
+    /**
+     * Moves every file or directory matching a glob pattern into a directory. The targets are checked for
+     * collisions first; if there is any, nothing is moved.
+     *
+     * @param pattern The directory followed by a glob, such as "*.log".
+     * @param destination The directory the matches are moved into.
+     */
+    static void moveMatching(const std::string& pattern, const std::string& destination);
+    
     /**
      * Lists all files and directories in the specified directory.
      *
+     * Listings are served from the watched directory cache when the directory is cached. Otherwise an unsorted
+     * listing is streamed from a DirectoryCursor, a batch at a time, and a sorted one is read with its metadata into an
+     * EntryTable. Only the entries of the requested page are formatted, and Ctrl-C stops the listing between batches.
+     *
      * @param directoryPath The path of the directory to list.
+     * @param sortKey The column to sort by. NONE keeps the filesystem order.
+     * @param descending Whether to reverse the order.
+     * @param longFormat Whether to show the size and the modification time of every entry.
+     * @param offset The number of entries to skip before the page.
+     * @param limit The largest number of entries to show. Zero shows all entries after the offset.
+     */
+    static void listFilesAndDirectories(const std::string& directoryPath, EntryTable::SortKey sortKey = EntryTable::SortKey::NONE,
+        bool descending = false, bool longFormat = false, std::size_t offset = 0, std::size_t limit = 0);
+    
+    /**
+     * Displays the counters of the directory watcher and its listing cache.
+     */
+    static void showDirectoryCacheStats();
+    
+    /**
+     * Shows the latency percentiles of every timed scope and the operation counters since the start or the last reset.
+     */
+    static void showInstrumentationStats();
+    
+    /**
+     * Prints every line containing a literal text in the files below a directory, in directory order.
+     *
+     * @param pattern The text to find.
+     * @param directoryPath The path of the directory to search.
+     */
+    static void findText(const std::string& pattern, const std::string& directoryPath);
+    
+    /**
+     * Prints the files and directories below a directory whose names match a glob or a regular expression.
+     *
+     * The search runs over the directory index when the index command has built one that covers the directory, and
+     * refreshes it incrementally first. Any other directory is searched by a parallel walk, which leaves no index behind.
+     *
+     * @param pattern The glob or regular expression.
+     * @param isRegex Whether the pattern is a regular expression.
+     * @param directoryPath The path of the directory to search.
      */
-    static void listFilesAndDirectories(const std::string& directoryPath);
+    static void findFiles(const std::string& pattern, bool isRegex, const std::string& directoryPath);
+    
+    /**
+     * Prints the groups of files with identical contents below a directory and the space that deleting the extra
+     * copies would free.
+     *
+     * @param directoryPath The path of the directory to search.
+     */
+    static void findDuplicates(const std::string& directoryPath);
+    
+    /**
+     * Displays the total size of a directory tree and its largest subtrees.
+     *
+     * @param directoryPath The path of the directory to measure.
+     */
+    static void showDiskUsage(const std::string& directoryPath);
     
     /**
      * Creates a file that represents the directory structure of the current directory and its subdirectories.
      *
+     * The directories are read in parallel by the DirectoryWalker, while the entries are written in the same
+     * depth-first order as a single-threaded walk.
+     *
      * @param outputFile The name of the output file to create.
+     * @param threadCount The number of threads used to read the directories. Zero selects the number of hardware threads.
+     */
+    static void createDirectoryStructureFile(const std::string& outputFile, unsigned threadCount = 0);
+    
+    /**
+     * Writes the directory structure of the given directory and its subdirectories to an output sink.
+     *
+     * @param directoryPath The path of the directory to describe.
+     * @param output The sink receiving one line per entry.
+     * @param threadCount The number of threads used to read the directories. Zero selects the number of hardware threads.
+     * @return True if the directory could be read, false otherwise.
+     */
+    static bool writeDirectoryStructure(const std::string& directoryPath, OutputSink& output, unsigned threadCount = 0);
+    
+    /**
+     * Builds the persistent index of the current directory, or refreshes it by re-reading only the directories that
+     * changed since the last update. While an index exists, tree and find are served from it.
+     *
+     * @param threadCount The number of threads used to read the directories. Zero selects the number of hardware threads.
      */
-    static void createDirectoryStructureFile(const std::string& outputFile);
+    static void updateDirectoryIndex(unsigned threadCount = 0);
     
     /**
-     * Recursive helper function to create the directory structure file.
+     * Writes a snapshot of the current directory tree, with the size, modification time and content hash of every entry.
      *
-     * @param directoryPath The current directory path.
-     * @param outputFile The output file stream to write to.
-     * @param indentation The indentation string for subdirectories.
-     * @param prefix The prefix string for subdirectories.
+     * @param snapshotFile The name of the snapshot file to create.
+     * @param threadCount The number of threads used to read and hash the files. Zero selects the number of hardware threads.
      */
-    static void createDirectoryStructureFileHelper(const std::string& directoryPath, std::ofstream& outputFile, const std::string& indentation, const std::string& prefix);
+    static void createSnapshot(const std::string& snapshotFile, unsigned threadCount = 0);
+    
+    /**
+     * Prints the entries added, removed and modified between two snapshots.
+     *
+     * @param beforeFile The older snapshot.
+     * @param afterFile The newer snapshot.
+     */
+    static void diffSnapshots(const std::string& beforeFile, const std::string& afterFile);
+    
+    /**
+     * Packs a directory tree into a compressed archive with an index, from which single files can be extracted.
+     *
+     * @param directoryPath The absolute path of the directory to pack.
+     * @param archivePath The absolute path of the archive to create.
+     * @param threadCount The number of threads used to read and compress. Zero selects the number of hardware threads.
+     */
+    static void packDirectory(const std::string& directoryPath, const std::string& archivePath, unsigned threadCount = 0);
+    
+    /**
+     * Unpacks an archive written by packDirectory, or a single file or directory of it.
+     *
+     * @param archivePath The absolute path of the archive.
+     * @param destination The absolute path of the directory to unpack into.
+     * @param entryPath The path of the entry to extract, relative to the packed directory, or an empty string for all.
+     */
+    static void unpackArchive(const std::string& archivePath, const std::string& destination, const std::string& entryPath);
     
     /**
      * Sets the permissions for a file or directory.
      *
      * @param name The name of the file or directory.
-     * @param permissions The permissions to set.
+     * @param access The access to grant.
      */
-    static void setFileOrDirectoryPermissions(const std::string& name, const DWORD& permissions);
+    static void setFileOrDirectoryPermissions(const std::string& name, FilesystemBackend::Access access);
+    
+    /**
+     * Sets the permissions of every file or directory matching a glob pattern.
+     *
+     * @param pattern The directory followed by a glob, such as "*.txt".
+     * @param access The access to grant.
+     */
+    static void setPermissionsMatching(const std::string& pattern, FilesystemBackend::Access access);
+    
+    /**
+     * Sets the permissions of a directory and of everything below it, changing only the entries that differ.
+     *
+     * @param path The absolute path of the directory, or of a single file.
+     * @param access The access to grant.
+     */
+    static void setPermissionsRecursively(const std::string& path, FilesystemBackend::Access access);
     
     /**
      * Retrieves the file name from a given file path.
      *
      * @param filePath The file path from which to extract the file name.
-     * @return The file name.
+     * @return The file name, a view into filePath.
      */
-    static std::string getFileNameFromPath(const std::string& filePath);
+    static std::string_view getFileNameFromPath(std::string_view filePath);
     
     /**
      * Combines two paths into a single path.
@@ -130,10 +294,19 @@ public:
      * @param path2 The second path.
      * @return The combined path.
      */
-    static std::string combinePaths(const std::string& path1, const std::string& path2);
+    static std::string combinePaths(std::string_view path1, std::string_view path2);
+    
+    /**
+     * Formats a number of bytes with a binary unit, for example "1.5 MiB".
+     *
+     * @param bytes The number of bytes.
+     * @return The formatted size.
+     */
+    static std::string formatSize(std::uint64_t bytes);
     
     /**
-     * Opens the file explorer at the specified directory path.
+     * Opens the file explorer at the specified directory path, or the default file browser through xdg-open on
+     * systems other than Windows.
      * @param directoryPath The path of the directory to open in the file explorer.
      */
     static void openFileExplorer(const std::string& directoryPath);
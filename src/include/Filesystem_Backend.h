@@ -0,0 +1,221 @@
+#ifndef FILESYSTEM_BACKEND_H
+#define FILESYSTEM_BACKEND_H
+
+#include <cstdint>
+#include <string>
+
+/**
+ * @class FilesystemBackend
+ * @brief The native filesystem calls behind the file manager commands, with one implementation per platform.
+ *
+ * The FileManager performs every stat, rename, unlink, directory creation and permission change through this class,
+ * so it contains no platform code of its own. The implementation is chosen when the tool is built: the Win32 API on
+ * Windows, and the POSIX calls elsewhere, using statx and renameat2 on Linux. Directories are enumerated by the
+ * DirectoryWalker, which already reads them with FindFirstFileExA and getdents64.
+ *
+ * Paths are passed as they are. Errors are reported as a Status rather than through errno or GetLastError, because
+ * the callers only need to tell the few outcomes apart that change what they do next.
+ */
+class FilesystemBackend {
+public:
+    /**
+     * Outcome of an operation that changes the filesystem.
+     */
+    enum class Status {
+        OK,
+        NOT_FOUND,
+        ALREADY_EXISTS,
+        /** A rename would cross filesystems or volumes; the caller has to copy instead. */
+        CROSS_DEVICE,
+        /** A directory to remove still has entries. */
+        NOT_EMPTY,
+        ACCESS_DENIED,
+        FAILED
+    };
+
+    /**
+     * The access granted by the permit command. Windows has only the read-only attribute, which it honours for files
+     * alone, so there every access makes a file either read-only or writable and directories are left as they are.
+     */
+    struct Access {
+        enum class Kind {
+            /** No write permission bits; the read-only attribute on Windows. */
+            READ,
+            /** Writable by the owner. */
+            WRITE,
+            /** Writable by the owner, and by the group if it can read it; never by others. */
+            MODIFY,
+            /** Exactly the permission bits in mode; read-only on Windows unless the owner's write bit is set. */
+            MODE
+        };
+
+        Kind kind;
+        /** The permission bits of a MODE access, such as 0750. */
+        std::uint32_t mode;
+    };
+
+    /**
+     * Metadata of a file or directory, read without following symbolic links.
+     */
+    struct Metadata {
+        bool isDirectory;
+        /** A symbolic link on POSIX systems; a reparse point, such as a junction, on Windows. */
+        bool isLink;
+        std::uint64_t size;
+        /** Last modification time in nanoseconds since the Unix epoch. */
+        std::int64_t modificationTime;
+        /** Raw platform attributes: dwFileAttributes on Windows, st_mode elsewhere. */
+        std::uint32_t attributes;
+    };
+
+    /**
+     * Reads the metadata of a file or directory without following symbolic links.
+     *
+     * @param path The path of the file or directory.
+     * @param metadata Receives the metadata.
+     * @return True if the metadata could be read, false otherwise.
+     */
+    static bool getMetadata(const std::string& path, Metadata& metadata);
+
+    /**
+     * Returns whether a path names a directory, following symbolic links.
+     *
+     * @param path The path to test.
+     * @return True if the path exists and is a directory, false otherwise.
+     */
+    static bool isDirectory(const std::string& path);
+
+    /**
+     * Returns whether a path names anything, without following symbolic links.
+     *
+     * @param path The path to test.
+     * @return True if the path exists, false otherwise.
+     */
+    static bool exists(const std::string& path);
+
+    /**
+     * Creates an empty file. An existing file is left untouched.
+     *
+     * @param path The path of the file.
+     * @return OK, ALREADY_EXISTS or the reason the file could not be created.
+     */
+    static Status createFile(const std::string& path);
+
+    /**
+     * Creates a directory.
+     *
+     * @param path The path of the directory.
+     * @return OK, ALREADY_EXISTS or the reason the directory could not be created.
+     */
+    static Status createDirectory(const std::string& path);
+
+    /**
+     * Renames or moves a file or directory within one filesystem. An existing target is never replaced; on Linux
+     * this is checked atomically with renameat2 and RENAME_NOREPLACE where the filesystem supports it.
+     *
+     * @param source The current path.
+     * @param target The new path.
+     * @return OK, ALREADY_EXISTS, CROSS_DEVICE or the reason the entry could not be renamed.
+     */
+    static Status rename(const std::string& source, const std::string& target);
+
+    /**
+     * Deletes a file or a symbolic link.
+     *
+     * @param path The path of the file.
+     * @return OK or the reason the file could not be deleted.
+     */
+    static Status removeFile(const std::string& path);
+
+    /**
+     * Deletes an empty directory.
+     *
+     * @param path The path of the directory.
+     * @return OK, NOT_EMPTY or the reason the directory could not be deleted.
+     */
+    static Status removeDirectory(const std::string& path);
+
+    /**
+     * Classifies an error code returned by an operation that ran elsewhere, such as on an AsyncIoEngine.
+     *
+     * @param error The error code: errno on POSIX, GetLastError() on Windows.
+     * @return The status the same failure of an operation of this class would return.
+     */
+    static Status statusOfError(int error);
+
+    /**
+     * Sets the raw permissions of a file or directory.
+     *
+     * @param path The path of the file or directory.
+     * @param attributes The attributes on Windows, the permission bits of st_mode elsewhere.
+     * @return OK or the reason the permissions could not be set.
+     */
+    static Status setPermissions(const std::string& path, std::uint32_t attributes);
+
+    /**
+     * Computes the permissions that grant an access, keeping everything else of the current permissions.
+     *
+     * @param attributes The current raw attributes, as returned in Metadata::attributes.
+     * @param access The access to grant.
+     * @return The permissions to pass to setPermissions.
+     */
+    static std::uint32_t permissionsForAccess(std::uint32_t attributes, Access access);
+
+    /**
+     * Extracts the permissions from raw attributes, in the form permissionsForAccess returns them.
+     *
+     * @param attributes The raw attributes, as returned in Metadata::attributes.
+     * @return The permissions that setPermissions would have to set to leave the entry unchanged.
+     */
+    static std::uint32_t permissionsOf(std::uint32_t attributes);
+
+    /**
+     * Returns whether raw attributes describe a symbolic link on POSIX systems or a reparse point on Windows.
+     *
+     * @param attributes The raw attributes, as returned in Metadata::attributes.
+     * @return True for links, false otherwise.
+     */
+    static bool isLink(std::uint32_t attributes);
+
+    /**
+     * Parses the access argument of the permit command.
+     *
+     * @param text "read", "write", "modify", or an octal mode such as 750 or 0644.
+     * @param access Receives the access.
+     * @return True if the text names an access, false otherwise.
+     */
+    static bool parseAccess(const std::string& text, Access& access);
+
+    /**
+     * Reads the working directory of the process.
+     *
+     * @param path Receives the absolute path of the working directory.
+     * @return True if the working directory could be read, false otherwise.
+     */
+    static bool getCurrentDirectory(std::string& path);
+
+    /**
+     * Changes the working directory of the process.
+     *
+     * @param path The new working directory.
+     * @return True if the working directory was changed, false otherwise.
+     */
+    static bool setCurrentDirectory(const std::string& path);
+
+    /**
+     * Returns the path separator of the platform.
+     *
+     * @return '\\' on Windows, '/' elsewhere.
+     */
+    static char separator();
+
+    /**
+     * Returns whether a character separates path components. Windows accepts both slashes.
+     *
+     * @param c The character to test.
+     * @return True if the character is a path separator, false otherwise.
+     */
+    static bool isSeparator(char c);
+};
+
+#endif
\ No newline at end of file
@@ -0,0 +1,226 @@
+#ifndef INSTRUMENTATION_H
+#define INSTRUMENTATION_H
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/**
+ * Set to 0 to compile every probe out. The probes then generate no code at all, so an uninstrumented build runs
+ * exactly the code it would run without them.
+ */
+#ifndef INSTRUMENTATION_ENABLED
+#define INSTRUMENTATION_ENABLED 1
+#endif
+
+/**
+ * @class Instrumentation
+ * @brief Low-overhead latency histograms, operation counters and an optional Chrome trace.
+ *
+ * Probes write only to state owned by the calling thread: a counter array and one latency histogram per scope name,
+ * allocated the first time the thread enters that scope. Nothing is shared on the hot path, so probes neither take
+ * locks nor contend for cache lines. Reports merge the per-thread state when they are asked for; the state of a
+ * thread that exits is folded into a process-wide total first.
+ *
+ * Histograms use HDR-style buckets: values below 2^SUB_BUCKET_BITS nanoseconds are counted exactly, and every larger
+ * power of two is split into 2^(SUB_BUCKET_BITS - 1) equal buckets, which bounds the error of a percentile to about
+ * 3% of its value at any magnitude.
+ *
+ * While a trace is running, every scope is also recorded as a complete event of the Chrome trace-event format, which
+ * chrome://tracing and Perfetto display as a timeline per thread.
+ */
+class Instrumentation {
+public:
+    /**
+     * Operations counted across the tool.
+     */
+    enum class Counter {
+        /** Calls into the filesystem: opening, reading, writing, stat, unlink and directory reads. */
+        SYSTEM_CALLS,
+        BYTES_READ,
+        BYTES_WRITTEN,
+        /** Directory entries listed. */
+        ENTRIES_VISITED
+    };
+
+    /**
+     * Number of counters.
+     */
+    static const std::size_t COUNTER_COUNT = 4;
+
+    /**
+     * Maximum number of distinct scope names.
+     */
+    static const std::size_t MAX_SCOPES = 128;
+
+    /**
+     * Number of bits of a value counted exactly; sets the precision of the histograms.
+     */
+    static const unsigned SUB_BUCKET_BITS = 6;
+
+    /**
+     * Number of buckets of a histogram, covering every 64-bit value.
+     */
+    static const std::size_t BUCKET_COUNT = (64 - SUB_BUCKET_BITS + 2) << (SUB_BUCKET_BITS - 1);
+
+    /**
+     * Maximum number of events kept by a trace; later events are counted but dropped.
+     */
+    static const std::size_t MAX_TRACE_EVENTS = 1000000;
+
+    /**
+     * Latency summary of one scope.
+     */
+    struct Summary {
+        std::string name;
+        std::uint64_t count;
+        std::uint64_t totalNanoseconds;
+        std::uint64_t p50;
+        std::uint64_t p90;
+        std::uint64_t p99;
+        std::uint64_t max;
+    };
+
+    /**
+     * Times the lifetime of an object as one sample of a scope.
+     */
+    class Scope {
+    public:
+        /**
+         * Starts timing.
+         *
+         * @param scopeId The scope returned by registerScope.
+         */
+        explicit Scope(std::size_t scopeId) : id(scopeId), start(std::chrono::steady_clock::now()) {}
+
+        /**
+         * Records the elapsed time.
+         */
+        ~Scope() {
+            record(id, start, std::chrono::steady_clock::now());
+        }
+
+        Scope(const Scope&) = delete;
+        Scope& operator=(const Scope&) = delete;
+
+    private:
+        std::size_t id;
+        std::chrono::steady_clock::time_point start;
+    };
+
+    /**
+     * Returns the identifier of a scope name, registering it the first time.
+     *
+     * @param name The name of the scope. It must stay valid for the lifetime of the process.
+     * @return The identifier, or MAX_SCOPES if there are too many names; samples of such a scope are dropped.
+     */
+    static std::size_t registerScope(const char* name);
+
+    /**
+     * Adds to a counter of the calling thread.
+     *
+     * @param counter The counter.
+     * @param amount The amount to add.
+     */
+    static void add(Counter counter, std::uint64_t amount);
+
+    /**
+     * Records one sample of a scope on the calling thread.
+     *
+     * @param scopeId The scope returned by registerScope.
+     * @param start The time the scope was entered.
+     * @param end The time the scope was left.
+     */
+    static void record(std::size_t scopeId, std::chrono::steady_clock::time_point start, std::chrono::steady_clock::time_point end);
+
+    /**
+     * Merges the histograms of all threads.
+     *
+     * @return One summary per scope with samples since the last reset, in the order the scopes were registered.
+     */
+    static std::vector<Summary> summarize();
+
+    /**
+     * Merges a counter of all threads.
+     *
+     * @param counter The counter.
+     * @return The total since the last reset.
+     */
+    static std::uint64_t total(Counter counter);
+
+    /**
+     * Returns the name of a counter as shown by the stats command.
+     *
+     * @param counter The counter.
+     * @return The name.
+     */
+    static const char* counterName(Counter counter);
+
+    /**
+     * Starts the statistics from zero. Threads keep recording while the reset runs.
+     */
+    static void reset();
+
+    /**
+     * Starts recording a trace.
+     *
+     * @param path The file the trace is written to when it stops.
+     */
+    static void startTrace(const std::string& path);
+
+    /**
+     * Stops recording and writes the trace as Chrome trace-event JSON.
+     *
+     * @return True if there was no trace running or the trace was written, false if the file could not be written.
+     */
+    static bool stopTrace();
+
+    /**
+     * Returns whether the probes were compiled in.
+     *
+     * @return True if INSTRUMENTATION_ENABLED is non-zero.
+     */
+    static bool isEnabled();
+
+    /**
+     * Returns the bucket a value is counted in.
+     *
+     * @param value The value.
+     * @return The index of the bucket.
+     */
+    static std::size_t bucketOf(std::uint64_t value);
+
+    /**
+     * Returns the middle of the range of values counted in a bucket, which is what a percentile reports.
+     *
+     * @param bucket The index of the bucket.
+     * @return The representative value.
+     */
+    static std::uint64_t valueOf(std::size_t bucket);
+};
+
+#define INSTRUMENTATION_CONCATENATE_(left, right) left##right
+#define INSTRUMENTATION_CONCATENATE(left, right) INSTRUMENTATION_CONCATENATE_(left, right)
+
+#if INSTRUMENTATION_ENABLED
+/**
+ * Times the rest of the enclosing block as one sample of the named scope.
+ */
+#define INSTRUMENT_SCOPE(name) \
+    static const std::size_t INSTRUMENTATION_CONCATENATE(instrumentationScopeId, __LINE__) = Instrumentation::registerScope(name); \
+    Instrumentation::Scope INSTRUMENTATION_CONCATENATE(instrumentationScope, __LINE__)(INSTRUMENTATION_CONCATENATE(instrumentationScopeId, __LINE__))
+
+/**
+ * Adds to one of the Instrumentation::Counter counters, such as INSTRUMENT_COUNT(BYTES_READ, size).
+ */
+#define INSTRUMENT_COUNT(counter, amount) Instrumentation::add(Instrumentation::Counter::counter, static_cast<std::uint64_t>(amount))
+#else
+// The amount stays an unevaluated operand, so variables kept only for a probe do not warn as unused.
+#define INSTRUMENT_SCOPE(name) static_cast<void>(0)
+#define INSTRUMENT_COUNT(counter, amount) static_cast<void>(sizeof(amount))
+#endif
+
+#endif
\ No newline at end of file
@@ -0,0 +1,35 @@
+#ifndef INTERRUPT_SCOPE_H
+#define INTERRUPT_SCOPE_H
+
+/**
+ * @class InterruptScope
+ * @brief Turns Ctrl-C into a request to stop the current command while the scope exists.
+ *
+ * Outside of a scope, Ctrl-C ends the program as usual. Inside, it only sets a flag that a long-running command checks
+ * between batches of work, so the command can stop cleanly and the session continues. Scopes may overlap, for example
+ * when a script runs several commands at once; the handler is installed by the first and removed by the last.
+ */
+class InterruptScope {
+public:
+    /**
+     * Installs the Ctrl-C handler if no other scope has, and clears an earlier request.
+     */
+    InterruptScope();
+
+    /**
+     * Restores the previous handling of Ctrl-C when this is the last scope.
+     */
+    ~InterruptScope();
+
+    InterruptScope(const InterruptScope&) = delete;
+    InterruptScope& operator=(const InterruptScope&) = delete;
+
+    /**
+     * Returns whether Ctrl-C was pressed since the first of the current scopes began.
+     *
+     * @return True if the command should stop, false otherwise.
+     */
+    bool requested() const;
+};
+
+#endif
\ No newline at end of file
@@ -0,0 +1,75 @@
+#ifndef MAPPED_FILE_H
+#define MAPPED_FILE_H
+
+#include <cstddef>
+#include <string>
+
+/**
+ * @class MappedFile
+ * @brief A read-only memory mapping of a whole file.
+ *
+ * The pages are read by the kernel on first access, so scanning a mapped file costs no copy into a user buffer. On
+ * POSIX systems the mapping is advised as sequential, which lets the kernel read ahead aggressively.
+ */
+class MappedFile {
+public:
+    /**
+     * Creates an object without a mapping.
+     */
+    MappedFile();
+
+    /**
+     * Unmaps the file.
+     */
+    ~MappedFile();
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    /**
+     * Maps a file, replacing the current mapping. An empty file is opened without a mapping.
+     *
+     * @param path The path of the file.
+     * @return True if the file is available, false otherwise.
+     */
+    bool open(const std::string& path);
+
+    /**
+     * Maps a file given as a C string, such as a path held by a PathArena.
+     *
+     * @param path The NUL-terminated path of the file.
+     * @return True if the file is available, false otherwise.
+     */
+    bool open(const char* path);
+
+    /**
+     * Unmaps the file and closes it.
+     */
+    void close();
+
+    /**
+     * Returns the first byte of the file.
+     *
+     * @return The mapped data, or nullptr if nothing is mapped.
+     */
+    const char* data() const;
+
+    /**
+     * Returns the size of the file.
+     *
+     * @return The number of mapped bytes.
+     */
+    std::size_t size() const;
+
+private:
+    const char* base;
+    std::size_t mappedSize;
+#ifdef _WIN32
+    void* fileHandle;
+    void* mappingHandle;
+#else
+    int fd;
+#endif
+};
+
+#endif
\ No newline at end of file
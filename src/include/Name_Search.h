@@ -0,0 +1,61 @@
+#ifndef NAME_SEARCH_H
+#define NAME_SEARCH_H
+
+#include "Pattern_Matcher.h"
+
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+class DirectoryIndex;
+
+/**
+ * @class NameSearch
+ * @brief Finds files and directories whose names match a pattern.
+ *
+ * The search runs over the name table of a DirectoryIndex: one string block with a parent index per entry, laid out
+ * breadth-first. The descendants of a directory therefore form one contiguous range per tree level, and these ranges
+ * are split into chunks that are matched in parallel without allocating per entry. Trees without an index are walked
+ * with the DirectoryWalker instead.
+ */
+class NameSearch {
+public:
+    /**
+     * Callback receiving the matches of a walk, in depth-first order.
+     *
+     * @param path The full path of the matching entry.
+     * @param isDirectory Whether the entry is a directory.
+     */
+    using Visitor = std::function<void(std::string_view path, bool isDirectory)>;
+
+    /**
+     * Number of index entries matched by one task.
+     */
+    static const std::uint32_t CHUNK_SIZE = 16384;
+
+    /**
+     * Finds the entries below a directory of an index whose names match a pattern.
+     *
+     * @param index The open index.
+     * @param directory The index of the directory to search.
+     * @param matcher The compiled pattern.
+     * @param threadCount The number of worker threads. Zero selects the number of hardware threads.
+     * @return The indices of the matching entries, shallower entries first.
+     */
+    static std::vector<std::uint32_t> searchIndex(const DirectoryIndex& index, std::uint32_t directory, const PatternMatcher& matcher, unsigned threadCount = 0);
+
+    /**
+     * Walks a directory tree and reports the entries whose names match a pattern.
+     *
+     * @param rootPath The path of the directory to search.
+     * @param matcher The compiled pattern.
+     * @param threadCount The number of worker threads. Zero selects the number of hardware threads.
+     * @param visitor The callback receiving the matches.
+     * @return True if the directory could be read, false otherwise.
+     */
+    static bool searchTree(const std::string& rootPath, const PatternMatcher& matcher, unsigned threadCount, const Visitor& visitor);
+};
+
+#endif
\ No newline at end of file
@@ -0,0 +1,119 @@
+#ifndef OUTPUT_SINK_H
+#define OUTPUT_SINK_H
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+/**
+ * @class OutputSink
+ * @brief A buffered file writer that issues one system call per filled buffer.
+ *
+ * The OutputSink class collects small writes in a large reusable buffer and hands the whole buffer to the operating
+ * system in a single call when it fills up, so writing millions of short lines costs only a few hundred system calls.
+ * With vectored writes enabled, a piece that does not fit into the remaining buffer is written together with the
+ * buffered data in one writev call instead of being copied (POSIX only; Windows always copies).
+ */
+class OutputSink {
+public:
+    /**
+     * Default size of the write buffer.
+     */
+    static const std::size_t DEFAULT_BUFFER_SIZE = 1 << 20;
+
+    /**
+     * Creates a sink that is not attached to a file yet.
+     *
+     * @param bufferSize The size of the write buffer in bytes.
+     */
+    explicit OutputSink(std::size_t bufferSize = DEFAULT_BUFFER_SIZE);
+
+    /**
+     * Flushes the buffered data and closes the file.
+     */
+    ~OutputSink();
+
+    OutputSink(const OutputSink&) = delete;
+    OutputSink& operator=(const OutputSink&) = delete;
+
+    /**
+     * Creates or truncates the file at the given path and attaches the sink to it.
+     *
+     * @param path The path of the file to write.
+     * @return True if the file could be opened, false otherwise.
+     */
+    bool open(const std::string& path);
+
+    /**
+     * Enables or disables writev batching of pieces that do not fit into the buffer.
+     *
+     * @param enabled Whether vectored writes are used.
+     */
+    void setVectoredWrites(bool enabled);
+
+    /**
+     * Appends data to the sink.
+     *
+     * @param data The data to write.
+     * @param size The number of bytes to write.
+     */
+    void write(const char* data, std::size_t size);
+
+    /**
+     * Appends a string to the sink.
+     *
+     * @param text The text to write.
+     */
+    void write(const std::string& text);
+
+    /**
+     * Appends a single character to the sink.
+     *
+     * @param character The character to write.
+     */
+    void put(char character);
+
+    /**
+     * Writes the buffered data to the file.
+     *
+     * @return True if all data written so far reached the file, false otherwise.
+     */
+    bool flush();
+
+    /**
+     * Flushes the buffered data and closes the file.
+     *
+     * @return True if all data reached the file and the file was closed, false otherwise.
+     */
+    bool close();
+
+    /**
+     * Returns whether every write so far succeeded.
+     *
+     * @return True if no write failed, false otherwise.
+     */
+    bool good() const;
+
+    /**
+     * Returns the number of write system calls issued so far.
+     *
+     * @return The number of write system calls.
+     */
+    std::size_t writeCallCount() const;
+
+private:
+    bool writeBuffered(const char* extra, std::size_t extraSize);
+
+    std::vector<char> buffer;
+    std::size_t used;
+    std::size_t writeCalls;
+    bool vectoredWrites;
+    bool failed;
+#ifdef _WIN32
+    void* handle;
+#else
+    int fd;
+#endif
+};
+
+#endif
\ No newline at end of file
@@ -0,0 +1,58 @@
+#ifndef PATH_ARENA_H
+#define PATH_ARENA_H
+
+#include <cstddef>
+#include <memory>
+#include <string_view>
+#include <vector>
+
+/**
+ * @class PathArena
+ * @brief Stores many paths in a few large blocks and hands out views of them.
+ *
+ * Paths that outlive the traversal that formed them, such as the candidates of a duplicate search, are copied into
+ * blocks of BLOCK_SIZE bytes instead of one std::string each. A stored path never moves, so its view stays valid until
+ * the arena is cleared or destroyed.
+ *
+ * Every path is followed by a NUL, so the data of a view can be passed to the system as a C string. An arena is not
+ * safe for concurrent use.
+ */
+class PathArena {
+public:
+    /**
+     * Size of the blocks paths are stored in. Longer paths get a block of their own.
+     */
+    static const std::size_t BLOCK_SIZE = 64 * 1024;
+
+    PathArena() = default;
+    PathArena(const PathArena&) = delete;
+    PathArena& operator=(const PathArena&) = delete;
+
+    /**
+     * Copies a path into the arena.
+     *
+     * @param path The path.
+     * @return A view of the copy, valid until the arena is cleared.
+     */
+    std::string_view store(std::string_view path);
+
+    /**
+     * Releases every path.
+     */
+    void clear();
+
+    /**
+     * Returns the memory held by the blocks.
+     *
+     * @return The number of bytes allocated.
+     */
+    std::size_t bytes() const;
+
+private:
+    std::vector<std::unique_ptr<char[]>> blocks;
+    std::size_t blockBytes = 0;
+    std::size_t used = 0;
+    std::size_t capacity = 0;
+};
+
+#endif
\ No newline at end of file
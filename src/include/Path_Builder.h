@@ -0,0 +1,80 @@
+#ifndef PATH_BUILDER_H
+#define PATH_BUILDER_H
+
+#include <cstddef>
+#include <string>
+#include <string_view>
+
+/**
+ * @class PathBuilder
+ * @brief A path that grows and shrinks in place while a traversal descends and returns.
+ *
+ * Appending a component remembers nothing but the old length, and truncating to that length undoes the append, so a
+ * depth-first traversal keeps one buffer for every path it forms. The buffer only grows, which makes the paths of a
+ * whole tree cost as many allocations as the deepest path needs, typically none after the first few entries.
+ *
+ * The path is always NUL-terminated, so c_str() can be passed to the system directly. Views returned by view() are
+ * valid until the next change.
+ */
+class PathBuilder {
+public:
+    /**
+     * Creates an empty path.
+     */
+    PathBuilder() = default;
+
+    /**
+     * Creates a path starting at a directory.
+     *
+     * @param path The starting path.
+     */
+    explicit PathBuilder(std::string_view path);
+
+    /**
+     * Replaces the whole path, keeping the buffer.
+     *
+     * @param path The new path.
+     */
+    void assign(std::string_view path);
+
+    /**
+     * Appends a component, inserting the platform separator unless the path is empty or already ends with one.
+     *
+     * @param name The component to append.
+     * @return The length of the path before the append, to pass to truncate.
+     */
+    std::size_t push(std::string_view name);
+
+    /**
+     * Shortens the path, undoing the appends made since it had this length.
+     *
+     * @param length The length to keep.
+     */
+    void truncate(std::size_t length);
+
+    /**
+     * Returns the path.
+     *
+     * @return A view of the path, valid until the next change.
+     */
+    std::string_view view() const;
+
+    /**
+     * Returns the path as a C string.
+     *
+     * @return The NUL-terminated path, valid until the next change.
+     */
+    const char* c_str() const;
+
+    /**
+     * Returns the length of the path.
+     *
+     * @return The number of characters.
+     */
+    std::size_t size() const;
+
+private:
+    std::string buffer;
+};
+
+#endif
\ No newline at end of file
@@ -0,0 +1,62 @@
+#ifndef PATTERN_MATCHER_H
+#define PATTERN_MATCHER_H
+
+#include <memory>
+#include <regex>
+#include <string>
+#include <string_view>
+
+/**
+ * @class PatternMatcher
+ * @brief Matches file names against a glob or a regular expression.
+ *
+ * Globs support "*", "?" and bracket classes such as "[a-z]" or "[!0-9]" and must match the whole name. Regular
+ * expressions use the ECMAScript syntax and match anywhere in the name. Matching is case-insensitive on Windows,
+ * where file names are, and case-sensitive elsewhere. A compiled matcher may be used from several threads at once.
+ */
+class PatternMatcher {
+public:
+    /**
+     * The syntax of a pattern.
+     */
+    enum class Syntax {
+        GLOB,
+        REGEX
+    };
+
+    /**
+     * Compiles a pattern, replacing the current one.
+     *
+     * @param pattern The pattern to compile.
+     * @param syntax The syntax of the pattern.
+     * @param error Receives the reason if the pattern is invalid.
+     * @return True if the pattern was compiled, false otherwise.
+     */
+    bool compile(const std::string& pattern, Syntax syntax, std::string& error);
+
+    /**
+     * Checks whether a name matches the compiled pattern.
+     *
+     * @param name The file name to test.
+     * @return True if the name matches, false otherwise.
+     */
+    bool matches(std::string_view name) const;
+
+    /**
+     * Returns the compiled pattern.
+     *
+     * @return The pattern.
+     */
+    const std::string& pattern() const;
+
+private:
+    bool matchGlob(std::string_view name) const;
+    bool matchClass(std::size_t& position, char character) const;
+
+    std::string source;
+    Syntax syntax = Syntax::GLOB;
+    bool caseSensitive = true;
+    std::shared_ptr<const std::regex> expression;
+};
+
+#endif
\ No newline at end of file
@@ -0,0 +1,86 @@
+#ifndef TEXT_SEARCH_H
+#define TEXT_SEARCH_H
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <string>
+
+/**
+ * @class TextSearch
+ * @brief Finds a literal string in every file of a directory tree.
+ *
+ * Each file is memory-mapped and scanned by a vectorized substring kernel on a worker pool. The kernel compares the
+ * first and the last byte of the pattern against 32 (AVX2) or 16 (SSE2) positions at once and checks the remaining
+ * bytes only where both match, so long runs without a candidate are skipped at memory speed. The widest kernel the
+ * processor supports is chosen at startup; other processors use a memchr-based scalar kernel. The files are found by
+ * DirectoryWalker and the matches are reported in its depth-first order while later files are still being scanned.
+ */
+class TextSearch {
+public:
+    /**
+     * A line containing the pattern.
+     */
+    struct Match {
+        const std::string* path;
+        std::uint64_t lineNumber;
+        std::string line;
+    };
+
+    /**
+     * Counters describing a finished search.
+     */
+    struct Stats {
+        std::size_t filesScanned;
+        std::size_t matchingFiles;
+        std::size_t matches;
+        std::size_t binaryFiles;
+        std::size_t unreadableFiles;
+        std::uint64_t bytesScanned;
+        double seconds;
+    };
+
+    /**
+     * Callback receiving the matches in order, on the calling thread.
+     *
+     * @param match The matching line. The path pointer is valid only during the call.
+     */
+    using Visitor = std::function<void(const Match& match)>;
+
+    /**
+     * Longest part of a matching line kept in a Match.
+     */
+    static const std::size_t MAX_LINE_LENGTH = 512;
+
+    /**
+     * Finds the first occurrence of a pattern in a buffer with the selected kernel.
+     *
+     * @param data The buffer to search.
+     * @param size The size of the buffer.
+     * @param pattern The pattern to find.
+     * @param patternLength The length of the pattern.
+     * @return The first occurrence, or nullptr if the buffer does not contain the pattern.
+     */
+    static const char* find(const char* data, std::size_t size, const char* pattern, std::size_t patternLength);
+
+    /**
+     * Returns the name of the kernel selected for this processor.
+     *
+     * @return "AVX2", "SSE2" or "scalar".
+     */
+    static const char* kernelName();
+
+    /**
+     * Searches every file below a directory. Files containing a NUL byte in their first 8 KiB are treated as binary
+     * and skipped. Each line is reported once, however many times it contains the pattern.
+     *
+     * @param rootPath The path of the directory to search.
+     * @param pattern The literal text to find.
+     * @param threadCount The number of worker threads. Zero selects the number of hardware threads.
+     * @param visitor The callback receiving the matches.
+     * @return The counters of the search.
+     */
+    static Stats search(const std::string& rootPath, const std::string& pattern, unsigned threadCount, const Visitor& visitor);
+};
+
+#endif
\ No newline at end of file
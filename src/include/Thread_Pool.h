@@ -0,0 +1,102 @@
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/**
+ * @class ThreadPool
+ * @brief A work-stealing pool of worker threads.
+ *
+ * Every worker owns a task queue. Tasks submitted from inside a worker are pushed to that worker's own queue and
+ * taken back in LIFO order, which keeps a recursive traversal depth-first and cache-warm. Idle workers steal the
+ * oldest task from the other queues, so a single large subtree is spread over all cores.
+ */
+class ThreadPool {
+public:
+    /**
+     * Creates the pool and starts the worker threads.
+     *
+     * @param threadCount The number of worker threads. Zero selects the number of hardware threads.
+     */
+    explicit ThreadPool(unsigned threadCount = 0);
+
+    /**
+     * Waits for the queued tasks to finish and joins the worker threads.
+     */
+    ~ThreadPool();
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    /**
+     * Queues a task for execution.
+     *
+     * @param task The task to run. Tasks may submit further tasks.
+     */
+    void submit(std::function<void()> task);
+
+    /**
+     * Blocks until every submitted task, including the tasks they submitted, has finished.
+     *
+     * A task that throws still counts as finished, and the other tasks keep running.
+     *
+     * @throws The first exception a task threw since the last wait, once every task has finished.
+     */
+    void wait();
+
+    /**
+     * Returns the number of worker threads.
+     *
+     * @return The number of worker threads.
+     */
+    unsigned size() const;
+
+    /**
+     * Returns the index of the worker of this pool running the calling thread.
+     *
+     * @return The worker index, or -1 if the calling thread is not a worker of this pool, such as a worker of another.
+     */
+    int currentWorkerIndex() const;
+
+    /**
+     * Returns the number of threads used when no explicit count is given.
+     *
+     * @return The number of hardware threads, at least 1.
+     */
+    static unsigned defaultThreadCount();
+
+private:
+    struct WorkerQueue {
+        std::mutex mutex;
+        std::deque<std::function<void()>> tasks;
+    };
+
+    bool popLocal(unsigned index, std::function<void()>& task);
+    bool steal(unsigned index, std::function<void()>& task);
+    void workerLoop(unsigned index);
+    std::exception_ptr waitForTasks();
+
+    std::vector<std::unique_ptr<WorkerQueue>> queues;
+    std::vector<std::thread> workers;
+
+    std::mutex stateMutex;
+    std::condition_variable workAvailable;
+    std::condition_variable allDone;
+
+    std::atomic<long> queuedTasks;
+    std::atomic<long> pendingTasks;
+    std::atomic<unsigned> nextQueue;
+    bool stopping;
+    /** The first exception a task threw since the last wait, guarded by stateMutex. */
+    std::exception_ptr firstException;
+};
+
+#endif
\ No newline at end of file
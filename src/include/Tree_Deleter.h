@@ -0,0 +1,45 @@
+#ifndef TREE_DELETER_H
+#define TREE_DELETER_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+/**
+ * @class TreeDeleter
+ * @brief Deletes directory trees in parallel, bottom-up.
+ *
+ * Every directory is read by its own task on a worker pool, which deletes the files of the directory right away and
+ * queues its subdirectories. A directory is removed by the task that finishes its last child, so no directory is
+ * visited twice. On POSIX systems each directory is opened once, relative to the descriptor of an open ancestor, and
+ * its entries are removed with unlinkat relative to its own descriptor, so the kernel never resolves the full path of
+ * a deleted file. The descriptors kept open for subdirectories are bounded by the DescriptorBudget, which lets trees
+ * deeper than the limit on open files be deleted. Where io_uring is available, the files of a large directory are
+ * unlinked in one batch through the AsyncIoEngine of the worker.
+ */
+class TreeDeleter {
+public:
+    /**
+     * Summary of a deletion or a dry run.
+     */
+    struct Result {
+        std::size_t filesDeleted;
+        std::size_t directoriesDeleted;
+        std::uint64_t bytesFreed;
+        std::size_t failures;
+        std::string firstFailure;
+        double seconds;
+    };
+
+    /**
+     * Deletes a file or a directory with all of its contents. Symbolic links and junctions are deleted, not followed.
+     *
+     * @param path The path of the file or directory to delete.
+     * @param threadCount The number of worker threads. Zero selects the number of hardware threads.
+     * @param dryRun If true, nothing is deleted and the result reports what would be deleted.
+     * @return The summary of the deletion. On POSIX systems the file sizes are only read, and bytesFreed filled, in a dry run.
+     */
+    static Result remove(const std::string& path, unsigned threadCount = 0, bool dryRun = false);
+};
+
+#endif
\ No newline at end of file
@@ -0,0 +1,49 @@
+#ifndef TREE_PERMISSIONS_H
+#define TREE_PERMISSIONS_H
+
+#include "Filesystem_Backend.h"
+
+#include <cstddef>
+#include <string>
+
+/**
+ * @class TreePermissions
+ * @brief Grants an access to every file and directory of a tree in parallel.
+ *
+ * Every directory is read by its own task on a worker pool. The mode of each entry is read once while the directory is
+ * listed, and only the entries whose mode differs from the one the access calls for are changed, so a second run over
+ * a tree that is already right changes nothing. On POSIX systems each directory is opened relative to the descriptor
+ * of an open ancestor, as by the TreeDeleter, and its entries are read and changed through the AsyncIoEngine relative
+ * to its own descriptor: the modes of a large batch are read in one go on the kernel queue, and the changes run on the
+ * worker with fchmodat. A directory with many entries is split into batches that run on all workers.
+ *
+ * Symbolic links and junctions are neither changed nor followed, since changing them would change their targets.
+ */
+class TreePermissions {
+public:
+    /**
+     * Summary of an application.
+     */
+    struct Result {
+        std::size_t changed;
+        /** Entries whose permissions already matched. */
+        std::size_t unchanged;
+        /** Symbolic links and junctions. */
+        std::size_t skipped;
+        std::size_t failures;
+        std::string firstFailure;
+        double seconds;
+    };
+
+    /**
+     * Grants an access to a file, or to a directory and everything below it.
+     *
+     * @param path The path of the file or directory.
+     * @param access The access to grant.
+     * @param threadCount The number of worker threads. Zero selects the number of hardware threads.
+     * @return The summary of the application.
+     */
+    static Result apply(const std::string& path, FilesystemBackend::Access access, unsigned threadCount = 0);
+};
+
+#endif
\ No newline at end of file
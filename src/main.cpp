@@ -1,10 +1,22 @@
+#include <exception>
+#include <fstream>
+#include <iomanip>
 #include <iostream>
 #include <string>
 #include <sstream>
+#ifdef _WIN32
+#include <io.h>
 #include <windows.h>
+#else
+#include <unistd.h>
+#endif
 #include "File_Manager.h"
 #include "Colored_Console.h"
+#include "Batch_Runner.h"
+#include "Bulk_Operation.h"
+#include "Instrumentation.h"
 
+#ifdef _WIN32
 // Sets the console font size to the specified size.
 void setConsoleFontSize(int size) {
     CONSOLE_FONT_INFOEX fontInfo = { sizeof(CONSOLE_FONT_INFOEX) };
@@ -12,6 +24,7 @@ void setConsoleFontSize(int size) {
     fontInfo.dwFontSize.Y = size;
     SetCurrentConsoleFontEx(GetStdHandle(STD_OUTPUT_HANDLE), FALSE, &fontInfo);
 }
+#endif
 
 // Displays the heading of the file manager program.
 void showHeading() {
@@ -20,13 +33,37 @@ void showHeading() {
     ColoredConsole::setConsoleColor(DEFAULT_COLOR);
 }
 
-// Shows the message indicating the wrong number of arguments for the command
-void showArgumentsNumberError() {
+const char ARGUMENTS_NUMBER_ERROR[] = "Invalid number of arguments. See \"help\" for usage instructions.";
+
+// Shows an error message for a command that could not be run.
+void showError(const std::string& message) {
     ColoredConsole::setConsoleColor(ERROR_COLOR);
-    std::cout << "\nInvalid number of arguments. See \"help\" for usage instructions." << std::endl << std::endl;
+    std::cout << "\n" << message << std::endl << std::endl;
     ColoredConsole::setConsoleColor(DEFAULT_COLOR);
 }
 
+// Parses a non-negative integer argument. Returns false if the argument is not a number.
+bool parseUnsigned(const std::string& argument, unsigned& value) {
+    if (argument.empty() || argument.find_first_not_of("0123456789") != std::string::npos || argument.size() > 9) {
+        return false;
+    }
+    value = static_cast<unsigned>(std::stoul(argument));
+    return true;
+}
+
+// Reads an argument that may be quoted with ' or ", so a substitution can contain spaces. Nothing inside the quotes is
+// unescaped. Returns false if a quote is not closed.
+bool readQuotedArgument(std::istream& input, std::string& argument) {
+    input >> std::ws;
+    int quote = input.peek();
+    if (quote != '\'' && quote != '"') {
+        input >> argument;
+        return true;
+    }
+    input.get();
+    return static_cast<bool>(std::getline(input, argument, static_cast<char>(quote)));
+}
+
 // Displays the available commands and their usage instructions.
 void showHelp() {
     std::cout << "\n -----------------------------------------------------------------------------------------" << std::endl;
@@ -37,11 +74,29 @@ void showHelp() {
     std::cout << "|  mkdir <dir>                         - Create a new directory                           |" << std::endl;
     std::cout << "|  mkfile <filename>                   - Create a new file                                |" << std::endl;
     std::cout << "|  rename <name> <new_name>            - Rename a file or directory                       |" << std::endl;
-    std::cout << "|  delete <file | dir>                 - Delete a file or directory                       |" << std::endl;
+    std::cout << "|  rename s/<regex>/<new>/ [dir]       - Rename every name the regex changes ($1, $2)     |" << std::endl;
+    std::cout << "|  delete [-r] [--dry-run] <path>      - Delete a file, or a directory tree with -r       |" << std::endl;
+    std::cout << "|  copy <source> <dest>                - Copy a file or directory tree                    |" << std::endl;
     std::cout << "|  move <source> <dest>                - Move a file or directory to a new location       |" << std::endl;
-    std::cout << "|  ls                                  - List files and directories                       |" << std::endl;
-    std::cout << "|  tree <filename>                     - Create a directory structure file                |" << std::endl;
+    std::cout << "|  ls [-l] [-r] [dir]                  - List files and directories, -l adds size/time    |" << std::endl;
+    std::cout << "|     [--sort=name|size|time]          - Sort by name, size or time, -r to reverse        |" << std::endl;
+    std::cout << "|     [--offset=<n>] [--limit=<n>]     - Show a page of entries; Ctrl-C stops a listing   |" << std::endl;
+    std::cout << "|  find [--regex] <pattern> [dir]      - Find files and directories by name               |" << std::endl;
+    std::cout << "|  find-text <text> [dir]              - Find lines containing text in a directory tree   |" << std::endl;
+    std::cout << "|  dupes [dir]                         - Find duplicate files and the space they use      |" << std::endl;
+    std::cout << "|  du [dir]                            - Show the size of a tree and its largest subtrees |" << std::endl;
+    std::cout << "|  cache                               - Show directory cache statistics                  |" << std::endl;
+    std::cout << "|  stats [reset]                       - Show command timings and I/O counters            |" << std::endl;
+    std::cout << "|  tree <filename> [threads]           - Create a directory structure file                |" << std::endl;
+    std::cout << "|  snapshot <file> [threads]           - Record sizes, times and hashes of the tree       |" << std::endl;
+    std::cout << "|  diff <snapshot1> <snapshot2>        - Show what changed between two snapshots          |" << std::endl;
+    std::cout << "|  pack <dir> <archive> [threads]      - Compress a tree into one indexed archive         |" << std::endl;
+    std::cout << "|  unpack <archive> <dir> [entry]      - Extract an archive, or one entry of it           |" << std::endl;
+    std::cout << "|  index [threads]                     - Build or refresh the current directory index     |" << std::endl;
     std::cout << "|  permit <file | dir> <access>        - Set permissions for a file or directory          |" << std::endl;
+    std::cout << "|  permit -r <dir> <access>            - Set permissions of a whole tree in parallel      |" << std::endl;
+    std::cout << "|    <access>: read, write, modify (owner and group may write) or an octal mode like 750  |" << std::endl;
+    std::cout << "|  move|delete|permit <glob> ...       - Apply to every match, e.g. move *.log archive    |" << std::endl;
     std::cout << "|  help                                - Show the help and available commands             |" << std::endl;
     std::cout << "|  openfe                              - Open File Explorer in the current directory      |" << std::endl;
     std::cout << "|  clear                               - Clear the console                                |" << std::endl;
@@ -51,133 +106,523 @@ void showHelp() {
 
 // Performs initialization tasks for the file manager program.
 void init() {
+#ifdef _WIN32
     HWND consoleHandle = GetConsoleWindow();
     SetWindowTextA(consoleHandle, "File Manager");
 
     setConsoleFontSize(20);
+#endif
     showHeading();
 }
 
-int main() {
-    init();
-
+// Parses a command line into the action that runs it and the paths it reads and writes. Paths are resolved against
+// the current directory when the action runs, so a command parsed ahead of a "cd" still sees the new directory.
+bool parseCommand(const std::string& line, BatchRunner::Command& parsed, std::string& error) {
     std::string command;
     std::string argument1;
     std::string argument2;
 
-    std::string currentDirectory = FileManager::currentDirectory;
+    std::stringstream ss(line);
+    ss >> command >> argument1 >> argument2;
 
-    while (true) {
-        FileManager::displayCurrentDirectory();
-
-        std::getline(std::cin, command);
-
-        std::stringstream ss(command);
-        ss >> command >> argument1 >> argument2;
-
-        if (command == "exit") {
-            break;
+    if (command == "cd") {
+        if (argument1.empty()) {
+            error = ARGUMENTS_NUMBER_ERROR;
+            return false;
         }
-        else if (command == "cd") {
-            if (argument1.empty()) {
-                showArgumentsNumberError();
-                ss.clear();
-                continue;
-            }
+        parsed.action = [argument1] {
             FileManager::navigateDirectory(FileManager::getAbsolutePath(argument1));
+            FileManager::updateCurrentDirectory();
+        };
+        parsed.barrier = true;
+    }
+    else if (command == "mkdir") {
+        if (argument1.empty()) {
+            error = ARGUMENTS_NUMBER_ERROR;
+            return false;
         }
-        else if (command == "mkdir") {
-            if (argument1.empty()) {
-                showArgumentsNumberError();
-                ss.clear();
-                continue;
-            }
-            FileManager::createDirectory(argument1);
+        parsed.action = [argument1] { FileManager::createDirectory(argument1); };
+        parsed.writes = { argument1 };
+    }
+    else if (command == "mkfile") {
+        if (argument1.empty()) {
+            error = ARGUMENTS_NUMBER_ERROR;
+            return false;
         }
-        else if (command == "mkfile") {
-            if (argument1.empty()) {
-                showArgumentsNumberError();
-                ss.clear();
-                continue;
-            }
-            FileManager::createFile(FileManager::getAbsolutePath(argument1));
+        parsed.action = [argument1] { FileManager::createFile(FileManager::getAbsolutePath(argument1)); };
+        parsed.writes = { argument1 };
+    }
+    else if (command == "rename") {
+        // rename s/regex/replacement/ [dir] renames every entry of a directory whose name the substitution changes.
+        std::stringstream arguments(line);
+        std::string expression;
+        std::string directory;
+        arguments >> command;
+        if (readQuotedArgument(arguments, expression) && BulkOperation::isSubstitution(expression)) {
+            arguments >> directory;
+            parsed.action = [expression, directory] {
+                FileManager::renameMatching(expression, directory.empty() ? FileManager::currentDirectory : FileManager::getAbsolutePath(directory));
+            };
+            parsed.writes = { directory };
         }
-        else if (command == "rename") {
-            if (argument1.empty() || argument2.empty()) {
-                showArgumentsNumberError();
-                ss.clear();
-                continue;
-            }
-            FileManager::renameFileOrDirectory(FileManager::getAbsolutePath(argument1), FileManager::getAbsolutePath(argument2));
+        else if (argument1.empty() || argument2.empty()) {
+            error = ARGUMENTS_NUMBER_ERROR;
+            return false;
         }
-        else if (command == "delete") {
-            if (argument1.empty()) {
-                showArgumentsNumberError();
-                ss.clear();
-                continue;
-            }
-            FileManager::deleteFileOrDirectory(FileManager::getAbsolutePath(argument1));
+        else {
+            parsed.action = [argument1, argument2] {
+                FileManager::renameFileOrDirectory(FileManager::getAbsolutePath(argument1), FileManager::getAbsolutePath(argument2));
+            };
+            parsed.writes = { argument1, argument2 };
         }
-        else if (command == "move") {
-            if (argument1.empty() || argument2.empty()) {
-                showArgumentsNumberError();
-                ss.clear();
-                continue;
+    }
+    else if (command == "delete") {
+        std::string target;
+        std::string argument3;
+        bool recursive = false;
+        bool dryRun = false;
+        bool valid = true;
+        ss >> argument3;
+        for (const std::string& argument : { argument1, argument2, argument3 }) {
+            if (argument == "-r") {
+                recursive = true;
+            }
+            else if (argument == "--dry-run") {
+                dryRun = true;
+            }
+            else if (!argument.empty()) {
+                valid = valid && target.empty();
+                target = argument;
             }
-            FileManager::moveFileOrDirectory(FileManager::getAbsolutePath(argument1), FileManager::getAbsolutePath(argument2));
         }
-        else if (command == "ls") {
-            FileManager::listFilesAndDirectories(currentDirectory);
+        if (!valid || target.empty()) {
+            error = ARGUMENTS_NUMBER_ERROR;
+            return false;
         }
-        else if (command == "tree") {
-            if (argument1.empty()) {
-                showArgumentsNumberError();
-                ss.clear();
-                continue;
-            }
-            FileManager::createDirectoryStructureFile(argument1);
+        // A pattern touches the directory it is expanded in, not only the files it matches.
+        std::string footprint = target;
+        if (BulkOperation::isPattern(target)) {
+            parsed.action = [target, recursive, dryRun] {
+                FileManager::deleteMatching(FileManager::getAbsolutePath(target), recursive, dryRun);
+            };
+            footprint = BulkOperation::directoryOf(target);
+        }
+        else {
+            parsed.action = [target, recursive, dryRun] {
+                FileManager::deleteFileOrDirectory(FileManager::getAbsolutePath(target), recursive, dryRun);
+            };
+        }
+        if (dryRun) {
+            parsed.reads = { footprint };
+        }
+        else {
+            parsed.writes = { footprint };
         }
-        else if (command == "permit") {
-            if (argument1.empty() || argument2.empty()) {
-                showArgumentsNumberError();
-                ss.clear();
-                continue;
+    }
+    else if (command == "move") {
+        if (argument1.empty() || argument2.empty()) {
+            error = ARGUMENTS_NUMBER_ERROR;
+            return false;
+        }
+        if (BulkOperation::isPattern(argument1)) {
+            parsed.action = [argument1, argument2] {
+                FileManager::moveMatching(FileManager::getAbsolutePath(argument1), FileManager::getAbsolutePath(argument2));
+            };
+            parsed.writes = { BulkOperation::directoryOf(argument1), argument2 };
+        }
+        else {
+            parsed.action = [argument1, argument2] {
+                FileManager::moveFileOrDirectory(FileManager::getAbsolutePath(argument1), FileManager::getAbsolutePath(argument2));
+            };
+            parsed.writes = { argument1, argument2 };
+        }
+    }
+    else if (command == "copy") {
+        if (argument1.empty() || argument2.empty()) {
+            error = ARGUMENTS_NUMBER_ERROR;
+            return false;
+        }
+        parsed.action = [argument1, argument2] {
+            FileManager::copyFileOrDirectory(FileManager::getAbsolutePath(argument1), FileManager::getAbsolutePath(argument2));
+        };
+        parsed.reads = { argument1 };
+        parsed.writes = { argument2 };
+    }
+    else if (command == "ls") {
+        EntryTable::SortKey sortKey = EntryTable::SortKey::NONE;
+        bool descending = false;
+        bool longFormat = false;
+        unsigned offset = 0;
+        unsigned limit = 0;
+        bool valid = true;
+        std::string directory;
+        std::string option;
+        std::stringstream options(line);
+        options >> option;
+        while (options >> option) {
+            if (option == "-l") {
+                longFormat = true;
             }
-            DWORD permissions = GetFileAttributesA(FileManager::getAbsolutePath(argument1).c_str());
-            if (argument2 == "read") {
-                permissions &= ~FILE_ATTRIBUTE_DIRECTORY;
-                permissions |= FILE_ATTRIBUTE_READONLY;
+            else if (option == "-r") {
+                descending = true;
             }
-            else if (argument2 == "write") {
-                permissions &= ~FILE_ATTRIBUTE_DIRECTORY;
-                permissions &= ~FILE_ATTRIBUTE_READONLY;
+            else if (option == "--sort=name") {
+                sortKey = EntryTable::SortKey::NAME;
             }
-            else if (argument2 == "modify") {
-                permissions &= ~FILE_ATTRIBUTE_DIRECTORY;
-                permissions &= ~FILE_ATTRIBUTE_READONLY;
+            else if (option == "--sort=size") {
+                sortKey = EntryTable::SortKey::SIZE;
+            }
+            else if (option == "--sort=time") {
+                sortKey = EntryTable::SortKey::TIME;
+            }
+            else if (option.compare(0, 8, "--limit=") == 0) {
+                valid = valid && parseUnsigned(option.substr(8), limit) && limit > 0;
+            }
+            else if (option.compare(0, 9, "--offset=") == 0) {
+                valid = valid && parseUnsigned(option.substr(9), offset);
+            }
+            else {
+                valid = valid && directory.empty() && option[0] != '-';
+                directory = option;
             }
-            FileManager::setFileOrDirectoryPermissions(FileManager::getAbsolutePath(argument1), permissions);
         }
-        else if (command == "help") {
-            showHelp();
+        if (!valid) {
+            error = ARGUMENTS_NUMBER_ERROR;
+            return false;
         }
-        else if (command == "openfe") {
-            FileManager::openFileExplorer(currentDirectory);
+        parsed.action = [directory, sortKey, descending, longFormat, offset, limit] {
+            FileManager::listFilesAndDirectories(FileManager::getAbsolutePath(directory), sortKey, descending, longFormat, offset, limit);
+        };
+        parsed.reads = { directory };
+    }
+    else if (command == "find-text") {
+        // The pattern may be quoted to search for text containing spaces.
+        std::string pattern;
+        std::string directory;
+        std::stringstream quoted(line);
+        quoted >> command >> std::quoted(pattern) >> directory;
+        if (pattern.empty()) {
+            error = ARGUMENTS_NUMBER_ERROR;
+            return false;
         }
-        else if (command == "clear") {
-            system("cls");
+        parsed.action = [pattern, directory] { FileManager::findText(pattern, FileManager::getAbsolutePath(directory)); };
+        parsed.reads = { directory };
+    }
+    else if (command == "find") {
+        bool isRegex = argument1 == "--regex";
+        std::string pattern;
+        std::string directory;
+        std::stringstream quoted(line);
+        quoted >> command;
+        if (isRegex) {
+            quoted >> argument1;
+        }
+        quoted >> std::quoted(pattern) >> directory;
+        if (pattern.empty()) {
+            error = ARGUMENTS_NUMBER_ERROR;
+            return false;
+        }
+        parsed.action = [pattern, isRegex, directory] { FileManager::findFiles(pattern, isRegex, FileManager::getAbsolutePath(directory)); };
+        parsed.reads = { directory };
+    }
+    else if (command == "dupes") {
+        parsed.action = [argument1] { FileManager::findDuplicates(FileManager::getAbsolutePath(argument1)); };
+        parsed.reads = { argument1 };
+    }
+    else if (command == "du") {
+        parsed.action = [argument1] { FileManager::showDiskUsage(FileManager::getAbsolutePath(argument1)); };
+        parsed.reads = { argument1 };
+    }
+    else if (command == "cache") {
+        parsed.action = [] { FileManager::showDirectoryCacheStats(); };
+    }
+    else if (command == "stats") {
+        if (!argument1.empty() && argument1 != "reset") {
+            error = ARGUMENTS_NUMBER_ERROR;
+            return false;
+        }
+        if (argument1 == "reset") {
+            parsed.action = [] { Instrumentation::reset(); };
         }
         else {
-            ColoredConsole::setConsoleColor(ERROR_COLOR);
-            std::cout << "\nInvalid command. Please try again." << std::endl << std::endl;
-            ColoredConsole::setConsoleColor(DEFAULT_COLOR);
+            parsed.action = [] { FileManager::showInstrumentationStats(); };
+        }
+        // The numbers cover every command before this one and none after it.
+        parsed.barrier = true;
+    }
+    else if (command == "tree") {
+        if (argument1.empty()) {
+            error = ARGUMENTS_NUMBER_ERROR;
+            return false;
+        }
+        unsigned threadCount = 0;
+        if (!argument2.empty() && !parseUnsigned(argument2, threadCount)) {
+            error = "Invalid thread count: " + argument2;
+            return false;
+        }
+        parsed.action = [argument1, threadCount] { FileManager::createDirectoryStructureFile(argument1, threadCount); };
+        parsed.reads = { "" };
+        parsed.writes = { argument1 };
+    }
+    else if (command == "snapshot") {
+        if (argument1.empty()) {
+            error = ARGUMENTS_NUMBER_ERROR;
+            return false;
+        }
+        unsigned threadCount = 0;
+        if (!argument2.empty() && !parseUnsigned(argument2, threadCount)) {
+            error = "Invalid thread count: " + argument2;
+            return false;
+        }
+        parsed.action = [argument1, threadCount] { FileManager::createSnapshot(argument1, threadCount); };
+        parsed.reads = { "" };
+        parsed.writes = { argument1 };
+    }
+    else if (command == "diff") {
+        if (argument1.empty() || argument2.empty()) {
+            error = ARGUMENTS_NUMBER_ERROR;
+            return false;
+        }
+        parsed.action = [argument1, argument2] { FileManager::diffSnapshots(argument1, argument2); };
+        parsed.reads = { argument1, argument2 };
+    }
+    else if (command == "pack") {
+        std::string argument3;
+        ss >> argument3;
+        if (argument1.empty() || argument2.empty()) {
+            error = ARGUMENTS_NUMBER_ERROR;
+            return false;
         }
+        unsigned threadCount = 0;
+        if (!argument3.empty() && !parseUnsigned(argument3, threadCount)) {
+            error = "Invalid thread count: " + argument3;
+            return false;
+        }
+        parsed.action = [argument1, argument2, threadCount] {
+            FileManager::packDirectory(FileManager::getAbsolutePath(argument1), FileManager::getAbsolutePath(argument2), threadCount);
+        };
+        parsed.reads = { argument1 };
+        parsed.writes = { argument2 };
+    }
+    else if (command == "unpack") {
+        std::string argument3;
+        ss >> argument3;
+        if (argument1.empty() || argument2.empty()) {
+            error = ARGUMENTS_NUMBER_ERROR;
+            return false;
+        }
+        parsed.action = [argument1, argument2, argument3] {
+            FileManager::unpackArchive(FileManager::getAbsolutePath(argument1), FileManager::getAbsolutePath(argument2), argument3);
+        };
+        parsed.reads = { argument1 };
+        parsed.writes = { argument2 };
+    }
+    else if (command == "index") {
+        unsigned threadCount = 0;
+        if (!argument1.empty() && !parseUnsigned(argument1, threadCount)) {
+            error = "Invalid thread count: " + argument1;
+            return false;
+        }
+        parsed.action = [threadCount] { FileManager::updateDirectoryIndex(threadCount); };
+        parsed.reads = { "" };
+    }
+    else if (command == "permit") {
+        FilesystemBackend::Access access;
+        if (argument1 == "-r") {
+            // permit -r <dir> <access> applies the access to the whole tree below the directory.
+            std::string argument3;
+            ss >> argument3;
+            if (argument2.empty() || argument3.empty()) {
+                error = ARGUMENTS_NUMBER_ERROR;
+                return false;
+            }
+            if (!FilesystemBackend::parseAccess(argument3, access)) {
+                error = "Invalid access: " + argument3 + ". Expected read, write, modify or an octal mode.";
+                return false;
+            }
+            parsed.action = [argument2, access] { FileManager::setPermissionsRecursively(FileManager::getAbsolutePath(argument2), access); };
+            parsed.writes = { argument2 };
+        }
+        else if (argument1.empty() || argument2.empty()) {
+            error = ARGUMENTS_NUMBER_ERROR;
+            return false;
+        }
+        else if (!FilesystemBackend::parseAccess(argument2, access)) {
+            error = "Invalid access: " + argument2 + ". Expected read, write, modify or an octal mode.";
+            return false;
+        }
+        else if (BulkOperation::isPattern(argument1)) {
+            parsed.action = [argument1, access] { FileManager::setPermissionsMatching(FileManager::getAbsolutePath(argument1), access); };
+            parsed.writes = { BulkOperation::directoryOf(argument1) };
+        }
+        else {
+            // The attributes are read when the command runs, after the commands before it have changed the file.
+            parsed.action = [argument1, access] { FileManager::setFileOrDirectoryPermissions(FileManager::getAbsolutePath(argument1), access); };
+            parsed.writes = { argument1 };
+        }
+    }
+    else if (command == "help") {
+        parsed.action = showHelp;
+        parsed.barrier = true;
+    }
+    else if (command == "openfe") {
+        parsed.action = [] { FileManager::openFileExplorer(FileManager::currentDirectory); };
+        parsed.barrier = true;
+    }
+    else if (command == "clear") {
+#ifdef _WIN32
+        parsed.action = [] {
+            ColoredConsole::flush();
+            system("cls");
+        };
+#else
+        parsed.action = [] {
+            ColoredConsole::flush();
+            system("clear");
+        };
+#endif
+        parsed.barrier = true;
+    }
+    else {
+        error = "Invalid command. Please try again.";
+        return false;
+    }
+
+    return true;
+}
+
+// Returns the first word of a command line.
+std::string commandName(const std::string& line) {
+    std::string name;
+    std::stringstream(line) >> name;
+    return name;
+}
+
+// Parses a whole script before running any of it, so a typo on the last line does not leave the work half done.
+// Empty lines and lines starting with '#' are skipped, and "exit" ends the script.
+int runScript(std::istream& script) {
+    ColoredConsole::setColorsEnabled(false);
+    FileManager::updateCurrentDirectory();
+
+    std::vector<BatchRunner::Command> commands;
+    std::string line;
+    std::size_t lineNumber = 0;
+    bool valid = true;
+    while (std::getline(script, line)) {
+        ++lineNumber;
+        if (!line.empty() && line.back() == '\r') {
+            line.pop_back();
+        }
+        std::string name = commandName(line);
+        if (name.empty() || name[0] == '#') {
+            continue;
+        }
+        if (name == "exit") {
+            break;
+        }
+
+        BatchRunner::Command command;
+        std::string error;
+        if (!parseCommand(line, command, error)) {
+            std::cout << "Line " << lineNumber << ": " << error << " (" << line << ")" << std::endl;
+            valid = false;
+            continue;
+        }
+        command.lineNumber = lineNumber;
+        commands.push_back(std::move(command));
+    }
+    if (!valid) {
+        std::cout << "\nThe script was not run." << std::endl;
+        return 1;
+    }
+
+    BatchRunner::Result result;
+    try {
+        result = BatchRunner::run(commands);
+    } catch (const std::exception& exception) {
+        std::cout << "\nThe script stopped: " << exception.what() << std::endl;
+        return 1;
+    }
+    std::cout << "Ran " << result.commands << " commands in " << result.seconds << " s (" << result.dependentCommands
+        << " waited for an earlier command, " << result.barriers << " ran alone)." << std::endl;
+    return 0;
+}
+
+// Reads commands from the console one line at a time until "exit".
+void runInteractive() {
+    init();
+
+    std::string line;
+    while (true) {
+        FileManager::displayCurrentDirectory();
+        ColoredConsole::flush();
+
+        if (!std::getline(std::cin, line) || commandName(line) == "exit") {
+            break;
+        }
+
+        BatchRunner::Command command;
+        std::string error;
+        if (!parseCommand(line, command, error)) {
+            showError(error);
+            continue;
+        }
+        command.action();
+    }
+}
+
+// Runs the commands of a script file, or of the standard input when it is not a console.
+int runSession(const std::string& scriptPath) {
+    if (!scriptPath.empty()) {
+        std::ifstream script(scriptPath);
+        if (!script) {
+            std::cout << "Failed to open script: " << scriptPath << std::endl;
+            return 1;
+        }
+        return runScript(script);
+    }
 
-        ss.str("");
-        ss.clear();
-        argument1.clear();
-        argument2.clear();
+#ifdef _WIN32
+    bool interactive = _isatty(_fileno(stdin)) != 0;
+#else
+    bool interactive = isatty(fileno(stdin)) != 0;
+#endif
+    if (!interactive) {
+        return runScript(std::cin);
     }
 
+    runInteractive();
     return 0;
+}
+
+// Accepts -f <script> to run a script and --trace <file> to record a Chrome trace of the session.
+int main(int argc, char* argv[]) {
+    std::string scriptPath;
+    std::string tracePath;
+    for (int index = 1; index < argc; ++index) {
+        std::string option = argv[index];
+        if (option == "-f" && index + 1 < argc) {
+            scriptPath = argv[++index];
+        }
+        else if (option == "--trace" && index + 1 < argc) {
+            tracePath = argv[++index];
+        }
+        else {
+            std::cout << "Usage: " << argv[0] << " [-f <script>] [--trace <file>]" << std::endl;
+            return 1;
+        }
+    }
+
+    if (!tracePath.empty()) {
+        if (!Instrumentation::isEnabled()) {
+            std::cout << "Instrumentation was compiled out of this build; the trace will be empty." << std::endl;
+        }
+        Instrumentation::startTrace(tracePath);
+    }
+    int status = runSession(scriptPath);
+    if (!Instrumentation::stopTrace()) {
+        std::cout << "Failed to write the trace to " << tracePath << std::endl;
+        status = status != 0 ? status : 1;
+    }
+    return status;
 }
\ No newline at end of file
@@ -0,0 +1,130 @@
+#include "Directory_Walker.h"
+#include "Path_Builder.h"
+#include "Test_Support.h"
+
+#include <atomic>
+#include <cstddef>
+#include <cstdlib>
+#include <new>
+#include <string>
+
+#include <sys/stat.h>
+
+// Every allocation of the process goes through these, so a test can count the allocations made by a piece of code.
+namespace {
+    std::atomic<std::size_t> allocationCount{0};
+}
+
+void* operator new(std::size_t size) {
+    allocationCount.fetch_add(1, std::memory_order_relaxed);
+    if (void* memory = std::malloc(size > 0 ? size : 1)) {
+        return memory;
+    }
+    throw std::bad_alloc();
+}
+
+void operator delete(void* memory) noexcept {
+    std::free(memory);
+}
+
+void operator delete(void* memory, std::size_t) noexcept {
+    std::free(memory);
+}
+
+namespace {
+    std::size_t allocations() {
+        return allocationCount.load(std::memory_order_relaxed);
+    }
+
+    bool createTree(const std::string& root, std::size_t directories, std::size_t filesPerDirectory) {
+        for (std::size_t directory = 0; directory < directories; ++directory) {
+            std::string directoryPath = root + "/directory_" + std::to_string(directory);
+            if (mkdir(directoryPath.c_str(), 0755) != 0) {
+                return false;
+            }
+            for (std::size_t file = 0; file < filesPerDirectory; ++file) {
+                if (!TestSupport::writeFile(directoryPath + "/file_with_a_long_enough_name_" + std::to_string(file), "")) {
+                    return false;
+                }
+            }
+        }
+        return true;
+    }
+
+    std::size_t countWalkAllocations(const std::string& root, std::size_t& entries) {
+        entries = 0;
+        std::size_t before = allocations();
+        bool walked = DirectoryWalker::walk(root, 2, [&entries](std::size_t, std::string_view, bool) { ++entries; });
+        CHECK(walked);
+        return allocations() - before;
+    }
+
+    // A walk allocates per directory: its node and its name buffers. Ten times the files must not cost ten times the
+    // allocations.
+    void testWalk(const std::string& root) {
+        const std::size_t DIRECTORIES = 20;
+        TestSupport::ScratchDirectory small(root);
+        TestSupport::ScratchDirectory large(root);
+        CHECK(createTree(small.path, DIRECTORIES, 50));
+        CHECK(createTree(large.path, DIRECTORIES, 500));
+
+        std::size_t smallEntries;
+        std::size_t largeEntries;
+        std::size_t smallAllocations = countWalkAllocations(small.path, smallEntries);
+        std::size_t largeAllocations = countWalkAllocations(large.path, largeEntries);
+        CHECK(smallEntries == DIRECTORIES * 51);
+        CHECK(largeEntries == DIRECTORIES * 501);
+
+        std::size_t addedEntries = largeEntries - smallEntries;
+        std::size_t addedAllocations = largeAllocations > smallAllocations ? largeAllocations - smallAllocations : 0;
+        // Only the geometric growth of the three name buffers of each directory depends on the number of entries.
+        CHECK(addedAllocations < DIRECTORIES * 16);
+        CHECK(addedAllocations * 20 < addedEntries);
+    }
+
+    // Reading a directory into a list that already has room for it allocates nothing per entry.
+    void testReadNames(const std::string& root) {
+        TestSupport::ScratchDirectory directory(root);
+        CHECK(createTree(directory.path, 1, 5000));
+        std::string path = directory.path + "/directory_0";
+
+        DirectoryWalker::NameList names;
+        CHECK(DirectoryWalker::readNames(path, names));
+        CHECK(names.size() == 5000);
+
+        names.clear();
+        std::size_t before = allocations();
+        CHECK(DirectoryWalker::readNames(path, names));
+        std::size_t reread = allocations() - before;
+        CHECK(names.size() == 5000);
+        CHECK(reread == 0);
+    }
+
+    // Once the buffer holds the deepest path, forming paths allocates nothing.
+    void testPathBuilder() {
+        PathBuilder path("/some/root/directory");
+        std::size_t length = path.push("a_first_level_directory");
+        path.push("a_file_name_long_enough_to_need_the_heap");
+        path.truncate(length);
+
+        std::size_t before = allocations();
+        for (int index = 0; index < 10000; ++index) {
+            std::size_t parent = path.push("a_file_name_long_enough_to_need_the_heap");
+            path.truncate(parent);
+        }
+        CHECK(allocations() == before);
+    }
+}
+
+int main() {
+    TestSupport::ScratchDirectory scratch;
+    CHECK(!scratch.path.empty());
+    if (scratch.path.empty()) {
+        return TestSupport::result();
+    }
+
+    testWalk(scratch.path);
+    testReadNames(scratch.path);
+    testPathBuilder();
+    return TestSupport::result();
+}
\ No newline at end of file
@@ -0,0 +1,70 @@
+#include "Block_Codec.h"
+#include "Test_Support.h"
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace {
+    // Compresses a block and checks that it decompresses to the same bytes; returns the compressed size.
+    std::size_t roundTrip(const std::string& input) {
+        std::vector<char> compressed;
+        BlockCodec::compress(input.data(), input.size(), compressed);
+        CHECK(compressed.size() <= BlockCodec::maxCompressedSize(input.size()));
+
+        std::string output(input.size(), '\0');
+        CHECK(BlockCodec::decompress(compressed.data(), compressed.size(), &output[0], output.size()));
+        CHECK(output == input);
+        return compressed.size();
+    }
+
+    // A fixed xorshift sequence, so a failure reproduces.
+    std::string randomBytes(std::size_t size) {
+        std::uint64_t state = 0x9E3779B97F4A7C15ULL;
+        std::string bytes(size, '\0');
+        for (char& byte : bytes) {
+            state ^= state << 13;
+            state ^= state >> 7;
+            state ^= state << 17;
+            byte = static_cast<char>(state);
+        }
+        return bytes;
+    }
+
+    void testRoundTrips() {
+        roundTrip("");
+        roundTrip("a");
+        roundTrip("short block");
+        // Runs long enough to need the extended literal and match lengths.
+        CHECK(roundTrip(std::string(100000, 'x')) < 1000);
+        std::string text;
+        while (text.size() < 300000) {
+            text += "The quick brown fox jumps over the lazy dog " + std::to_string(text.size() % 97) + "\n";
+        }
+        CHECK(roundTrip(text) < text.size() / 2);
+        // Incompressible data stays within the bound; a mix exercises literals between matches.
+        std::string random = randomBytes(1 << 20);
+        roundTrip(random);
+        roundTrip(random.substr(0, 5000) + text.substr(0, 5000) + random.substr(5000, 70000) + text.substr(0, 70000));
+    }
+
+    // A damaged block is refused instead of producing wrong data.
+    void testDamagedBlocks() {
+        std::string input(50000, 'y');
+        input += randomBytes(1000);
+        std::vector<char> compressed;
+        BlockCodec::compress(input.data(), input.size(), compressed);
+
+        std::string output(input.size(), '\0');
+        CHECK(!BlockCodec::decompress(compressed.data(), compressed.size() / 2, &output[0], output.size()));
+        CHECK(!BlockCodec::decompress(compressed.data(), compressed.size(), &output[0], output.size() - 1));
+        std::string larger(input.size() + 1, '\0');
+        CHECK(!BlockCodec::decompress(compressed.data(), compressed.size(), &larger[0], larger.size()));
+    }
+}
+
+int main() {
+    testRoundTrips();
+    testDamagedBlocks();
+    return TestSupport::result();
+}
\ No newline at end of file
@@ -0,0 +1,129 @@
+#include "Directory_Index.h"
+#include "Test_Support.h"
+
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <string>
+
+#include <sys/stat.h>
+
+namespace {
+    // The column order and header layout of the index file: magic, version, entry count, then the offsets and sizes.
+    enum Column {
+        PARENTS,
+        NAME_OFFSETS,
+        NAME_LENGTHS,
+        SIZES,
+        MODIFICATION_TIMES,
+        ATTRIBUTES,
+        FLAGS,
+        FIRST_CHILDREN,
+        CHILD_COUNTS,
+        NAMES,
+        ROOT_PATH,
+        COLUMN_COUNT
+    };
+    const std::size_t OFFSETS_POSITION = 16;
+
+    std::string readFile(const std::string& path) {
+        std::ifstream input(path, std::ios::binary);
+        return std::string(std::istreambuf_iterator<char>(input), std::istreambuf_iterator<char>());
+    }
+
+    template <typename T>
+    void patch(std::string& contents, Column column, std::uint32_t entry, T value) {
+        std::uint64_t offset;
+        std::memcpy(&offset, contents.data() + OFFSETS_POSITION + column * sizeof(std::uint64_t), sizeof(offset));
+        std::memcpy(&contents[offset + entry * sizeof(T)], &value, sizeof(value));
+    }
+
+    // Writes a damaged copy of the index in place of the original and checks that it is refused.
+    template <typename T>
+    bool refuses(const std::string& root, const std::string& original, Column column, std::uint32_t entry, T value) {
+        std::string contents = original;
+        patch(contents, column, entry, value);
+        DirectoryIndex index;
+        return TestSupport::writeFile(DirectoryIndex::indexFilePath(root), contents) && !index.open(root) && !index.isOpen();
+    }
+
+    void testDamagedFiles(const std::string& scratch) {
+        std::string root = scratch + "/tree";
+        CHECK(mkdir(root.c_str(), 0755) == 0);
+        CHECK(mkdir((root + "/directory").c_str(), 0755) == 0);
+        CHECK(TestSupport::writeFile(root + "/directory/file", "contents"));
+        CHECK(TestSupport::writeFile(root + "/file", ""));
+
+        DirectoryIndex index;
+        CHECK(index.update(root));
+        CHECK(index.entryCount() == 4);
+        CHECK(index.findDirectory(root + "/directory") != DirectoryIndex::NO_ENTRY);
+        index.close();
+        std::string original = readFile(DirectoryIndex::indexFilePath(root));
+        CHECK(!original.empty());
+
+        // Child ranges past the end, or that would lead a walk back to the root.
+        CHECK(refuses(root, original, CHILD_COUNTS, 0, std::uint32_t(1000)));
+        CHECK(refuses(root, original, FIRST_CHILDREN, 0, std::uint32_t(0)));
+        CHECK(refuses(root, original, FIRST_CHILDREN, 0, std::uint32_t(0xFFFFFFFFu)));
+        // Names outside the string block.
+        CHECK(refuses(root, original, NAME_OFFSETS, 1, std::uint64_t(1) << 40));
+        CHECK(refuses(root, original, NAME_LENGTHS, 1, std::uint16_t(0xFFFF)));
+        // Parents that point forward form cycles when a path is built.
+        CHECK(refuses(root, original, PARENTS, 1, std::uint32_t(1)));
+        CHECK(refuses(root, original, PARENTS, 3, std::uint32_t(7)));
+
+        // The undamaged file is still accepted.
+        CHECK(TestSupport::writeFile(DirectoryIndex::indexFilePath(root), original));
+        CHECK(index.open(root));
+        CHECK(index.findDirectory(root + "/directory") != DirectoryIndex::NO_ENTRY);
+    }
+
+    // A refresh that finds every directory unchanged keeps the file; one that finds a change rewrites it.
+    void testWarmUpdate(const std::string& scratch) {
+        std::string root = scratch + "/warm";
+        CHECK(mkdir(root.c_str(), 0755) == 0);
+        CHECK(mkdir((root + "/directory").c_str(), 0755) == 0);
+        CHECK(TestSupport::writeFile(root + "/directory/file", "contents"));
+
+        DirectoryIndex index;
+        DirectoryIndex::RefreshStats stats = {};
+        CHECK(index.update(root, 0, &stats));
+        CHECK(stats.directoriesRead == 2);
+        struct stat written;
+        CHECK(stat(DirectoryIndex::indexFilePath(root).c_str(), &written) == 0);
+
+        stats = {};
+        CHECK(index.update(index.rootPath(), 0, &stats));
+        CHECK(stats.directoriesRead == 0 && stats.directoriesReused == 2 && stats.entryCount == 3);
+        struct stat kept;
+        CHECK(stat(DirectoryIndex::indexFilePath(root).c_str(), &kept) == 0);
+        CHECK(kept.st_ino == written.st_ino);
+
+        CHECK(TestSupport::writeFile(root + "/directory/added", ""));
+        stats = {};
+        CHECK(index.update(root, 0, &stats));
+        CHECK(stats.directoriesRead == 1 && stats.directoriesReused == 1 && stats.entryCount == 4);
+        std::uint32_t directory = index.findDirectory(root + "/directory");
+        CHECK(directory != DirectoryIndex::NO_ENTRY && index.childCount(directory) == 2);
+        CHECK(index.name(index.firstChild(0)) == "directory");
+    }
+}
+
+int main() {
+    TestSupport::ScratchDirectory scratch;
+    CHECK(!scratch.path.empty());
+    if (scratch.path.empty()) {
+        return TestSupport::result();
+    }
+
+    // The index files go below the scratch directory instead of the user's cache.
+    std::string cache = scratch.path + "/cache";
+    CHECK(mkdir(cache.c_str(), 0755) == 0);
+    CHECK(setenv("XDG_CACHE_HOME", cache.c_str(), 1) == 0);
+
+    testDamagedFiles(scratch.path);
+    testWarmUpdate(scratch.path);
+    return TestSupport::result();
+}
\ No newline at end of file
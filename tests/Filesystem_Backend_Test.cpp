@@ -0,0 +1,188 @@
+#include "Filesystem_Backend.h"
+#include "Directory_Walker.h"
+#include "Test_Support.h"
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#include <sys/stat.h>
+
+namespace {
+    using Status = FilesystemBackend::Status;
+
+    void testCreate(const std::string& root) {
+        std::string file = root + "/created";
+        CHECK(FilesystemBackend::createFile(file) == Status::OK);
+        CHECK(FilesystemBackend::exists(file));
+        CHECK(!FilesystemBackend::isDirectory(file));
+        // An existing file is reported, never truncated.
+        CHECK(TestSupport::writeFile(file, "kept"));
+        CHECK(FilesystemBackend::createFile(file) == Status::ALREADY_EXISTS);
+        FilesystemBackend::Metadata metadata;
+        CHECK(FilesystemBackend::getMetadata(file, metadata) && metadata.size == 4);
+
+        std::string directory = root + "/directory";
+        CHECK(FilesystemBackend::createDirectory(directory) == Status::OK);
+        CHECK(FilesystemBackend::isDirectory(directory));
+        CHECK(FilesystemBackend::createDirectory(directory) == Status::ALREADY_EXISTS);
+        CHECK(FilesystemBackend::createDirectory(root + "/missing/directory") == Status::NOT_FOUND);
+    }
+
+    void testRename(const std::string& root) {
+        std::string source = root + "/source";
+        std::string target = root + "/target";
+        CHECK(TestSupport::writeFile(source, "source"));
+        CHECK(FilesystemBackend::rename(source, target) == Status::OK);
+        CHECK(!FilesystemBackend::exists(source));
+        CHECK(FilesystemBackend::exists(target));
+
+        // An existing target is never replaced, and neither side changes.
+        CHECK(TestSupport::writeFile(source, "other"));
+        CHECK(FilesystemBackend::rename(source, target) == Status::ALREADY_EXISTS);
+        FilesystemBackend::Metadata metadata;
+        CHECK(FilesystemBackend::getMetadata(source, metadata) && metadata.size == 5);
+        CHECK(FilesystemBackend::getMetadata(target, metadata) && metadata.size == 6);
+
+        CHECK(FilesystemBackend::rename(root + "/missing", root + "/anything") == Status::NOT_FOUND);
+    }
+
+    void testRenameAcrossDevices(const std::string& root) {
+        // /dev/shm is a tmpfs on Linux; the check is skipped where it shares a filesystem with the scratch directory.
+        struct stat rootStatus;
+        struct stat sharedStatus;
+        if (stat(root.c_str(), &rootStatus) != 0 || stat("/dev/shm", &sharedStatus) != 0 || rootStatus.st_dev == sharedStatus.st_dev) {
+            return;
+        }
+        TestSupport::ScratchDirectory other("/dev/shm");
+        if (other.path.empty()) {
+            return;
+        }
+        std::string source = root + "/crossing";
+        CHECK(TestSupport::writeFile(source, "crossing"));
+        CHECK(FilesystemBackend::rename(source, other.path + "/crossing") == Status::CROSS_DEVICE);
+        CHECK(FilesystemBackend::exists(source));
+        CHECK(!FilesystemBackend::exists(other.path + "/crossing"));
+    }
+
+    void testRemove(const std::string& root) {
+        std::string file = root + "/removed";
+        CHECK(TestSupport::writeFile(file, ""));
+        CHECK(FilesystemBackend::removeFile(file) == Status::OK);
+        CHECK(!FilesystemBackend::exists(file));
+        CHECK(FilesystemBackend::removeFile(file) == Status::NOT_FOUND);
+
+        // A symbolic link is removed itself, not its target.
+        std::string target = root + "/link_target";
+        std::string link = root + "/link";
+        CHECK(TestSupport::writeFile(target, ""));
+        CHECK(symlink(target.c_str(), link.c_str()) == 0);
+        CHECK(FilesystemBackend::removeFile(link) == Status::OK);
+        CHECK(!FilesystemBackend::exists(link));
+        CHECK(FilesystemBackend::exists(target));
+
+        std::string directory = root + "/full";
+        CHECK(FilesystemBackend::createDirectory(directory) == Status::OK);
+        CHECK(TestSupport::writeFile(directory + "/entry", ""));
+        CHECK(FilesystemBackend::removeDirectory(directory) == Status::NOT_EMPTY);
+        CHECK(FilesystemBackend::removeFile(directory + "/entry") == Status::OK);
+        CHECK(FilesystemBackend::removeDirectory(directory) == Status::OK);
+        CHECK(!FilesystemBackend::exists(directory));
+    }
+
+    void testPermissions(const std::string& root) {
+        std::string file = root + "/permissions";
+        CHECK(TestSupport::writeFile(file, ""));
+        CHECK(FilesystemBackend::setPermissions(file, 0640) == Status::OK);
+        FilesystemBackend::Metadata metadata;
+        CHECK(FilesystemBackend::getMetadata(file, metadata) && (metadata.attributes & 07777) == 0640);
+
+        // Read access clears every write bit and keeps the rest; write access adds the owner's write bit only; modify
+        // access adds the write bits of the owner and of a group that can read, never of others; a mode replaces the
+        // permission bits.
+        using Kind = FilesystemBackend::Access::Kind;
+        std::uint32_t readOnly = FilesystemBackend::permissionsForAccess(S_IFREG | 0664, { Kind::READ, 0 });
+        CHECK(readOnly == 0444);
+        CHECK(FilesystemBackend::permissionsForAccess(S_IFREG | 0444, { Kind::WRITE, 0 }) == 0644);
+        CHECK(FilesystemBackend::permissionsForAccess(S_IFREG | 0740, { Kind::MODIFY, 0 }) == 0760);
+        CHECK(FilesystemBackend::permissionsForAccess(S_IFDIR | 0555, { Kind::MODIFY, 0 }) == 0775);
+        CHECK(FilesystemBackend::permissionsForAccess(S_IFREG | 0644, { Kind::MODIFY, 0 }) == 0664);
+        CHECK(FilesystemBackend::permissionsForAccess(S_IFREG | 0400, { Kind::MODIFY, 0 }) == 0600);
+        CHECK(FilesystemBackend::permissionsForAccess(S_IFREG | 0644, { Kind::MODE, 0750 }) == 0750);
+        CHECK(FilesystemBackend::setPermissions(file, readOnly) == Status::OK);
+        CHECK(FilesystemBackend::getMetadata(file, metadata) && (metadata.attributes & 07777) == 0444);
+
+        FilesystemBackend::Access access;
+        CHECK(FilesystemBackend::parseAccess("read", access) && access.kind == Kind::READ);
+        CHECK(FilesystemBackend::parseAccess("write", access) && access.kind == Kind::WRITE);
+        CHECK(FilesystemBackend::parseAccess("modify", access) && access.kind == Kind::MODIFY);
+        CHECK(FilesystemBackend::parseAccess("750", access) && access.kind == Kind::MODE && access.mode == 0750);
+        CHECK(FilesystemBackend::parseAccess("2775", access) && access.kind == Kind::MODE && access.mode == 02775);
+        CHECK(!FilesystemBackend::parseAccess("execute", access));
+        CHECK(!FilesystemBackend::parseAccess("789", access));
+        CHECK(!FilesystemBackend::parseAccess("17777", access));
+
+        CHECK(FilesystemBackend::setPermissions(root + "/missing", 0644) == Status::NOT_FOUND);
+    }
+
+    void testMetadata(const std::string& root) {
+        std::string file = root + "/metadata";
+        CHECK(TestSupport::writeFile(file, std::string(3000, 'x')));
+        struct timespec times[2] = { { 1000000000, 123456789 }, { 1500000000, 987654321 } };
+        CHECK(utimensat(AT_FDCWD, file.c_str(), times, 0) == 0);
+
+        FilesystemBackend::Metadata metadata;
+        CHECK(FilesystemBackend::getMetadata(file, metadata));
+        CHECK(!metadata.isDirectory && !metadata.isLink);
+        CHECK(metadata.size == 3000);
+        CHECK(metadata.modificationTime == 1500000000LL * 1000000000LL + 987654321);
+        CHECK(S_ISREG(metadata.attributes));
+
+        // Metadata is read without following symbolic links.
+        std::string link = root + "/metadata_link";
+        CHECK(symlink(file.c_str(), link.c_str()) == 0);
+        CHECK(FilesystemBackend::getMetadata(link, metadata) && metadata.isLink && !metadata.isDirectory);
+        CHECK(FilesystemBackend::getMetadata(root, metadata) && metadata.isDirectory && !metadata.isLink);
+        CHECK(!FilesystemBackend::getMetadata(root + "/missing", metadata));
+    }
+
+    void testEnumeration(const std::string& root) {
+        std::string directory = root + "/listing";
+        CHECK(FilesystemBackend::createDirectory(directory) == Status::OK);
+        CHECK(FilesystemBackend::createDirectory(directory + "/child") == Status::OK);
+        CHECK(TestSupport::writeFile(directory + "/file", "12345"));
+
+        std::vector<DirectoryWalker::Entry> entries;
+        CHECK(DirectoryWalker::readDirectory(directory, entries, true));
+        std::sort(entries.begin(), entries.end(), [](const DirectoryWalker::Entry& left, const DirectoryWalker::Entry& right) {
+            return left.name < right.name;
+        });
+        CHECK(entries.size() == 2);
+        if (entries.size() == 2) {
+            CHECK(entries[0].name == "child" && entries[0].isDirectory);
+            CHECK(entries[1].name == "file" && !entries[1].isDirectory && entries[1].size == 5);
+        }
+
+        DirectoryWalker::NameList names;
+        CHECK(DirectoryWalker::readNames(directory, names));
+        CHECK(names.size() == 2);
+        CHECK(!DirectoryWalker::readNames(root + "/missing", names));
+    }
+}
+
+int main() {
+    TestSupport::ScratchDirectory scratch;
+    CHECK(!scratch.path.empty());
+    if (scratch.path.empty()) {
+        return TestSupport::result();
+    }
+
+    testCreate(scratch.path);
+    testRename(scratch.path);
+    testRenameAcrossDevices(scratch.path);
+    testRemove(scratch.path);
+    testPermissions(scratch.path);
+    testMetadata(scratch.path);
+    testEnumeration(scratch.path);
+    return TestSupport::result();
+}
\ No newline at end of file
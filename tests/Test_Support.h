@@ -0,0 +1,99 @@
+#ifndef TEST_SUPPORT_H
+#define TEST_SUPPORT_H
+
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+
+#include <fcntl.h>
+#include <ftw.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/**
+ * @file Test_Support.h
+ * @brief The checks and scratch directories shared by the test executables.
+ *
+ * Every test is a plain executable that returns a non-zero exit code when a check failed, so ctest needs no framework.
+ */
+
+namespace TestSupport {
+    inline int& failures() {
+        static int count = 0;
+        return count;
+    }
+
+    inline void check(bool condition, const char* expression, const char* file, int line) {
+        if (!condition) {
+            std::fprintf(stderr, "%s:%d: check failed: %s\n", file, line, expression);
+            ++failures();
+        }
+    }
+
+    /**
+     * Returns the exit code of a test executable.
+     *
+     * @return 0 if every check passed, 1 otherwise.
+     */
+    inline int result() {
+        return failures() == 0 ? 0 : 1;
+    }
+
+    /**
+     * A directory created below the system temporary directory and removed with everything in it on destruction.
+     */
+    class ScratchDirectory {
+    public:
+        explicit ScratchDirectory(const std::string& parent = "") {
+            std::string base = parent;
+            if (base.empty()) {
+                const char* temporary = std::getenv("TMPDIR");
+                base = temporary != nullptr && *temporary != '\0' ? temporary : "/tmp";
+            }
+            std::string pattern = base + "/file_manager_test_XXXXXX";
+            if (mkdtemp(&pattern[0]) != nullptr) {
+                path = pattern;
+            }
+        }
+
+        ~ScratchDirectory() {
+            if (!path.empty()) {
+                nftw(path.c_str(), removeEntry, 16, FTW_DEPTH | FTW_PHYS);
+            }
+        }
+
+        ScratchDirectory(const ScratchDirectory&) = delete;
+        ScratchDirectory& operator=(const ScratchDirectory&) = delete;
+
+        /** The path of the directory, or empty if it could not be created. */
+        std::string path;
+
+    private:
+        static int removeEntry(const char* entryPath, const struct stat*, int, struct FTW*) {
+            chmod(entryPath, 0700);
+            std::remove(entryPath);
+            return 0;
+        }
+    };
+
+    /**
+     * Writes a file, replacing any previous contents.
+     *
+     * @param path The path of the file.
+     * @param contents The bytes to write.
+     * @return True if every byte was written, false otherwise.
+     */
+    inline bool writeFile(const std::string& path, const std::string& contents) {
+        int fd = open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+        if (fd < 0) {
+            return false;
+        }
+        bool written = write(fd, contents.data(), contents.size()) == static_cast<ssize_t>(contents.size());
+        close(fd);
+        return written;
+    }
+}
+
+#define CHECK(condition) TestSupport::check((condition), #condition, __FILE__, __LINE__)
+
+#endif
\ No newline at end of file